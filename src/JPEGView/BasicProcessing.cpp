@@ -5,8 +5,12 @@
 #include "Helpers.h"
 #include "WorkThread.h"
 #include "ProcessingThreadPool.h"
+#include "YCbCrImage.h"
+#include "PixelKernels.h"
+#include "SettingsProvider.h"
 #ifdef _WIN64
 #include "ApplyFilterAVX.h"
+#include "PointSampleAVX.h"
 #endif
 #include <math.h>
 
@@ -28,88 +32,132 @@ static TCHAR s_TimingInfo[256];
 /////////////////////////////////////////////////////////////////////////////////////////////
 
 static void* SampleDown_HQ_MMX_SSE_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-	CSize sourceSize, const void* pIJLPixels, int nChannels, double dSharpen,
+	CSize sourceSize, const void* pIJLPixels, int nSourceStride, int nChannels, double dSharpen,
 	EFilterType eFilter, bool bSSE, uint8* pTarget);
 
 static void* SampleDown_HQ_AVX_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-	CSize sourceSize, const void* pIJLPixels, int nChannels, double dSharpen,
+	CSize sourceSize, const void* pIJLPixels, int nSourceStride, int nChannels, double dSharpen,
 	EFilterType eFilter, uint8* pTarget);
 
 static void* SampleUp_HQ_MMX_SSE_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-	CSize sourceSize, const void* pIJLPixels, int nChannels, bool bSSE,
+	CSize sourceSize, const void* pIJLPixels, int nSourceStride, int nChannels, bool bSSE,
 	uint8* pTarget);
 
 static void* SampleUp_HQ_AVX_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-	CSize sourceSize, const void* pIJLPixels, int nChannels,
+	CSize sourceSize, const void* pIJLPixels, int nSourceStride, int nChannels,
 	uint8* pTarget);
 
+static void* SampleDown_HQ_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, double dSharpen, EFilterType eFilter,
+	uint8* pTarget);
+
+static void* SampleUp_HQ_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, uint8* pTarget);
+
 static void* ApplyLDC32bpp_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize dibSize,
 	CSize ldcMapSize, const void* pDIBPixels, const int32* pSatLUTs, const uint8* pLUT, const uint8* pLDCMap,
 	float fBlackPt, float fWhitePt, float fBlackPtSteepness, uint32* pTarget);
 
 static int16* GaussFilter16bpp1Channel_Core(CSize fullSize, CPoint offset, CSize rect, int nTargetWidth, double dRadius,
-	const int16* pSourcePixels, int16* pTargetPixels);
+	bool bUseSSE, const int16* pSourcePixels, int16* pTargetPixels);
 
 static void* UnsharpMask_Core(CSize fullSize, CPoint offset, CSize rect, double dAmount, const int16* pThresholdLUT,
 	const int16* pGrayImage, const int16* pSmoothedGrayImage, const void* pSourcePixels, void* pTargetPixels, int nChannels);
 
 static void* RotateHQ_Core(CPoint targetOffset, CSize targetSize, double dRotation, CSize sourceSize,
-	const void* pSourcePixels, void* pTargetPixels, int nChannels, COLORREF backColor);
+	const void* pSourcePixels, int nSourceStride, void* pTargetPixels, int nChannels, COLORREF backColor, bool bUseSSE);
 
 static void* TrapezoidHQ_Core(CPoint targetOffset, CSize targetSize, const CTrapezoid& trapezoid, CSize sourceSize,
-	const void* pSourcePixels, void* pTargetPixels, int nChannels, COLORREF backColor);
+	const void* pSourcePixels, int nSourceStride, void* pTargetPixels, int nChannels, COLORREF backColor, bool bUseSSE);
+
+static void* PointSample_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, CSize sourceSize,
+	const void* pPixels, int nSourceStride, int nChannels, const CYCbCrImage* pYCbCrImage, bool bUseAVX2, void* pTargetPixels);
+
+static void* PointSampleWithRotation_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, CSize sourceSize,
+	double dRotation, const void* pPixels, int nSourceStride, int nChannels, const CYCbCrImage* pYCbCrImage, COLORREF backColor,
+	bool bUseAVX2, void* pTargetPixels);
+
+static void* PointSampleTrapezoid_Core(CSize clippedTargetSize, const int* pTableY, const int* pStartX, const int* pIncrementX,
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, uint32 nBackColor, bool bUseAVX2, void* pTargetPixels);
+
+// The AVX2 gather instructions are only used on 64 bit builds
+static bool UseAVX2PointSampling() {
+#ifdef _WIN64
+	return CSettingsProvider::This().AlgorithmImplementation() == Helpers::CPU_AVX2;
+#else
+	return false;
+#endif
+}
 
 //---------------------------------------------------------------------------------------------
 
 // Request for upsampling or downsampling
 class CRequestUpDownSampling : public CProcessingRequest {
 public:
-	CRequestUpDownSampling(const void* pSourcePixels, CSize sourceSize, void* pTargetPixels,
+	CRequestUpDownSampling(const void* pSourcePixels, CSize sourceSize, int nSourceStride, void* pTargetPixels,
 		CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
 		int nChannels, double dSharpen, EFilterType eFilter, CBasicProcessing::SIMDArchitecture simd)
 		: CProcessingRequest(pSourcePixels, sourceSize, pTargetPixels, fullTargetSize, fullTargetOffset, clippedTargetSize) {
+		SourceStride = nSourceStride;
 		Channels = nChannels;
 		Sharpen = dSharpen;
 		Filter = eFilter;
 		SIMD = simd;
 		StripPadding = (simd == CBasicProcessing::AVX2) ? 16 : 8; // important to set for AVX
+		Kernel = Kernel_UpDownSampling;
 	}
 
 	virtual bool ProcessStrip(int offsetY, int sizeY) {
 		if (Filter == Filter_Upsampling_Bicubic) {
-			if (SIMD == CBasicProcessing::AVX2)
+			if (SIMD == CBasicProcessing::NoSIMD)
+				return NULL != SampleUp_HQ_Core(FullTargetSize,
+					CPoint(FullTargetOffset.x, FullTargetOffset.y + offsetY),
+					CSize(ClippedTargetSize.cx, sizeY),
+					SourceSize, SourcePixels, SourceStride,
+					Channels,
+					(uint8*)TargetPixels + (size_t)offsetY * ClippedTargetSize.cx * 4);
+			else if (SIMD == CBasicProcessing::AVX2)
 				return NULL != SampleUp_HQ_AVX_Core(FullTargetSize,
 					CPoint(FullTargetOffset.x, FullTargetOffset.y + offsetY),
 					CSize(ClippedTargetSize.cx, sizeY),
-					SourceSize, SourcePixels,
+					SourceSize, SourcePixels, SourceStride,
 					Channels,
-					(uint8*)TargetPixels + ClippedTargetSize.cx * 4 * offsetY);
+					(uint8*)TargetPixels + (size_t)offsetY * ClippedTargetSize.cx * 4);
 			else
 				return NULL != SampleUp_HQ_MMX_SSE_Core(FullTargetSize,
 					CPoint(FullTargetOffset.x, FullTargetOffset.y + offsetY),
 					CSize(ClippedTargetSize.cx, sizeY),
-					SourceSize, SourcePixels,
+					SourceSize, SourcePixels, SourceStride,
 					Channels, SIMD == CBasicProcessing::SSE,
-					(uint8*)TargetPixels + ClippedTargetSize.cx * 4 * offsetY);
+					(uint8*)TargetPixels + (size_t)offsetY * ClippedTargetSize.cx * 4);
 		}
+		else if (SIMD == CBasicProcessing::NoSIMD)
+			return NULL != SampleDown_HQ_Core(FullTargetSize,
+				CPoint(FullTargetOffset.x, FullTargetOffset.y + offsetY),
+				CSize(ClippedTargetSize.cx, sizeY),
+				SourceSize, SourcePixels, SourceStride,
+				Channels, Sharpen,
+				Filter,
+				(uint8*)TargetPixels + (size_t)offsetY * ClippedTargetSize.cx * 4);
 		else if (SIMD == CBasicProcessing::AVX2)
 			return NULL != SampleDown_HQ_AVX_Core(FullTargetSize,
 				CPoint(FullTargetOffset.x, FullTargetOffset.y + offsetY),
 				CSize(ClippedTargetSize.cx, sizeY),
-				SourceSize, SourcePixels,
+				SourceSize, SourcePixels, SourceStride,
 				Channels, Sharpen,
 				Filter,
-				(uint8*)TargetPixels + ClippedTargetSize.cx * 4 * offsetY);
+				(uint8*)TargetPixels + (size_t)offsetY * ClippedTargetSize.cx * 4);
 		else
 			return NULL != SampleDown_HQ_MMX_SSE_Core(FullTargetSize,
 				CPoint(FullTargetOffset.x, FullTargetOffset.y + offsetY),
 				CSize(ClippedTargetSize.cx, sizeY),
-				SourceSize, SourcePixels,
+				SourceSize, SourcePixels, SourceStride,
 				Channels, Sharpen,
 				Filter, SIMD == CBasicProcessing::SSE,
-				(uint8*)TargetPixels + ClippedTargetSize.cx * 4 * offsetY);
+				(uint8*)TargetPixels + (size_t)offsetY * ClippedTargetSize.cx * 4);
 	}
 
+	int SourceStride;
 	int Channels;
 	double Sharpen;
 	EFilterType Filter;
@@ -130,6 +178,7 @@ public:
 		BlackPt = fBlackPt;
 		WhitePt = fWhitePt;
 		BlackPtSteepness = fBlackPtSteepness;
+		Kernel = Kernel_LDC;
 	}
 
 	virtual bool ProcessStrip(int offsetY, int sizeY) {
@@ -137,10 +186,10 @@ public:
 			CPoint(FullTargetOffset.x, FullTargetOffset.y + offsetY),
 			CSize(ClippedTargetSize.cx, sizeY),
 			LDCMapSize,
-			(const uint32*)SourcePixels + ClippedTargetSize.cx * offsetY,
+			(const uint32*)SourcePixels + (size_t)offsetY * ClippedTargetSize.cx,
 			SatLUTs, LUT, LDCMap,
 			BlackPt, WhitePt, BlackPtSteepness,
-			(uint32*)TargetPixels + ClippedTargetSize.cx * offsetY);
+			(uint32*)TargetPixels + (size_t)offsetY * ClippedTargetSize.cx);
 	}
 
 	CSize LDCMapSize;
@@ -154,9 +203,11 @@ public:
 
 class CRequestGauss : public CProcessingRequest {
 public:
-	CRequestGauss(const int16* pSourcePixels, CSize fullSize, CPoint offset, CSize rect, double dRadius, int16* pTargetPixels)
+	CRequestGauss(const int16* pSourcePixels, CSize fullSize, CPoint offset, CSize rect, double dRadius, bool bUseSSE, int16* pTargetPixels)
 		: CProcessingRequest(pSourcePixels, fullSize, pTargetPixels, rect, offset, rect) {
 		Radius = dRadius;
+		UseSSE = bUseSSE;
+		Kernel = Kernel_Gauss;
 	}
 
 	virtual bool ProcessStrip(int offsetY, int sizeY) {
@@ -165,11 +216,13 @@ public:
 			CSize(FullTargetSize.cx, sizeY),
 			FullTargetSize.cy,
 			Radius,
+			UseSSE,
 			(int16*)SourcePixels,
 			(int16*)TargetPixels + offsetY);
 	}
 
 	double Radius;
+	bool UseSSE;
 };
 
 class CRequestUnsharpMask : public CProcessingRequest {
@@ -183,6 +236,7 @@ public:
 		GrayImage = pGrayImage;
 		SmoothedGrayImage = pSmoothedGrayImage;
 		Channels = nChannels;
+		Kernel = Kernel_UnsharpMask;
 	}
 
 	virtual bool ProcessStrip(int offsetY, int sizeY) {
@@ -205,44 +259,135 @@ public:
 
 class CRequestRotate : public CProcessingRequest {
 public:
-	CRequestRotate(const void* pSourcePixels, CPoint targetOffset, CSize targetSize, double dRotation,
-		CSize sourceSize, void* pTargetPixels, int nChannels, COLORREF backColor)
+	CRequestRotate(const void* pSourcePixels, int nSourceStride, CPoint targetOffset, CSize targetSize, double dRotation,
+		CSize sourceSize, void* pTargetPixels, int nChannels, COLORREF backColor, bool bUseSSE)
 		: CProcessingRequest(pSourcePixels, sourceSize, pTargetPixels, targetSize, targetOffset, targetSize) {
+		SourceStride = nSourceStride;
 		Rotation = dRotation;
 		Channels = nChannels;
 		BackColor = backColor;
+		UseSSE = bUseSSE;
+		Kernel = Kernel_Rotate;
 	}
 
 	virtual bool ProcessStrip(int offsetY, int sizeY) {
 		return NULL != RotateHQ_Core(CPoint(FullTargetOffset.x, FullTargetOffset.y + offsetY),
-			CSize(FullTargetSize.cx, sizeY), Rotation, SourceSize, SourcePixels,
-			(uint8*)TargetPixels + FullTargetSize.cx * 4 * offsetY, Channels, BackColor);
+			CSize(FullTargetSize.cx, sizeY), Rotation, SourceSize, SourcePixels, SourceStride,
+			(uint8*)TargetPixels + (size_t)offsetY * FullTargetSize.cx * 4, Channels, BackColor, UseSSE);
 	}
 
 	double Rotation;
+	int SourceStride;
 	int Channels;
 	COLORREF BackColor;
+	bool UseSSE;
 };
 
 class CRequestTrapezoid : public CProcessingRequest {
 public:
-	CRequestTrapezoid(const void* pSourcePixels, CPoint targetOffset, CSize targetSize, const CTrapezoid& trapezoid,
-		CSize sourceSize, void* pTargetPixels, int nChannels, COLORREF backColor)
+	CRequestTrapezoid(const void* pSourcePixels, int nSourceStride, CPoint targetOffset, CSize targetSize, const CTrapezoid& trapezoid,
+		CSize sourceSize, void* pTargetPixels, int nChannels, COLORREF backColor, bool bUseSSE)
 		: CProcessingRequest(pSourcePixels, sourceSize, pTargetPixels, targetSize, targetOffset, targetSize) {
+		SourceStride = nSourceStride;
 		Trapezoid = trapezoid;
 		Channels = nChannels;
 		BackColor = backColor;
+		UseSSE = bUseSSE;
+		Kernel = Kernel_Trapezoid;
 	}
 
 	virtual bool ProcessStrip(int offsetY, int sizeY) {
 		return NULL != TrapezoidHQ_Core(CPoint(FullTargetOffset.x, FullTargetOffset.y + offsetY),
-			CSize(FullTargetSize.cx, sizeY), Trapezoid, SourceSize, SourcePixels,
-			(uint8*)TargetPixels + FullTargetSize.cx * 4 * offsetY, Channels, BackColor);
+			CSize(FullTargetSize.cx, sizeY), Trapezoid, SourceSize, SourcePixels, SourceStride,
+			(uint8*)TargetPixels + (size_t)offsetY * FullTargetSize.cx * 4, Channels, BackColor, UseSSE);
 	}
 
 	CTrapezoid Trapezoid;
+	int SourceStride;
+	int Channels;
+	COLORREF BackColor;
+	bool UseSSE;
+};
+
+class CRequestPointSample : public CProcessingRequest {
+public:
+	CRequestPointSample(const void* pSourcePixels, CSize sourceSize, int nSourceStride, int nChannels, const CYCbCrImage* pYCbCrImage,
+		void* pTargetPixels, CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, bool bUseAVX2)
+		: CProcessingRequest(pSourcePixels, sourceSize, pTargetPixels, fullTargetSize, fullTargetOffset, clippedTargetSize) {
+		SourceStride = nSourceStride;
+		Channels = nChannels;
+		YCbCrImage = pYCbCrImage;
+		UseAVX2 = bUseAVX2;
+	}
+
+	virtual bool ProcessStrip(int offsetY, int sizeY) {
+		return NULL != PointSample_Core(FullTargetSize, CPoint(FullTargetOffset.x, FullTargetOffset.y + offsetY),
+			CSize(ClippedTargetSize.cx, sizeY), SourceSize, SourcePixels, SourceStride, Channels, YCbCrImage, UseAVX2,
+			(uint32*)TargetPixels + (size_t)offsetY * ClippedTargetSize.cx);
+	}
+
+	int SourceStride;
 	int Channels;
+	const CYCbCrImage* YCbCrImage;
+	bool UseAVX2;
+};
+
+class CRequestPointSampleRotation : public CProcessingRequest {
+public:
+	CRequestPointSampleRotation(const void* pSourcePixels, CSize sourceSize, int nSourceStride, int nChannels, const CYCbCrImage* pYCbCrImage,
+		void* pTargetPixels, CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, double dRotation,
+		COLORREF backColor, bool bUseAVX2)
+		: CProcessingRequest(pSourcePixels, sourceSize, pTargetPixels, fullTargetSize, fullTargetOffset, clippedTargetSize) {
+		SourceStride = nSourceStride;
+		Channels = nChannels;
+		YCbCrImage = pYCbCrImage;
+		Rotation = dRotation;
+		BackColor = backColor;
+		UseAVX2 = bUseAVX2;
+	}
+
+	virtual bool ProcessStrip(int offsetY, int sizeY) {
+		return NULL != PointSampleWithRotation_Core(FullTargetSize, CPoint(FullTargetOffset.x, FullTargetOffset.y + offsetY),
+			CSize(ClippedTargetSize.cx, sizeY), SourceSize, Rotation, SourcePixels, SourceStride, Channels, YCbCrImage, BackColor, UseAVX2,
+			(uint32*)TargetPixels + (size_t)offsetY * ClippedTargetSize.cx);
+	}
+
+	int SourceStride;
+	int Channels;
+	const CYCbCrImage* YCbCrImage;
+	double Rotation;
 	COLORREF BackColor;
+	bool UseAVX2;
+};
+
+// The per row tables must contain an entry for each row of the clipped target size
+class CRequestPointSampleTrapezoid : public CProcessingRequest {
+public:
+	CRequestPointSampleTrapezoid(const void* pSourcePixels, CSize sourceSize, int nSourceStride, int nChannels, void* pTargetPixels,
+		CSize clippedTargetSize, const int* pTableY, const int* pStartX, const int* pIncrementX, uint32 nBackColor, bool bUseAVX2)
+		: CProcessingRequest(pSourcePixels, sourceSize, pTargetPixels, clippedTargetSize, CPoint(0, 0), clippedTargetSize) {
+		SourceStride = nSourceStride;
+		Channels = nChannels;
+		TableY = pTableY;
+		StartX = pStartX;
+		IncrementX = pIncrementX;
+		BackColor = nBackColor;
+		UseAVX2 = bUseAVX2;
+	}
+
+	virtual bool ProcessStrip(int offsetY, int sizeY) {
+		return NULL != PointSampleTrapezoid_Core(CSize(ClippedTargetSize.cx, sizeY), TableY + offsetY, StartX + offsetY,
+			IncrementX + offsetY, SourceSize, SourcePixels, SourceStride, Channels, BackColor, UseAVX2,
+			(uint32*)TargetPixels + (size_t)offsetY * ClippedTargetSize.cx);
+	}
+
+	int SourceStride;
+	int Channels;
+	const int* TableY;
+	const int* StartX;
+	const int* IncrementX;
+	uint32 BackColor;
+	bool UseAVX2;
 };
 
 /////////////////////////////////////////////////////////////////////////////////////////////
@@ -346,16 +491,7 @@ void* CBasicProcessing::Apply3ChannelLUT32bpp(int nWidth, int nHeight, const voi
 
 	uint32* pTarget = new(std::nothrow) uint32[nWidth * nHeight];
 	if (pTarget == NULL) return NULL;
-	const uint32* pSrc = (uint32*)pDIBPixels;
-	uint32* pTgt = pTarget;
-	for (int j = 0; j < nHeight; j++) {
-		for (int i = 0; i < nWidth; i++) {
-			uint32 nSrcPixels = *pSrc;
-			*pTgt = pLUT[nSrcPixels & 0xFF] + pLUT[256 + ((nSrcPixels >> 8) & 0xFF)] * 256 + 
-				pLUT[512 + ((nSrcPixels >> 16) & 0xFF)] * 65536 + ALPHA_OPAQUE;
-			pTgt++; pSrc++;
-		}
-	}
+	CPixelKernels::Get().Apply3ChannelLUT((const uint32*)pDIBPixels, pTarget, nWidth * nHeight, pLUT);
 	return pTarget;
 }
 
@@ -438,7 +574,14 @@ void* ApplyLDC32bpp_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize di
 
 	const int cnScaler = 1 << 16;
 	const int cnMax = 255 * cnScaler;
+	int32* pMaskRow = new(std::nothrow) int32[ldcMapSize.cx + 1];
+	if (pMaskRow == NULL) return NULL;
 	const int32* pMulLUT = CreateMulLUT(fBlackPt, fWhitePt, fBlackPtSteepness);
+	int32 LUT32[3 * 256];
+	for (int i = 0; i < 3 * 256; i++) {
+		LUT32[i] = pLUT[i];
+	}
+	const CPixelKernels& kernels = CPixelKernels::Get();
 	const uint32* pSrc = (uint32*)pDIBPixels;
 	uint32* pTgt = pTarget;
 	for (int j = 0; j < dibSize.cy; j++) {
@@ -447,30 +590,14 @@ void* ApplyLDC32bpp_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize di
 		const uint8* pLDCMapSrc = pLDCMap + ldcMapSize.cx * nCurYTrunc;
 		uint32 nCurX = nStartX;
 		if (pSatLUTs == NULL) {
-			for (int i = 0; i < dibSize.cx; i++) {
-				// perform bilinear interpolation of mask
-				uint32 nCurXTrunc = nCurX >> 16;
-				uint32 nCurXFrac = nCurX & 0xFFFF;
-				uint32 nMaskTopLeft  = pLDCMapSrc[nCurXTrunc];
-				uint32 nMaskTopRight = pLDCMapSrc[nCurXTrunc + 1];
-				uint32 nMaskBottomLeft = pLDCMapSrc[nCurXTrunc + ldcMapSize.cx];
-				uint32 nMaskBottomRight = pLDCMapSrc[nCurXTrunc + ldcMapSize.cx + 1];
-				uint32 nLeft = ((int)nCurYFrac*(int)(nMaskBottomLeft - nMaskTopLeft) >> 16) + nMaskTopLeft;
-				uint32 nRight = ((int)nCurYFrac*(int)(nMaskBottomRight - nMaskTopRight) >> 16) + nMaskTopRight;
-				int32 nMaskValue = ((int)nCurXFrac*(int)(nRight - nLeft) >> 16) + nLeft - 127;
-
-				uint32 nSrcPixels = *pSrc;
-				uint32 nBlue = pLUT[nSrcPixels & 0xFF];
-				nBlue = nBlue + (nMaskValue*pMulLUT[nBlue] >> 14);
-				uint32 nGreen = pLUT[((nSrcPixels >> 8) & 0xFF) + 256];
-				nGreen = nGreen + (nMaskValue*pMulLUT[nGreen] >> 14);
-				uint32 nRed = pLUT[((nSrcPixels >> 16) & 0xFF) + 512];
-				nRed = nRed + (nMaskValue*pMulLUT[nRed] >> 14);
-
-				*pTgt = max(0, min(255, (int)nBlue)) + max(0, min(255, (int)nGreen))*256 + max(0, min(255, (int)nRed))*65536 + ALPHA_OPAQUE;
-				pTgt++; pSrc++;
-				nCurX += nIncrementX;
+			// interpolation of mask in y direction for the whole row of the LDC map, the kernel interpolates in x direction
+			for (int i = 0; i < ldcMapSize.cx; i++) {
+				pMaskRow[i] = ((int)nCurYFrac*((int)pLDCMapSrc[i + ldcMapSize.cx] - (int)pLDCMapSrc[i]) >> 16) + pLDCMapSrc[i];
 			}
+			pMaskRow[ldcMapSize.cx] = pMaskRow[ldcMapSize.cx - 1];
+			kernels.ApplyLDCRow(pSrc, pTgt, dibSize.cx, pMaskRow, nStartX, nIncrementX, LUT32, pMulLUT);
+			pSrc += dibSize.cx;
+			pTgt += dibSize.cx;
 		} else {
 			for (int i = 0; i < dibSize.cx; i++) {
 				// perform bilinear interpolation of mask
@@ -507,6 +634,7 @@ void* ApplyLDC32bpp_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize di
 		nCurY += nIncrementY;
 	}
 	delete[] pMulLUT;
+	delete[] pMaskRow;
 	return pTarget;
 }
 
@@ -583,8 +711,10 @@ void CBasicProcessing::FillRectangle32bpp(int nWidth, int nHeight, void* pDIBPix
 /////////////////////////////////////////////////////////////////////////////////////////////
 
 // Rotate a block of a 32 bit DIB from source to target by 90 or 270 degrees
+// If pBackgroundColor is not NULL, the pixels are alpha blended against this color while copying
 static void RotateBlock32bpp(const uint32* pSrc, uint32* pTgt, int nWidth, int nHeight,
-							 int nXStart, int nYStart, int nBlockWidth, int nBlockHeight, bool bCW) {
+							 int nXStart, int nYStart, int nBlockWidth, int nBlockHeight, bool bCW,
+							 const COLORREF* pBackgroundColor = NULL) {
 	int nIncTargetLine = nHeight;
 	int nIncSource = nWidth - nBlockWidth;
 	const uint32* pSource = pSrc + nWidth * nYStart + nXStart;
@@ -596,7 +726,7 @@ static void RotateBlock32bpp(const uint32* pSrc, uint32* pTgt, int nWidth, int n
 
 	for (uint32 i = 0; i < nBlockHeight; i++) {
 		for (uint32 j = 0; j < nBlockWidth; j++) {
-			*pTarget = *pSource;
+			*pTarget = (pBackgroundColor == NULL) ? *pSource : Helpers::AlphaBlendBackground(*pSource, *pBackgroundColor);
 			pTarget += nIncTargetLine;
 			pSource++;
 		}
@@ -610,17 +740,130 @@ static void RotateBlock32bpp(const uint32* pSrc, uint32* pTgt, int nWidth, int n
 static void* Rotate32bpp180(int nWidth, int nHeight, const void* pDIBPixels) {
 	uint32* pTarget = new(std::nothrow) uint32[nWidth * nHeight];
 	if (pTarget == NULL) return NULL;
-	const uint32* pSource = (uint32*)pDIBPixels;
-	for (uint32 i = 0; i < nHeight; i++) {
-		uint32* pTgt = pTarget + nWidth*(nHeight - 1 - i) + (nWidth - 1);
-		const uint32* pSrc = pSource + nWidth*i;
-		for (uint32 j = 0; j < nWidth; j++) {
-			*pTgt = *pSrc;
-			pTgt -= 1;
-			pSrc += 1;
+	// the pixels of the whole image in reverse order
+	CPixelKernels::Get().MirrorRow((const uint32*)pDIBPixels, pTarget, nWidth * nHeight);
+	return pTarget;
+}
+
+// Reverses the order of the pixels in each row
+static void MirrorRowsInplace(int nWidth, int nHeight, uint32* pPixels) {
+	const CPixelKernels& kernels = CPixelKernels::Get();
+	for (int j = 0; j < nHeight; j++) {
+		kernels.MirrorRowInplace(pPixels + (size_t)j * nWidth, nWidth);
+	}
+}
+
+// Transposes a square image in place, swapping pairs of cnBlockSize x cnBlockSize blocks
+static void TransposeSquareInplace(int nSize, uint32* pPixels) {
+	const int cnBlockSize = 32;
+	for (int nBlockY = 0; nBlockY < nSize; nBlockY += cnBlockSize) {
+		for (int nBlockX = nBlockY; nBlockX < nSize; nBlockX += cnBlockSize) {
+			int nEndY = min(nBlockY + cnBlockSize, nSize);
+			int nEndX = min(nBlockX + cnBlockSize, nSize);
+			for (int y = nBlockY; y < nEndY; y++) {
+				for (int x = (nBlockX == nBlockY) ? y + 1 : nBlockX; x < nEndX; x++) {
+					uint32 nTemp = pPixels[(size_t)y * nSize + x];
+					pPixels[(size_t)y * nSize + x] = pPixels[(size_t)x * nSize + y];
+					pPixels[(size_t)x * nSize + y] = nTemp;
+				}
+			}
 		}
 	}
-	return pTarget;
+}
+
+// Transposes nNumStrips consecutive matrices of nRows x nColumns pixels each, using a scratch buffer of one matrix
+static void TransposeStrips(uint32* pPixels, int nNumStrips, int nRows, int nColumns, uint32* pScratch) {
+	size_t nStripSize = (size_t)nRows * nColumns;
+	for (int nStrip = 0; nStrip < nNumStrips; nStrip++) {
+		uint32* pStrip = pPixels + nStrip * nStripSize;
+		memcpy(pScratch, pStrip, nStripSize * sizeof(uint32));
+		for (int i = 0; i < nColumns; i++) {
+			const uint32* pSrc = pScratch + i;
+			uint32* pTgt = pStrip + (size_t)i * nRows;
+			for (int j = 0; j < nRows; j++) {
+				*pTgt++ = *pSrc;
+				pSrc += nColumns;
+			}
+		}
+	}
+}
+
+// Transposes a matrix of nRows x nColumns chunks of nChunkSize pixels in place by following the cycles of the
+// permutation. The chunk at index i moves to (i * nRows) mod (n - 1), thus the chunk to move to index i comes from
+// (i * nColumns) mod (n - 1), first and last chunk do not move. pVisited has one bit per chunk, all zero.
+static void TransposeChunks(uint32* pPixels, int nRows, int nColumns, int nChunkSize, uint32* pVisited, uint32* pScratch) {
+	size_t nChunkBytes = nChunkSize * sizeof(uint32);
+	__int64 nModulus = (__int64)nRows * nColumns - 1;
+	for (__int64 nStart = 1; nStart < nModulus; nStart++) {
+		if (pVisited[nStart >> 5] & (1u << (nStart & 31))) {
+			continue;
+		}
+		memcpy(pScratch, pPixels + nStart * nChunkSize, nChunkBytes);
+		__int64 nCurrent = nStart;
+		for (;;) {
+			pVisited[nCurrent >> 5] |= 1u << (nCurrent & 31);
+			__int64 nPrevious = (nCurrent * nColumns) % nModulus;
+			if (nPrevious == nStart) {
+				memcpy(pPixels + nCurrent * nChunkSize, pScratch, nChunkBytes);
+				break;
+			}
+			memcpy(pPixels + nCurrent * nChunkSize, pPixels + nPrevious * nChunkSize, nChunkBytes);
+			nCurrent = nPrevious;
+		}
+	}
+}
+
+// Gets the largest divisor of nValue that is not larger than nMax
+static int GetLargestDivisor(int nValue, int nMax) {
+	int nDivisor = nMax;
+	while (nValue % nDivisor != 0) nDivisor--;
+	return nDivisor;
+}
+
+// Transposes the image in place, the transposed image has nHeight columns and nWidth rows.
+// To be cache friendly, whole chunks of up to 16 pixels (a cache line) are moved when following the cycles of the
+// transposition. The chunks are taken from the rows if the width is a multiple of the chunk size, the chunk matrix
+// then needs a transposition of strips of nHeight x chunk size pixels afterwards. Else the chunks are taken from the
+// columns, prepared by transposing strips of chunk size rows. Needs one bit per chunk and one strip as additional
+// memory, returns false if out of memory.
+static bool TransposeInplace(int nWidth, int nHeight, uint32* pPixels) {
+	if (nWidth == nHeight) {
+		TransposeSquareInplace(nWidth, pPixels);
+		return true;
+	}
+	if (nWidth == 1 || nHeight == 1) {
+		return true; // memory layout does not change
+	}
+
+	const int cnMaxChunkSize = 16;
+	int nChunkSizeX = GetLargestDivisor(nWidth, cnMaxChunkSize);
+	int nChunkSizeY = GetLargestDivisor(nHeight, cnMaxChunkSize);
+	bool bChunksFromRows = nChunkSizeX >= nChunkSizeY;
+	int nChunkSize = bChunksFromRows ? nChunkSizeX : nChunkSizeY;
+	int nChunkRows = bChunksFromRows ? nHeight : nHeight / nChunkSize;
+	int nChunkColumns = bChunksFromRows ? nWidth / nChunkSize : nWidth;
+
+	size_t nVisitedSize = (size_t)(((__int64)nChunkRows * nChunkColumns) / 32 + 1);
+	uint32* pVisited = new(std::nothrow) uint32[nVisitedSize];
+	uint32* pScratch = new(std::nothrow) uint32[(size_t)(bChunksFromRows ? nHeight : nWidth) * nChunkSize];
+	if (pVisited == NULL || pScratch == NULL) {
+		delete[] pVisited;
+		delete[] pScratch;
+		return false;
+	}
+	memset(pVisited, 0, nVisitedSize * sizeof(uint32));
+
+	if (bChunksFromRows) {
+		TransposeChunks(pPixels, nChunkRows, nChunkColumns, nChunkSize, pVisited, pScratch);
+		TransposeStrips(pPixels, nChunkColumns, nHeight, nChunkSize, pScratch);
+	} else {
+		TransposeStrips(pPixels, nChunkRows, nChunkSize, nWidth, pScratch);
+		TransposeChunks(pPixels, nChunkRows, nChunkColumns, nChunkSize, pVisited, pScratch);
+	}
+
+	delete[] pVisited;
+	delete[] pScratch;
+	return true;
 }
 
 void* CBasicProcessing::Rotate32bpp(int nWidth, int nHeight, const void* pDIBPixels, int nRotationAngleCW) {
@@ -636,13 +879,14 @@ void* CBasicProcessing::Rotate32bpp(int nWidth, int nHeight, const void* pDIBPix
 	uint32* pTarget = new(std::nothrow) uint32[nHeight * nWidth];
 	if (pTarget == NULL) return NULL;
 	const uint32* pSource = (uint32*)pDIBPixels;
+	const CPixelKernels& kernels = CPixelKernels::Get();
 
 	const int cnBlockSize = 32;
 	int nX = 0, nY = 0;
 	while (nY < nHeight) {
 		nX = 0;
 		while (nX < nWidth) {
-			RotateBlock32bpp(pSource, pTarget, nWidth, nHeight,
+			kernels.RotateBlock(pSource, pTarget, nWidth, nHeight,
 				nX, nY, 
 				min(cnBlockSize, nWidth - nX),
 				min(cnBlockSize, nHeight - nY), nRotationAngleCW == 90);
@@ -654,6 +898,48 @@ void* CBasicProcessing::Rotate32bpp(int nWidth, int nHeight, const void* pDIBPix
 	return pTarget;
 }
 
+void* CBasicProcessing::AlphaBlendRotate32bpp(int nWidth, int nHeight, void* pDIBPixels, COLORREF backgroundColor, int nRotationAngleCW) {
+	if (pDIBPixels == NULL) {
+		return NULL;
+	}
+	uint32* pPixels = (uint32*)pDIBPixels;
+	if (nRotationAngleCW == 0) {
+		size_t nNumPixels = (size_t)nWidth * nHeight;
+		for (size_t i = 0; i < nNumPixels; i++) {
+			pPixels[i] = Helpers::AlphaBlendBackground(pPixels[i], backgroundColor);
+		}
+		return pDIBPixels;
+	} else if (nRotationAngleCW == 180) {
+		// swap the pixels from both ends towards the center
+		uint32* pFirst = pPixels;
+		uint32* pLast = pPixels + (size_t)nWidth * nHeight - 1;
+		while (pFirst < pLast) {
+			uint32 nTemp = Helpers::AlphaBlendBackground(*pFirst, backgroundColor);
+			*pFirst++ = Helpers::AlphaBlendBackground(*pLast, backgroundColor);
+			*pLast-- = nTemp;
+		}
+		if (pFirst == pLast) {
+			*pFirst = Helpers::AlphaBlendBackground(*pFirst, backgroundColor);
+		}
+		return pDIBPixels;
+	} else if (nRotationAngleCW != 90 && nRotationAngleCW != 270) {
+		return NULL; // not allowed
+	}
+
+	uint32* pTarget = new(std::nothrow) uint32[(size_t)nHeight * nWidth];
+	if (pTarget == NULL) return NULL;
+
+	const int cnBlockSize = 32;
+	for (int nY = 0; nY < nHeight; nY += cnBlockSize) {
+		for (int nX = 0; nX < nWidth; nX += cnBlockSize) {
+			RotateBlock32bpp(pPixels, pTarget, nWidth, nHeight, nX, nY,
+				min(cnBlockSize, nWidth - nX), min(cnBlockSize, nHeight - nY), nRotationAngleCW == 90, &backgroundColor);
+		}
+	}
+
+	return pTarget;
+}
+
 void* CBasicProcessing::Mirror32bpp(int nWidth, int nHeight, const void* pDIBPixels, bool bHorizontally) {
 	return bHorizontally ? CBasicProcessing::MirrorH32bpp(nWidth, nHeight, pDIBPixels) :
 		CBasicProcessing::MirrorV32bpp(nWidth, nHeight, pDIBPixels);
@@ -662,13 +948,9 @@ void* CBasicProcessing::Mirror32bpp(int nWidth, int nHeight, const void* pDIBPix
 void* CBasicProcessing::MirrorH32bpp(int nWidth, int nHeight, const void* pDIBPixels) {
 	uint32* pTarget = new(std::nothrow) uint32[nWidth * nHeight];
 	if (pTarget == NULL) return NULL;
-	uint32* pTgt = pTarget;
+	const CPixelKernels& kernels = CPixelKernels::Get();
 	for (int j = 0; j < nHeight; j++) {
-		const uint32* pSource = (uint32*)pDIBPixels + (j + 1) * nWidth - 1;
-		for (int i = 0; i < nWidth; i++) {
-			*pTgt = *pSource;
-			pTgt++; pSource--;
-		}
+		kernels.MirrorRow((const uint32*)pDIBPixels + j * nWidth, pTarget + j * nWidth, nWidth);
 	}
 	return pTarget;
 }
@@ -691,8 +973,8 @@ void CBasicProcessing::MirrorVInplace(int nWidth, int nHeight, int nStride, void
 	for (int j = 0; j < (nHeight >> 1); j++) {
 		if ((nStride & 3) == 0) {
 			uint32 nPixelsPerStride = nStride >> 2;
-			uint32* pSource = (uint32*)pDIBPixels + (nHeight - 1 - j) * nPixelsPerStride;
-			uint32* pTgt = (uint32*)pDIBPixels + j * nPixelsPerStride;
+			uint32* pSource = (uint32*)pDIBPixels + (size_t)(nHeight - 1 - j) * nPixelsPerStride;
+			uint32* pTgt = (uint32*)pDIBPixels + (size_t)j * nPixelsPerStride;
 			for (int i = 0; i < nPixelsPerStride; i++) {
 				uint32 t = *pTgt;
 				*pTgt = *pSource;
@@ -700,8 +982,8 @@ void CBasicProcessing::MirrorVInplace(int nWidth, int nHeight, int nStride, void
 				pTgt++; pSource++;
 			}
 		} else {
-			uint8* pSource = (uint8*)pDIBPixels + (nHeight - 1 - j) * nStride;
-			uint8* pTgt = (uint8*)pDIBPixels + j * nStride;
+			uint8* pSource = (uint8*)pDIBPixels + (ptrdiff_t)(nHeight - 1 - j) * nStride;
+			uint8* pTgt = (uint8*)pDIBPixels + (ptrdiff_t)j * nStride;
 			for (int i = 0; i < nStride; i++) {
 				uint8 t = *pTgt;
 				*pTgt = *pSource;
@@ -712,6 +994,54 @@ void CBasicProcessing::MirrorVInplace(int nWidth, int nHeight, int nStride, void
 	}
 }
 
+bool CBasicProcessing::Rotate32bppInplace(int nWidth, int nHeight, void* pDIBPixels, int nRotationAngleCW) {
+	if (pDIBPixels == NULL) {
+		return false;
+	}
+	uint32* pPixels = (uint32*)pDIBPixels;
+	if (nRotationAngleCW == 180) {
+		CPixelKernels::Get().MirrorRowInplace(pPixels, nWidth * nHeight);
+		return true;
+	} else if (nRotationAngleCW != 90 && nRotationAngleCW != 270) {
+		return false; // not allowed
+	}
+
+	// Rotation is transposition followed by mirroring, the transposed image has nHeight columns and nWidth rows
+	if (!TransposeInplace(nWidth, nHeight, pPixels)) {
+		return false;
+	}
+	if (nRotationAngleCW == 90) {
+		MirrorRowsInplace(nHeight, nWidth, pPixels);
+	} else {
+		MirrorVInplace(nHeight, nWidth, nHeight * sizeof(uint32), pPixels);
+	}
+	return true;
+}
+
+void CBasicProcessing::Mirror32bppInplace(int nWidth, int nHeight, void* pDIBPixels, bool bHorizontally) {
+	if (bHorizontally) {
+		MirrorRowsInplace(nWidth, nHeight, (uint32*)pDIBPixels);
+	} else {
+		MirrorVInplace(nWidth, nHeight, nWidth * sizeof(uint32), pDIBPixels);
+	}
+}
+
+void CBasicProcessing::PackRowsInplace(int nWidth, int nHeight, int nChannels, int nStride, size_t nOffset, void* pPixels) {
+	int nPaddedWidth = Helpers::DoPadding(nWidth * nChannels, 4);
+	if (pPixels == NULL || (nOffset == 0 && nStride == nPaddedWidth)) {
+		return;
+	}
+	// the view is inside the rows of the image, thus the target row is never behind the source row and
+	// moving the rows from top to bottom is safe
+	uint8* pTarget = (uint8*)pPixels;
+	const uint8* pSource = (uint8*)pPixels + nOffset;
+	for (int y = 0; y < nHeight; y++) {
+		memmove(pTarget, pSource, nWidth * nChannels);
+		pTarget += nPaddedWidth;
+		pSource += nStride;
+	}
+}
+
 void* CBasicProcessing::Convert8bppTo32bppDIB(int nWidth, int nHeight, const void* pDIBPixels, const uint8* pPalette) {
 	if (pDIBPixels == NULL || pPalette == NULL) {
 		return NULL;
@@ -738,7 +1068,7 @@ void CBasicProcessing::Convert32bppTo24bppDIB(int nWidth, int nHeight, void* pDI
 		return;
 	}
 	int nPaddedWidth = Helpers::DoPadding(nWidth*3, 4);
-	int nPad = nPaddedWidth - nWidth*3;
+	const CPixelKernels& kernels = CPixelKernels::Get();
 	uint8* pTargetDIB = (uint8*)pDIBTarget;
 	for (int j = 0; j < nHeight; j++) {
 		const uint8* pSourceDIB;
@@ -747,13 +1077,8 @@ void CBasicProcessing::Convert32bppTo24bppDIB(int nWidth, int nHeight, void* pDI
 		} else {
 			pSourceDIB = (uint8*)pDIBSource + j*nWidth*4;
 		}
-		for (int i = 0; i < nWidth; i++) {
-			*pTargetDIB++ = pSourceDIB[0];
-			*pTargetDIB++ = pSourceDIB[1];
-			*pTargetDIB++ = pSourceDIB[2];
-			pSourceDIB += 4;
-		}
-		pTargetDIB += nPad;
+		kernels.Convert4To3ChannelsRow(pSourceDIB, pTargetDIB, nWidth);
+		pTargetDIB += nPaddedWidth;
 	}
 }
 
@@ -795,17 +1120,16 @@ void* CBasicProcessing::Convert3To4Channels(int nWidth, int nHeight, const void*
 	if (pIJLPixels == NULL) {
 		return NULL;
 	}
-	int nPadSrc = Helpers::DoPadding(nWidth*3, 4) - nWidth*3;
+	int nPaddedWidthSrc = Helpers::DoPadding(nWidth*3, 4);
 	uint32* pNewDIB = new(std::nothrow) uint32[nWidth * nHeight];
 	if (pNewDIB == NULL) return NULL;
+	const CPixelKernels& kernels = CPixelKernels::Get();
 	uint32* pTarget = pNewDIB;
 	const uint8* pSource = (uint8*)pIJLPixels;
 	for (int j = 0; j < nHeight; j++) {
-		for (int i = 0; i < nWidth; i++) {
-			*pTarget++ = pSource[0] + pSource[1] * 256 + pSource[2] * 65536 + ALPHA_OPAQUE;
-			pSource += 3;
-		}
-		pSource += nPadSrc;
+		kernels.Convert3To4ChannelsRow(pSource, pTarget, nWidth);
+		pTarget += nWidth;
+		pSource += nPaddedWidthSrc;
 	}
 	return pNewDIB;
 }
@@ -816,11 +1140,11 @@ void* CBasicProcessing::ConvertGdiplus32bppRGB(int nWidth, int nHeight, int nStr
 	}
 	uint32* pNewDIB = new(std::nothrow) uint32[nWidth * nHeight];
 	if (pNewDIB == NULL) return NULL;
+	const CPixelKernels& kernels = CPixelKernels::Get();
 	uint32* pTgt = pNewDIB;
 	const uint8* pSrc = (const uint8*)pGdiplusPixels;
 	for (int j = 0; j < nHeight; j++) {
-		for (int i = 0; i < nWidth; i++)
-			pTgt[i] = ((uint32*)pSrc)[i] | ALPHA_OPAQUE;
+		kernels.SetAlphaOpaque((const uint32*)pSrc, pTgt, nWidth);
 		pTgt += nWidth;
 		pSrc += nStride;
 	}
@@ -868,21 +1192,8 @@ void* CBasicProcessing::Crop32bpp(int nWidth, int nHeight, const void* pDIBPixel
 // Simple point sampling resize and rotation methods
 /////////////////////////////////////////////////////////////////////////////////////////////
 
-void* CBasicProcessing::PointSample(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, 
-	CSize sourceSize, const void* pPixels, int nChannels) {
-	if (fullTargetSize.cx < 1 || fullTargetSize.cy < 1 ||
-		clippedTargetSize.cx < 1 || clippedTargetSize.cy < 1 ||
-		fullTargetOffset.x < 0 || fullTargetOffset.x < 0 ||
-		clippedTargetSize.cx + fullTargetOffset.x > fullTargetSize.cx ||
-		clippedTargetSize.cy + fullTargetOffset.y > fullTargetSize.cy ||
-		pPixels == NULL || (nChannels != 3 && nChannels != 4)) {
-		return NULL;
-	}
-
-	uint8* pDIB = new(std::nothrow) uint8[clippedTargetSize.cx*4 * clippedTargetSize.cy];
-	if (pDIB == NULL) return NULL;
-
-	uint32 nIncrementX, nIncrementY;
+// Gets the 16.16 fixed point increments in the source image when stepping one pixel in the target image
+static void GetPointSampleIncrements(CSize fullTargetSize, CSize sourceSize, uint32& nIncrementX, uint32& nIncrementY) {
 	if (fullTargetSize.cx <= sourceSize.cx) {
 		// Downsampling
 		nIncrementX = (uint32)(sourceSize.cx << 16)/fullTargetSize.cx + 1;
@@ -892,48 +1203,54 @@ void* CBasicProcessing::PointSample(CSize fullTargetSize, CPoint fullTargetOffse
 		nIncrementX = (fullTargetSize.cx == 1) ? 0 : (uint32)((65536*(uint32)(sourceSize.cx - 1) + 65535)/(fullTargetSize.cx - 1));
 		nIncrementY = (fullTargetSize.cy == 1) ? 0 : (uint32)((65536*(uint32)(sourceSize.cy - 1) + 65535)/(fullTargetSize.cy - 1));
 	}
+}
 
-	int nPaddedSourceWidth = Helpers::DoPadding(sourceSize.cx * nChannels, 4);
-	const uint8* pSrc = NULL;
-	uint8* pDst = pDIB;
+// Point sampling of the target rows given by fullTargetOffset and clippedTargetSize, from pPixels or from pYCbCrImage if not NULL
+static void* PointSample_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, CSize sourceSize,
+	const void* pPixels, int nSourceStride, int nChannels, const CYCbCrImage* pYCbCrImage, bool bUseAVX2, void* pTargetPixels) {
+	uint32 nIncrementX, nIncrementY;
+	GetPointSampleIncrements(fullTargetSize, sourceSize, nIncrementX, nIncrementY);
+
+	uint32* pDst = (uint32*)pTargetPixels;
 	uint32 nCurY = fullTargetOffset.y*nIncrementY;
 	uint32 nStartX = fullTargetOffset.x*nIncrementX;
 	for (int j = 0; j < clippedTargetSize.cy; j++) {
-		pSrc = (uint8*)pPixels + nPaddedSourceWidth * (nCurY >> 16);
-		uint32 nCurX = nStartX;
-		if (nChannels == 3) {
+		if (pYCbCrImage != NULL) {
+			uint32 nCurX = nStartX;
 			for (int i = 0; i < clippedTargetSize.cx; i++) {
-				uint32 sx = nCurX >> 16; 
-				uint32 s = sx*3;
-				uint32 d = i*4;
-				pDst[d] = pSrc[s];
-				pDst[d+1] = pSrc[s+1];
-				pDst[d+2] = pSrc[s+2];
-				pDst[d+3] = 0xFF;
+				pDst[i] = pYCbCrImage->GetPixel(nCurX >> 16, nCurY >> 16);
 				nCurX += nIncrementX;
 			}
 		} else {
-			for (int i = 0; i < clippedTargetSize.cx; i++) {
-				uint32 sx = nCurX >> 16; 
-				((uint32*)pDst)[i] = ((uint32*)pSrc)[sx];
-				nCurX += nIncrementX;
+			const uint8* pSrc = (uint8*)pPixels + (ptrdiff_t)nSourceStride * (nCurY >> 16);
+			int i = 0;
+#ifdef _WIN64
+			if (bUseAVX2) {
+				i = PointSampleRow_AVX2(pSrc, sourceSize.cx, nChannels, nStartX, nIncrementX, clippedTargetSize.cx, pDst);
+			}
+#endif
+			uint32 nCurX = nStartX + i*nIncrementX;
+			if (nChannels == 3) {
+				for (; i < clippedTargetSize.cx; i++) {
+					uint32 s = (nCurX >> 16)*3;
+					pDst[i] = pSrc[s] + (pSrc[s+1] << 8) + (pSrc[s+2] << 16) + ALPHA_OPAQUE;
+					nCurX += nIncrementX;
+				}
+			} else {
+				for (; i < clippedTargetSize.cx; i++) {
+					pDst[i] = ((uint32*)pSrc)[nCurX >> 16];
+					nCurX += nIncrementX;
+				}
 			}
 		}
-		pDst += clippedTargetSize.cx*4;
+		pDst += clippedTargetSize.cx;
 		nCurY += nIncrementY;
 	}
-	return pDIB;
-}
-
-static void RotateInplace(double& dX, double& dY, double dAngle) {
-	double dXr = cos(dAngle) * dX - sin(dAngle) * dY;
-	double dYr = sin(dAngle) * dX + cos(dAngle) * dY;
-	dX = dXr;
-	dY = dYr;
+	return pTargetPixels;
 }
 
-void* CBasicProcessing::PointSampleWithRotation(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, 
-	CSize sourceSize, double dRotation, const void* pPixels, int nChannels, COLORREF backColor) {
+void* CBasicProcessing::PointSample(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, 
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels) {
 	if (fullTargetSize.cx < 1 || fullTargetSize.cy < 1 ||
 		clippedTargetSize.cx < 1 || clippedTargetSize.cy < 1 ||
 		fullTargetOffset.x < 0 || fullTargetOffset.x < 0 ||
@@ -946,7 +1263,42 @@ void* CBasicProcessing::PointSampleWithRotation(CSize fullTargetSize, CPoint ful
 	uint8* pDIB = new(std::nothrow) uint8[clippedTargetSize.cx*4 * clippedTargetSize.cy];
 	if (pDIB == NULL) return NULL;
 
-	uint32 nBackColor = (GetRValue(backColor) << 16) + (GetGValue(backColor) << 8) + GetBValue(backColor) + ALPHA_OPAQUE;
+	CRequestPointSample request(pPixels, sourceSize, nSourceStride, nChannels, NULL, pDIB,
+		fullTargetSize, fullTargetOffset, clippedTargetSize, UseAVX2PointSampling());
+	CProcessingThreadPool::This().Process(&request);
+	return pDIB;
+}
+
+void* CBasicProcessing::PointSample(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, 
+	const CYCbCrImage& image) {
+	if (fullTargetSize.cx < 1 || fullTargetSize.cy < 1 ||
+		clippedTargetSize.cx < 1 || clippedTargetSize.cy < 1 ||
+		fullTargetOffset.x < 0 || fullTargetOffset.x < 0 ||
+		clippedTargetSize.cx + fullTargetOffset.x > fullTargetSize.cx ||
+		clippedTargetSize.cy + fullTargetOffset.y > fullTargetSize.cy) {
+		return NULL;
+	}
+
+	uint32* pDIB = new(std::nothrow) uint32[clippedTargetSize.cx * clippedTargetSize.cy];
+	if (pDIB == NULL) return NULL;
+
+	CRequestPointSample request(NULL, CSize(image.Width(), image.Height()), 0, 4, &image, pDIB,
+		fullTargetSize, fullTargetOffset, clippedTargetSize, false);
+	CProcessingThreadPool::This().Process(&request);
+	return pDIB;
+}
+
+static void RotateInplace(double& dX, double& dY, double dAngle) {
+	double dXr = cos(dAngle) * dX - sin(dAngle) * dY;
+	double dYr = sin(dAngle) * dX + cos(dAngle) * dY;
+	dX = dXr;
+	dY = dYr;
+}
+
+// Gets the 16.16 fixed point start position and increments in the source image for point sampling with rotation.
+// Stepping one pixel in x direction in the target image adds nIncrementX1/nIncrementY1, one pixel in y direction adds nIncrementX2/nIncrementY2.
+static void GetRotationIncrements(CSize fullTargetSize, CSize sourceSize, double dRotation, int32& nFirstX, int32& nFirstY,
+	int32& nIncrementX1, int32& nIncrementY1, int32& nIncrementX2, int32& nIncrementY2) {
 	double dFirstX = -(sourceSize.cx - 1) * 0.5;
 	double dFirstY = -(sourceSize.cy - 1) * 0.5;
 	double dIncX1 = dFirstX + ((fullTargetSize.cx == 1) ? 0 : (double)(sourceSize.cx)/(fullTargetSize.cx - 1));
@@ -961,56 +1313,97 @@ void* CBasicProcessing::PointSampleWithRotation(CSize fullTargetSize, CPoint ful
 	dIncX2 = dIncX2 - dFirstX;
 	dIncY2 = dIncY2 - dFirstY;
 
-	int32 nFirstX = Helpers::RoundToInt(65536 * (dFirstX + (sourceSize.cx - 1) * 0.5));
-	int32 nFirstY = Helpers::RoundToInt(65536 * (dFirstY + (sourceSize.cy - 1) * 0.5));
-	int32 nIncrementX1 = Helpers::RoundToInt(65536 * dIncX1);
-	int32 nIncrementY1 = Helpers::RoundToInt(65536 * dIncY1);
-	int32 nIncrementX2 = Helpers::RoundToInt(65536 * dIncX2);
-	int32 nIncrementY2 = Helpers::RoundToInt(65536 * dIncY2);
+	nFirstX = Helpers::RoundToInt(65536 * (dFirstX + (sourceSize.cx - 1) * 0.5));
+	nFirstY = Helpers::RoundToInt(65536 * (dFirstY + (sourceSize.cy - 1) * 0.5));
+	nIncrementX1 = Helpers::RoundToInt(65536 * dIncX1);
+	nIncrementY1 = Helpers::RoundToInt(65536 * dIncY1);
+	nIncrementX2 = Helpers::RoundToInt(65536 * dIncX2);
+	nIncrementY2 = Helpers::RoundToInt(65536 * dIncY2);
+}
 
-	int nPaddedSourceWidth = Helpers::DoPadding(sourceSize.cx * nChannels, 4);
-	const uint8* pSrc = NULL;
-	uint8* pDst = pDIB;
+// Point sampling with rotation of the target rows given by fullTargetOffset and clippedTargetSize,
+// from pPixels or from pYCbCrImage if not NULL
+static void* PointSampleWithRotation_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, CSize sourceSize,
+	double dRotation, const void* pPixels, int nSourceStride, int nChannels, const CYCbCrImage* pYCbCrImage, COLORREF backColor,
+	bool bUseAVX2, void* pTargetPixels) {
+	uint32 nBackColor = (GetRValue(backColor) << 16) + (GetGValue(backColor) << 8) + GetBValue(backColor) + ALPHA_OPAQUE;
+	int32 nFirstX, nFirstY, nIncrementX1, nIncrementY1, nIncrementX2, nIncrementY2;
+	GetRotationIncrements(fullTargetSize, sourceSize, dRotation, nFirstX, nFirstY, nIncrementX1, nIncrementY1, nIncrementX2, nIncrementY2);
+
+	uint32* pDst = (uint32*)pTargetPixels;
 	int32 nX = nFirstX + fullTargetOffset.x * nIncrementX1 + fullTargetOffset.y * nIncrementX2;
 	int32 nY = nFirstY + fullTargetOffset.x * nIncrementY1 + fullTargetOffset.y * nIncrementY2;
 	for (int j = 0; j < clippedTargetSize.cy; j++) {
-		int nCurX = nX;
-		int nCurY = nY;
-		if (nChannels == 3) {
-			for (int i = 0; i < clippedTargetSize.cx; i++) {
-				int32 nCurRealX = nCurX >> 16;
-				int32 nCurRealY = nCurY >> 16;
-				if (nCurRealX >= 0 && nCurRealX < sourceSize.cx && nCurRealY >= 0 && nCurRealY < sourceSize.cy) {
-					pSrc = (uint8*)pPixels + nPaddedSourceWidth * nCurRealY + nCurRealX * 3;
-					uint32 d = i*4;
-					pDst[d] = pSrc[0];
-					pDst[d+1] = pSrc[1];
-					pDst[d+2] = pSrc[2];
-					pDst[d+3] = 0xFF;
-				} else {
-					*((uint32*)pDst + i) = nBackColor;
-				}
-				nCurX += nIncrementX1;
-				nCurY += nIncrementY1;
-			}
-		} else {
-			for (int i = 0; i < clippedTargetSize.cx; i++) {
-				int32 nCurRealX = nCurX >> 16;
-				int32 nCurRealY = nCurY >> 16;
-				if (nCurRealX >= 0 && nCurRealX < sourceSize.cx && nCurRealY >= 0 && nCurRealY < sourceSize.cy) {
-					pSrc = (uint8*)pPixels + nPaddedSourceWidth * nCurRealY + nCurRealX * 4;
-					*((uint32*)pDst + i) = *((uint32*)pSrc);
+		int i = 0;
+#ifdef _WIN64
+		if (bUseAVX2) {
+			i = PointSampleRotated_AVX2((const uint8*)pPixels, sourceSize.cx, sourceSize.cy, nSourceStride, nChannels,
+				nX, nY, nIncrementX1, nIncrementY1, nBackColor, clippedTargetSize.cx, pDst);
+		}
+#endif
+		int nCurX = nX + i * nIncrementX1;
+		int nCurY = nY + i * nIncrementY1;
+		for (; i < clippedTargetSize.cx; i++) {
+			int32 nCurRealX = nCurX >> 16;
+			int32 nCurRealY = nCurY >> 16;
+			if (nCurRealX >= 0 && nCurRealX < sourceSize.cx && nCurRealY >= 0 && nCurRealY < sourceSize.cy) {
+				if (pYCbCrImage != NULL) {
+					pDst[i] = pYCbCrImage->GetPixel(nCurRealX, nCurRealY);
+				} else if (nChannels == 3) {
+					const uint8* pSrc = (uint8*)pPixels + (ptrdiff_t)nSourceStride * nCurRealY + nCurRealX * 3;
+					pDst[i] = pSrc[0] + (pSrc[1] << 8) + (pSrc[2] << 16) + ALPHA_OPAQUE;
 				} else {
-					*((uint32*)pDst + i) = nBackColor;
+					pDst[i] = *(const uint32*)((uint8*)pPixels + (ptrdiff_t)nSourceStride * nCurRealY + nCurRealX * 4);
 				}
-				nCurX += nIncrementX1;
-				nCurY += nIncrementY1;
+			} else {
+				pDst[i] = nBackColor;
 			}
+			nCurX += nIncrementX1;
+			nCurY += nIncrementY1;
 		}
-		pDst += clippedTargetSize.cx*4;
+		pDst += clippedTargetSize.cx;
 		nX += nIncrementX2;
 		nY += nIncrementY2;
 	}
+	return pTargetPixels;
+}
+
+void* CBasicProcessing::PointSampleWithRotation(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, 
+	CSize sourceSize, double dRotation, const void* pPixels, int nSourceStride, int nChannels, COLORREF backColor) {
+	if (fullTargetSize.cx < 1 || fullTargetSize.cy < 1 ||
+		clippedTargetSize.cx < 1 || clippedTargetSize.cy < 1 ||
+		fullTargetOffset.x < 0 || fullTargetOffset.x < 0 ||
+		clippedTargetSize.cx + fullTargetOffset.x > fullTargetSize.cx ||
+		clippedTargetSize.cy + fullTargetOffset.y > fullTargetSize.cy ||
+		pPixels == NULL || (nChannels != 3 && nChannels != 4)) {
+		return NULL;
+	}
+
+	uint8* pDIB = new(std::nothrow) uint8[clippedTargetSize.cx*4 * clippedTargetSize.cy];
+	if (pDIB == NULL) return NULL;
+
+	CRequestPointSampleRotation request(pPixels, sourceSize, nSourceStride, nChannels, NULL, pDIB,
+		fullTargetSize, fullTargetOffset, clippedTargetSize, dRotation, backColor, UseAVX2PointSampling());
+	CProcessingThreadPool::This().Process(&request);
+	return pDIB;
+}
+
+void* CBasicProcessing::PointSampleWithRotation(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, 
+	double dRotation, const CYCbCrImage& image, COLORREF backColor) {
+	if (fullTargetSize.cx < 1 || fullTargetSize.cy < 1 ||
+		clippedTargetSize.cx < 1 || clippedTargetSize.cy < 1 ||
+		fullTargetOffset.x < 0 || fullTargetOffset.x < 0 ||
+		clippedTargetSize.cx + fullTargetOffset.x > fullTargetSize.cx ||
+		clippedTargetSize.cy + fullTargetOffset.y > fullTargetSize.cy) {
+		return NULL;
+	}
+
+	uint32* pDIB = new(std::nothrow) uint32[clippedTargetSize.cx * clippedTargetSize.cy];
+	if (pDIB == NULL) return NULL;
+
+	CRequestPointSampleRotation request(NULL, CSize(image.Width(), image.Height()), 0, 4, &image, pDIB,
+		fullTargetSize, fullTargetOffset, clippedTargetSize, dRotation, backColor, false);
+	CProcessingThreadPool::This().Process(&request);
 	return pDIB;
 }
 
@@ -1081,8 +1474,50 @@ static int* CalculateTrapezoidYIntersectionTable(const CTrapezoid& trapezoid, in
 	return pTableY;
 }
 
+// Point sampling into the trapezoid for the given target rows. pTableY, pStartX and pIncrementX give the source row and
+// the x position and increment in the source row for each of the target rows.
+static void* PointSampleTrapezoid_Core(CSize clippedTargetSize, const int* pTableY, const int* pStartX, const int* pIncrementX,
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, uint32 nBackColor, bool bUseAVX2, void* pTargetPixels) {
+	uint32* pDst = (uint32*)pTargetPixels;
+	for (int j = 0; j < clippedTargetSize.cy; j++) {
+		const uint8* pSrc = (uint8*)pPixels + (ptrdiff_t)nSourceStride * (pTableY[j] >> 16);
+		int nIncrementX = pIncrementX[j];
+		int i = 0;
+#ifdef _WIN64
+		if (bUseAVX2) {
+			i = PointSampleRowClipped_AVX2(pSrc, sourceSize.cx, nChannels, pStartX[j], nIncrementX, nBackColor, clippedTargetSize.cx, pDst);
+		}
+#endif
+		int nCurX = pStartX[j] + i*nIncrementX;
+		if (nChannels == 3) {
+			for (; i < clippedTargetSize.cx; i++) {
+				int sx = nCurX >> 16;
+				if (sx >= 0 && sx < sourceSize.cx) {
+					int s = sx*3;
+					pDst[i] = pSrc[s] + (pSrc[s+1] << 8) + (pSrc[s+2] << 16) + ALPHA_OPAQUE;
+				} else {
+					pDst[i] = nBackColor;
+				}
+				nCurX += nIncrementX;
+			}
+		} else {
+			for (; i < clippedTargetSize.cx; i++) {
+				int sx = nCurX >> 16; 
+				if (sx >= 0 && sx < sourceSize.cx) {
+					pDst[i] = ((uint32*)pSrc)[sx];
+				} else {
+					pDst[i] = nBackColor;
+				}
+				nCurX += nIncrementX;
+			}
+		}
+		pDst += clippedTargetSize.cx;
+	}
+	return pTargetPixels;
+}
+
 void* CBasicProcessing::PointSampleTrapezoid(CSize fullTargetSize, const CTrapezoid& fullTargetTrapezoid, CPoint fullTargetOffset, CSize clippedTargetSize, 
-	CSize sourceSize, const void* pPixels, int nChannels, COLORREF backColor) {
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, COLORREF backColor) {
 	if (fullTargetSize.cx < 1 || fullTargetSize.cy < 1 ||
 		(fullTargetTrapezoid.x1e - fullTargetTrapezoid.x1s) <= 0  ||
 		(fullTargetTrapezoid.x2e - fullTargetTrapezoid.x2s) <= 0  ||
@@ -1105,49 +1540,27 @@ void* CBasicProcessing::PointSampleTrapezoid(CSize fullTargetSize, const CTrapez
 	float fIncrementTx2 = ((float)(fullTargetTrapezoid.x2e - fullTargetTrapezoid.x1e))/fullTargetTrapezoid.Height();
 
 	uint32 nBackColor = (GetRValue(backColor) << 16) + (GetGValue(backColor) << 8) + GetBValue(backColor) + ALPHA_OPAQUE;
-	int nPaddedSourceWidth = Helpers::DoPadding(sourceSize.cx * nChannels, 4);
-	const uint8* pSrc = NULL;
-	uint8* pDst = pDIB;
 	fTx1 = fTx1 + fullTargetOffset.y*fIncrementTx1;
 	fTx2 = fTx2 + fullTargetOffset.y*fIncrementTx2;
 	int nSourceSizeXFP16 = sourceSize.cx << 16;
+
+	// The row parameters are accumulated row by row, thus they are calculated before processing the rows in parallel
+	int* pStartX = new int[clippedTargetSize.cy];
+	int* pIncrementX = new int[clippedTargetSize.cy];
 	for (int j = 0; j < clippedTargetSize.cy; j++) {
-		pSrc = (uint8*)pPixels + nPaddedSourceWidth * (pTableY[j] >> 16);
-		int nIncrementX = (int)(nSourceSizeXFP16/(fTx2 - fTx1 + 1)) + 1;
-		int nStartX = (int)((fullTargetOffset.x - fTx1)*nIncrementX);
-		int nCurX = nStartX;
-		if (nChannels == 3) {
-			for (int i = 0; i < clippedTargetSize.cx; i++) {
-				int sx = nCurX >> 16;
-				if (sx >= 0 && sx < sourceSize.cx) {
-					int s = sx*3;
-					int d = i*4;
-					pDst[d] = pSrc[s];
-					pDst[d+1] = pSrc[s+1];
-					pDst[d+2] = pSrc[s+2];
-					pDst[d+3] = 0xFF;
-				} else {
-					((uint32*)pDst)[i] = nBackColor;
-				}
-				nCurX += nIncrementX;
-			}
-		} else {
-			for (int i = 0; i < clippedTargetSize.cx; i++) {
-				int sx = nCurX >> 16; 
-				if (sx >= 0 && sx < sourceSize.cx) {
-					((uint32*)pDst)[i] = ((uint32*)pSrc)[sx];
-				} else {
-					((uint32*)pDst)[i] = nBackColor;
-				}
-				nCurX += nIncrementX;
-			}
-		}
-		pDst += clippedTargetSize.cx*4;
+		pIncrementX[j] = (int)(nSourceSizeXFP16/(fTx2 - fTx1 + 1)) + 1;
+		pStartX[j] = (int)((fullTargetOffset.x - fTx1)*pIncrementX[j]);
 		fTx1 += fIncrementTx1;
 		fTx2 += fIncrementTx2;
 	}
 
+	CRequestPointSampleTrapezoid request(pPixels, sourceSize, nSourceStride, nChannels, pDIB, clippedTargetSize,
+		pTableY, pStartX, pIncrementX, nBackColor, UseAVX2PointSampling());
+	CProcessingThreadPool::This().Process(&request);
+
 	delete[] pTableY;
+	delete[] pStartX;
+	delete[] pIncrementX;
 	return pDIB;
 }
 
@@ -1162,20 +1575,20 @@ void* CBasicProcessing::PointSampleTrapezoid(CSize fullTargetSize, const CTrapez
 // Bicubic resampling of one pixel at pSource (in 3 or 4 channel format) into one destination pixel in 32 bit format
 // The fractional part of the pixel position is given in .16 fixed point format
 // pKernels contains NUM_KERNELS_BICUBIC precalculated bicubic filter kernels each of length 4, applied with offset -1 to the source pixels
-static void InterpolateBicubic(const uint8* pSource, uint8* pDest, int16* pKernels, int32 nFracX, int32 nFracY, int nPaddedSourceWidth, int nChannels) {
+static void InterpolateBicubic(const uint8* pSource, uint8* pDest, int16* pKernels, int32 nFracX, int32 nFracY, int nSourceStride, int nChannels) {
 	int16* pKernelX = &(pKernels[4*(nFracX >> (16 - NUM_KERNELS_LOG2))]);
 	int16* pKernelY = &(pKernels[4*(nFracY >> (16 - NUM_KERNELS_LOG2))]);
 	int nChannels2 = nChannels * 2;
 	for (int i = 0; i < nChannels; i++) {
 		const uint8* pSrc = pSource;
-		pSrc -= nPaddedSourceWidth;
+		pSrc -= nSourceStride;
 
 		int32 nSum1 = pSrc[-nChannels] * pKernelX[0] + pSrc[0] * pKernelX[1] + pSrc[nChannels] * pKernelX[2] + pSrc[nChannels2] * pKernelX[3] + FP_HALF;
-		pSrc += nPaddedSourceWidth;
+		pSrc += nSourceStride;
 		int32 nSum2 = pSrc[-nChannels] * pKernelX[0] + pSrc[0] * pKernelX[1] + pSrc[nChannels] * pKernelX[2] + pSrc[nChannels2] * pKernelX[3] + FP_HALF;
-		pSrc += nPaddedSourceWidth;
+		pSrc += nSourceStride;
 		int32 nSum3 = pSrc[-nChannels] * pKernelX[0] + pSrc[0] * pKernelX[1] + pSrc[nChannels] * pKernelX[2] + pSrc[nChannels2] * pKernelX[3] + FP_HALF;
-		pSrc += nPaddedSourceWidth;
+		pSrc += nSourceStride;
 		int32 nSum4 = pSrc[-nChannels] * pKernelX[0] + pSrc[0] * pKernelX[1] + pSrc[nChannels] * pKernelX[2] + pSrc[nChannels2] * pKernelX[3] + FP_HALF;
 
 		int32 nSum = (nSum1 >> 14) * pKernelY[0] + (nSum2 >> 14) * pKernelY[1] + (nSum3 >> 14) * pKernelY[2] + (nSum4 >> 14) * pKernelY[3] + FP_HALF;
@@ -1197,13 +1610,13 @@ static inline void Get4Pixels(const uint8* pSrc, uint8 dest[4], int nFrom, int n
 // Same as method above but with border handling, assuming that the filter kernels are only evaluated from nXFrom to nXTo and nYFrom to nYTo
 // Pixels that are outside this range are assumed to have value nBackColor
 static void InterpolateBicubicBorder(const uint8* pSource, uint8* pDest, int16* pKernels, 
-									 int32 nFracX, int32 nFracY, int nXFrom, int nXTo, int nYFrom, int nYTo, int nPaddedSourceWidth, int nChannels, uint32 nBackColor) {
+									 int32 nFracX, int32 nFracY, int nXFrom, int nXTo, int nYFrom, int nYTo, int nSourceStride, int nChannels, uint32 nBackColor) {
 	int16* pKernelX = &(pKernels[4*(nFracX >> (16 - NUM_KERNELS_LOG2))]);
 	int16* pKernelY = &(pKernels[4*(nFracY >> (16 - NUM_KERNELS_LOG2))]);
 	uint32 nBackColorShifted = nBackColor;
 	for (int i = 0; i < nChannels; i++) {
 		const uint8* pSrc = pSource;
-		pSrc -= nPaddedSourceWidth;
+		pSrc -= nSourceStride;
 		uint32 nFill = nBackColorShifted & 0xFF;
 		int32 nFillShifted = nFill << 14;
 		nBackColorShifted = nBackColorShifted >> 8;
@@ -1215,19 +1628,19 @@ static void InterpolateBicubicBorder(const uint8* pSource, uint8* pDest, int16*
 			Get4Pixels(pSrc, pixels, nXFrom, nXTo, nChannels, nFill); 
 			nSum1 = pixels[0] * pKernelX[0] + pixels[1] * pKernelX[1] + pixels[2] * pKernelX[2] + pixels[3] * pKernelX[3] + FP_HALF;
 		}
-		pSrc += nPaddedSourceWidth;
+		pSrc += nSourceStride;
 		int nSum2 = nFillShifted;
 		if (nYFrom <= 0 && nYTo >= 0) {
 			Get4Pixels(pSrc, pixels, nXFrom, nXTo, nChannels, nFill); 
 			nSum2 = pixels[0] * pKernelX[0] + pixels[1] * pKernelX[1] + pixels[2] * pKernelX[2] + pixels[3] * pKernelX[3] + FP_HALF;
 		}
-		pSrc += nPaddedSourceWidth;
+		pSrc += nSourceStride;
 		int32 nSum3 = nFillShifted;
 		if (nYFrom <= 1 && nYTo >= 1) {
 			Get4Pixels(pSrc, pixels, nXFrom, nXTo, nChannels, nFill); 
 			nSum3 = pixels[0] * pKernelX[0] + pixels[1] * pKernelX[1] + pixels[2] * pKernelX[2] + pixels[3] * pKernelX[3] + FP_HALF;
 		}
-		pSrc += nPaddedSourceWidth;
+		pSrc += nSourceStride;
 		int32 nSum4 = nFillShifted;
 		if (nYTo >= 2) {
 			Get4Pixels(pSrc, pixels, nXFrom, nXTo, nChannels, nFill); 
@@ -1243,8 +1656,52 @@ static void InterpolateBicubicBorder(const uint8* pSource, uint8* pDest, int16*
 	if (nChannels == 3) *pDest = 0xFF;
 }
 
+// Returns a vector with the pair (nKernel0, nKernel1) of 16 bit kernel elements repeated four times, for _mm_madd_epi16()
+static inline __m128i KernelPair(int16 nKernel0, int16 nKernel1) {
+	return _mm_set1_epi32((uint16)nKernel0 | ((uint32)(uint16)nKernel1 << 16));
+}
+
+// Weighted sum of four pixels with 8 bit channels, the 16 bit channels of the pixels p0, p1 in pixels01 and p2, p3 in pixels23.
+// Returns the four 32 bit sums of the channels, rounded and in the same fixed point format as the kernels.
+static inline __m128i Interpolate4Pixels_SSE(__m128i pixels01, __m128i pixels23, __m128i kernel01, __m128i kernel23) {
+	// interleave the two pixels: c0 of p0, c0 of p1, c1 of p0, c1 of p1, ...
+	pixels01 = _mm_unpacklo_epi16(pixels01, _mm_srli_si128(pixels01, 8));
+	pixels23 = _mm_unpacklo_epi16(pixels23, _mm_srli_si128(pixels23, 8));
+	__m128i sum = _mm_add_epi32(_mm_madd_epi16(pixels01, kernel01), _mm_madd_epi16(pixels23, kernel23));
+	return _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(FP_HALF)), 14);
+}
+
+// Same as InterpolateBicubic(), computing all channels of the pixel at once with SSE2. Gives identical results.
+// The fourth channel of the destination pixel is garbage for 3 channel sources and must be set by the caller.
+static uint32 InterpolateBicubic_SSE(const uint8* pSource, const int16* pKernels, int32 nFracX, int32 nFracY, int nSourceStride, int nChannels) {
+	const int16* pKernelX = &(pKernels[4*(nFracX >> (16 - NUM_KERNELS_LOG2))]);
+	const int16* pKernelY = &(pKernels[4*(nFracY >> (16 - NUM_KERNELS_LOG2))]);
+	__m128i kernelX01 = KernelPair(pKernelX[0], pKernelX[1]);
+	__m128i kernelX23 = KernelPair(pKernelX[2], pKernelX[3]);
+	__m128i zero = _mm_setzero_si128();
+	__m128i rowSums[4];
+	const uint8* pSrc = pSource - nSourceStride;
+	for (int nRow = 0; nRow < 4; nRow++) {
+		__m128i pixels;
+		if (nChannels == 4) {
+			pixels = _mm_loadu_si128((const __m128i*)(pSrc - 4));
+		} else {
+			// the fourth byte of the first three pixels is the first channel of the next pixel, do not read after the last pixel
+			pixels = _mm_setr_epi32(*(const int*)(pSrc - 3), *(const int*)pSrc, *(const int*)(pSrc + 3),
+				pSrc[6] | (pSrc[7] << 8) | (pSrc[8] << 16));
+		}
+		rowSums[nRow] = Interpolate4Pixels_SSE(_mm_unpacklo_epi8(pixels, zero), _mm_unpackhi_epi8(pixels, zero), kernelX01, kernelX23);
+		pSrc += nSourceStride;
+	}
+	// the row sums are small enough to be packed to 16 bit without saturation
+	__m128i sum = Interpolate4Pixels_SSE(_mm_packs_epi32(rowSums[0], rowSums[1]), _mm_packs_epi32(rowSums[2], rowSums[3]),
+		KernelPair(pKernelY[0], pKernelY[1]), KernelPair(pKernelY[2], pKernelY[3]));
+	sum = _mm_packs_epi32(sum, sum);
+	return (uint32)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+}
+
 void* RotateHQ_Core(CPoint targetOffset, CSize targetSize, double dRotation, CSize sourceSize, 
-									  const void* pSourcePixels, void* pTargetPixels, int nChannels, COLORREF backColor){
+									  const void* pSourcePixels, int nSourceStride, void* pTargetPixels, int nChannels, COLORREF backColor, bool bUseSSE){
 
 	double dFirstX = -(sourceSize.cx - 1) * 0.5;
 	double dFirstY = -(sourceSize.cy - 1) * 0.5;
@@ -1271,7 +1728,6 @@ void* RotateHQ_Core(CPoint targetOffset, CSize targetSize, double dRotation, CSi
 	CResizeFilter::GetBicubicFilterKernels(NUM_KERNELS_BICUBIC, pKernels);
 
 	uint32 nBackColor = (GetRValue(backColor) << 16) + (GetGValue(backColor) << 8) + GetBValue(backColor) + ALPHA_OPAQUE;
-	int nPaddedSourceWidth = Helpers::DoPadding(sourceSize.cx * nChannels, 4);
 	const uint8* pSrc = NULL;
 	uint8* pDst = (uint8*)pTargetPixels;
 	int32 nX = nFirstX + targetOffset.x * nIncrementX1 + targetOffset.y * nIncrementX2;
@@ -1285,15 +1741,20 @@ void* RotateHQ_Core(CPoint targetOffset, CSize targetSize, double dRotation, CSi
 			int32 nFracX = nCurX & 0xFFFF;
 			int32 nFracY = nCurY & 0xFFFF;
 			if (nCurRealX >= -1 && nCurRealX <= sourceSize.cx && nCurRealY >= -1 && nCurRealY <= sourceSize.cy) {
-				pSrc = (uint8*)pSourcePixels + nPaddedSourceWidth * nCurRealY + nCurRealX * nChannels;
+				pSrc = (uint8*)pSourcePixels + (ptrdiff_t)nSourceStride * nCurRealY + nCurRealX * nChannels;
 				if (nCurRealX > 0 && nCurRealX < sourceSize.cx - 2 && nCurRealY > 0 && nCurRealY < sourceSize.cy - 2) {
-					InterpolateBicubic(pSrc, pDst + i*4, pKernels, nFracX, nFracY, nPaddedSourceWidth, nChannels);
+					if (bUseSSE) {
+						uint32 nPixel = InterpolateBicubic_SSE(pSrc, pKernels, nFracX, nFracY, nSourceStride, nChannels);
+						*((uint32*)pDst + i) = (nChannels == 3) ? (nPixel | ALPHA_OPAQUE) : nPixel;
+					} else {
+						InterpolateBicubic(pSrc, pDst + i*4, pKernels, nFracX, nFracY, nSourceStride, nChannels);
+					}
 				} else {
 					int nXFrom = (nCurRealX > 0) ? -1 : -nCurRealX;
 					int nXTo = (nCurRealX < sourceSize.cx - 2) ? 2 : sourceSize.cx - nCurRealX - 1;
 					int nYFrom = (nCurRealY > 0) ? -1 : -nCurRealY;
 					int nYTo = (nCurRealY < sourceSize.cy - 2) ? 2 : sourceSize.cy - nCurRealY - 1;
-					InterpolateBicubicBorder(pSrc, pDst + i*4, pKernels, nFracX, nFracY, nXFrom, nXTo, nYFrom, nYTo, nPaddedSourceWidth, nChannels, nBackColor);
+					InterpolateBicubicBorder(pSrc, pDst + i*4, pKernels, nFracX, nFracY, nXFrom, nXTo, nYFrom, nYTo, nSourceStride, nChannels, nBackColor);
 				}
 			} else {
 				*((uint32*)pDst + i) = nBackColor;
@@ -1309,7 +1770,7 @@ void* RotateHQ_Core(CPoint targetOffset, CSize targetSize, double dRotation, CSi
 	return pTargetPixels;
 }
 
-void* CBasicProcessing::RotateHQ(CPoint targetOffset, CSize targetSize, double dRotation, CSize sourceSize, const void* pSourcePixels, int nChannels, COLORREF backColor) {
+void* CBasicProcessing::RotateHQ(CPoint targetOffset, CSize targetSize, double dRotation, CSize sourceSize, const void* pSourcePixels, int nSourceStride, int nChannels, COLORREF backColor, bool bUseSSE) {
 	 if (pSourcePixels == NULL || (nChannels != 3 && nChannels != 4)) {
 		return NULL;
 	}
@@ -1318,7 +1779,7 @@ void* CBasicProcessing::RotateHQ(CPoint targetOffset, CSize targetSize, double d
 	if (pTargetPixels == NULL) return NULL;
 
 	CProcessingThreadPool& threadPool = CProcessingThreadPool::This();
-	CRequestRotate request(pSourcePixels, targetOffset, targetSize, dRotation, sourceSize, pTargetPixels, nChannels, backColor);
+	CRequestRotate request(pSourcePixels, nSourceStride, targetOffset, targetSize, dRotation, sourceSize, pTargetPixels, nChannels, backColor, bUseSSE);
 	bool bSuccess = threadPool.Process(&request);
 
 	return bSuccess ? pTargetPixels : NULL;
@@ -1372,17 +1833,97 @@ static void InterpolateBicubicBorderX(const uint16* pSource, uint8* pDest, int16
 	*pDest = 0xFF;
 }
 
-// Bicubic interpolation in y of one line in the image
-static void InterpolateBicubicY(const uint8* pSourcePixels, int nChannelsSource, int nPaddedSourceWidth, uint16* pTarget, int nPixelsPerLine, 
+// Same as InterpolateBicubicX(), computing the three channels at once with SSE2. Gives identical results.
+// Reads one 16 bit element after the last source pixel, the fourth channel of the returned pixel is garbage.
+static uint32 InterpolateBicubicX_SSE(const uint16* pSource, const int16* pKernels, int32 nFracX) {
+	const int16* pKernelX = &(pKernels[4*(nFracX >> (16 - NUM_KERNELS_LOG2))]);
+	__m128i kernel01 = KernelPair(pKernelX[0], pKernelX[1]);
+	__m128i kernel23 = KernelPair(pKernelX[2], pKernelX[3]);
+	// interleave the pixels p0, p1 and p2, p3: c0 of p0, c0 of p1, c1 of p0, c1 of p1, ...
+	__m128i pixels01 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(pSource - 3)), _mm_loadl_epi64((const __m128i*)pSource));
+	__m128i pixels23 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(pSource + 3)), _mm_loadl_epi64((const __m128i*)(pSource + 6)));
+	__m128i sum = _mm_add_epi32(_mm_madd_epi16(pixels01, kernel01), _mm_madd_epi16(pixels23, kernel23));
+	// _mm_madd_epi16() multiplies signed values, the pixels are unsigned: add kernel*65536 for the pixels >= 32768
+	__m128i correction = _mm_add_epi32(
+		_mm_madd_epi16(_mm_and_si128(_mm_srai_epi16(pixels01, 15), kernel01), _mm_set1_epi16(1)),
+		_mm_madd_epi16(_mm_and_si128(_mm_srai_epi16(pixels23, 15), kernel23), _mm_set1_epi16(1)));
+	sum = _mm_add_epi32(sum, _mm_slli_epi32(correction, 16));
+	sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(FP_HALF)), 22);
+	sum = _mm_packs_epi32(sum, sum);
+	return (uint32)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+}
+
+// Same as the inner part of InterpolateBicubicY() for 16 bytes of the four source rows, giving 16 unsigned 16 bit values
+static inline void InterpolateBicubic16BytesY_SSE(const uint8* pSource, int nSourceStride, __m128i kernel01, __m128i kernel23,
+												  __m128i& valuesLow, __m128i& valuesHigh) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i row0 = _mm_loadu_si128((const __m128i*)(pSource - nSourceStride));
+	__m128i row1 = _mm_loadu_si128((const __m128i*)pSource);
+	__m128i row2 = _mm_loadu_si128((const __m128i*)(pSource + nSourceStride));
+	__m128i row3 = _mm_loadu_si128((const __m128i*)(pSource + nSourceStride * 2));
+	// zero extension to 16 bit, then interleaving two rows: byte 0 of row0, byte 0 of row1, byte 1 of row0, ...
+	__m128i row0Low = _mm_unpacklo_epi8(row0, zero), row0High = _mm_unpackhi_epi8(row0, zero);
+	__m128i row1Low = _mm_unpacklo_epi8(row1, zero), row1High = _mm_unpackhi_epi8(row1, zero);
+	__m128i row2Low = _mm_unpacklo_epi8(row2, zero), row2High = _mm_unpackhi_epi8(row2, zero);
+	__m128i row3Low = _mm_unpacklo_epi8(row3, zero), row3High = _mm_unpackhi_epi8(row3, zero);
+	__m128i sources01[4] = { _mm_unpacklo_epi16(row0Low, row1Low), _mm_unpackhi_epi16(row0Low, row1Low),
+		_mm_unpacklo_epi16(row0High, row1High), _mm_unpackhi_epi16(row0High, row1High) };
+	__m128i sources23[4] = { _mm_unpacklo_epi16(row2Low, row3Low), _mm_unpackhi_epi16(row2Low, row3Low),
+		_mm_unpacklo_epi16(row2High, row3High), _mm_unpackhi_epi16(row2High, row3High) };
+	__m128i offset = _mm_set1_epi32(32768);
+	__m128i half = _mm_set1_epi32(FP_HALF);
+	__m128i results[4];
+	for (int n = 0; n < 4; n++) {
+		__m128i sum = _mm_add_epi32(_mm_madd_epi16(sources01[n], kernel01), _mm_madd_epi16(sources23[n], kernel23));
+		// shifting by 32768 allows saturating to [0, 65535] with the signed pack instruction
+		results[n] = _mm_sub_epi32(_mm_srai_epi32(_mm_add_epi32(sum, half), 6), offset);
+	}
+	__m128i offset16 = _mm_set1_epi16((short)0x8000);
+	valuesLow = _mm_xor_si128(_mm_packs_epi32(results[0], results[1]), offset16);
+	valuesHigh = _mm_xor_si128(_mm_packs_epi32(results[2], results[3]), offset16);
+}
+
+// Bicubic interpolation in y of one line in the image.
+// With SSE, the target line must have space for one additional 16 bit element.
+static void InterpolateBicubicY(const uint8* pSourcePixels, int nChannelsSource, int nSourceStride, uint16* pTarget, int nPixelsPerLine, 
 								const int16* pKernels, 
-								int nCurY, int nCurYFrac, int nSizeY) {
+								int nCurY, int nCurYFrac, int nSizeY, bool bUseSSE) {
 	if (nCurY > 0 && nCurY < nSizeY - 2) {
 		const int16* pKernelY = &(pKernels[4*(nCurYFrac >> (16 - NUM_KERNELS_LOG2))]);
-		int nPaddedSourceWidth2 = nPaddedSourceWidth * 2;
-		for (int i = 0; i < nPixelsPerLine; i++) {
+		int nSourceStride2 = nSourceStride * 2;
+		int i = 0;
+		if (bUseSSE) {
+			__m128i kernel01 = KernelPair(pKernelY[0], pKernelY[1]);
+			__m128i kernel23 = KernelPair(pKernelY[2], pKernelY[3]);
+			__m128i valuesLow, valuesHigh;
+			if (nChannelsSource == 3) {
+				// the channels of the source and target line correspond one to one
+				for (; i + 16 <= nPixelsPerLine; i += 16) {
+					for (int n = 0; n < 3; n++) {
+						InterpolateBicubic16BytesY_SSE(pSourcePixels + n * 16, nSourceStride, kernel01, kernel23, valuesLow, valuesHigh);
+						_mm_storeu_si128((__m128i*)(pTarget + n * 16), valuesLow);
+						_mm_storeu_si128((__m128i*)(pTarget + n * 16 + 8), valuesHigh);
+					}
+					pSourcePixels += 48;
+					pTarget += 48;
+				}
+			} else {
+				// four pixels at once, each storing four channels, the fourth is overwritten by the next pixel
+				for (; i + 4 <= nPixelsPerLine; i += 4) {
+					InterpolateBicubic16BytesY_SSE(pSourcePixels, nSourceStride, kernel01, kernel23, valuesLow, valuesHigh);
+					_mm_storel_epi64((__m128i*)pTarget, valuesLow);
+					_mm_storel_epi64((__m128i*)(pTarget + 3), _mm_srli_si128(valuesLow, 8));
+					_mm_storel_epi64((__m128i*)(pTarget + 6), valuesHigh);
+					_mm_storel_epi64((__m128i*)(pTarget + 9), _mm_srli_si128(valuesHigh, 8));
+					pSourcePixels += 16;
+					pTarget += 12;
+				}
+			}
+		}
+		for (; i < nPixelsPerLine; i++) {
 			for (int c = 0; c < 3; c++) {
-				int32 nSum = pSourcePixels[-nPaddedSourceWidth + c] * pKernelY[0] + pSourcePixels[c] * pKernelY[1] + 
-					pSourcePixels[nPaddedSourceWidth + c] * pKernelY[2] + pSourcePixels[nPaddedSourceWidth2 + c] * pKernelY[3] + FP_HALF;
+				int32 nSum = pSourcePixels[-nSourceStride + c] * pKernelY[0] + pSourcePixels[c] * pKernelY[1] + 
+					pSourcePixels[nSourceStride + c] * pKernelY[2] + pSourcePixels[nSourceStride2 + c] * pKernelY[3] + FP_HALF;
 				nSum = nSum >> 6;
 				*pTarget++ = min(65535, max(0, nSum));
 			}
@@ -1400,7 +1941,7 @@ static void InterpolateBicubicY(const uint8* pSourcePixels, int nChannelsSource,
 }
 
 void* TrapezoidHQ_Core(CPoint targetOffset, CSize targetSize, const CTrapezoid& trapezoid, CSize sourceSize, 
-										 const void* pSourcePixels, void* pTargetPixels, int nChannels, COLORREF backColor) {
+										 const void* pSourcePixels, int nSourceStride, void* pTargetPixels, int nChannels, COLORREF backColor, bool bUseSSE) {
 
 	float fTx1 = (float)trapezoid.x1s;
 	float fTx2 = (float)trapezoid.x1e;
@@ -1408,14 +1949,13 @@ void* TrapezoidHQ_Core(CPoint targetOffset, CSize targetSize, const CTrapezoid&
 	float fIncrementTx2 = ((float)(trapezoid.x2e - trapezoid.x1e))/trapezoid.Height();
 
 	uint32 nBackColor = (GetRValue(backColor) << 16) + (GetGValue(backColor) << 8) + GetBValue(backColor) + ALPHA_OPAQUE;
-	int nPaddedSourceWidth = Helpers::DoPadding(sourceSize.cx * nChannels, 4);
 	uint8* pDst = (uint8*)pTargetPixels;
 	fTx1 = fTx1 + targetOffset.y*fIncrementTx1;
 	fTx2 = fTx2 + targetOffset.y*fIncrementTx2;
 	int nSourceSizeXFP16 = (sourceSize.cx - 1) << 16;
 
 	int* pTableY = CalculateTrapezoidYIntersectionTable(trapezoid, targetSize.cy, sourceSize.cy, trapezoid.Height() + 1, targetOffset.y);
-	uint16* pLine = new uint16[sourceSize.cx * 3];
+	uint16* pLine = new uint16[sourceSize.cx * 3 + 1]; // one additional element for the SSE code
 	
 	int16* pKernels = new int16[NUM_KERNELS_BICUBIC * 4];
 	CResizeFilter::GetBicubicFilterKernels(NUM_KERNELS_BICUBIC, pKernels);
@@ -1427,15 +1967,19 @@ void* TrapezoidHQ_Core(CPoint targetOffset, CSize targetSize, const CTrapezoid&
 		int nCurX = nStartX;
 		int nCurY = pTableY[j] >> 16;
 		int nCurYFrac = pTableY[j] & 0xFFFF;
-		InterpolateBicubicY((uint8*)pSourcePixels + nPaddedSourceWidth * nCurY, nChannels, nPaddedSourceWidth, pLine, sourceSize.cx,
-			pKernels, nCurY, nCurYFrac, trapezoid.Height() + 1);
+		InterpolateBicubicY((uint8*)pSourcePixels + (ptrdiff_t)nSourceStride * nCurY, nChannels, nSourceStride, pLine, sourceSize.cx,
+			pKernels, nCurY, nCurYFrac, trapezoid.Height() + 1, bUseSSE);
 		for (int i = 0; i < targetSize.cx; i++) {
 			int nCurXInt = nCurX >> 16;
 			int nCurXFrac = nCurX & 0xFFFF;
 			if (nCurXInt >= -1 && nCurXInt <= sourceSize.cx) {
 				const uint16* pSourceLineStart = pLine + nCurXInt*3;
 				if (nCurXInt > 0 && nCurXInt < sourceSize.cx - 2) {
-					InterpolateBicubicX(pSourceLineStart, pDst + i*4, pKernels, nCurXFrac);
+					if (bUseSSE) {
+						*((uint32*)pDst + i) = InterpolateBicubicX_SSE(pSourceLineStart, pKernels, nCurXFrac) | ALPHA_OPAQUE;
+					} else {
+						InterpolateBicubicX(pSourceLineStart, pDst + i*4, pKernels, nCurXFrac);
+					}
 				} else {
 					int nXFrom = (nCurXInt > 0) ? -1 : -nCurXInt;
 					int nXTo = (nCurXInt < sourceSize.cx - 2) ? 2 : sourceSize.cx - nCurXInt - 1;
@@ -1460,7 +2004,7 @@ void* TrapezoidHQ_Core(CPoint targetOffset, CSize targetSize, const CTrapezoid&
 }
 
 void* CBasicProcessing::TrapezoidHQ(CPoint targetOffset, CSize targetSize, const CTrapezoid& trapezoid, CSize sourceSize, 
-									const void* pSourcePixels, int nChannels, COLORREF backColor) {
+									const void* pSourcePixels, int nSourceStride, int nChannels, COLORREF backColor, bool bUseSSE) {
 	 if (pSourcePixels == NULL || (nChannels != 3 && nChannels != 4)) {
 		return NULL;
 	}
@@ -1469,7 +2013,7 @@ void* CBasicProcessing::TrapezoidHQ(CPoint targetOffset, CSize targetSize, const
 	if (pTargetPixels == NULL) return NULL;
 
 	CProcessingThreadPool& threadPool = CProcessingThreadPool::This();
-	CRequestTrapezoid request(pSourcePixels, targetOffset, targetSize, trapezoid, sourceSize, pTargetPixels, nChannels, backColor);
+	CRequestTrapezoid request(pSourcePixels, nSourceStride, targetOffset, targetSize, trapezoid, sourceSize, pTargetPixels, nChannels, backColor, bUseSSE);
 	bool bSuccess = threadPool.Process(&request);
 
 	return bSuccess ? pTargetPixels : NULL;
@@ -1481,6 +2025,7 @@ void* CBasicProcessing::TrapezoidHQ(CPoint targetOffset, CSize targetSize, const
 
 // Apply filtering in x-direction and rotate
 // nSourceWidth: Width of the image in pSource in pixels
+// nSourceStride: Distance of the rows of the image in pSource in bytes
 // nTargetWidth: Target width of the image after filtering.
 // nHeight: Height of the target image in pixels
 // nSourceBytesPerPixel: 3 or 4, the target will always have 4 bytes per pixel
@@ -1490,26 +2035,28 @@ void* CBasicProcessing::TrapezoidHQ(CPoint targetOffset, CSize targetSize, const
 // filter: Filter to apply (in x direction)
 // nFilterOffset: Offset into filter (to filter.Indices array)
 // pSource: Source image
+// pTarget: Target image of size(nHeight, nTargetWidth), if NULL a new image is allocated
 // Returns the filtered image of size(nHeight, nTargetWidth)
-static uint8* ApplyFilter(int nSourceWidth, int nTargetWidth, int nHeight,
+static uint8* ApplyFilter(int nSourceWidth, int nSourceStride, int nTargetWidth, int nHeight,
 						  int nSourceBytesPerPixel,
 						  int nStartX_FP, int nStartY, int nIncrementX_FP,
 						  const FilterKernelBlock& filter,
 						  int nFilterOffset,
-						  const uint8* pSource) {
+						  const uint8* pSource, uint8* pTarget) {
 
-	uint8* pTarget = new(std::nothrow) uint8[nTargetWidth*4*nHeight];
-	if (pTarget == NULL) return NULL;
+	if (pTarget == NULL) {
+		pTarget = new(std::nothrow) uint8[nTargetWidth*4*nHeight];
+		if (pTarget == NULL) return NULL;
+	}
 
 	// width of new image is (after rotation) : nHeight
 	// height of new image is (after rotation) : nTargetWidth
 	
-	int nPaddedSourceWidth = Helpers::DoPadding(nSourceWidth * nSourceBytesPerPixel, 4);
 	const uint8* pSourcePixelLine = NULL;
 	uint8* pTargetPixelLine = NULL;
 	const int FP_05 = 255; // rounding correction because in filter 1.0 is 16383 but we shift by 14 what is a division by 16384
 	for (int j = 0; j < nHeight; j++) {
-		pSourcePixelLine = ((uint8*) pSource) + nPaddedSourceWidth * (j + nStartY);
+		pSourcePixelLine = ((uint8*) pSource) + (ptrdiff_t)nSourceStride * (j + nStartY);
 		pTargetPixelLine = pTarget + 4*j;
 		uint8* pTargetPixel = pTargetPixelLine;
 		uint32 nX = nStartX_FP;
@@ -1560,7 +2107,7 @@ static void ApplyFilter1C16bpp(int nSourceWidth, int nTargetWidth,
 							   const int16* pSource, int16* pTarget) {
 
 	for (int j = 0; j < nRunY; j++) {
-		const int16* pSourcePixelLine = pSource + nStartX + nSourceWidth * (j + nStartY);
+		const int16* pSourcePixelLine = pSource + nStartX + (size_t)nSourceWidth * (j + nStartY);
 		int16* pTargetPixelLine = pTarget + j;
 		int16* pTargetPixel = pTargetPixelLine;
 		for (int i = 0; i < nRunX; i++) {
@@ -1583,8 +2130,118 @@ static void ApplyFilter1C16bpp(int nSourceWidth, int nTargetWidth,
 // Gauss filter (C++ implementation)
 /////////////////////////////////////////////////////////////////////////////////////////////
 
+// Above this radius the Gauss kernel does not fit into MAX_FILTER_LEN elements anymore and the recursive filter is used,
+// its cost does not depend on the radius.
+static const double GAUSS_RECURSIVE_MIN_RADIUS = 2.75;
+
+// Coefficients of the recursive Gauss filter of Young and van Vliet. The third order filter is applied forward and
+// then backward over each row, giving a symmetric approximation of the Gauss kernel.
+struct RecursiveGaussCoeffs {
+	float B; // gain of the input
+	float b1, b2, b3; // feedback coefficients, normalized by b0
+};
+
+static RecursiveGaussCoeffs CalculateRecursiveGaussCoeffs(double dRadius) {
+	double q = (dRadius >= 2.5) ? 0.98711*dRadius - 0.96330 : 3.97156 - 4.14554*sqrt(1.0 - 0.26891*dRadius);
+	double q2 = q*q, q3 = q2*q;
+	double b0 = 1.57825 + 2.44413*q + 1.4281*q2 + 0.422205*q3;
+	double b1 = 2.44413*q + 2.85619*q2 + 1.26661*q3;
+	double b2 = -(1.4281*q2 + 1.26661*q3);
+	double b3 = 0.422205*q3;
+	RecursiveGaussCoeffs coeffs;
+	coeffs.b1 = (float)(b1/b0);
+	coeffs.b2 = (float)(b2/b0);
+	coeffs.b3 = (float)(b3/b0);
+	coeffs.B = 1.0f - (coeffs.b1 + coeffs.b2 + coeffs.b3); // unity gain
+	return coeffs;
+}
+
+// Recursive Gauss filter of one row of nWidth pixels into pBuffer. At the borders the first and last pixels are continued.
+// The terms are summed in the same order as in RecursiveGauss4Rows_SSE() so that both give the same result.
+static void RecursiveGaussRow(const int16* pSource, int nWidth, const RecursiveGaussCoeffs& c, float* pBuffer) {
+	float w1 = pSource[0], w2 = w1, w3 = w1;
+	for (int i = 0; i < nWidth; i++) {
+		float w = (c.B*pSource[i] + c.b1*w1) + (c.b2*w2 + c.b3*w3);
+		pBuffer[i] = w;
+		w3 = w2; w2 = w1; w1 = w;
+	}
+	float y1 = pBuffer[nWidth - 1], y2 = y1, y3 = y1;
+	for (int i = nWidth - 1; i >= 0; i--) {
+		float y = (c.B*pBuffer[i] + c.b1*y1) + (c.b2*y2 + c.b3*y3);
+		pBuffer[i] = y;
+		y3 = y2; y2 = y1; y1 = y;
+	}
+}
+
+// Same as RecursiveGaussRow() for four rows at once, pBuffer gets the four results of each pixel interleaved
+static void RecursiveGauss4Rows_SSE(const int16* pSource[4], int nWidth, const RecursiveGaussCoeffs& c, float* pBuffer) {
+	__m128 B = _mm_set1_ps(c.B);
+	__m128 b1 = _mm_set1_ps(c.b1);
+	__m128 b2 = _mm_set1_ps(c.b2);
+	__m128 b3 = _mm_set1_ps(c.b3);
+	__m128 w1 = _mm_set_ps(pSource[3][0], pSource[2][0], pSource[1][0], pSource[0][0]);
+	__m128 w2 = w1, w3 = w1;
+	for (int i = 0; i < nWidth; i++) {
+		__m128 x = _mm_set_ps(pSource[3][i], pSource[2][i], pSource[1][i], pSource[0][i]);
+		__m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(B, x), _mm_mul_ps(b1, w1)), _mm_add_ps(_mm_mul_ps(b2, w2), _mm_mul_ps(b3, w3)));
+		_mm_storeu_ps(pBuffer + i*4, w);
+		w3 = w2; w2 = w1; w1 = w;
+	}
+	__m128 y1 = _mm_loadu_ps(pBuffer + (nWidth - 1)*4);
+	__m128 y2 = y1, y3 = y1;
+	for (int i = nWidth - 1; i >= 0; i--) {
+		__m128 x = _mm_loadu_ps(pBuffer + i*4);
+		__m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(B, x), _mm_mul_ps(b1, y1)), _mm_add_ps(_mm_mul_ps(b2, y2), _mm_mul_ps(b3, y3)));
+		_mm_storeu_ps(pBuffer + i*4, y);
+		y3 = y2; y2 = y1; y1 = y;
+	}
+}
+
+// Recursive Gauss filter in x direction, the target image is rotated as in ApplyFilter1C16bpp().
+// With SSE, four rows are filtered at once and give four adjacent pixels in the rotated target image.
+static int16* GaussFilterRecursive16bpp1Channel_Core(CSize fullSize, CPoint offset, CSize rect, int nTargetWidth, double dRadius,
+	bool bUseSSE, const int16* pSourcePixels, int16* pTargetPixels) {
+	RecursiveGaussCoeffs coeffs = CalculateRecursiveGaussCoeffs(dRadius);
+	int nWidth = fullSize.cx;
+	float* pBuffer = new(std::nothrow) float[nWidth * 4];
+	if (pBuffer == NULL) return NULL;
+
+	int j = 0;
+	if (bUseSSE) {
+		for (; j + 4 <= rect.cy; j += 4) {
+			const int16* pRows[4];
+			for (int k = 0; k < 4; k++) {
+				pRows[k] = pSourcePixels + (size_t)nWidth * (offset.y + j + k);
+			}
+			RecursiveGauss4Rows_SSE(pRows, nWidth, coeffs, pBuffer);
+			int16* pTargetPixel = pTargetPixels + j;
+			for (int i = 0; i < rect.cx; i++) {
+				__m128i values = _mm_cvtps_epi32(_mm_loadu_ps(pBuffer + (i + offset.x)*4));
+				_mm_storel_epi64((__m128i*)pTargetPixel, _mm_packs_epi32(values, values));
+				pTargetPixel += nTargetWidth;
+			}
+		}
+	}
+	for (; j < rect.cy; j++) {
+		RecursiveGaussRow(pSourcePixels + (size_t)nWidth * (offset.y + j), nWidth, coeffs, pBuffer);
+		int16* pTargetPixel = pTargetPixels + j;
+		for (int i = 0; i < rect.cx; i++) {
+			// round to nearest even and saturate as _mm_cvtps_epi32() and _mm_packs_epi32() do
+			int nValue = _mm_cvtss_si32(_mm_set_ss(pBuffer[i + offset.x]));
+			*pTargetPixel = (int16)max(-32768, min(32767, nValue));
+			pTargetPixel += nTargetWidth;
+		}
+	}
+
+	delete[] pBuffer;
+	return pTargetPixels;
+}
+
 int16* GaussFilter16bpp1Channel_Core(CSize fullSize, CPoint offset, CSize rect, int nTargetWidth, double dRadius, 
-													  const int16* pSourcePixels, int16* pTargetPixels) {
+													  bool bUseSSE, const int16* pSourcePixels, int16* pTargetPixels) {
+	if (dRadius >= GAUSS_RECURSIVE_MIN_RADIUS) {
+		return GaussFilterRecursive16bpp1Channel_Core(fullSize, offset, rect, nTargetWidth, dRadius, bUseSSE, pSourcePixels, pTargetPixels);
+	}
 	CGaussFilter filterX(fullSize.cx, dRadius);
 	ApplyFilter1C16bpp(fullSize.cx, nTargetWidth, offset.x, offset.y, rect.cx, rect.cy, filterX.GetFilterKernels(), pSourcePixels, pTargetPixels);
 	return pTargetPixels;
@@ -1597,9 +2254,10 @@ int16* CBasicProcessing::GaussFilter16bpp1Channel(CSize fullSize, CPoint offset,
 
 	// Gauss filter x-direction
 	CProcessingThreadPool& threadPool = CProcessingThreadPool::This();
+	bool bUseSSE = CSettingsProvider::This().AlgorithmImplementation() >= Helpers::CPU_SSE;
 	int16* pIntermediate = new(std::nothrow) int16[rect.cx * rect.cy];
 	if (pIntermediate == NULL) return NULL;
-	CRequestGauss requestX(pPixels, fullSize, offset, rect, dRadius, pIntermediate);
+	CRequestGauss requestX(pPixels, fullSize, offset, rect, dRadius, bUseSSE, pIntermediate);
 	if (!threadPool.Process(&requestX)) {
 		delete[] pIntermediate;
 		return NULL;
@@ -1611,7 +2269,7 @@ int16* CBasicProcessing::GaussFilter16bpp1Channel(CSize fullSize, CPoint offset,
 		delete[] pIntermediate;
 		return NULL;
 	}
-	CRequestGauss requestY(pIntermediate, CSize(rect.cy, rect.cx), CPoint(0, 0), CSize(rect.cy, rect.cx), dRadius, pTargetPixels);
+	CRequestGauss requestY(pIntermediate, CSize(rect.cy, rect.cx), CPoint(0, 0), CSize(rect.cy, rect.cx), dRadius, bUseSSE, pTargetPixels);
 	bool bSuccess = threadPool.Process(&requestY);
 	delete[] pIntermediate;
 
@@ -1622,17 +2280,14 @@ int16* CBasicProcessing::GaussFilter16bpp1Channel(CSize fullSize, CPoint offset,
 // Bicubic resize (C++ implementation)
 /////////////////////////////////////////////////////////////////////////////////////////////
 
-void* CBasicProcessing::SampleUp_HQ(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-	CSize sourceSize, const void* pPixels, int nChannels) {
+static void* SampleUp_HQ_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, uint8* pTarget) {
 
 	// Resizing consists of resize in x direction followed by resize in y direction.
 	// To simplify implementation, the method performs a 90 degree rotation/flip while resizing,
 	// thus enabling to use the same loop on the rows for both resize directions.
 	// The image is correctly orientated again after two rotation/flip operations!
 
-	if (pPixels == NULL || fullTargetSize.cx < 2 || fullTargetSize.cy < 2 || clippedTargetSize.cx <= 0 || clippedTargetSize.cy <= 0) {
-		return NULL;
-	}
 	int nTargetWidth = clippedTargetSize.cx;
 	int nTargetHeight = clippedTargetSize.cy;
 	int nSourceWidth = sourceSize.cx;
@@ -1651,45 +2306,59 @@ void* CBasicProcessing::SampleUp_HQ(CSize fullTargetSize, CPoint fullTargetOffse
 	int nStartX = nIncrementX*fullTargetOffset.x;
 	int nStartY = nIncrementY*fullTargetOffset.y - 65536*nFirstY;
 
-	CResizeFilter filterX(nSourceWidth, fullTargetSize.cx, 0.0, Filter_Upsampling_Bicubic, FilterSIMDType_None);
-	const FilterKernelBlock& kernelsX = filterX.GetFilterKernels();
+	CAutoFilter filterX(nSourceWidth, fullTargetSize.cx, 0.0, Filter_Upsampling_Bicubic);
+	const FilterKernelBlock& kernelsX = filterX.Kernels();
 
-	uint8* pTemp = ApplyFilter(nSourceWidth, nTempTargetHeight, nTempTargetWidth,
+	uint8* pTemp = ApplyFilter(nSourceWidth, nSourceStride, nTempTargetHeight, nTempTargetWidth,
 		nChannels, nStartX, nFirstY, nIncrementX,
-		kernelsX, nFilterOffsetX, (const uint8*)pPixels);
+		kernelsX, nFilterOffsetX, (const uint8*)pPixels, NULL);
 	if (pTemp == NULL) return NULL;
 
-	CResizeFilter filterY(nSourceHeight, fullTargetSize.cy, 0.0, Filter_Upsampling_Bicubic, FilterSIMDType_None);
-	const FilterKernelBlock& kernelsY = filterY.GetFilterKernels();
+	CAutoFilter filterY(nSourceHeight, fullTargetSize.cy, 0.0, Filter_Upsampling_Bicubic);
+	const FilterKernelBlock& kernelsY = filterY.Kernels();
 
-	uint8* pDIB = ApplyFilter(nTempTargetWidth, nTargetHeight, nTargetWidth,
+	uint8* pDIB = ApplyFilter(nTempTargetWidth, nTempTargetWidth * 4, nTargetHeight, nTargetWidth,
 			4, nStartY, 0, nIncrementY,
-			kernelsY, nFilterOffsetY, pTemp);
+			kernelsY, nFilterOffsetY, pTemp, pTarget);
 
 	delete[] pTemp;
 
 	return pDIB;
 }
 
+void* CBasicProcessing::SampleUp_HQ(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels) {
+	if (pPixels == NULL || fullTargetSize.cx < 2 || fullTargetSize.cy < 2 || clippedTargetSize.cx <= 0 || clippedTargetSize.cy <= 0) {
+		return NULL;
+	}
+	uint8* pTarget = new(std::nothrow) uint8[clippedTargetSize.cx * 4 * Helpers::DoPadding(clippedTargetSize.cy, 8)];
+	if (pTarget == NULL) return NULL;
+	CProcessingThreadPool& threadPool = CProcessingThreadPool::This();
+	CRequestUpDownSampling request(pPixels, sourceSize, nSourceStride,
+		pTarget, fullTargetSize, fullTargetOffset, clippedTargetSize,
+		nChannels, 0.0, Filter_Upsampling_Bicubic, NoSIMD);
+	bool bSuccess = threadPool.Process(&request);
+
+	return bSuccess ? pTarget : NULL;
+}
+
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // High quality downsampling (C++ implementation)
 /////////////////////////////////////////////////////////////////////////////////////////////
 
-void* CBasicProcessing::SampleDown_HQ(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-	CSize sourceSize, const void* pPixels, int nChannels, double dSharpen, EFilterType eFilter) {
+static void* SampleDown_HQ_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, double dSharpen, EFilterType eFilter,
+	uint8* pTarget) {
 	// Resizing consists of resize in x direction followed by resize in y direction.
 	// To simplify implementation, the method performs a 90 degree rotation/flip while resizing,
 	// thus enabling to use the same loop on the rows for both resize directions.
 	// The image is correctly orientated again after two rotation/flip operations!
 
-	if (pPixels == NULL || clippedTargetSize.cx <= 0 || clippedTargetSize.cy <= 0) {
-		return NULL;
-	}
-	CResizeFilter filterX(sourceSize.cx, fullTargetSize.cx, dSharpen, eFilter, FilterSIMDType_None);
-	const FilterKernelBlock& kernelsX = filterX.GetFilterKernels();
-	CResizeFilter filterY(sourceSize.cy, fullTargetSize.cy, dSharpen, eFilter, FilterSIMDType_None);
-	const FilterKernelBlock& kernelsY = filterY.GetFilterKernels();
+	CAutoFilter filterX(sourceSize.cx, fullTargetSize.cx, dSharpen, eFilter);
+	const FilterKernelBlock& kernelsX = filterX.Kernels();
+	CAutoFilter filterY(sourceSize.cy, fullTargetSize.cy, dSharpen, eFilter);
+	const FilterKernelBlock& kernelsY = filterY.Kernels();
 
 	uint32 nIncrementX = (uint32)(sourceSize.cx << 16)/fullTargetSize.cx + 1;
 	uint32 nIncrementY = (uint32)(sourceSize.cy << 16)/fullTargetSize.cy + 1;
@@ -1708,20 +2377,36 @@ void* CBasicProcessing::SampleDown_HQ(CSize fullTargetSize, CPoint fullTargetOff
 	int nStartX = nIncOffsetX + nIncrementX*fullTargetOffset.x;
 	int nStartY = nIncOffsetY + nIncrementY*fullTargetOffset.y - 65536*nFirstY;
 
-	uint8* pTemp = ApplyFilter(sourceSize.cx, nTempTargetHeight, nTempTargetWidth,
+	uint8* pTemp = ApplyFilter(sourceSize.cx, nSourceStride, nTempTargetHeight, nTempTargetWidth,
 		nChannels, nStartX, nFirstY, nIncrementX,
-		kernelsX, nFilterOffsetX, (const uint8*)pPixels);
+		kernelsX, nFilterOffsetX, (const uint8*)pPixels, NULL);
 	if (pTemp == NULL) return NULL;
 
-	uint8* pDIB = ApplyFilter(nTempTargetWidth, clippedTargetSize.cy, clippedTargetSize.cx,
+	uint8* pDIB = ApplyFilter(nTempTargetWidth, nTempTargetWidth * 4, clippedTargetSize.cy, clippedTargetSize.cx,
 			4, nStartY, 0, nIncrementY,
-			kernelsY, nFilterOffsetY, pTemp);
+			kernelsY, nFilterOffsetY, pTemp, pTarget);
 
 	delete[] pTemp;
 
 	return pDIB;
 }
 
+void* CBasicProcessing::SampleDown_HQ(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, double dSharpen, EFilterType eFilter) {
+	if (pPixels == NULL || clippedTargetSize.cx <= 0 || clippedTargetSize.cy <= 0) {
+		return NULL;
+	}
+	uint8* pTarget = new(std::nothrow) uint8[clippedTargetSize.cx * 4 * Helpers::DoPadding(clippedTargetSize.cy, 8)];
+	if (pTarget == NULL) return NULL;
+	CProcessingThreadPool& threadPool = CProcessingThreadPool::This();
+	CRequestUpDownSampling request(pPixels, sourceSize, nSourceStride,
+		pTarget, fullTargetSize, fullTargetOffset, clippedTargetSize,
+		nChannels, dSharpen, eFilter, NoSIMD);
+	bool bSuccess = threadPool.Process(&request);
+
+	return bSuccess ? pTarget : NULL;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////
 // High quality downsampling (Helpers for SSE and MMX implementation)
 /////////////////////////////////////////////////////////////////////////////////////////////
@@ -2329,7 +3014,7 @@ FilterKernelLoop:
 /////////////////////////////////////////////////////////////////////////////////////////////
 
 void* SampleDown_HQ_MMX_SSE_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-	CSize sourceSize, const void* pPixels, int nChannels, double dSharpen,
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, double dSharpen,
 	EFilterType eFilter, bool bSSE, uint8* pTarget) {
 
 	CAutoXMMFilter filterY(sourceSize.cy, fullTargetSize.cy, dSharpen, eFilter);
@@ -2359,7 +3044,7 @@ void* SampleDown_HQ_MMX_SSE_Core(CSize fullTargetSize, CPoint fullTargetOffset,
 
 	// Resize Y
 	double t1 = Helpers::GetExactTickCount();
-	CXMMImage* pImage1 = new CXMMImage(sourceSize.cx, sourceSize.cy, nFirstX, nLastX, nFirstY, nLastY, pPixels, nChannels, 8);
+	CXMMImage* pImage1 = new CXMMImage(sourceSize.cx, sourceSize.cy, nFirstX, nLastX, nFirstY, nLastY, pPixels, nSourceStride, nChannels, 8);
 	if (pImage1->AlignedPtr() == NULL) {
 		delete pImage1;
 		return NULL;
@@ -2393,7 +3078,7 @@ void* SampleDown_HQ_MMX_SSE_Core(CSize fullTargetSize, CPoint fullTargetOffset,
 }
 
 void* SampleDown_HQ_AVX_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-	CSize sourceSize, const void* pPixels, int nChannels, double dSharpen,
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, double dSharpen,
 	EFilterType eFilter, uint8* pTarget) {
 
 	CAutoAVXFilter filterY(sourceSize.cy, fullTargetSize.cy, dSharpen, eFilter);
@@ -2423,7 +3108,7 @@ void* SampleDown_HQ_AVX_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSiz
 
 	// Resize Y
 	double t1 = Helpers::GetExactTickCount();
-	CXMMImage* pImage1 = new CXMMImage(sourceSize.cx, sourceSize.cy, nFirstX, nLastX, nFirstY, nLastY, pPixels, nChannels, 16);
+	CXMMImage* pImage1 = new CXMMImage(sourceSize.cx, sourceSize.cy, nFirstX, nLastX, nFirstY, nLastY, pPixels, nSourceStride, nChannels, 16);
 	if (pImage1->AlignedPtr() == NULL) {
 		delete pImage1;
 		return NULL;
@@ -2455,7 +3140,7 @@ void* SampleDown_HQ_AVX_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSiz
 }
 
 void* SampleUp_HQ_MMX_SSE_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-	CSize sourceSize, const void* pPixels, int nChannels, bool bSSE, uint8* pTarget) {
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, bool bSSE, uint8* pTarget) {
 	int nTargetWidth = clippedTargetSize.cx;
 	int nTargetHeight = clippedTargetSize.cy;
 	int nSourceWidth = sourceSize.cx;
@@ -2482,7 +3167,7 @@ void* SampleUp_HQ_MMX_SSE_Core(CSize fullTargetSize, CPoint fullTargetOffset, CS
 	const XMMFilterKernelBlock& kernelsX = filterX.Kernels();
 
 	// Resize Y
-	CXMMImage* pImage1 = new CXMMImage(nSourceWidth, nSourceHeight, nFirstX, nLastX, nFirstY, nLastY, pPixels, nChannels, 8);
+	CXMMImage* pImage1 = new CXMMImage(nSourceWidth, nSourceHeight, nFirstX, nLastX, nFirstY, nLastY, pPixels, nSourceStride, nChannels, 8);
 	if (pImage1->AlignedPtr() == NULL) {
 		delete pImage1;
 		return NULL;
@@ -2505,7 +3190,7 @@ void* SampleUp_HQ_MMX_SSE_Core(CSize fullTargetSize, CPoint fullTargetOffset, CS
 }
 
 void* SampleUp_HQ_AVX_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-	CSize sourceSize, const void* pPixels, int nChannels, uint8* pTarget) {
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, uint8* pTarget) {
 
 	int nTargetWidth = clippedTargetSize.cx;
 	int nTargetHeight = clippedTargetSize.cy;
@@ -2533,7 +3218,7 @@ void* SampleUp_HQ_AVX_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize
 	const AVXFilterKernelBlock& kernelsX = filterX.Kernels();
 
 	// Resize Y
-	CXMMImage* pImage1 = new CXMMImage(nSourceWidth, nSourceHeight, nFirstX, nLastX, nFirstY, nLastY, pPixels, nChannels, 16);
+	CXMMImage* pImage1 = new CXMMImage(nSourceWidth, nSourceHeight, nFirstX, nLastX, nFirstY, nLastY, pPixels, nSourceStride, nChannels, 16);
 	if (pImage1->AlignedPtr() == NULL) {
 		delete pImage1;
 		return NULL;
@@ -2554,7 +3239,7 @@ void* SampleUp_HQ_AVX_Core(CSize fullTargetSize, CPoint fullTargetOffset, CSize
 }
 
 void* CBasicProcessing::SampleDown_HQ_SIMD(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-	CSize sourceSize, const void* pPixels, int nChannels, double dSharpen,
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, double dSharpen,
 	EFilterType eFilter, SIMDArchitecture simd) {
 	if (pPixels == NULL || clippedTargetSize.cx <= 0 || clippedTargetSize.cy <= 0) {
 		return NULL;
@@ -2563,7 +3248,7 @@ void* CBasicProcessing::SampleDown_HQ_SIMD(CSize fullTargetSize, CPoint fullTarg
 	uint8* pTarget = new(std::nothrow) uint8[clippedTargetSize.cx * 4 * Helpers::DoPadding(clippedTargetSize.cy, padding)];
 	if (pTarget == NULL) return NULL;
 	CProcessingThreadPool& threadPool = CProcessingThreadPool::This();
-	CRequestUpDownSampling request(pPixels, sourceSize,
+	CRequestUpDownSampling request(pPixels, sourceSize, nSourceStride,
 		pTarget, fullTargetSize, fullTargetOffset, clippedTargetSize,
 		nChannels, dSharpen, eFilter, simd);
 	bool bSuccess = threadPool.Process(&request);
@@ -2572,7 +3257,7 @@ void* CBasicProcessing::SampleDown_HQ_SIMD(CSize fullTargetSize, CPoint fullTarg
 }
 
 void* CBasicProcessing::SampleUp_HQ_SIMD(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-	CSize sourceSize, const void* pPixels, int nChannels, SIMDArchitecture simd) {
+	CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, SIMDArchitecture simd) {
 	if (pPixels == NULL || fullTargetSize.cx < 2 || fullTargetSize.cy < 2 || clippedTargetSize.cx <= 0 || clippedTargetSize.cy <= 0) {
 		return NULL;
 	}
@@ -2580,7 +3265,7 @@ void* CBasicProcessing::SampleUp_HQ_SIMD(CSize fullTargetSize, CPoint fullTarget
 	uint8* pTarget = new(std::nothrow) uint8[clippedTargetSize.cx * 4 * Helpers::DoPadding(clippedTargetSize.cy, padding)];
 	if (pTarget == NULL) return NULL;
 	CProcessingThreadPool& threadPool = CProcessingThreadPool::This();
-	CRequestUpDownSampling request(pPixels, sourceSize,
+	CRequestUpDownSampling request(pPixels, sourceSize, nSourceStride,
 		pTarget, fullTargetSize, fullTargetOffset, clippedTargetSize,
 		nChannels, 0.0, Filter_Upsampling_Bicubic, simd);
 	bool bSuccess = threadPool.Process(&request);
@@ -2632,11 +3317,11 @@ void* UnsharpMask_Core(CSize fullSize, CPoint offset, CSize rect, double dAmount
 	int nAmount = (int)(dAmount * (1 << 12) + 0.5);
 
 	for (int j = 0; j < rect.cy; j++) {
-		int nStartOffsetGray = offset.x + (offset.y + j) * fullSize.cx;
+		size_t nStartOffsetGray = offset.x + (size_t)(offset.y + j) * fullSize.cx;
 		const int16* pGrayPtr = pGrayImage + nStartOffsetGray;
 		const int16* pSmoothPtr = pSmoothedGrayImage + nStartOffsetGray;
 
-		int nStartOffsetDIB = offset.x * nChannels + (offset.y + j)* nDIBLineLen;
+		size_t nStartOffsetDIB = offset.x * nChannels + (size_t)(offset.y + j) * nDIBLineLen;
 		uint8* pTargetPixelLine = (uint8*)pTargetPixels + nStartOffsetDIB;
 		uint8* pSourcePixelLine = (uint8*)pSourcePixels + nStartOffsetDIB;
 
@@ -1,5 +1,7 @@
 #pragma once
 
+class CYCbCrImage;
+
 // Basic image processing methods processing the image pixel data
 class CBasicProcessing
 {
@@ -10,7 +12,8 @@ public:
 	{
 		MMX, // 64 bit
 		SSE, // 128 bit
-		AVX2 // 256 bit
+		AVX2, // 256 bit
+		NoSIMD // C++ implementation
 	};
 
 	// Note for all methods: The caller gets ownership of the returned image and is responsible to delete 
@@ -56,6 +59,11 @@ public:
 	// cases the return value is NULL
 	static void* Rotate32bpp(int nWidth, int nHeight, const void* pDIBPixels, int nRotationAngleCW);
 
+	// Alpha blends the 32 bit DIB against the background color (see Helpers::AlphaBlendBackground()) and rotates it
+	// clockwise by 0, 90, 180 or 270 degrees in the same pass. For 0 and 180 degrees this is done in place and
+	// pDIBPixels is returned, else a new DIB is returned. Returns NULL for other angles or when out of memory.
+	static void* AlphaBlendRotate32bpp(int nWidth, int nHeight, void* pDIBPixels, COLORREF backgroundColor, int nRotationAngleCW);
+
 	// Mirror 32 bit DIB
 	static void* Mirror32bpp(int nWidth, int nHeight, const void* pDIBPixels, bool bHorizontally);
 
@@ -71,6 +79,16 @@ public:
 	// Crop specified 32 bpp image. Returns NULL if cropRect is not fully inside source image.
 	static void* Crop32bpp(int nWidth, int nHeight, const void* pDIBPixels, CRect cropRect);
 
+	// Inplace variants of the methods above, for huge images that cannot be allocated twice.
+	// Inplace rotation by 90 or 270 degrees needs one bit per 16 pixels (one bit per pixel at worst, when width and
+	// height are primes) and a strip of 16 rows or columns as temporary memory. Returns false if this memory is not
+	// available or the angle is not 90, 180 or 270 degrees. The rotated DIB has nHeight columns and nWidth rows.
+	static bool Rotate32bppInplace(int nWidth, int nHeight, void* pDIBPixels, int nRotationAngleCW);
+	static void Mirror32bppInplace(int nWidth, int nHeight, void* pDIBPixels, bool bHorizontally);
+	// Moves the 24 or 32 bpp view of nWidth x nHeight pixels starting nOffset bytes into pPixels, having rows of nStride
+	// bytes, to the start of pPixels. The moved rows are padded to 4 bytes, the memory behind is unused.
+	static void PackRowsInplace(int nWidth, int nHeight, int nChannels, int nStride, size_t nOffset, void* pPixels);
+
 	// Create a lookup-table for brightness and contrast correction.
 	// dContrastEnh is in [-0.5 .. 0.5], dGamma in [0.1 .. 10]
 	// The lookup table contains 256 uint8 entries (single channel LUT)
@@ -141,11 +159,16 @@ public:
 	// fullTargetOffset: Offset for start of clipping window (in the region given by fullTargetSize)
 	// clippedTargetSize: Size of clipped window - returned DIB has this size
 	// sourceSize: Size of source image
-	// pPixels: Source image
+	// pPixels: Source image, first pixel of the first row
+	// nSourceStride: Distance of the rows in the source image in bytes. The source image can be a section of a larger image.
 	// nChannels: Number of channels (bytes) in source image, must be 3 or 4
 	// Returns a 32 bpp BGRA DIB of size 'clippedTargetSize'
 	static void* PointSample(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, 
-		CSize sourceSize, const void* pPixels, int nChannels);
+		CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels);
+
+	// Same as above for planar YCbCr source images (JPEG), only the sampled pixels are converted to BGR
+	static void* PointSample(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, 
+		const CYCbCrImage& image);
 
 	// Rotate 32 or 24 bpp BGR(A) image and resample using point sampling (i.e. no interpolation). Rotation is around image center.
 	// Notice that the A channel is kept unchanged for 32 bpp images.
@@ -155,7 +178,11 @@ public:
 	// See PointSample() for other parameters
 	// Returns a 32 bpp BGRA DIB of size 'clippedTargetSize'
 	static void* PointSampleWithRotation(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, 
-		CSize sourceSize, double dRotation, const void* pPixels, int nChannels, COLORREF backColor);
+		CSize sourceSize, double dRotation, const void* pPixels, int nSourceStride, int nChannels, COLORREF backColor);
+
+	// Same as above for planar YCbCr source images (JPEG), only the sampled pixels are converted to BGR
+	static void* PointSampleWithRotation(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize, 
+		double dRotation, const CYCbCrImage& image, COLORREF backColor);
 
 	// Resample 32 or 24 bpp BGR(A) image using point sampling (i.e. no interpolation) and map to trapezoid.
 	// Notice that the A channel is kept unchanged for 32 bpp images.
@@ -166,7 +193,7 @@ public:
 	// See PointSample() for other parameters
 	// Returns a 32 bpp BGRA DIB of size 'clippedTargetSize'
 	static void* PointSampleTrapezoid(CSize fullTargetSize, const CTrapezoid& fullTargetTrapezoid, CPoint fullTargetOffset, CSize clippedTargetSize, 
-		CSize sourceSize, const void* pPixels, int nChannels, COLORREF backColor);
+		CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, COLORREF backColor);
 
 	// High quality downsampling of 32 or 24 bpp BGR(A) image to target size, using a set of down-sampling kernels that
 	// do some sharpening during down-sampling if desired. 
@@ -176,27 +203,28 @@ public:
 	// eFilter: Filter to apply. Note that the filter type can only be one of the downsampling filter types.
 	// See PointSample() for other parameters
 	// Returns a 32 bpp BGRA DIB of size 'clippedTargetSize'
+	// The C++ implementation is processed stripwise on the thread pool, as the SIMD implementations.
 	static void* SampleDown_HQ(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-		CSize sourceSize, const void* pPixels, int nChannels, double dSharpen, EFilterType eFilter);
+		CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, double dSharpen, EFilterType eFilter);
 
 	// Same as above, SIMD (AVX2/SSE/MMX) implementation.
 	// Notice that the A channel is not processed and set to fixed value 0xFF.
 	// Notice that the returned image is always 32 bpp!
 	static void* SampleDown_HQ_SIMD(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-		CSize sourceSize, const void* pPixels, int nChannels, double dSharpen, EFilterType eFilter, SIMDArchitecture simd);
+		CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, double dSharpen, EFilterType eFilter, SIMDArchitecture simd);
 
 	// High quality upsampling of 32 or 24 bpp BGR(A) image using bicubic interpolation.
 	// Notice that the A channel is not processed and set to fixed value 0xFF.
 	// Notice that the returned image is always 32 bpp!
 	// See PointSample() for parameters
 	static void* SampleUp_HQ(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-		CSize sourceSize, const void* pPixels, int nChannels);
+		CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels);
 
 	// Same as above, SIMD (AVX2/SSE/MMX) implementation.
 	// Notice that the A channel is not processed and set to fixed value 0xFF.
 	// Notice that the returned image is always 32 bpp!
 	static void* SampleUp_HQ_SIMD(CSize fullTargetSize, CPoint fullTargetOffset, CSize clippedTargetSize,
-		CSize sourceSize, const void* pPixels, int nChannels, SIMDArchitecture simd);
+		CSize sourceSize, const void* pPixels, int nSourceStride, int nChannels, SIMDArchitecture simd);
 
 	// Rotate 32 or 24 bpp BGR(A) image around image center using bicubic interpolation.
 	// Notice that the A channel is processed for 32 bpp images.
@@ -206,11 +234,13 @@ public:
 	// dRotation: rotation angle in radians
 	// sourceSize: Size of source image (pSourcePixels)
 	// pSourcePixels: Source image
+	// nSourceStride: Distance of the rows in the source image in bytes
 	// nChannels: number of channels (bytes) in source image, must be 3 or 4
 	// backColor: color to fill background of rotated image
+	// bUseSSE: Use SSE2 for the interpolation, giving identical results as the C++ code
 	// Returns a 32 bpp DIB of size targetSize
 	static void* RotateHQ(CPoint targetOffset, CSize targetSize, double dRotation, CSize sourceSize, 
-		const void* pSourcePixels, int nChannels, COLORREF backColor);
+		const void* pSourcePixels, int nSourceStride, int nChannels, COLORREF backColor, bool bUseSSE);
 
 	// Trapezoid correction (used for perspective correction) using bicubic interpolation of 32 or 24 bpp BGR(A) image.
 	// This method is used for perspective correction.
@@ -221,14 +251,16 @@ public:
 	// trapezoid: Trapezoid end points, height + 1 must equal sourceSize.cy
 	// sourceSize: Size of source image
 	// pSourcePixels: Source image
+	// nSourceStride: Distance of the rows in the source image in bytes
 	// nChannels: Number of channels (bytes) in source image, must be 3 or 4
 	// backColor: Color to fill background of rotated image
+	// bUseSSE: Use SSE2 for the interpolation, giving identical results as the C++ code
 	// Returns a 32 bpp DIB of size targetSize
 	static void* TrapezoidHQ(CPoint targetOffset, CSize targetSize, const CTrapezoid& trapezoid, CSize sourceSize, 
-		const void* pSourcePixels, int nChannels, COLORREF backColor);
+		const void* pSourcePixels, int nSourceStride, int nChannels, COLORREF backColor, bool bUseSSE);
 
 	// Gauss filtering of a 16 bpp 1 channel image. In the image with size fullSize, the rectangle rect at position offset is filtered.
-	// The returned image has size 'rect'.
+	// The returned image has size 'rect'. For large radii a recursive filter is used, its cost does not depend on the radius.
 	static int16* GaussFilter16bpp1Channel(CSize fullSize, CPoint offset, CSize rect, double dRadius, const int16* pPixels);
 
 	// Apply unsharp masking to the given source 32 or 24 bpp BGR(A) image and store result in pTargetPixels.
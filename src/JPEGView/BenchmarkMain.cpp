@@ -0,0 +1,38 @@
+// BenchmarkMain.cpp : main entry point for JPEGViewBenchmark.exe
+
+#include "stdafx.h"
+#include <stdio.h>
+#include "SettingsProvider.h"
+#include "ProcessingThreadPool.h"
+#include "ProcessingBenchmark.h"
+#include "Tracing.h"
+
+// Console version of 'JPEGView.exe /benchmark', linking only the image processing and needing neither WTL nor GDI+.
+// Usage: JPEGViewBenchmark.exe [/trace] [output file], the output file defaults to JPEGViewBenchmark.json.
+// Returns 0 on success and 1 if the benchmark failed.
+// JPEGViewBenchmark.vcxproj is not part of the solutions yet, build it separately with msbuild.
+int _tmain(int argc, TCHAR* argv[]) {
+	LPCTSTR sOutputFile = _T("JPEGViewBenchmark.json");
+	bool bTrace = CSettingsProvider::This().EnableTracing();
+	for (int i = 1; i < argc; i++) {
+		if (_tcsicmp(argv[i], _T("/trace")) == 0) {
+			bTrace = true;
+		} else {
+			sOutputFile = argv[i];
+		}
+	}
+	if (bTrace) {
+		CTracing::Enable();
+	}
+
+	CProcessingThreadPool::This().CreateThreadPoolThreads();
+	bool bSuccess = CProcessingBenchmark::Run(sOutputFile);
+	CProcessingThreadPool::This().StopAllThreads();
+	if (CTracing::IsEnabled()) {
+		::CreateDirectory(Helpers::JPEGViewAppDataPath(), NULL);
+		CTracing::WriteChromeTrace(CTracing::DefaultFileName());
+	}
+
+	_tprintf(bSuccess ? _T("Benchmark results written to %s\n") : _T("Benchmark failed, no results written to %s\n"), sOutputFile);
+	return bSuccess ? 0 : 1;
+}
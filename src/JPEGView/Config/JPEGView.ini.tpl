@@ -55,9 +55,22 @@ DisplayMonitor=-1
 CPUType=AutoDetect
 
 ; Number of CPU cores used. Set to 0 for auto detection.
-; Must be 1 to 4, or 0 for auto detect.
+; Must be 1 to 16, or 0 for auto detect.
+; This is an upper bound, the processing calibration (see below) may decide to use less threads for some operations.
 CPUCoresUsed=0
 
+; Measure the best strip size and number of threads for each image processing operation once per CPU at startup
+; and store the result in ProcessingTuning.ini in the JPEGView application data folder.
+; Start JPEGView with /calibrate to redo the calibration, e.g. after changing CPUType or CPUCoresUsed.
+; If set to false, built-in default values are used, unless a calibration was explicitly done with /calibrate.
+AutoCalibrateProcessing=true
+
+; Record the time spent in the stages of loading and processing images (waiting for the image, decoding, local density
+; correction, resampling, color corrections, unsharp mask and each strip processed by the processing threads).
+; When JPEGView exits, the trace is written to JPEGViewTrace.json in the JPEGView application data folder, it can be viewed
+; with chrome://tracing or Perfetto. Starting JPEGView with /trace also enables tracing. Only enable to diagnose performance problems.
+EnableTracing=false
+
 ; Editor for INI files
 ; notepad : Use notepad.exe
 ; system : Use application registered for INI files
@@ -0,0 +1,251 @@
+#include "StdAfx.h"
+#include "DecodeBenchmark.h"
+#include "ImageLoadThread.h"
+#include "JPEGImage.h"
+#include "FileList.h"
+#include "SettingsProvider.h"
+#include "ProcessingThreadPool.h"
+#include "Helpers.h"
+#include <psapi.h>
+#include <algorithm>
+#include <vector>
+
+#pragma comment(lib, "psapi.lib")
+
+// Increment when the measured stages change, results with different versions cannot be compared
+static const int BENCHMARK_VERSION = 1;
+
+// Images are processed for display in a window of this size
+static const int TARGET_WIDTH = 1920;
+static const int TARGET_HEIGHT = 1080;
+
+// Besides the stages of the image load thread, the wait for the background image analysis (histogram and
+// local density correction map) and the total time until the image is fully available are reported
+static const int STAGE_LDCAnalysis = LoadStage_NumStages;
+static const int STAGE_Total = LoadStage_NumStages + 1;
+static const int NUM_STAGES = LoadStage_NumStages + 2;
+static const char* STAGE_NAMES[NUM_STAGES] = {
+	"file_read", "decode", "alpha_blend", "exif", "image_creation", "process_after_load", "ldc_analysis", "total" };
+
+// Must be in the order of EImageFormat
+static const char* FORMAT_NAMES[IF_Unknown + 1] = {
+	"JPEG", "BMP", "PNG", "GIF", "TIFF", "WEBP", "JXL", "HEIF", "AVIF", "QOI", "PSD", "ICO", "WMF", "EMF", "WIC",
+	"Clipboard", "RAW", "JPEG_Embedded", "TGA", "Unknown" };
+
+static const double PERCENTILES[] = { 0.5, 0.9, 0.99, 1.0 };
+static const char* PERCENTILE_NAMES[] = { "p50", "p90", "p99", "max" };
+static const int NUM_PERCENTILES = sizeof(PERCENTILES) / sizeof(double);
+
+#ifdef _WIN64
+static const char PLATFORM[] = "x64";
+#else
+static const char PLATFORM[] = "x86";
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////
+// Supporting classes
+///////////////////////////////////////////////////////////////////////////////////
+
+// Measurements of all successfully loaded files of one image format
+class CFormatResults {
+public:
+	CFormatResults() {
+		NumFiles = 0;
+		FileBytes = 0;
+		Pixels = 0;
+		TotalTime = 0;
+		MaxWorkingSet = 0;
+	}
+
+	int NumFiles;
+	__int64 FileBytes;
+	__int64 Pixels;
+	double TotalTime; // sum of the total load time in ms
+	SIZE_T MaxWorkingSet; // maximal working set of the process after loading one of the files
+	std::vector<double> StageTimes[NUM_STAGES]; // in ms, one entry per file
+};
+
+static CFormatResults s_results[IF_Unknown + 1];
+
+///////////////////////////////////////////////////////////////////////////////////
+// Private
+///////////////////////////////////////////////////////////////////////////////////
+
+// Gets the files of the folder with one of the supported file endings
+static std::vector<CString> GetImageFiles(LPCTSTR sFolder, std::vector<__int64>& fileSizes) {
+	std::vector<CString> files;
+	CString sEndings = CFileList::GetSupportedFileEndings() + _T(";");
+	sEndings.MakeLower();
+	CString sPattern = CString(sFolder) + _T("\\*");
+	WIN32_FIND_DATA findData;
+	HANDLE hFind = ::FindFirstFile(sPattern, &findData);
+	if (hFind == INVALID_HANDLE_VALUE) {
+		return files;
+	}
+	do {
+		if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+			continue;
+		}
+		LPCTSTR sExtension = _tcsrchr(findData.cFileName, _T('.'));
+		if (sExtension == NULL) {
+			continue;
+		}
+		CString sEnding = CString(_T("*")) + sExtension + _T(";");
+		sEnding.MakeLower();
+		if (sEndings.Find(sEnding) >= 0) {
+			files.push_back(CString(sFolder) + _T("\\") + findData.cFileName);
+			fileSizes.push_back(((__int64)findData.nFileSizeHigh << 32) + findData.nFileSizeLow);
+		}
+	} while (::FindNextFile(hFind, &findData));
+	::FindClose(hFind);
+	return files;
+}
+
+// Processing as configured in the INI file, as done by the main dialog for a new image
+static CProcessParams GetProcessParams() {
+	CSettingsProvider& sp = CSettingsProvider::This();
+	CImageProcessingParams imageProcParams(sp.Contrast(), sp.Gamma(), sp.Saturation(), sp.Sharpen(), 0.0, 0.5,
+		sp.BrightenShadows(), sp.DarkenHighlights(), sp.BrightenShadowsSteepness(), sp.CyanRed(), sp.MagentaGreen(), sp.YellowBlue());
+	EProcessingFlags eProcFlags = PFLAG_None;
+	eProcFlags = SetProcessingFlag(eProcFlags, PFLAG_HighQualityResampling, sp.HighQualityResampling());
+	eProcFlags = SetProcessingFlag(eProcFlags, PFLAG_AutoContrast, sp.AutoContrastCorrection());
+	eProcFlags = SetProcessingFlag(eProcFlags, PFLAG_LDC, sp.LocalDensityCorrection());
+	return CProcessParams(TARGET_WIDTH, TARGET_HEIGHT, CSize(TARGET_WIDTH, TARGET_HEIGHT), CRotationParams(0), 0, -1,
+		sp.AutoZoomMode(), CPoint(0, 0), imageProcParams, eProcFlags);
+}
+
+static SIZE_T GetWorkingSet(bool bPeak) {
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return bPeak ? counters.PeakWorkingSetSize : counters.WorkingSetSize;
+}
+
+// Nearest rank percentile of the sorted values
+static double Percentile(const std::vector<double>& sortedValues, double dPercentile) {
+	int nRank = (int)ceil(dPercentile * sortedValues.size());
+	return sortedValues[max(0, min((int)sortedValues.size() - 1, nRank - 1))];
+}
+
+static CStringA EscapeJSON(const CStringA& sText) {
+	CStringA sEscaped(sText);
+	sEscaped.Replace("\\", "\\\\");
+	sEscaped.Replace("\"", "\\\"");
+	return sEscaped;
+}
+
+static bool WriteTextFile(LPCTSTR sFileName, const CStringA& sContent) {
+	FILE* fptr;
+	if ((fptr = _tfopen(sFileName, _T("wb"))) == NULL) {
+		return false;
+	}
+	bool bSuccess = fwrite((LPCSTR)sContent, 1, sContent.GetLength(), fptr) == (size_t)sContent.GetLength();
+	return (fclose(fptr) == 0) && bSuccess;
+}
+
+// Loads one file and adds the measurements to the results of its format. Returns false if the file cannot be loaded.
+static bool LoadFile(CImageLoadThread& loadThread, HANDLE hEventFinished, const CProcessParams& processParams,
+	LPCTSTR sFileName, __int64 nFileSize) {
+	double dStartTime = Helpers::GetExactTickCount();
+	int nHandle = loadThread.AsyncLoad(sFileName, 0, processParams, NULL, hEventFinished);
+	::WaitForSingleObject(hEventFinished, INFINITE);
+	CImageData imageData = loadThread.GetLoadedImage(nHandle);
+	CJPEGImage* pImage = imageData.Image;
+	if (pImage == NULL) {
+		loadThread.ReleaseFile(sFileName);
+		return false;
+	}
+	double dLoadedTime = Helpers::GetExactTickCount();
+	// waits for the image analysis running in the background or analyzes the image if not started by the loader
+	pImage->GetLightenShadowFactor();
+	double dEndTime = Helpers::GetExactTickCount();
+
+	CFormatResults& results = s_results[min(IF_Unknown, pImage->GetImageFormat())];
+	results.NumFiles++;
+	results.FileBytes += nFileSize;
+	results.Pixels += (__int64)pImage->OrigWidth() * pImage->OrigHeight();
+	results.TotalTime += dEndTime - dStartTime;
+	results.MaxWorkingSet = max(results.MaxWorkingSet, GetWorkingSet(false));
+	for (int i = 0; i < LoadStage_NumStages; i++) {
+		results.StageTimes[i].push_back(pImage->GetLoadStageTickCount((ELoadStage)i));
+	}
+	results.StageTimes[STAGE_LDCAnalysis].push_back(dEndTime - dLoadedTime);
+	results.StageTimes[STAGE_Total].push_back(dEndTime - dStartTime);
+
+	delete pImage;
+	// the file cache would keep the files in memory
+	loadThread.ReleaseFile(sFileName);
+	return true;
+}
+
+static CStringA FormatResultsToJSON(EImageFormat eFormat, const CFormatResults& results) {
+	double dSeconds = max(results.TotalTime, 0.001) / 1000.0;
+	CStringA sJSON;
+	sJSON.Format("    { \"format\": \"%s\", \"files\": %d, \"mbytes\": %.3f, \"mbytes_per_s\": %.2f, \"mpixels_per_s\": %.2f, "
+		"\"max_working_set_mb\": %.1f,\n      \"stages_ms\": {",
+		FORMAT_NAMES[eFormat], results.NumFiles, results.FileBytes / (1024.0 * 1024.0),
+		results.FileBytes / (1024.0 * 1024.0) / dSeconds, results.Pixels / 1000000.0 / dSeconds,
+		results.MaxWorkingSet / (1024.0 * 1024.0));
+	for (int nStage = 0; nStage < NUM_STAGES; nStage++) {
+		std::vector<double> sortedTimes(results.StageTimes[nStage]);
+		std::sort(sortedTimes.begin(), sortedTimes.end());
+		sJSON.AppendFormat("%s\n        \"%s\": {", (nStage == 0) ? "" : ",", STAGE_NAMES[nStage]);
+		for (int i = 0; i < NUM_PERCENTILES; i++) {
+			sJSON.AppendFormat("%s \"%s\": %.3f", (i == 0) ? "" : ",", PERCENTILE_NAMES[i], Percentile(sortedTimes, PERCENTILES[i]));
+		}
+		sJSON += " }";
+	}
+	sJSON += "\n      } }";
+	return sJSON;
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// Public
+///////////////////////////////////////////////////////////////////////////////////
+
+bool CDecodeBenchmark::Run(LPCTSTR sFolder, LPCTSTR sOutputFile) {
+	CString sFolderPath(sFolder);
+	sFolderPath.TrimRight(_T("\\"));
+	std::vector<__int64> fileSizes;
+	std::vector<CString> files = GetImageFiles(sFolderPath, fileSizes);
+	if (files.empty()) {
+		return false;
+	}
+
+	HANDLE hEventFinished = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (hEventFinished == NULL) {
+		return false;
+	}
+	CProcessParams processParams = GetProcessParams();
+	CImageLoadThread* pLoadThread = new CImageLoadThread();
+	int nNumFailed = 0;
+	double dStartTime = Helpers::GetExactTickCount();
+	for (size_t i = 0; i < files.size(); i++) {
+		if (!LoadFile(*pLoadThread, hEventFinished, processParams, files[i], fileSizes[i])) {
+			nNumFailed++;
+		}
+	}
+	double dTotalTime = Helpers::GetExactTickCount() - dStartTime;
+	delete pLoadThread;
+	::CloseHandle(hEventFinished);
+
+	CStringA sResults;
+	for (int i = 0; i <= IF_Unknown; i++) {
+		if (s_results[i].NumFiles > 0) {
+			if (!sResults.IsEmpty()) {
+				sResults += ",\n";
+			}
+			sResults += FormatResultsToJSON((EImageFormat)i, s_results[i]);
+		}
+	}
+
+	CStringA sJSON;
+	sJSON.Format("{\n  \"version\": %d,\n  \"cpu\": \"%s\",\n  \"platform\": \"%s\",\n  \"threads_available\": %d,\n"
+		"  \"folder\": \"%s\",\n  \"files\": %d,\n  \"failed\": %d,\n  \"total_s\": %.3f,\n  \"peak_working_set_mb\": %.1f,\n"
+		"  \"target_width\": %d,\n  \"target_height\": %d,\n  \"results\": [\n%s\n  ]\n}\n",
+		BENCHMARK_VERSION, (LPCSTR)EscapeJSON(CStringA(Helpers::CPUName())), PLATFORM, CProcessingThreadPool::This().NumberOfThreads(),
+		(LPCSTR)EscapeJSON(CStringA(sFolderPath)), (int)files.size(), nNumFailed, dTotalTime / 1000.0,
+		GetWorkingSet(true) / (1024.0 * 1024.0), TARGET_WIDTH, TARGET_HEIGHT, (LPCSTR)sResults);
+	return WriteTextFile(sOutputFile, sJSON);
+}
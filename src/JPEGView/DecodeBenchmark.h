@@ -0,0 +1,14 @@
+#pragma once
+
+// Headless benchmark of loading images, started with the /decodebenchmark command line parameter. No window is created.
+// All supported image files of a folder are loaded once with the image load thread, as when viewing them. The time spent in
+// each stage of loading (see ELoadStage), the throughput and the memory used are reported per image format.
+// The results are written to a JSON file, allowing to compare the performance of different versions.
+class CDecodeBenchmark
+{
+public:
+	// Loads all images in the folder sFolder (not recursive) and writes the results to the file sOutputFile.
+	// Must be called after GDI+ has been initialized and the thread pool threads have been created.
+	// Returns false if the folder contains no supported files or the output file cannot be written.
+	static bool Run(LPCTSTR sFolder, LPCTSTR sOutputFile);
+};
@@ -8,6 +8,45 @@
 #include "SettingsProvider.h"
 #include "HelpersGUI.h"
 #include "NLS.h"
+#include "JPEGProvider.h"
+
+// Formats a number of bytes with the unit fitting best, e.g. 1.5 MB
+static CString FormatBytes(__int64 nBytes) {
+	const TCHAR* units[] = { _T("Bytes"), _T("KB"), _T("MB"), _T("GB") };
+	double value = (double)nBytes;
+	int exponent = 0;
+	while (value >= 1024 && exponent < sizeof(units) / sizeof(units[0]) - 1) {
+		value /= 1024.0;
+		exponent++;
+	}
+	CString sFormatted;
+	sFormatted.Format(_T("%.1f %s"), value, units[exponent]);
+	return sFormatted;
+}
+
+// Adds a line for each category of the memory usage, categories not using memory are left out
+static void AddMemoryUsageLines(CEXIFDisplay* pEXIFDisplay, const CImageMemoryUsage& usage) {
+	const struct {
+		LPCTSTR Description;
+		size_t Bytes;
+	} categories[] = {
+		{ _T("Original pixels:"), usage.OriginalPixels },
+		{ _T("Compressed pixels:"), usage.CompressedPixels },
+		{ _T("Processed pixels:"), usage.DIBs },
+		{ _T("Unsharp mask:"), usage.UnsharpMask },
+		{ _T("Thumbnails:"), usage.Thumbnails },
+		{ _T("LDC:"), usage.LDC },
+		{ _T("Histogram:"), usage.Histogram },
+		{ _T("Lookup tables:"), usage.LUTs },
+		{ _T("EXIF:"), usage.EXIF },
+		{ _T("Undo steps:"), usage.UndoSteps },
+	};
+	for (int i = 0; i < sizeof(categories) / sizeof(categories[0]); i++) {
+		if (categories[i].Bytes > 0) {
+			pEXIFDisplay->AddLine(CString(_T("  ")) + CNLS::GetString(categories[i].Description), FormatBytes(categories[i].Bytes));
+		}
+	}
+}
 
 static int GetFileNameHeight(HDC dc) {
 	CSize size;
@@ -134,19 +173,22 @@ void CEXIFDisplayCtl::FillEXIFDataDisplay() {
 			::GetFileSizeEx(hFile, (PLARGE_INTEGER)&fileSize);
 			::CloseHandle(hFile);
 			if (fileSize > 0) {
-				const TCHAR* units[] = { _T("Bytes"), _T("KB"), _T("MB"), _T("GB") };
-				double value = fileSize;
-				int exponent = 0;
-				while (value >= 1024 && exponent < sizeof(units) / sizeof(units[0]) - 1) {
-					value /= 1024.0;
-					exponent++;
-				}
-				sFileSize.Format(_T("%.1f %s"), value, units[exponent]);
+				sFileSize = FormatBytes(fileSize);
 			}
 		}
 	}
 	m_pEXIFDisplay->AddLine(CNLS::GetString(_T("Size:")), sFileSize);
 
+	// memory used by this image and by all images held by the image provider, e.g. for tuning the cache sizes
+	CImageMemoryUsage memoryUsage = CurrentImage()->GetMemoryUsage();
+	CString sMemory = FormatBytes(memoryUsage.Total());
+	CJPEGProvider* pJPEGProvider = m_pMainDlg->GetJPEGProvider();
+	if (pJPEGProvider != NULL) {
+		sMemory += CString(_T(" (")) + CNLS::GetString(_T("all images")) + _T(": ") + FormatBytes(pJPEGProvider->GetMemoryUsage().Total()) + _T(")");
+	}
+	m_pEXIFDisplay->AddLine(CNLS::GetString(_T("Memory:")), sMemory);
+	AddMemoryUsageLines(m_pEXIFDisplay, memoryUsage);
+
 	if (!CurrentImage()->IsClipboardImage()) {
 		CEXIFReader* pEXIFReader = CurrentImage()->GetEXIFReader();
 		CRawMetadata* pRawMetaData = CurrentImage()->GetRawMetadata();
@@ -0,0 +1,105 @@
+#include "StdAfx.h"
+#include "FileCache.h"
+#include "Helpers.h"
+#include "SettingsProvider.h"
+
+CFileCache* CFileCache::sm_instance;
+
+///////////////////////////////////////////////////////////////////////////////////
+// Public interface
+///////////////////////////////////////////////////////////////////////////////////
+
+CFileCache& CFileCache::This() {
+	if (sm_instance == NULL) {
+		sm_instance = new CFileCache();
+		atexit(&Delete);
+	}
+	return *sm_instance;
+}
+
+bool CFileCache::Read(LPCTSTR sFileName, __int64 nFileSize, const FILETIME& lastWriteTime, void* pBuffer) {
+	Helpers::CAutoCriticalSection lock(m_csList);
+	std::list<CEntry>::iterator iter = Find(sFileName);
+	if (iter == m_entries.end()) {
+		return false;
+	}
+	if (iter->FileSize != nFileSize || ::CompareFileTime(&(iter->LastWriteTime), &lastWriteTime) != 0) {
+		// file has been changed on disk
+		RemoveEntry(iter);
+		return false;
+	}
+	memcpy(pBuffer, iter->Bytes, (size_t)nFileSize);
+	m_entries.splice(m_entries.begin(), m_entries, iter);
+	return true;
+}
+
+void CFileCache::Add(LPCTSTR sFileName, __int64 nFileSize, const FILETIME& lastWriteTime, const void* pBuffer) {
+	if (nFileSize <= 0 || nFileSize > m_nMaxSizeBytes / 2) {
+		return;
+	}
+	Helpers::CAutoCriticalSection lock(m_csList);
+	std::list<CEntry>::iterator iter = Find(sFileName);
+	if (iter != m_entries.end()) {
+		RemoveEntry(iter);
+	}
+	while (!m_entries.empty() && m_nSizeBytes + nFileSize > m_nMaxSizeBytes) {
+		RemoveEntry(--m_entries.end());
+	}
+	uint8* pBytes = new(std::nothrow) uint8[(size_t)nFileSize];
+	if (pBytes == NULL) {
+		return;
+	}
+	memcpy(pBytes, pBuffer, (size_t)nFileSize);
+	CEntry entry;
+	entry.FileName = sFileName;
+	entry.FileSize = nFileSize;
+	entry.LastWriteTime = lastWriteTime;
+	entry.Bytes = pBytes;
+	m_entries.push_front(entry);
+	m_nSizeBytes += nFileSize;
+}
+
+void CFileCache::Remove(LPCTSTR sFileName) {
+	Helpers::CAutoCriticalSection lock(m_csList);
+	std::list<CEntry>::iterator iter = Find(sFileName);
+	if (iter != m_entries.end()) {
+		RemoveEntry(iter);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// Private
+///////////////////////////////////////////////////////////////////////////////////
+
+CFileCache::CFileCache()
+	: m_csList{ 0 }
+{
+	::InitializeCriticalSection(&m_csList);
+	m_nSizeBytes = 0;
+	m_nMaxSizeBytes = (__int64)CSettingsProvider::This().FileCacheSizeMB() * 1024 * 1024;
+}
+
+CFileCache::~CFileCache() {
+	::DeleteCriticalSection(&m_csList);
+	std::list<CEntry>::iterator iter;
+	for (iter = m_entries.begin( ); iter != m_entries.end( ); iter++ ) {
+		delete[] iter->Bytes;
+	}
+	m_entries.clear();
+}
+
+std::list<CFileCache::CEntry>::iterator CFileCache::Find(LPCTSTR sFileName) {
+	std::list<CEntry>::iterator iter;
+	for (iter = m_entries.begin( ); iter != m_entries.end( ); iter++ ) {
+		if (iter->FileName.CompareNoCase(sFileName) == 0) {
+			return iter;
+		}
+	}
+	return m_entries.end();
+}
+
+void CFileCache::RemoveEntry(std::list<CEntry>::iterator iter) {
+	m_nSizeBytes -= iter->FileSize;
+	delete[] iter->Bytes;
+	m_entries.erase(iter);
+}
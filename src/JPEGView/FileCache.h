@@ -0,0 +1,47 @@
+#pragma once
+
+#include <list>
+
+// Caches the compressed bytes of the last read image files (LRU cache with a byte budget, see FileCacheSizeMB in INI file).
+// When going back to an image no longer held decoded by the JPEG provider, the file is then decoded from memory
+// instead of reading it again from disk, which is expensive on network shares.
+// A file is identified by its name, size and last write time, thus files changed on disk are read again.
+class CFileCache
+{
+public:
+	// Singleton instance. Creating it is not thread safe, it is created when constructing the first image load thread.
+	static CFileCache& This();
+
+	// Copies the cached bytes of the file into pBuffer, which must hold nFileSize bytes.
+	// Returns false if the file is not cached with this size and last write time.
+	bool Read(LPCTSTR sFileName, __int64 nFileSize, const FILETIME& lastWriteTime, void* pBuffer);
+
+	// Adds the bytes of a file that has just been read, the least recently used files are removed if the budget is exceeded.
+	// Files larger than half of the budget are not cached.
+	void Add(LPCTSTR sFileName, __int64 nFileSize, const FILETIME& lastWriteTime, const void* pBuffer);
+
+	// Removes the file from the cache, e.g. when it is deleted or renamed
+	void Remove(LPCTSTR sFileName);
+
+private:
+	struct CEntry {
+		CString FileName;
+		__int64 FileSize;
+		FILETIME LastWriteTime;
+		uint8* Bytes;
+	};
+
+	static CFileCache* sm_instance;
+
+	CRITICAL_SECTION m_csList; // access to list must be thread safe
+	std::list<CEntry> m_entries; // most recently used first
+	__int64 m_nSizeBytes;
+	__int64 m_nMaxSizeBytes;
+
+	CFileCache();
+	~CFileCache();
+	static void Delete() { delete sm_instance; }
+
+	std::list<CEntry>::iterator Find(LPCTSTR sFileName);
+	void RemoveEntry(std::list<CEntry>::iterator iter);
+};
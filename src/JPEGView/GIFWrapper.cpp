@@ -0,0 +1,445 @@
+#include "stdafx.h"
+
+#include "GIFWrapper.h"
+#include "MaxImageDef.h"
+#include "PixelMemory.h"
+
+// Native GIF87a/GIF89a decoder.
+// The frames are LZW decoded into palette indices and composed onto a BGRA canvas of the size of the logical screen,
+// honoring the disposal method and the transparent color index of the graphic control extension.
+// Areas never painted and areas restored to background are fully transparent, the caller blends them onto the background color.
+
+#define GIF_MAX_CODES 4096
+#define GIF_MAX_CODE_SIZE 12
+
+struct GifReader::gif_frame {
+	int x;
+	int y;
+	int width;
+	int height;
+	bool interlaced;
+	int disposal; // 0, 1: leave in place, 2: restore to background, 3: restore to previous
+	int transparent_index; // -1 if the frame has no transparent color
+	int delay_ms;
+	const uint8* color_table; // local or global color table in RGB order, NULL if none
+	int color_table_size; // number of entries in color table
+	int min_code_size;
+	int data_offset; // offset of first LZW data sub-block
+	int data_size; // sum of the sizes of all LZW data sub-blocks
+};
+
+struct GifReader::gif_cache {
+	uint8* data;
+	int data_size;
+	int width;
+	int height;
+	gif_frame* frames;
+	int frame_count;
+	uint32* canvas; // composed image
+	uint32* previous; // saved canvas for frames with disposal 'restore to previous', NULL if not needed
+	uint8* indices; // decoded palette indices of one frame
+	uint8* lzw_data; // concatenated LZW data sub-blocks of one frame
+	int next_frame; // index of next frame to compose onto canvas
+};
+
+GifReader::gif_cache GifReader::cache = { 0 };
+
+// Skips a sequence of data sub-blocks, returns position after block terminator or -1 if truncated
+static int SkipSubBlocks(const uint8* data, int size, int pos, int* payloadSize) {
+	int nPayload = 0;
+	while (pos < size) {
+		int nLen = data[pos++];
+		if (nLen == 0) {
+			if (payloadSize != NULL) *payloadSize = nPayload;
+			return pos;
+		}
+		pos += nLen;
+		nPayload += nLen;
+	}
+	if (payloadSize != NULL) *payloadSize = nPayload;
+	return -1;
+}
+
+bool GifReader::BeginReading(const void* buffer, int sizebytes, bool& outOfMemory)
+{
+	const uint8* p = (const uint8*)buffer;
+	if (buffer == NULL || sizebytes < 13 || memcmp(p, "GIF8", 4) != 0)
+		return false;
+
+	cache.data = (uint8*)malloc(sizebytes);
+	if (cache.data == NULL) {
+		outOfMemory = true;
+		return false;
+	}
+	memcpy(cache.data, buffer, sizebytes);
+	cache.data_size = sizebytes;
+	const uint8* data = cache.data;
+
+	int nScreenWidth = data[6] | (data[7] << 8);
+	int nScreenHeight = data[8] | (data[9] << 8);
+	uint8 nScreenFlags = data[10];
+	int pos = 13;
+	const uint8* pGlobalColorTable = NULL;
+	int nGlobalColorTableSize = 0;
+	if (nScreenFlags & 0x80) {
+		nGlobalColorTableSize = 2 << (nScreenFlags & 7);
+		pGlobalColorTable = data + pos;
+		pos += 3 * nGlobalColorTableSize;
+	}
+
+	int nDisposal = 0, nTransparentIndex = -1, nDelay = 0;
+	int nFrameCapacity = 0;
+	bool bNeedsPrevious = false;
+	size_t nMaxFramePixels = 0;
+	int nMaxDataSize = 0;
+	while (pos < sizebytes) {
+		uint8 nBlockType = data[pos++];
+		if (nBlockType == 0x3B) {
+			break; // trailer
+		} else if (nBlockType == 0x21) {
+			// extension block
+			if (pos >= sizebytes)
+				break;
+			uint8 nLabel = data[pos++];
+			if (nLabel == 0xF9 && pos + 5 <= sizebytes && data[pos] >= 4) {
+				// graphic control extension, applies to the next image
+				uint8 nPacked = data[pos + 1];
+				nDisposal = (nPacked >> 2) & 7;
+				nDelay = (data[pos + 2] | (data[pos + 3] << 8)) * 10;
+				nTransparentIndex = (nPacked & 1) ? data[pos + 4] : -1;
+			}
+			pos = SkipSubBlocks(data, sizebytes, pos, NULL);
+			if (pos < 0)
+				break;
+		} else if (nBlockType == 0x2C) {
+			// image descriptor
+			if (pos + 10 > sizebytes)
+				break;
+			gif_frame frame;
+			frame.x = data[pos] | (data[pos + 1] << 8);
+			frame.y = data[pos + 2] | (data[pos + 3] << 8);
+			frame.width = data[pos + 4] | (data[pos + 5] << 8);
+			frame.height = data[pos + 6] | (data[pos + 7] << 8);
+			uint8 nFlags = data[pos + 8];
+			frame.interlaced = (nFlags & 0x40) != 0;
+			frame.disposal = nDisposal;
+			frame.transparent_index = nTransparentIndex;
+			frame.delay_ms = nDelay;
+			pos += 9;
+			if (nFlags & 0x80) {
+				frame.color_table_size = 2 << (nFlags & 7);
+				frame.color_table = data + pos;
+				pos += 3 * frame.color_table_size;
+			} else {
+				frame.color_table_size = nGlobalColorTableSize;
+				frame.color_table = pGlobalColorTable;
+			}
+			if (pos >= sizebytes)
+				break;
+			frame.min_code_size = data[pos++];
+			frame.data_offset = pos;
+			pos = SkipSubBlocks(data, sizebytes, pos, &frame.data_size);
+			if (frame.min_code_size < 1 || frame.min_code_size >= GIF_MAX_CODE_SIZE)
+				break;
+
+			// the graphic control extension is only valid for one image
+			nDisposal = 0;
+			nTransparentIndex = -1;
+			nDelay = 0;
+
+			if ((double)frame.width * frame.height > MAX_IMAGE_PIXELS) {
+				outOfMemory = true;
+				return false;
+			}
+			if (frame.width > 0 && frame.height > 0) {
+				if (cache.frame_count == nFrameCapacity) {
+					nFrameCapacity = max(16, nFrameCapacity * 2);
+					gif_frame* pNewFrames = (gif_frame*)realloc(cache.frames, nFrameCapacity * sizeof(gif_frame));
+					if (pNewFrames == NULL) {
+						outOfMemory = true;
+						return false;
+					}
+					cache.frames = pNewFrames;
+				}
+				cache.frames[cache.frame_count++] = frame;
+				bNeedsPrevious |= frame.disposal == 3;
+				nMaxFramePixels = max(nMaxFramePixels, (size_t)frame.width * frame.height);
+				nMaxDataSize = max(nMaxDataSize, frame.data_size);
+			}
+			if (pos < 0)
+				break; // truncated file, show what has been read so far
+		} else {
+			break; // unknown block type, stop here
+		}
+	}
+	if (cache.frame_count == 0)
+		return false;
+
+	// Some encoders write an empty logical screen, use the extent of the first frame in this case
+	if (nScreenWidth == 0 || nScreenHeight == 0) {
+		nScreenWidth = cache.frames[0].x + cache.frames[0].width;
+		nScreenHeight = cache.frames[0].y + cache.frames[0].height;
+	}
+	if (nScreenWidth > MAX_IMAGE_DIMENSION || nScreenHeight > MAX_IMAGE_DIMENSION)
+		return false;
+	if ((double)nScreenWidth * nScreenHeight > MAX_IMAGE_PIXELS) {
+		outOfMemory = true;
+		return false;
+	}
+	cache.width = nScreenWidth;
+	cache.height = nScreenHeight;
+
+	size_t nCanvasPixels = (size_t)nScreenWidth * nScreenHeight;
+	// the canvas of a single frame image is handed over to the image, which frees it with CPixelMemory::Free()
+	cache.canvas = (uint32*)CPixelMemory::Allocate(nCanvasPixels * sizeof(uint32));
+	cache.indices = new(std::nothrow) uint8[nMaxFramePixels];
+	cache.lzw_data = new(std::nothrow) uint8[nMaxDataSize + 4];
+	if (bNeedsPrevious)
+		cache.previous = new(std::nothrow) uint32[nCanvasPixels];
+	if (cache.canvas == NULL || cache.indices == NULL || cache.lzw_data == NULL || (bNeedsPrevious && cache.previous == NULL)) {
+		outOfMemory = true;
+		return false;
+	}
+	memset(cache.canvas, 0, nCanvasPixels * sizeof(uint32));
+	cache.next_frame = 0;
+	return true;
+}
+
+size_t GifReader::DecodeLZW(const gif_frame& frame)
+{
+	// Concatenate the data sub-blocks so that the bit reader does not need to care about block boundaries
+	uint8* pSrc = cache.lzw_data;
+	int nSrcSize = 0;
+	int pos = frame.data_offset;
+	while (pos < cache.data_size && nSrcSize < frame.data_size) {
+		int nLen = cache.data[pos++];
+		if (nLen == 0)
+			break;
+		nLen = min(nLen, min(cache.data_size - pos, frame.data_size - nSrcSize));
+		memcpy(pSrc + nSrcSize, cache.data + pos, nLen);
+		nSrcSize += nLen;
+		pos += nLen;
+	}
+
+	uint16 prefix[GIF_MAX_CODES];
+	uint8 suffix[GIF_MAX_CODES];
+	uint8 first[GIF_MAX_CODES];
+	uint16 length[GIF_MAX_CODES];
+
+	int nClearCode = 1 << frame.min_code_size;
+	int nEndCode = nClearCode + 1;
+	for (int i = 0; i < nClearCode; i++) {
+		prefix[i] = 0;
+		suffix[i] = first[i] = (uint8)i;
+		length[i] = 1;
+	}
+	int nCodeSize = frame.min_code_size + 1;
+	int nCodeMask = (1 << nCodeSize) - 1;
+	int nNextCode = nEndCode + 1;
+	int nPrevCode = -1;
+
+	uint8* pOut = cache.indices;
+	size_t nOutSize = (size_t)frame.width * frame.height;
+	size_t nOutPos = 0;
+	uint32 nBits = 0;
+	int nNumBits = 0;
+	int nSrcPos = 0;
+	while (nOutPos < nOutSize) {
+		while (nNumBits < nCodeSize) {
+			if (nSrcPos >= nSrcSize)
+				return nOutPos; // premature end of data
+			nBits |= (uint32)pSrc[nSrcPos++] << nNumBits;
+			nNumBits += 8;
+		}
+		int nCode = nBits & nCodeMask;
+		nBits >>= nCodeSize;
+		nNumBits -= nCodeSize;
+
+		if (nCode == nClearCode) {
+			nCodeSize = frame.min_code_size + 1;
+			nCodeMask = (1 << nCodeSize) - 1;
+			nNextCode = nEndCode + 1;
+			nPrevCode = -1;
+			continue;
+		}
+		if (nCode == nEndCode)
+			break;
+		if (nPrevCode < 0) {
+			if (nCode >= nClearCode)
+				break; // corrupt data, the first code after a clear must be a literal
+			pOut[nOutPos++] = (uint8)nCode;
+			nPrevCode = nCode;
+			continue;
+		}
+		if (nCode > nNextCode || (nCode == nNextCode && nNextCode >= GIF_MAX_CODES))
+			break; // corrupt data
+
+		// Add new table entry: previous string plus first character of current string.
+		// If the current code is not yet in the table (KwKwK case) its first character is the one of the previous string.
+		if (nNextCode < GIF_MAX_CODES) {
+			prefix[nNextCode] = (uint16)nPrevCode;
+			suffix[nNextCode] = (nCode == nNextCode) ? first[nPrevCode] : first[nCode];
+			first[nNextCode] = first[nPrevCode];
+			length[nNextCode] = length[nPrevCode] + 1;
+			nNextCode++;
+			if (nNextCode > nCodeMask && nCodeSize < GIF_MAX_CODE_SIZE) {
+				nCodeSize++;
+				nCodeMask = (1 << nCodeSize) - 1;
+			}
+		}
+
+		// Output string of current code, written back to front by following the prefix chain
+		size_t nEndPos = nOutPos + length[nCode];
+		int nCurCode = nCode;
+		for (size_t i = nEndPos; i > nOutPos; i--) {
+			if (i - 1 < nOutSize)
+				pOut[i - 1] = suffix[nCurCode];
+			nCurCode = prefix[nCurCode];
+		}
+		nOutPos = min(nEndPos, nOutSize);
+		nPrevCode = nCode;
+	}
+	return nOutPos;
+}
+
+// Interlaced images store the rows in four passes: every 8th row from 0, every 8th from 4, every 4th from 2, every 2nd from 1
+static int InterlacedRow(int nSrcRow, int nHeight) {
+	static const int cPassStart[4] = { 0, 4, 2, 1 };
+	static const int cPassStep[4] = { 8, 8, 4, 2 };
+	for (int nPass = 0; nPass < 4; nPass++) {
+		int nRowsInPass = (nHeight - cPassStart[nPass] + cPassStep[nPass] - 1) / cPassStep[nPass];
+		if (nSrcRow < nRowsInPass)
+			return cPassStart[nPass] + nSrcRow * cPassStep[nPass];
+		nSrcRow -= nRowsInPass;
+	}
+	return nHeight;
+}
+
+void GifReader::DrawFrame(const gif_frame& frame, size_t num_decoded_pixels)
+{
+	uint32 palette[256];
+	for (int i = 0; i < 256; i++) {
+		if (i < frame.color_table_size) {
+			const uint8* pRGB = frame.color_table + 3 * i;
+			palette[i] = 0xFF000000 | (pRGB[0] << 16) | (pRGB[1] << 8) | pRGB[2];
+		} else {
+			palette[i] = 0xFF000000;
+		}
+	}
+
+	int nVisibleWidth = min(frame.width, cache.width - frame.x);
+	if (nVisibleWidth <= 0)
+		return;
+
+	int nNumRows = (int)((num_decoded_pixels + frame.width - 1) / frame.width);
+	for (int nSrcRow = 0; nSrcRow < nNumRows; nSrcRow++) {
+		int nRow = frame.interlaced ? InterlacedRow(nSrcRow, frame.height) : nSrcRow;
+		int nTargetY = frame.y + nRow;
+		if (nTargetY < cache.height) {
+			size_t nSrcOffset = (size_t)nSrcRow * frame.width;
+			const uint8* pSrc = cache.indices + nSrcOffset;
+			uint32* pDst = cache.canvas + (size_t)nTargetY * cache.width + frame.x;
+			int nCount = (int)min((size_t)nVisibleWidth, num_decoded_pixels - nSrcOffset);
+			if (frame.transparent_index < 0) {
+				for (int i = 0; i < nCount; i++)
+					pDst[i] = palette[pSrc[i]];
+			} else {
+				for (int i = 0; i < nCount; i++) {
+					if (pSrc[i] != frame.transparent_index)
+						pDst[i] = palette[pSrc[i]];
+				}
+			}
+		}
+	}
+}
+
+void GifReader::ComposeFrame(int frame_index)
+{
+	if (frame_index < cache.next_frame) {
+		// going back requires composing from the start
+		memset(cache.canvas, 0, (size_t)cache.width * cache.height * sizeof(uint32));
+		cache.next_frame = 0;
+	}
+	while (cache.next_frame <= frame_index) {
+		int nIndex = cache.next_frame;
+		if (nIndex > 0) {
+			// dispose the previous frame
+			const gif_frame& prevFrame = cache.frames[nIndex - 1];
+			if (prevFrame.disposal == 2) {
+				int nWidth = min(prevFrame.width, cache.width - prevFrame.x);
+				int nHeight = min(prevFrame.height, cache.height - prevFrame.y);
+				for (int y = 0; y < nHeight && nWidth > 0; y++)
+					memset(cache.canvas + (size_t)(prevFrame.y + y) * cache.width + prevFrame.x, 0, nWidth * sizeof(uint32));
+			} else if (prevFrame.disposal == 3 && cache.previous != NULL) {
+				memcpy(cache.canvas, cache.previous, (size_t)cache.width * cache.height * sizeof(uint32));
+			}
+		}
+		const gif_frame& frame = cache.frames[nIndex];
+		if (frame.disposal == 3 && cache.previous != NULL)
+			memcpy(cache.previous, cache.canvas, (size_t)cache.width * cache.height * sizeof(uint32));
+		DrawFrame(frame, DecodeLZW(frame));
+		cache.next_frame++;
+	}
+}
+
+void* GifReader::ReadImage(int& width,
+	int& height,
+	int& nchannels,
+	bool& has_animation,
+	int& frame_index,
+	int& frame_count,
+	int& frame_time,
+	bool& outOfMemory,
+	const void* buffer,
+	int sizebytes)
+{
+	outOfMemory = false;
+	width = height = 0;
+	nchannels = 4;
+	has_animation = false;
+	frame_count = 1;
+	frame_time = 0;
+
+	// Cache animations
+	if (cache.data == NULL) {
+		if (!BeginReading(buffer, sizebytes, outOfMemory)) {
+			DeleteCache();
+			return NULL;
+		}
+	}
+
+	frame_index = max(0, min(cache.frame_count - 1, frame_index));
+	ComposeFrame(frame_index);
+
+	width = cache.width;
+	height = cache.height;
+	frame_count = cache.frame_count;
+	has_animation = frame_count > 1;
+	frame_time = cache.frames[frame_index].delay_ms;
+
+	void* pPixelData;
+	if (!has_animation) {
+		// single frame, hand over the canvas
+		pPixelData = cache.canvas;
+		cache.canvas = NULL;
+		DeleteCache();
+	} else {
+		pPixelData = new(std::nothrow) uint8[(size_t)width * height * nchannels];
+		if (pPixelData == NULL) {
+			outOfMemory = true;
+			return NULL;
+		}
+		memcpy(pPixelData, cache.canvas, (size_t)width * height * nchannels);
+	}
+	return pPixelData;
+}
+
+void GifReader::DeleteCache() {
+	free(cache.data);
+	free(cache.frames);
+	CPixelMemory::Free(cache.canvas);
+	delete[] cache.previous;
+	delete[] cache.indices;
+	delete[] cache.lzw_data;
+	cache = { 0 };
+}
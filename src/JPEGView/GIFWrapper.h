@@ -0,0 +1,29 @@
+
+#pragma once
+
+class GifReader
+{
+public:
+	// Returns data in 4 byte BGRA, the frame is composed onto the logical screen (disposal and transparency applied)
+	static void* ReadImage(int& width,   // width of the image loaded.
+		int& height,  // height of the image loaded.
+		int& bpp,     // BYTES (not bits) PER PIXEL.
+		bool& has_animation,     // if the image is animated
+		int& frame_index, // index of frame, clamped to the valid range on return
+		int& frame_count, // number of frames
+		int& frame_time, // frame duration in milliseconds
+		bool& outOfMemory, // set to true when no memory to read image
+		const void* buffer, // memory address containing gif compressed data, ignored when an animation is cached
+		int sizebytes); // size of gif compressed data
+
+	static void DeleteCache();
+
+private:
+	struct gif_frame;
+	struct gif_cache;
+	static gif_cache cache;
+	static bool BeginReading(const void* buffer, int sizebytes, bool& outOfMemory);
+	static void ComposeFrame(int frame_index);
+	static size_t DecodeLZW(const gif_frame& frame);
+	static void DrawFrame(const gif_frame& frame, size_t num_decoded_pixels);
+};
@@ -2,8 +2,10 @@
 #include "Helpers.h"
 #include "immintrin.h"
 #include "NLS.h"
+#ifndef JPEGVIEW_PROCESSING_ONLY
 #include "MultiMonitorSupport.h"
 #include "JPEGImage.h"
+#endif
 #include "FileList.h"
 #include "SettingsProvider.h"
 #include <math.h>
@@ -251,6 +253,22 @@ GiveUp:
 #endif
 }
 
+CString CPUName(void) {
+	char sBrand[3 * 16 + 1];
+	memset(sBrand, 0, sizeof(sBrand));
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 0x80000000);
+	if ((unsigned int)cpuInfo[0] >= 0x80000004) {
+		for (int i = 0; i < 3; i++) {
+			__cpuid(cpuInfo, 0x80000002 + i);
+			memcpy(sBrand + 16 * i, cpuInfo, 16);
+		}
+	}
+	CString sCPUName(sBrand);
+	sCPUName.Trim();
+	return sCPUName.IsEmpty() ? CString(_T("Unknown CPU")) : sCPUName;
+}
+
 // returns if the CPU supports some form of hardware multiprocessing, e.g. hyperthreading or multicore
 static bool CPUSupportsHWMultiprocessing(void) {   
 	if (ProbeCPU() >= CPU_SSE) {
@@ -550,6 +568,7 @@ CSize GetTotalBorderSize() {
 	return CSize(nBorderWidth, nBorderHeight);
 }
 
+#ifndef JPEGVIEW_PROCESSING_ONLY
 CRect GetWindowRectMatchingImageSize(HWND hWnd, CSize minSize, CSize maxSize, double& dZoom, CJPEGImage* pImage, bool bForceCenterWindow, bool bKeepAspectRatio, bool bWindowBorderless) {
 	int nOrigWidth = (pImage == NULL) ? ::GetSystemMetrics(SM_CXSCREEN) / 2 : pImage->OrigWidth();
 	int nOrigWidthUnzoomed = nOrigWidth;
@@ -626,6 +645,7 @@ bool CanDisplayImageWithoutResize(HWND hWnd, CJPEGImage* pImage) {
 	CSize borderSize = GetTotalBorderSize();
 	return pImage->OrigWidth() + borderSize.cx <= workingArea.Width() && pImage->OrigHeight() + borderSize.cy <= workingArea.Height();
 }
+#endif
 
 CRect CalculateMaxIncludedRectKeepAR(const CTrapezoid& trapezoid, double dAspectRatio) {
 	int w1 = trapezoid.x1e - trapezoid.x1s;
@@ -655,11 +675,13 @@ CRect CalculateMaxIncludedRectKeepAR(const CTrapezoid& trapezoid, double dAspect
 	}
 }
 
+#ifndef JPEGVIEW_PROCESSING_ONLY
 CSize GetMaxClientSize(HWND hWnd) {
 	CRect workingArea = CMultiMonitorSupport::GetWorkingRect(hWnd);
 	CSize borderSize = GetTotalBorderSize();
 	return CSize(workingArea.Width() - borderSize.cx, workingArea.Height() - borderSize.cy);
 }
+#endif
 
 ETransitionEffect ConvertTransitionEffectFromString(LPCTSTR str) {
 	if (_tcsicmp(str, _T("Blend")) == 0) {
@@ -861,6 +883,7 @@ __int64 GetFileSize(HANDLE hFile) {
 	return fileSize;
 }
 
+#ifndef JPEGVIEW_PROCESSING_ONLY
 // Gets the frame index of the next frame, depending on the index of the last image (relevant if the image is a multiframe image)
 int GetFrameIndex(CJPEGImage* pImage, bool bNext, bool bPlayAnimation, bool & switchImage) {
 	bool isMultiFrame = pImage != NULL && pImage->NumberOfFrames() > 1;
@@ -959,6 +982,7 @@ CString GetFileInfoString(LPCTSTR sFormat, CJPEGImage* pImage, CFileList* pFilel
 	sFileInfo.TrimRight();
 	return sFileInfo;
 }
+#endif
 
 int GetWindowsVersion() {
 #pragma warning(push)
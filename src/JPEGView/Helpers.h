@@ -189,6 +189,9 @@ namespace Helpers {
 	// Tests if the CPU supports AVX2, SSE, MMX(2)
 	CPUType ProbeCPU(void);
 
+	// Brand name of the CPU as reported by the processor, "Unknown CPU" if not available
+	CString CPUName(void);
+
 	// Get number of cores per physical processor, not counting hyperthreading
 	int NumCoresPerPhysicalProc(void);
 
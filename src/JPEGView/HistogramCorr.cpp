@@ -33,17 +33,19 @@ CHistogram::CHistogram(const CJPEGImage & image, bool bUseOrigPixels)
 	m_bUseOrigPixels = bUseOrigPixels;
 	m_fNightshot = -1.0f;
 
-	int nWidth, nHeight, nChannels;
+	int nWidth, nHeight, nChannels, nLineSize;
 	const uint8* pSourcePixels;
 	if (bUseOrigPixels || image.DIBPixels() == NULL) {
 		nWidth = image.OrigWidth();
 		nHeight = image.OrigHeight();
 		nChannels = image.OriginalChannels();
+		nLineSize = image.OriginalStride();
 		pSourcePixels = (const uint8*)image.OriginalPixels();
 	} else {
 		nWidth = image.DIBWidth();
 		nHeight = image.DIBHeight();
 		nChannels = 4;
+		nLineSize = nWidth * 4;
 		pSourcePixels = (const uint8*)image.DIBPixels();
 	}
 	
@@ -51,7 +53,6 @@ CHistogram::CHistogram(const CJPEGImage & image, bool bUseOrigPixels)
 	int nGrid = (int) (0.5 + sqrt(1.0 + nNumPixels/NUM_VALUES));
 	int nPixPerLine = max(1, nWidth / nGrid);
 	int nLines = max(1, nHeight / nGrid);
-	int nLineSize = Helpers::DoPadding(nWidth * nChannels, 4);
 	for (int j = 0; j < nLines; j++) {
 		const uint8* pSrc = pSourcePixels + nLineSize*j*nGrid;
 		if (nChannels == 3) {
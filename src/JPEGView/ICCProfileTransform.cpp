@@ -2,6 +2,8 @@
 
 #include "ICCProfileTransform.h"
 #include "SettingsProvider.h"
+#include "ProcessingThreadPool.h"
+#include "Helpers.h"
 
 
 #ifndef WINXP
@@ -14,10 +16,160 @@
 
 void* ICCProfileTransform::sRGBProfile = NULL;
 
+// Number of transforms kept in the cache while not used by any image
+#define MAX_UNUSED_TRANSFORMS 8
+
+// Request for transforming an image in strips on the processing thread pool
+class CRequestICCTransform : public CProcessingRequest {
+public:
+	CRequestICCTransform(void* transform, const void* pSourcePixels, void* pTargetPixels, CSize size, int nSourceStride, int nTargetStride)
+		: CProcessingRequest(pSourcePixels, size, pTargetPixels, size, CPoint(0, 0), size) {
+		Transform = transform;
+		SourceStride = nSourceStride;
+		TargetStride = nTargetStride;
+	}
+
+	virtual bool ProcessStrip(int offsetY, int sizeY) {
+		const uint8* pSource = (const uint8*)SourcePixels + (size_t)offsetY * SourceStride;
+		uint8* pTarget = (uint8*)TargetPixels + (size_t)offsetY * TargetStride;
+		cmsDoTransformLineStride(Transform, pSource, pTarget, SourceSize.cx, sizeY, SourceStride, TargetStride, SourceStride * sizeY, TargetStride * sizeY);
+		return true;
+	}
+
+	void* Transform;
+	int SourceStride;
+	int TargetStride;
+};
+
+// LRU cache of color transforms. Images carrying the same profile (e.g. sRGB or Display P3) share the transform.
+// Transforms are reference counted, unused transforms are deleted when there are too many of them.
+class CTransformCache {
+public:
+	CTransformCache() {
+		::InitializeCriticalSection(&m_csList);
+	}
+
+	~CTransformCache() {
+		std::list<CEntry*>::iterator iter;
+		for (iter = m_list.begin(); iter != m_list.end(); iter++) {
+			cmsDeleteTransform((*iter)->Transform);
+			delete[] (*iter)->Profile;
+			delete (*iter);
+		}
+		::DeleteCriticalSection(&m_csList);
+	}
+
+	// Gets the cached transform for this profile and pixel format and increments its reference count, NULL if not cached
+	void* Find(const void* profile, unsigned int size, ICCProfileTransform::PixelFormat format) {
+		unsigned __int64 nHash = Hash(profile, size);
+		Helpers::CAutoCriticalSection autoCriticalSection(m_csList);
+		std::list<CEntry*>::iterator iter;
+		for (iter = m_list.begin(); iter != m_list.end(); iter++) {
+			CEntry* pEntry = *iter;
+			if (pEntry->Hash == nHash && pEntry->ProfileSize == size && pEntry->Format == format && (size == 0 || memcmp(pEntry->Profile, profile, size) == 0)) {
+				pEntry->RefCnt++;
+				m_list.erase(iter);
+				m_list.push_front(pEntry); // move to top in list
+				return pEntry->Transform;
+			}
+		}
+		return NULL;
+	}
+
+	// Adds a newly created transform with a reference count of one. Returns false if out of memory.
+	bool Add(const void* profile, unsigned int size, ICCProfileTransform::PixelFormat format, void* transform) {
+		CEntry* pEntry = new(std::nothrow) CEntry;
+		uint8* pProfileCopy = (size == 0) ? NULL : new(std::nothrow) uint8[size];
+		if (pEntry == NULL || (size != 0 && pProfileCopy == NULL)) {
+			delete pEntry;
+			return false;
+		}
+		if (size != 0) {
+			memcpy(pProfileCopy, profile, size);
+		}
+		pEntry->Hash = Hash(profile, size);
+		pEntry->Profile = pProfileCopy;
+		pEntry->ProfileSize = size;
+		pEntry->Format = format;
+		pEntry->Transform = transform;
+		pEntry->RefCnt = 1;
+		Helpers::CAutoCriticalSection autoCriticalSection(m_csList);
+		m_list.push_front(pEntry);
+		return true;
+	}
+
+	// Decrements the reference count of the transform. Returns false if the transform is not in the cache.
+	bool Release(void* transform) {
+		Helpers::CAutoCriticalSection autoCriticalSection(m_csList);
+		bool bFound = false;
+		int nUnused = 0;
+		std::list<CEntry*>::iterator iter;
+		for (iter = m_list.begin(); iter != m_list.end(); iter++) {
+			if ((*iter)->Transform == transform && !bFound) {
+				(*iter)->RefCnt--;
+				bFound = true;
+			}
+			if ((*iter)->RefCnt <= 0) {
+				nUnused++;
+			}
+		}
+		// cache too large - free the least recently used transforms that are no longer referenced
+		iter = m_list.end();
+		while (nUnused > MAX_UNUSED_TRANSFORMS && iter != m_list.begin()) {
+			iter--;
+			if ((*iter)->RefCnt <= 0) {
+				cmsDeleteTransform((*iter)->Transform);
+				delete[] (*iter)->Profile;
+				delete (*iter);
+				iter = m_list.erase(iter);
+				nUnused--;
+			}
+		}
+		return bFound;
+	}
+
+private:
+	struct CEntry {
+		unsigned __int64 Hash;
+		uint8* Profile; // copy of the profile, used to verify that a matching hash is not a collision
+		unsigned int ProfileSize;
+		ICCProfileTransform::PixelFormat Format;
+		void* Transform;
+		int RefCnt;
+	};
+
+	CRITICAL_SECTION m_csList; // access to list must be thread safe
+	std::list<CEntry*> m_list;
+
+	// 64 bit FNV-1a hash of the profile
+	static unsigned __int64 Hash(const void* profile, unsigned int size) {
+		const uint8* p = (const uint8*)profile;
+		unsigned __int64 nHash = 14695981039346656037ULL;
+		for (unsigned int i = 0; i < size; i++) {
+			nHash = (nHash ^ p[i]) * 1099511628211ULL;
+		}
+		return nHash;
+	}
+};
+
+static CTransformCache s_transformCache;
+
+// Adds the transform to the cache, the transform is deleted if it cannot be cached
+static void* AddToCache(const void* profile, unsigned int size, ICCProfileTransform::PixelFormat format, void* transform) {
+	if (transform != NULL && !s_transformCache.Add(profile, size, format, transform)) {
+		cmsDeleteTransform(transform);
+		return NULL;
+	}
+	return transform;
+}
+
 void* ICCProfileTransform::CreateTransform(const void* profile, unsigned int size, PixelFormat format)
 {
 	if (profile == NULL || size == 0)
 		return NULL; // No ICC Profile
+	void* cachedTransform = s_transformCache.Find(profile, size, format);
+	if (cachedTransform != NULL)
+		return cachedTransform;
 	if (sRGBProfile == NULL) {
 		try {
 			sRGBProfile = cmsCreate_sRGBProfile();
@@ -55,7 +207,7 @@ void* ICCProfileTransform::CreateTransform(const void* profile, unsigned int siz
 	}
 	cmsHTRANSFORM transform = cmsCreateTransform(hInProfile, inFormat, sRGBProfile, outFormat, INTENT_RELATIVE_COLORIMETRIC, flags);
 	cmsCloseProfile(hInProfile);
-	return transform;
+	return AddToCache(profile, size, format, transform);
 }
 
 bool ICCProfileTransform::DoTransform(void* transform, const void* inputBuffer, void* outputBuffer, unsigned int width, unsigned int height, unsigned int stride)
@@ -81,17 +233,27 @@ bool ICCProfileTransform::DoTransform(void* transform, const void* inputBuffer,
 	}
 	if (stride == 0)
 		stride = width * nchannels;
-	cmsDoTransformLineStride(transform, inputBuffer, outputBuffer, width, height, stride, Helpers::DoPadding(width * nchannels, 4), stride * height, Helpers::DoPadding(width * nchannels, 4) * height);
-	return true;
+	unsigned int outStride = Helpers::DoPadding(width * nchannels, 4);
+	if (inputBuffer == outputBuffer && stride != outStride) {
+		// in-place transform with differing strides, rows must be processed in order
+		cmsDoTransformLineStride(transform, inputBuffer, outputBuffer, width, height, stride, outStride, stride * height, outStride * height);
+		return true;
+	}
+	CRequestICCTransform request(transform, inputBuffer, outputBuffer, CSize(width, height), stride, outStride);
+	return CProcessingThreadPool::This().Process(&request);
 }
 
 void ICCProfileTransform::DeleteTransform(void* transform)
 {
-	if (transform != NULL)
+	if (transform != NULL && !s_transformCache.Release(transform))
 		cmsDeleteTransform(transform);
 }
 
 void* ICCProfileTransform::CreateLabTransform(PixelFormat format) {
+	void* cachedTransform = s_transformCache.Find(NULL, 0, format);
+	if (cachedTransform != NULL)
+		return cachedTransform;
+
 	cmsHTRANSFORM transform = NULL;
 	cmsHPROFILE hLabProfile = NULL;
 	try {
@@ -122,7 +284,7 @@ void* ICCProfileTransform::CreateLabTransform(PixelFormat format) {
 	}
 	transform = cmsCreateTransform(hLabProfile, inFormat, sRGBProfile, outFormat, INTENT_RELATIVE_COLORIMETRIC, flags);
 	cmsCloseProfile(hLabProfile);
-	return transform;
+	return AddToCache(NULL, 0, format, transform);
 }
 
 #else
@@ -13,6 +13,8 @@ public:
 	};
 
 	// Create a transform from given ICC Profile to standard sRGB color space.
+	// Transforms are cached by profile content and pixel format, images carrying the same profile share the transform.
+	// Each call must be paired with a call to DeleteTransform().
 	static void* CreateTransform(
 		const void* profile, // pointer to ICC profile
 		unsigned int size, // size of ICC profile in bytes
@@ -20,6 +22,7 @@ public:
 	);
 
 	// Apply color transform to image. Returns true on success, false otherwise.
+	// Large images are transformed in strips on the processing thread pool.
 	static bool DoTransform(
 		void* transform, // ICCP transform
 		const void* inputBuffer, // 4-byte BGRA or RGBA input depending on transform pixel format
@@ -29,9 +32,10 @@ public:
 		unsigned int stride=0 // number of bytes per row of pixels in the input, only needed if not equal to width * 4
 	);
 
-	// Free memory associated with the given transform
+	// Release the given transform. The transform stays in the cache for reuse until the cache gets too large.
 	static void DeleteTransform(void* transform);
 
+	// Create a transform from CIELAB D50 to sRGB, must be released with DeleteTransform()
 	static void* CreateLabTransform(PixelFormat format);
 
 private:
@@ -0,0 +1,62 @@
+#include "StdAfx.h"
+#include "ImageAnalysisThread.h"
+#include "LocalDensityCorr.h"
+#include "MessageDef.h"
+
+CImageAnalysisThread* CImageAnalysisThread::sm_instance;
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Public
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+CImageAnalysisThread& CImageAnalysisThread::This() {
+	if (sm_instance == NULL) {
+		sm_instance = new CImageAnalysisThread();
+		atexit(&Delete);
+	}
+	return *sm_instance;
+}
+
+void CImageAnalysisThread::NotifyAnalysisFinished() {
+	if (m_hNotificationWnd != NULL) {
+		::PostMessage(m_hNotificationWnd, WM_IMAGE_ANALYSIS_FINISHED, 0, 0);
+	}
+}
+
+CImageAnalysisRequest* CImageAnalysisThread::AsyncAnalyze(const CJPEGImage* pImage, bool bFullAnalysis, int nSourceRotation) {
+	CImageAnalysisRequest* pRequest = new CImageAnalysisRequest(pImage, bFullAnalysis, nSourceRotation);
+	ProcessAsync(pRequest);
+	return pRequest;
+}
+
+CLocalDensityCorr* CImageAnalysisThread::WaitForResult(CImageAnalysisRequest* pRequest) {
+	::WaitForSingleObject(pRequest->EventFinished, INFINITE);
+	CLocalDensityCorr* pResult = pRequest->Result;
+	pRequest->Deleted = true; // the worker thread removes the request from its queue
+	return pResult;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Protected
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+void CImageAnalysisThread::ProcessRequest(CRequestBase& request) {
+	CImageAnalysisRequest& rq = (CImageAnalysisRequest&)request;
+	try {
+		rq.Result = new CLocalDensityCorr(*rq.Image, rq.FullAnalysis, rq.SourceRotation);
+	} catch (...) {
+		rq.Result = NULL;
+	}
+}
+
+void CImageAnalysisThread::AfterFinishProcess(CRequestBase& request) {
+	NotifyAnalysisFinished();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Private
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+CImageAnalysisThread::CImageAnalysisThread(void) : CWorkThread(false) {
+	m_hNotificationWnd = NULL;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "WorkThread.h"
+
+class CJPEGImage;
+class CLocalDensityCorr;
+
+// Request for the analysis of an image, see CImageAnalysisThread
+class CImageAnalysisRequest : public CRequestBase {
+public:
+	CImageAnalysisRequest(const CJPEGImage* pImage, bool bFullAnalysis, int nSourceRotation) : CRequestBase(::CreateEvent(NULL, TRUE, FALSE, NULL)) {
+		Image = pImage;
+		FullAnalysis = bFullAnalysis;
+		SourceRotation = nSourceRotation;
+		Result = NULL;
+	}
+
+	~CImageAnalysisRequest() {
+		::CloseHandle(EventFinished);
+	}
+
+	const CJPEGImage* Image;
+	bool FullAnalysis; // also the LDC map and the sunset detection, else only point sampled image, histogram and pixel hash
+	int SourceRotation; // see CLocalDensityCorr constructor
+	CLocalDensityCorr* Result; // NULL if the analysis failed
+};
+
+// Thread analyzing newly created images in the background (histogram, pixel hash, sunset detection and LDC map),
+// thus the loader can process and show the image without waiting for the analysis. The message WM_IMAGE_ANALYSIS_FINISHED
+// is posted to the notification window when an analysis has finished.
+class CImageAnalysisThread : public CWorkThread
+{
+public:
+	// Singleton instance. Creation is not thread safe, create it before the image load threads.
+	static CImageAnalysisThread& This();
+
+	// Sets the window receiving the WM_IMAGE_ANALYSIS_FINISHED message, NULL if none
+	void SetNotificationWindow(HWND hWnd) { m_hNotificationWnd = hWnd; }
+
+	// Posts WM_IMAGE_ANALYSIS_FINISHED to the notification window, also for images analyzed synchronously
+	void NotifyAnalysisFinished();
+
+	// Starts the analysis of the image, its original pixels must not be modified until the analysis is finished.
+	// The returned request must be passed to WaitForResult().
+	CImageAnalysisRequest* AsyncAnalyze(const CJPEGImage* pImage, bool bFullAnalysis, int nSourceRotation);
+
+	// Returns if the analysis has finished, WaitForResult() does not block then
+	static bool IsFinished(CImageAnalysisRequest* pRequest) { return ::WaitForSingleObject(pRequest->EventFinished, 0) == WAIT_OBJECT_0; }
+
+	// Waits until the analysis is finished and returns the fully constructed LDC object, the caller takes ownership.
+	// The request is deleted and must not be accessed anymore.
+	static CLocalDensityCorr* WaitForResult(CImageAnalysisRequest* pRequest);
+
+protected:
+	virtual void ProcessRequest(CRequestBase& request);
+	virtual void AfterFinishProcess(CRequestBase& request);
+
+private:
+	static CImageAnalysisThread* sm_instance;
+	HWND m_hNotificationWnd;
+
+	CImageAnalysisThread(void);
+	static void Delete() { delete sm_instance; }
+};
@@ -0,0 +1,32 @@
+#include "StdAfx.h"
+#include "ImageCompressThread.h"
+#include "JPEGImage.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Public
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+CImageCompressThread::CImageCompressThread(void) : CWorkThread(false) {
+}
+
+void CImageCompressThread::AsyncCompress(CJPEGImage* pImage, HANDLE eventFinished) {
+	ProcessAsync(new CRequest(pImage, eventFinished));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Protected
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+void CImageCompressThread::ProcessRequest(CRequestBase& request) {
+	CRequest& rq = (CRequest&)request;
+	try {
+		rq.Image->CompressOriginalPixels();
+	} catch (...) {
+		// the image keeps its original pixels
+	}
+}
+
+void CImageCompressThread::AfterFinishProcess(CRequestBase& request) {
+	// the caller waits for the event and never queries the request
+	request.Deleted = true;
+}
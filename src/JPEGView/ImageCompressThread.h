@@ -0,0 +1,31 @@
+#pragma once
+
+#include "WorkThread.h"
+
+class CJPEGImage;
+
+// Thread compressing the original pixels of the images moved to the second tier of the JPEG provider
+class CImageCompressThread : public CWorkThread
+{
+public:
+	CImageCompressThread(void);
+
+	// Asynchronous compression of the original pixels of the image, see CJPEGImage::CompressOriginalPixels().
+	// The given event is signaled when finished, the image must not be accessed or deleted before.
+	void AsyncCompress(CJPEGImage* pImage, HANDLE eventFinished);
+
+protected:
+	virtual void ProcessRequest(CRequestBase& request);
+	virtual void AfterFinishProcess(CRequestBase& request);
+
+private:
+	// Request for compressing an image
+	class CRequest : public CRequestBase {
+	public:
+		CRequest(CJPEGImage* pImage, HANDLE eventFinished) : CRequestBase(eventFinished) {
+			Image = pImage;
+		}
+
+		CJPEGImage* Image;
+	};
+};
@@ -11,7 +11,11 @@
 #include "BasicProcessing.h"
 #include "dcraw_mod.h"
 #include "TJPEGWrapper.h"
+#include "YCbCrImage.h"
+#include "PixelMemory.h"
+#include "FileCache.h"
 #include "PNGWrapper.h"
+#include "GIFWrapper.h"
 #ifndef WINXP
 #include "JXLWrapper.h"
 #include "HEIFWrapper.h"
@@ -22,6 +26,7 @@
 #include "QOIWrapper.h"
 #include "PSDWrapper.h"
 #include "MaxImageDef.h"
+#include "Tracing.h"
 
 
 using namespace Gdiplus;
@@ -219,12 +224,34 @@ static CJPEGImage* ConvertGDIPlusBitmapToJPEGImage(Gdiplus::Bitmap* pBitmap, int
 	return pJPEGImage;
 }
 
+// Multiplies the alpha value into each AABBGGRR pixel and rotates the pixels by the EXIF orientation in the same pass.
+// nRotation returns the rotation applied, nWidth and nHeight are updated to the size of the rotated pixels.
+// If the returned pixels are not pPixels, the caller must free pPixels.
+static void* AlphaBlendAndRotateByEXIF(void* pPixels, int& nWidth, int& nHeight, void* pEXIFData, EImageFormat eImageFormat, int& nRotation) {
+	COLORREF backgroundColor = CSettingsProvider::This().ColorTransparency();
+	nRotation = CJPEGImage::GetRotationFromEXIF(pEXIFData, eImageFormat, nWidth, nHeight);
+	void* pBlendedPixels = CBasicProcessing::AlphaBlendRotate32bpp(nWidth, nHeight, pPixels, backgroundColor, nRotation);
+	if (pBlendedPixels == NULL) {
+		// no memory for the rotated copy, blend in place
+		nRotation = 0;
+		return CBasicProcessing::AlphaBlendRotate32bpp(nWidth, nHeight, pPixels, backgroundColor, 0);
+	}
+	if (nRotation == 90 || nRotation == 270) {
+		int nTemp = nWidth;
+		nWidth = nHeight;
+		nHeight = nTemp;
+	}
+	return pBlendedPixels;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Public
 /////////////////////////////////////////////////////////////////////////////////////////////
 
 CImageLoadThread::CImageLoadThread(void) : CWorkThread(true) {
 	m_pLastBitmap = NULL;
+	// the file cache is shared by all load threads, create it before any request can reach them
+	CFileCache::This();
 }
 
 CImageLoadThread::~CImageLoadThread(void) {
@@ -233,10 +260,25 @@ CImageLoadThread::~CImageLoadThread(void) {
 	DeleteCachedPngDecoder();
 	DeleteCachedJxlDecoder();
 	DeleteCachedAvifDecoder();
+	DeleteCachedGifDecoder();
+}
+
+CFileStamp CFileStamp::OfFile(LPCTSTR sFileName) {
+	CFileStamp stamp;
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (::GetFileAttributesEx(sFileName, GetFileExInfoStandard, &attributes)) {
+		stamp.Size = ((__int64)attributes.nFileSizeHigh << 32) + attributes.nFileSizeLow;
+		stamp.LastWriteTime = attributes.ftLastWriteTime;
+	}
+	return stamp;
 }
 
-int CImageLoadThread::AsyncLoad(LPCTSTR strFileName, int nFrameIndex, const CProcessParams & processParams, HWND targetWnd, HANDLE eventFinished) {
+int CImageLoadThread::AsyncLoad(LPCTSTR strFileName, int nFrameIndex, const CProcessParams & processParams, HWND targetWnd, HANDLE eventFinished,
+								const CFileStamp* pKnownFileStamp) {
 	CRequest* pRequest = new CRequest(strFileName, nFrameIndex, targetWnd, processParams, eventFinished);
+	if (pKnownFileStamp != NULL) {
+		pRequest->KnownFileStamp = *pKnownFileStamp;
+	}
 
 	ProcessAsync(pRequest);
 
@@ -248,6 +290,8 @@ CImageData CImageLoadThread::GetLoadedImage(int nHandle) {
 	CJPEGImage* imageFound = NULL;
 	bool bFailedMemory = false;
 	bool bFailedException = false;
+	bool bUnchanged = false;
+	CFileStamp fileStamp;
 	std::list<CRequestBase*>::iterator iter;
 	for (iter = m_requestList.begin( ); iter != m_requestList.end( ); iter++ ) {
 		CRequest* pRequest = (CRequest*)(*iter);
@@ -255,12 +299,14 @@ CImageData CImageLoadThread::GetLoadedImage(int nHandle) {
 			imageFound = pRequest->Image;
 			bFailedMemory = pRequest->OutOfMemory;
 			bFailedException = pRequest->ExceptionError;
+			bUnchanged = pRequest->Unchanged;
+			fileStamp = pRequest->FileStamp;
 			// only mark as deleted
 			pRequest->Deleted = true;
 			break;
 		}
 	}
-	return CImageData(imageFound, bFailedMemory, bFailedException);
+	return CImageData(imageFound, bFailedMemory, bFailedException, bUnchanged, fileStamp);
 }
 
 void CImageLoadThread::ReleaseFile(LPCTSTR strFileName) {
@@ -291,11 +337,22 @@ void CImageLoadThread::ProcessRequest(CRequestBase& request) {
 		if (rq.FileName == m_sLastAvifFileName) {
 			DeleteCachedAvifDecoder();
 		}
+		if (rq.FileName == m_sLastGifFileName) {
+			DeleteCachedGifDecoder();
+		}
+		CFileCache::This().Remove(rq.FileName);
 		return;
 	}
 
 	CRequest& rq = (CRequest&)request;
+	// taken before reading, a change of the file while reading makes the stamp outdated rather than wrong
+	rq.FileStamp = CFileStamp::OfFile(rq.FileName);
+	if (rq.KnownFileStamp.IsValid() && rq.FileStamp == rq.KnownFileStamp) {
+		rq.Unchanged = true;
+		return;
+	}
 	double dStartTime = Helpers::GetExactTickCount(); 
+	rq.LastLapTickCount = dStartTime;
 	// Get image format and read the image
 	switch (GetImageFormat(rq.FileName)) {
 		case IF_JPEG :
@@ -304,6 +361,7 @@ void CImageLoadThread::ProcessRequest(CRequestBase& request) {
 			DeleteCachedPngDecoder();
 			DeleteCachedJxlDecoder();
 			DeleteCachedAvifDecoder();
+			DeleteCachedGifDecoder();
 			ProcessReadJPEGRequest(&rq);
 			break;
 		case IF_WindowsBMP :
@@ -312,6 +370,7 @@ void CImageLoadThread::ProcessRequest(CRequestBase& request) {
 			DeleteCachedPngDecoder();
 			DeleteCachedJxlDecoder();
 			DeleteCachedAvifDecoder();
+			DeleteCachedGifDecoder();
 			ProcessReadBMPRequest(&rq);
 			break;
 		case IF_TGA :
@@ -320,6 +379,7 @@ void CImageLoadThread::ProcessRequest(CRequestBase& request) {
 			DeleteCachedPngDecoder();
 			DeleteCachedJxlDecoder();
 			DeleteCachedAvifDecoder();
+			DeleteCachedGifDecoder();
 			ProcessReadTGARequest(&rq);
 			break;
 		case IF_WEBP:
@@ -327,6 +387,7 @@ void CImageLoadThread::ProcessRequest(CRequestBase& request) {
 			DeleteCachedPngDecoder();
 			DeleteCachedJxlDecoder();
 			DeleteCachedAvifDecoder();
+			DeleteCachedGifDecoder();
 			ProcessReadWEBPRequest(&rq);
 			break;
 		case IF_PNG:
@@ -334,14 +395,24 @@ void CImageLoadThread::ProcessRequest(CRequestBase& request) {
 			DeleteCachedWebpDecoder();
 			DeleteCachedJxlDecoder();
 			DeleteCachedAvifDecoder();
+			DeleteCachedGifDecoder();
 			ProcessReadPNGRequest(&rq);
 			break;
+		case IF_GIF:
+			DeleteCachedGDIBitmap();
+			DeleteCachedWebpDecoder();
+			DeleteCachedPngDecoder();
+			DeleteCachedJxlDecoder();
+			DeleteCachedAvifDecoder();
+			ProcessReadGIFRequest(&rq);
+			break;
 #ifndef WINXP
 		case IF_JXL:
 			DeleteCachedGDIBitmap();
 			DeleteCachedWebpDecoder();
 			DeleteCachedPngDecoder();
 			DeleteCachedAvifDecoder();
+			DeleteCachedGifDecoder();
 			ProcessReadJXLRequest(&rq);
 			break;
 		case IF_AVIF:
@@ -349,6 +420,7 @@ void CImageLoadThread::ProcessRequest(CRequestBase& request) {
 			DeleteCachedWebpDecoder();
 			DeleteCachedPngDecoder();
 			DeleteCachedJxlDecoder();
+			DeleteCachedGifDecoder();
 			ProcessReadAVIFRequest(&rq);
 			break;
 		case IF_HEIF:
@@ -357,6 +429,7 @@ void CImageLoadThread::ProcessRequest(CRequestBase& request) {
 			DeleteCachedPngDecoder();
 			DeleteCachedJxlDecoder();
 			DeleteCachedAvifDecoder();
+			DeleteCachedGifDecoder();
 			ProcessReadHEIFRequest(&rq);
 			break;
 		case IF_PSD:
@@ -365,6 +438,7 @@ void CImageLoadThread::ProcessRequest(CRequestBase& request) {
 			DeleteCachedPngDecoder();
 			DeleteCachedJxlDecoder();
 			DeleteCachedAvifDecoder();
+			DeleteCachedGifDecoder();
 			ProcessReadPSDRequest(&rq);
 			break;
 		case IF_CameraRAW:
@@ -373,6 +447,7 @@ void CImageLoadThread::ProcessRequest(CRequestBase& request) {
 			DeleteCachedPngDecoder();
 			DeleteCachedJxlDecoder();
 			DeleteCachedAvifDecoder();
+			DeleteCachedGifDecoder();
 			ProcessReadRAWRequest(&rq);
 			break;
 #endif
@@ -382,6 +457,7 @@ void CImageLoadThread::ProcessRequest(CRequestBase& request) {
 			DeleteCachedPngDecoder();
 			DeleteCachedJxlDecoder();
 			DeleteCachedAvifDecoder();
+			DeleteCachedGifDecoder();
 			ProcessReadQOIRequest(&rq);
 			break;
 		case IF_WIC:
@@ -390,6 +466,7 @@ void CImageLoadThread::ProcessRequest(CRequestBase& request) {
 			DeleteCachedPngDecoder();
 			DeleteCachedJxlDecoder();
 			DeleteCachedAvifDecoder();
+			DeleteCachedGifDecoder();
 			ProcessReadWICRequest(&rq);
 			break;
 		default:
@@ -398,16 +475,27 @@ void CImageLoadThread::ProcessRequest(CRequestBase& request) {
 			DeleteCachedPngDecoder();
 			DeleteCachedJxlDecoder();
 			DeleteCachedAvifDecoder();
+			DeleteCachedGifDecoder();
 			ProcessReadGDIPlusRequest(&rq);
 			break;
 	}
+	CTracing::AddEvent("Decode", dStartTime, "frame", rq.FrameIndex);
 	// then process the image if read was successful
 	if (rq.Image != NULL) {
+		// the readers not reporting their stages and the cleanup after creating the image are counted as decoding
+		rq.Lap(LoadStage_Decode);
+		// EXIF is parsed when constructing the image
+		double dEXIFParseTime = min(rq.Image->GetEXIFParseTickCount(), rq.StageTickCounts[LoadStage_ImageCreation]);
+		rq.StageTickCounts[LoadStage_ImageCreation] -= dEXIFParseTime;
+		rq.StageTickCounts[LoadStage_EXIF] += dEXIFParseTime;
 		rq.Image->SetLoadTickCount(Helpers::GetExactTickCount() - dStartTime); 
 		if (!ProcessImageAfterLoad(&rq)) {
 			delete rq.Image;
 			rq.Image = NULL;
 			rq.OutOfMemory = true;
+		} else {
+			rq.Lap(LoadStage_ProcessAfterLoad);
+			rq.Image->SetLoadStageTickCounts(rq.StageTickCounts);
 		}
 	}
 }
@@ -429,6 +517,23 @@ void CImageLoadThread::AfterFinishProcess(CRequestBase& request) {
 // Private
 /////////////////////////////////////////////////////////////////////////////////////////////
 
+// Reads the whole file into pBuffer. Files read recently are copied from the file cache instead of reading them again.
+static bool ReadFileCached(HANDLE hFile, LPCTSTR sFileName, void* pBuffer, long long nFileSize) {
+	FILETIME lastWriteTime;
+	bool bHasWriteTime = ::GetFileTime(hFile, NULL, NULL, &lastWriteTime) != FALSE;
+	if (bHasWriteTime && CFileCache::This().Read(sFileName, nFileSize, lastWriteTime, pBuffer)) {
+		return true;
+	}
+	unsigned int nNumBytesRead;
+	if (!::ReadFile(hFile, pBuffer, (DWORD)nFileSize, (LPDWORD)&nNumBytesRead, NULL) || nNumBytesRead != nFileSize) {
+		return false;
+	}
+	if (bHasWriteTime) {
+		CFileCache::This().Add(sFileName, nFileSize, lastWriteTime, pBuffer);
+	}
+	return true;
+}
+
 static void LimitOffsets(CPoint& offsets, CSize clippingSize, const CSize & imageSize) {
 	int nMaxOffsetX = (imageSize.cx - clippingSize.cx)/2;
 	nMaxOffsetX = max(0, nMaxOffsetX);
@@ -477,6 +582,11 @@ void CImageLoadThread::DeleteCachedAvifDecoder() {
 #endif
 }
 
+void CImageLoadThread::DeleteCachedGifDecoder() {
+	GifReader::DeleteCache();
+	m_sLastGifFileName.Empty();
+}
+
 void CImageLoadThread::ProcessReadJPEGRequest(CRequest * request) {
 	HANDLE hFile = ::CreateFile(request->FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
 	if (hFile == INVALID_HANDLE_VALUE) {
@@ -501,9 +611,14 @@ void CImageLoadThread::ProcessReadJPEGRequest(CRequest * request) {
 			::CloseHandle(hFile);
 			return;
 		}
-		unsigned int nNumBytesRead;
-		if (::ReadFile(hFile, pBuffer, nFileSize, (LPDWORD) &nNumBytesRead, NULL) && nNumBytesRead == nFileSize) {
+		if (ReadFileCached(hFile, request->FileName, pBuffer, nFileSize)) {
+			request->Lap(LoadStage_FileRead);
+#ifndef WINXP
+			// Embedded color profiles are applied by TurboJpeg, GDI+ is only used when forced
+			bool bUseGDIPlus = CSettingsProvider::This().ForceGDIPlus();
+#else
 			bool bUseGDIPlus = CSettingsProvider::This().ForceGDIPlus() || CSettingsProvider::This().UseEmbeddedColorProfiles();
+#endif
 			if (bUseGDIPlus) {
 				IStream* pStream = NULL;
 				if (::CreateStreamOnHGlobal(hFileBuffer, FALSE, &pStream) == S_OK) {
@@ -524,10 +639,41 @@ void CImageLoadThread::ProcessReadJPEGRequest(CRequest * request) {
 			if (!bUseGDIPlus || request->OutOfMemory) {
 				int nWidth, nHeight, nBPP;
 				TJSAMP eChromoSubSampling;
-				bool bOutOfMemory;
+				bool bOutOfMemory = false;
 				// int nTicks = ::GetTickCount();
 
-				void* pPixelData = TurboJpeg::ReadImage(nWidth, nHeight, nBPP, eChromoSubSampling, bOutOfMemory, pBuffer, nFileSize);
+				void* pPixelData = NULL;
+				CYCbCrImage* pYCbCrPixels = NULL;
+				void* pEXIFData = Helpers::FindEXIFBlock(pBuffer, nFileSize);
+				request->Lap(LoadStage_EXIF);
+				bool bKeepYCbCr = CSettingsProvider::This().KeepJPEGAsYCbCr();
+				// Images rotated by EXIF are converted from the planar pixels directly into the rotated layout
+				int nRotation = 0;
+				if (pEXIFData != NULL && TurboJpeg::ReadImageSize(nWidth, nHeight, pBuffer, nFileSize)) {
+					nRotation = CJPEGImage::GetRotationFromEXIF(pEXIFData, IF_JPEG, nWidth, nHeight);
+				}
+				if (bKeepYCbCr || nRotation != 0) {
+					// keep the planar pixels so that the BGR pixels can be released while the image is not displayed
+					pYCbCrPixels = TurboJpeg::ReadImageYCbCr(nWidth, nHeight, eChromoSubSampling, bOutOfMemory, pBuffer, nFileSize);
+					if (pYCbCrPixels != NULL) {
+						pYCbCrPixels->SetRotation(nRotation);
+						nWidth = pYCbCrPixels->Width();
+						nHeight = pYCbCrPixels->Height();
+						nBPP = 3;
+						pPixelData = pYCbCrPixels->ConvertToBGR(nBPP);
+						if (pPixelData == NULL) {
+							bOutOfMemory = true;
+						}
+						if (pPixelData == NULL || !bKeepYCbCr) {
+							delete pYCbCrPixels;
+							pYCbCrPixels = NULL;
+						}
+					}
+				}
+				if (pPixelData == NULL && !bOutOfMemory) {
+					nRotation = 0;
+					pPixelData = TurboJpeg::ReadImage(nWidth, nHeight, nBPP, eChromoSubSampling, bOutOfMemory, pBuffer, nFileSize);
+				}
 				
 				/*
 				TCHAR buffer[20];
@@ -535,18 +681,20 @@ void CImageLoadThread::ProcessReadJPEGRequest(CRequest * request) {
 				::MessageBox(NULL, CString(_T("Elapsed ticks: ")) + buffer, _T("Time"), MB_OK);
 				*/
 
+				request->Lap(LoadStage_Decode);
 				// Color and b/w JPEG is supported
 				if (pPixelData != NULL && (nBPP == 3 || nBPP == 1)) {
-					request->Image = new CJPEGImage(nWidth, nHeight, pPixelData, 
-						Helpers::FindEXIFBlock(pBuffer, nFileSize), nBPP, 
-						Helpers::CalculateJPEGFileHash(pBuffer, nFileSize), IF_JPEG, false, 0, 1, 0);
+					request->Image = new CJPEGImage(nWidth, nHeight, pPixelData, pEXIFData, nBPP, 
+						Helpers::CalculateJPEGFileHash(pBuffer, nFileSize), IF_JPEG, false, 0, 1, 0, NULL, false, NULL, nRotation);
 					request->Image->SetJPEGComment(Helpers::GetJPEGComment(pBuffer, nFileSize));
 					request->Image->SetJPEGChromoSampling(eChromoSubSampling);
+					request->Image->SetYCbCrPixels(pYCbCrPixels);
+					request->Lap(LoadStage_ImageCreation);
 				} else if (bOutOfMemory) {
 					request->OutOfMemory = true;
 				} else {
 					// failed, try GDI+
-					delete[] pPixelData;
+					CPixelMemory::Free(pPixelData);
 					ProcessReadGDIPlusRequest(request);
 				}
 			}
@@ -602,7 +750,6 @@ void CImageLoadThread::ProcessReadWEBPRequest(CRequest * request) {
 	char* pBuffer = NULL;
 	try {
 		long long nFileSize = 0;
-		unsigned int nNumBytesRead;
 		if (!bUseCachedDecoder) {
 			// Don't read too huge files
 			nFileSize = Helpers::GetFileSize(hFile);
@@ -619,7 +766,8 @@ void CImageLoadThread::ProcessReadWEBPRequest(CRequest * request) {
 				return;
 			}
 		}
-		if (bUseCachedDecoder || (::ReadFile(hFile, pBuffer, nFileSize, (LPDWORD)&nNumBytesRead, NULL) && nNumBytesRead == nFileSize)) {
+		if (bUseCachedDecoder || ReadFileCached(hFile, request->FileName, pBuffer, nFileSize)) {
+			request->Lap(LoadStage_FileRead);
 			int nWidth, nHeight;
 			bool bHasAnimation = bUseCachedDecoder;
 			int nFrameCount = 1;
@@ -628,15 +776,21 @@ void CImageLoadThread::ProcessReadWEBPRequest(CRequest * request) {
 			void* pEXIFData;
 			uint8* pPixelData = (uint8*)WebpReaderWriter::ReadImage(nWidth, nHeight, nBPP, bHasAnimation, nFrameCount, nFrameTimeMs, pEXIFData, request->OutOfMemory, pBuffer, nFileSize);
 			if (pPixelData && nBPP == 4) {
+				request->Lap(LoadStage_Decode);
 				// Multiply alpha value into each AABBGGRR pixel
-				uint32* pImage32 = (uint32*)pPixelData;
-				for (int i = 0; i < nWidth * nHeight; i++)
-					*pImage32++ = Helpers::AlphaBlendBackground(*pImage32, CSettingsProvider::This().ColorTransparency());
+				int nRotation;
+				uint8* pRotatedPixels = (uint8*)AlphaBlendAndRotateByEXIF(pPixelData, nWidth, nHeight, pEXIFData, IF_WEBP, nRotation);
+				if (pRotatedPixels != pPixelData) {
+					delete[] pPixelData;
+				}
 
 				if (bHasAnimation) {
 					m_sLastWebpFileName = sFileName;
 				}
-				request->Image = new CJPEGImage(nWidth, nHeight, pPixelData, pEXIFData, nBPP, 0, IF_WEBP, bHasAnimation, request->FrameIndex, nFrameCount, nFrameTimeMs);
+				request->Lap(LoadStage_AlphaBlend);
+				request->Image = new CJPEGImage(nWidth, nHeight, pRotatedPixels, pEXIFData, nBPP, 0, IF_WEBP, bHasAnimation, request->FrameIndex, nFrameCount, nFrameTimeMs,
+					NULL, false, NULL, nRotation);
+				request->Lap(LoadStage_ImageCreation);
 				free(pEXIFData);
 			}
 			else {
@@ -677,7 +831,6 @@ void CImageLoadThread::ProcessReadPNGRequest(CRequest* request) {
 	void* pBuffer = NULL;
 	try {
 		long long nFileSize;
-		unsigned int nNumBytesRead;
 		if (!bUseCachedDecoder) {
 			// Don't read too huge files
 			nFileSize = Helpers::GetFileSize(hFile);
@@ -697,15 +850,16 @@ void CImageLoadThread::ProcessReadPNGRequest(CRequest* request) {
 		} else {
 			nFileSize = 0; // to avoid compiler warnings, not used
 		}
-		if (bUseCachedDecoder || (::ReadFile(hFile, pBuffer, nFileSize, (LPDWORD)&nNumBytesRead, NULL) && nNumBytesRead == nFileSize)) {
+		if (bUseCachedDecoder || ReadFileCached(hFile, request->FileName, pBuffer, nFileSize)) {
+			request->Lap(LoadStage_FileRead);
 			int nWidth, nHeight, nBPP, nFrameCount, nFrameTimeMs;
 			bool bHasAnimation;
 			uint8* pPixelData = NULL;
 			void* pEXIFData = NULL;
 
 #ifndef WINXP
-			// If UseEmbeddedColorProfiles is true and the image isn't animated, we should use GDI+ for better color management
-			bool bUseGDIPlus = CSettingsProvider::This().ForceGDIPlus() || CSettingsProvider::This().UseEmbeddedColorProfiles();
+			// Embedded color profiles are applied by the libpng reader, GDI+ is only used when forced
+			bool bUseGDIPlus = CSettingsProvider::This().ForceGDIPlus();
 			if (bUseCachedDecoder || !bUseGDIPlus || PngReader::MustUseLibpng(pBuffer, nFileSize))
 				pPixelData = (uint8*)PngReader::ReadImage(nWidth, nHeight, nBPP, bHasAnimation, nFrameCount, nFrameTimeMs, pEXIFData, request->OutOfMemory, pBuffer, nFileSize);
 #endif
@@ -713,12 +867,18 @@ void CImageLoadThread::ProcessReadPNGRequest(CRequest* request) {
 			if (pPixelData != NULL) {
 				if (bHasAnimation)
 					m_sLastPngFileName = sFileName;
+				request->Lap(LoadStage_Decode);
 				// Multiply alpha value into each AABBGGRR pixel
-				uint32* pImage32 = (uint32*)pPixelData;
-				for (int i = 0; i < nWidth * nHeight; i++)
-					*pImage32++ = Helpers::AlphaBlendBackground(*pImage32, CSettingsProvider::This().ColorTransparency());
+				int nRotation;
+				uint8* pRotatedPixels = (uint8*)AlphaBlendAndRotateByEXIF(pPixelData, nWidth, nHeight, pEXIFData, IF_PNG, nRotation);
+				if (pRotatedPixels != pPixelData) {
+					free(pPixelData);
+				}
 
-				request->Image = new CJPEGImage(nWidth, nHeight, pPixelData, pEXIFData, 4, 0, IF_PNG, bHasAnimation, request->FrameIndex, nFrameCount, nFrameTimeMs);
+				request->Lap(LoadStage_AlphaBlend);
+				request->Image = new CJPEGImage(nWidth, nHeight, pRotatedPixels, pEXIFData, 4, 0, IF_PNG, bHasAnimation, request->FrameIndex, nFrameCount, nFrameTimeMs,
+					NULL, false, NULL, nRotation);
+				request->Lap(LoadStage_ImageCreation);
 			} else {
 				DeleteCachedPngDecoder();
 				
@@ -773,7 +933,6 @@ void CImageLoadThread::ProcessReadJXLRequest(CRequest* request) {
 	UINT nPrevErrorMode = SetErrorMode(SEM_FAILCRITICALERRORS);
 	try {
 		long long nFileSize = 0;
-		unsigned int nNumBytesRead;
 		if (!bUseCachedDecoder) {
 			// Don't read too huge files
 			nFileSize = Helpers::GetFileSize(hFile);
@@ -790,7 +949,8 @@ void CImageLoadThread::ProcessReadJXLRequest(CRequest* request) {
 				return;
 			}
 		}
-		if (bUseCachedDecoder || (::ReadFile(hFile, pBuffer, nFileSize, (LPDWORD)&nNumBytesRead, NULL) && nNumBytesRead == nFileSize)) {
+		if (bUseCachedDecoder || ReadFileCached(hFile, request->FileName, pBuffer, nFileSize)) {
+			request->Lap(LoadStage_FileRead);
 			int nWidth, nHeight, nBPP, nFrameCount, nFrameTimeMs;
 			bool bHasAnimation;
 			void* pEXIFData;
@@ -798,12 +958,15 @@ void CImageLoadThread::ProcessReadJXLRequest(CRequest* request) {
 			if (pPixelData != NULL) {
 				if (bHasAnimation)
 					m_sLastJxlFileName = sFileName;
+				request->Lap(LoadStage_Decode);
 				// Multiply alpha value into each AABBGGRR pixel
 				uint32* pImage32 = (uint32*)pPixelData;
 				for (int i = 0; i < nWidth * nHeight; i++)
 					*pImage32++ = Helpers::AlphaBlendBackground(*pImage32, CSettingsProvider::This().ColorTransparency());
 
+				request->Lap(LoadStage_AlphaBlend);
 				request->Image = new CJPEGImage(nWidth, nHeight, pPixelData, pEXIFData, 4, 0, IF_JXL, bHasAnimation, request->FrameIndex, nFrameCount, nFrameTimeMs);
+				request->Lap(LoadStage_ImageCreation);
 				free(pEXIFData);
 			} else {
 				DeleteCachedJxlDecoder();
@@ -846,7 +1009,6 @@ void CImageLoadThread::ProcessReadAVIFRequest(CRequest* request) {
 	UINT nPrevErrorMode = SetErrorMode(SEM_FAILCRITICALERRORS);
 	try {
 		long long nFileSize = 0;
-		unsigned int nNumBytesRead;
 		if (!bUseCachedDecoder) {
 			// Don't read too huge files
 			nFileSize = Helpers::GetFileSize(hFile);
@@ -863,7 +1025,8 @@ void CImageLoadThread::ProcessReadAVIFRequest(CRequest* request) {
 				return;
 			}
 		}
-		if (bUseCachedDecoder || (::ReadFile(hFile, pBuffer, nFileSize, (LPDWORD)&nNumBytesRead, NULL) && nNumBytesRead == nFileSize)) {
+		if (bUseCachedDecoder || ReadFileCached(hFile, request->FileName, pBuffer, nFileSize)) {
+			request->Lap(LoadStage_FileRead);
 			int nWidth, nHeight, nBPP, nFrameCount, nFrameTimeMs;
 			bool bHasAnimation;
 			void* pEXIFData;
@@ -872,12 +1035,15 @@ void CImageLoadThread::ProcessReadAVIFRequest(CRequest* request) {
 			if (pPixelData != NULL) {
 				if (bHasAnimation)
 					m_sLastAvifFileName = sFileName;
+				request->Lap(LoadStage_Decode);
 				// Multiply alpha value into each AABBGGRR pixel
 				uint32* pImage32 = (uint32*)pPixelData;
 				for (int i = 0; i < nWidth * nHeight; i++)
 					*pImage32++ = Helpers::AlphaBlendBackground(*pImage32, CSettingsProvider::This().ColorTransparency());
 
+				request->Lap(LoadStage_AlphaBlend);
 				request->Image = new CJPEGImage(nWidth, nHeight, pPixelData, pEXIFData, 4, 0, IF_AVIF, bHasAnimation, request->FrameIndex, nFrameCount, nFrameTimeMs);
+				request->Lap(LoadStage_ImageCreation);
 				free(pEXIFData);
 				bSuccess = true;
 			} else {
@@ -910,7 +1076,6 @@ void CImageLoadThread::ProcessReadHEIFRequest(CRequest* request) {
 	char* pBuffer = NULL;
 	UINT nPrevErrorMode = SetErrorMode(SEM_FAILCRITICALERRORS);
 	try {
-		unsigned int nNumBytesRead;
 		// Don't read too huge files
 		long long nFileSize = Helpers::GetFileSize(hFile);
 		if (nFileSize > MAX_HEIF_FILE_SIZE) {
@@ -925,19 +1090,23 @@ void CImageLoadThread::ProcessReadHEIFRequest(CRequest* request) {
 			::CloseHandle(hFile);
 			return;
 		}
-		if (::ReadFile(hFile, pBuffer, nFileSize, (LPDWORD)&nNumBytesRead, NULL) && nNumBytesRead == nFileSize) {
+		if (ReadFileCached(hFile, request->FileName, pBuffer, nFileSize)) {
+			request->Lap(LoadStage_FileRead);
 			int nWidth, nHeight, nBPP, nFrameCount, nFrameTimeMs;
 			nFrameCount = 1;
 			nFrameTimeMs = 0;
 			void* pEXIFData;
 			uint8* pPixelData = (uint8*)HeifReader::ReadImage(nWidth, nHeight, nBPP, nFrameCount, pEXIFData, request->OutOfMemory, request->FrameIndex, pBuffer, nFileSize);
 			if (pPixelData != NULL) {
+				request->Lap(LoadStage_Decode);
 				// Multiply alpha value into each AABBGGRR pixel
 				uint32* pImage32 = (uint32*)pPixelData;
 				for (int i = 0; i < nWidth * nHeight; i++)
 					*pImage32++ = Helpers::AlphaBlendBackground(*pImage32, CSettingsProvider::This().ColorTransparency());
 
+				request->Lap(LoadStage_AlphaBlend);
 				request->Image = new CJPEGImage(nWidth, nHeight, pPixelData, pEXIFData, nBPP, 0, IF_HEIF, false, request->FrameIndex, nFrameCount, nFrameTimeMs);
+				request->Lap(LoadStage_ImageCreation);
 				free(pEXIFData);
 			}
 		}
@@ -964,6 +1133,83 @@ void CImageLoadThread::ProcessReadPSDRequest(CRequest* request) {
 
 #endif
 
+void CImageLoadThread::ProcessReadGIFRequest(CRequest * request) {
+	bool bSuccess = false;
+	bool bUseCachedDecoder = false;
+	const wchar_t* sFileName;
+	sFileName = (const wchar_t*)request->FileName;
+	if (sFileName != m_sLastGifFileName) {
+		DeleteCachedGifDecoder();
+	} else {
+		bUseCachedDecoder = true;
+	}
+
+	HANDLE hFile;
+	if (!bUseCachedDecoder) {
+		hFile = ::CreateFile(request->FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+		if (hFile == INVALID_HANDLE_VALUE) {
+			return;
+		}
+	}
+	char* pBuffer = NULL;
+	try {
+		long long nFileSize = 0;
+		if (!bUseCachedDecoder) {
+			// Don't read too huge files
+			nFileSize = Helpers::GetFileSize(hFile);
+			if (nFileSize > MAX_GIF_FILE_SIZE) {
+				request->OutOfMemory = true;
+				::CloseHandle(hFile);
+				return;
+			}
+
+			pBuffer = new(std::nothrow) char[nFileSize];
+			if (pBuffer == NULL) {
+				request->OutOfMemory = true;
+				::CloseHandle(hFile);
+				return;
+			}
+		}
+		if (bUseCachedDecoder || ReadFileCached(hFile, request->FileName, pBuffer, nFileSize)) {
+			request->Lap(LoadStage_FileRead);
+			int nWidth, nHeight, nBPP, nFrameCount, nFrameTimeMs;
+			int nFrameIndex = request->FrameIndex;
+			bool bHasAnimation;
+			uint8* pPixelData = (uint8*)GifReader::ReadImage(nWidth, nHeight, nBPP, bHasAnimation, nFrameIndex,
+				nFrameCount, nFrameTimeMs, request->OutOfMemory, pBuffer, (int)nFileSize);
+			if (pPixelData != NULL) {
+				if (bHasAnimation)
+					m_sLastGifFileName = sFileName;
+				request->Lap(LoadStage_Decode);
+				// Multiply alpha value into each AABBGGRR pixel
+				uint32* pImage32 = (uint32*)pPixelData;
+				size_t nNumPixels = (size_t)nWidth * nHeight;
+				for (size_t i = 0; i < nNumPixels; i++)
+					*pImage32++ = Helpers::AlphaBlendBackground(*pImage32, CSettingsProvider::This().ColorTransparency());
+
+				request->Lap(LoadStage_AlphaBlend);
+				request->Image = new CJPEGImage(nWidth, nHeight, pPixelData, NULL, 4, 0, IF_GIF, bHasAnimation, nFrameIndex, nFrameCount, nFrameTimeMs);
+				request->Lap(LoadStage_ImageCreation);
+				bSuccess = true;
+			} else {
+				DeleteCachedGifDecoder();
+			}
+		}
+	} catch (...) {
+		delete request->Image;
+		request->Image = NULL;
+		request->ExceptionError = true;
+	}
+	if (!bUseCachedDecoder) {
+		::CloseHandle(hFile);
+		delete[] pBuffer;
+	}
+	if (!bSuccess && !request->OutOfMemory && !request->ExceptionError) {
+		// not decodable by the native decoder, try with GDI+
+		ProcessReadGDIPlusRequest(request);
+	}
+}
+
 void CImageLoadThread::ProcessReadQOIRequest(CRequest* request) {
 	HANDLE hFile;
 	hFile = ::CreateFile(request->FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
@@ -972,7 +1218,6 @@ void CImageLoadThread::ProcessReadQOIRequest(CRequest* request) {
 	}
 	char* pBuffer = NULL;
 	try {
-		unsigned int nNumBytesRead;
 		// Don't read too huge files
 		long long nFileSize = Helpers::GetFileSize(hFile);
 		if (nFileSize > MAX_PNG_FILE_SIZE) {
@@ -987,17 +1232,21 @@ void CImageLoadThread::ProcessReadQOIRequest(CRequest* request) {
 			::CloseHandle(hFile);
 			return;
 		}
-		if (::ReadFile(hFile, pBuffer, nFileSize, (LPDWORD)&nNumBytesRead, NULL) && nNumBytesRead == nFileSize) {
+		if (ReadFileCached(hFile, request->FileName, pBuffer, nFileSize)) {
+			request->Lap(LoadStage_FileRead);
 			int nWidth, nHeight, nBPP;
 			void* pPixelData = QoiReaderWriter::ReadImage(nWidth, nHeight, nBPP, request->OutOfMemory, pBuffer, nFileSize);
 			if (pPixelData != NULL) {
+				request->Lap(LoadStage_Decode);
 				if (nBPP == 4) {
 					// Multiply alpha value into each AABBGGRR pixel
 					uint32* pImage32 = (uint32*)pPixelData;
 					for (int i = 0; i < nWidth * nHeight; i++)
 						*pImage32++ = Helpers::AlphaBlendBackground(*pImage32, CSettingsProvider::This().ColorTransparency());
 				}
+				request->Lap(LoadStage_AlphaBlend);
 				request->Image = new CJPEGImage(nWidth, nHeight, pPixelData, NULL, nBPP, 0, IF_QOI, false, 0, 1, 0);
+				request->Lap(LoadStage_ImageCreation);
 			}
 		}
 	} catch (...) {
@@ -1073,11 +1322,11 @@ void CImageLoadThread::ProcessReadGDIPlusRequest(CRequest * request) {
 }
 
 static unsigned char* alloc(size_t sizeInBytes) {
-	return new(std::nothrow) unsigned char[sizeInBytes];
+	return (unsigned char*)CPixelMemory::Allocate(sizeInBytes);
 }
 
 static void dealloc(unsigned char* buffer) {
-	delete[] buffer;
+	CPixelMemory::Free(buffer);
 }
 
 typedef unsigned char* Allocator(size_t sizeInBytes);
@@ -1102,6 +1351,7 @@ void CImageLoadThread::ProcessReadWICRequest(CRequest* request) {
 }
 
 bool CImageLoadThread::ProcessImageAfterLoad(CRequest * request) {
+	CTraceScope traceScope("ProcessImageAfterLoad");
 	// set process parameters depending on filename
 	request->Image->SetFileDependentProcessParams(request->FileName, &(request->ProcessParams));
 
@@ -1110,6 +1360,10 @@ bool CImageLoadThread::ProcessImageAfterLoad(CRequest * request) {
 		return false;
 	}
 
+	// The analysis needed for the processing flags and the parameter DB runs in the background, it is not needed
+	// for processing without LDC and auto contrast
+	request->Image->StartImageAnalysis(request->ProcessParams.ProcFlags);
+
 	// Do nothing (except rotation) if processing after load turned off
 	if (GetProcessingFlag(request->ProcessParams.ProcFlags, PFLAG_NoProcessingAfterLoad)) {
 		return true;
@@ -7,6 +7,27 @@
 
 class CJPEGImage;
 
+// Size and last write time of a file, used to detect that a file has been changed
+class CFileStamp
+{
+public:
+	__int64 Size; // -1 if unknown
+	FILETIME LastWriteTime;
+
+	CFileStamp() {
+		Size = -1;
+		LastWriteTime.dwLowDateTime = LastWriteTime.dwHighDateTime = 0;
+	}
+
+	// Gets the stamp of the given file, the stamp is invalid if the file cannot be accessed
+	static CFileStamp OfFile(LPCTSTR sFileName);
+
+	bool IsValid() const { return Size >= 0; }
+	bool operator==(const CFileStamp& other) const {
+		return Size == other.Size && ::CompareFileTime(&LastWriteTime, &other.LastWriteTime) == 0;
+	}
+};
+
 // returned image data by CImageLoadThread.GetLoadedImage() method
 class CImageData
 {
@@ -17,11 +38,18 @@ public:
 	bool IsRequestFailedOutOfMemory;
 	// True if the request failed due to an unhandled exception
 	bool IsRequestFailedException;
+	// True if the file still had the known stamp passed to AsyncLoad(), the image has not been loaded then
+	bool IsUnchanged;
+	// Stamp of the file taken before loading it
+	CFileStamp FileStamp;
 
-	CImageData(CJPEGImage* pImage, bool isRequestFailedOutOfMemory, bool isRequestFailedException) {
+	CImageData(CJPEGImage* pImage, bool isRequestFailedOutOfMemory, bool isRequestFailedException,
+		bool isUnchanged = false, const CFileStamp& fileStamp = CFileStamp()) {
 		Image = pImage;
 		IsRequestFailedOutOfMemory = isRequestFailedOutOfMemory;
 		IsRequestFailedException = isRequestFailedException;
+		IsUnchanged = isUnchanged;
+		FileStamp = fileStamp;
 	}
 };
 
@@ -38,7 +66,10 @@ public:
 	// received or the event has been signaled.
 	// The file to load is given by its filename (with path) and the frame index (for multiframe images). The
 	// frame index needs to be zero when the image only has one frame.
-	int AsyncLoad(LPCTSTR strFileName, int nFrameIndex, const CProcessParams & processParams, HWND targetWnd, HANDLE eventFinished);
+	// If pKnownFileStamp is given and the file still has this stamp, the file is not loaded and CImageData::IsUnchanged
+	// is set. Allows validating an image loaded before without accessing the file on the calling thread.
+	int AsyncLoad(LPCTSTR strFileName, int nFrameIndex, const CProcessParams & processParams, HWND targetWnd, HANDLE eventFinished,
+		const CFileStamp* pKnownFileStamp = NULL);
 
 	// Get loaded image, CImageData::Image is null if not (yet) available - use handle returned by AsyncLoad().
 	// Call after having received the WM_IMAGE_LOAD_COMPLETED message to retrieve the loaded image.
@@ -65,6 +96,16 @@ private:
 			Image = NULL;
 			OutOfMemory = false;
 			ExceptionError = false;
+			Unchanged = false;
+			memset(StageTickCounts, 0, sizeof(StageTickCounts));
+			LastLapTickCount = 0;
+		}
+
+		// Adds the time since the previous call, or since the start of processing, to the given stage
+		void Lap(ELoadStage eStage) {
+			double dNow = Helpers::GetExactTickCount();
+			StageTickCounts[eStage] += dNow - LastLapTickCount;
+			LastLapTickCount = dNow;
 		}
 
 		CString FileName;
@@ -75,6 +116,11 @@ private:
 		CProcessParams ProcessParams;
 		bool OutOfMemory;  // load caused an out of memory condition
 		bool ExceptionError;  // an unhandled exception caused the load to fail
+		CFileStamp KnownFileStamp; // the file is not loaded if it still has this stamp
+		CFileStamp FileStamp; // stamp of the file when it was loaded
+		bool Unchanged; // the file has the known stamp and has not been loaded
+		double StageTickCounts[LoadStage_NumStages]; // time in ms spent in the stages of loading
+		double LastLapTickCount;
 	};
 
 	// Request to release image file
@@ -92,12 +138,13 @@ private:
 
 	static volatile int m_curHandle; // Request handle returned by AsyncLoad()
 
-	Gdiplus::Bitmap* m_pLastBitmap; // Last read GDI+ bitmap, cached to speed up GIF animations
+	Gdiplus::Bitmap* m_pLastBitmap; // Last read GDI+ bitmap, cached to speed up multiframe images
 	CString m_sLastFileName; // Only for GDI+ files
 	CString m_sLastWebpFileName; // Only for animated WebP files
 	CString m_sLastPngFileName; // Only for animated PNG files
 	CString m_sLastJxlFileName; // Only for animated JPEG XL files
 	CString m_sLastAvifFileName; // Only for animated AVIF files
+	CString m_sLastGifFileName; // Only for animated GIF files
 
 	virtual void ProcessRequest(CRequestBase& request);
 	virtual void AfterFinishProcess(CRequestBase& request);
@@ -106,9 +153,11 @@ private:
 	void DeleteCachedPngDecoder();
 	void DeleteCachedJxlDecoder();
 	void DeleteCachedAvifDecoder();
+	void DeleteCachedGifDecoder();
 
 	void ProcessReadJPEGRequest(CRequest * request);
 	void ProcessReadPNGRequest(CRequest * request);
+	void ProcessReadGIFRequest(CRequest * request);
 	void ProcessReadBMPRequest(CRequest * request);
 	void ProcessReadTGARequest(CRequest * request);
 	void ProcessReadWEBPRequest(CRequest * request);
@@ -52,6 +52,17 @@ enum EImageFormat {
 	IF_Unknown
 };
 
+// Stages of loading an image by the image load thread, the time spent in each stage is measured
+enum ELoadStage {
+	LoadStage_FileRead, // reading the file into memory or copying it from the file cache
+	LoadStage_Decode, // decoding the pixels, includes reading the file for the readers reading the file themselves
+	LoadStage_AlphaBlend, // compositing against the transparency color, including rotation by EXIF orientation
+	LoadStage_EXIF, // locating and parsing the EXIF block
+	LoadStage_ImageCreation, // construction of the CJPEGImage
+	LoadStage_ProcessAfterLoad, // processing the DIB for the first display
+	LoadStage_NumStages
+};
+
 // Horizontal trapezoid
 /*
  (x1s, y1)----------(x1e, y1)
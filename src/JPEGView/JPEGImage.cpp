@@ -11,6 +11,13 @@
 #include "RawMetadata.h"
 #include "MaxImageDef.h"
 #include "libjpeg-turbo\include\turbojpeg.h"
+#include "YCbCrImage.h"
+#include "QOIWrapper.h"
+#include "UndoStack.h"
+#include "ImageAnalysisThread.h"
+#include "PixelMemory.h"
+#include "ResizeFilter.h"
+#include "Tracing.h"
 #include <math.h>
 #include <assert.h>
 
@@ -44,6 +51,24 @@ static bool SupportsSIMD(Helpers::CPUType cpuType) {
 	}
 }
 
+// The SSE2 kernels are used for the SSE and AVX2 CPU types
+static bool SupportsSSE(Helpers::CPUType cpuType) {
+	return SupportsSIMD(cpuType) && cpuType != Helpers::CPU_MMX;
+}
+
+// CPU type used for high quality resampling of a section of clippingSize, see comment block in CJPEGImage::Resample()
+static Helpers::CPUType GetResampleCPUType(CSize clippingSize) {
+	Helpers::CPUType cpu = CSettingsProvider::This().AlgorithmImplementation();
+#ifdef AVX_SSE_FREEZE_FALLBACK
+	if (cpu == Helpers::CPU_AVX2 && clippingSize.cx > 3200) {
+		// only override the usage for SSE for these specific conditions
+		// AVX2 is supposed to be ~2.4x faster than SSE
+		cpu = Helpers::CPU_SSE;
+	}
+#endif
+	return cpu;
+}
+
 static CBasicProcessing::SIMDArchitecture ToSIMDArchitecture(Helpers::CPUType cpuType) {
 	switch (cpuType)
 	{
@@ -65,7 +90,7 @@ static CBasicProcessing::SIMDArchitecture ToSIMDArchitecture(Helpers::CPUType cp
 
 CJPEGImage::CJPEGImage(int nWidth, int nHeight, void* pPixels, void* pEXIFData, int nChannels, __int64 nJPEGHash,
 					   EImageFormat eImageFormat, bool bIsAnimation, int nFrameIndex, int nNumberOfFrames, int nFrameTimeMs,
-					   CLocalDensityCorr* pLDC, bool bIsThumbnailImage, CRawMetadata* pRawMetadata)
+					   CLocalDensityCorr* pLDC, bool bIsThumbnailImage, CRawMetadata* pRawMetadata, int nRotation)
 	: m_rotationParams{ 0 },
 	m_fColorCorrectionFactorsNull{ 0 }
 {
@@ -74,7 +99,7 @@ CJPEGImage::CJPEGImage(int nWidth, int nHeight, void* pPixels, void* pEXIFData,
 		m_nOriginalChannels = nChannels;
 	} else if (nChannels == 1) {
 		m_pOrigPixels = CBasicProcessing::Convert1To4Channels(nWidth, nHeight, pPixels);
-		delete[] pPixels;
+		CPixelMemory::Free(pPixels);
 		m_nOriginalChannels = 4;
 	} else {
 		assert(false);
@@ -82,12 +107,15 @@ CJPEGImage::CJPEGImage(int nWidth, int nHeight, void* pPixels, void* pEXIFData,
 		m_nOriginalChannels = 0;
 	}
 
+	m_dEXIFParseTickCount = 0;
 	if (pEXIFData != NULL) {
+		double dStartTickCount = Helpers::GetExactTickCount();
 		unsigned char * pEXIF = (unsigned char *)pEXIFData;
 		m_nEXIFSize = pEXIF[2]*256 + pEXIF[3] + 2;
 		m_pEXIFData = new char[m_nEXIFSize];
 		memcpy(m_pEXIFData, pEXIFData, m_nEXIFSize);
 		m_pEXIFReader = new CEXIFReader(m_pEXIFData, eImageFormat);
+		m_dEXIFParseTickCount = Helpers::GetExactTickCount() - dStartTickCount;
 	} else {
 		m_nEXIFSize = 0;
 		m_pEXIFData = NULL;
@@ -104,8 +132,17 @@ CJPEGImage::CJPEGImage(int nWidth, int nHeight, void* pPixels, void* pEXIFData,
 	m_nFrameTimeMs = nFrameTimeMs;
 	m_eJPEGChromoSampling = TJSAMP_420;
 
-	m_nOrigWidth = m_nInitOrigWidth = nWidth;
-	m_nOrigHeight = m_nInitOrigHeight = nHeight;
+	m_nOrigWidth = nWidth;
+	m_nOrigHeight = nHeight;
+	ResetOriginalPixelsView();
+	// the initial size is the size before any rotation, also for pixels rotated by the loader
+	bool bRotatedWH = nRotation == 90 || nRotation == 270;
+	m_nInitOrigWidth = bRotatedWH ? nHeight : nWidth;
+	m_nInitOrigHeight = bRotatedWH ? nWidth : nHeight;
+	m_rotationParams.Rotation = nRotation;
+	m_pYCbCrPixels = NULL;
+	m_pQOIPixels = NULL;
+	m_nQOISize = 0;
 	m_pDIBPixels = NULL;
 	m_pDIBPixelsLUTProcessed = NULL;
 	m_pLastDIB = NULL;
@@ -139,6 +176,7 @@ CJPEGImage::CJPEGImage(int nWidth, int nHeight, void* pPixels, void* pEXIFData,
 	m_bFirstReprocessing = true;
 	m_dLastOpTickCount = 0;
 	m_dLoadTickCount = 0;
+	memset(m_dLoadStageTickCounts, 0, sizeof(m_dLoadStageTickCounts));
 	m_dUnsharpMaskTickCount = 0;
 	m_FullTargetSize = CSize(0, 0);
 	m_ClippingSize = CSize(0, 0);
@@ -146,22 +184,37 @@ CJPEGImage::CJPEGImage(int nWidth, int nHeight, void* pPixels, void* pEXIFData,
 	m_dRotationLQ = 0.0;
 	m_bTrapezoidValid = false;
 
-	// Create the LDC object on the image
-	m_pLDC = (pLDC == NULL) ? (new CLocalDensityCorr(*this, true)) : pLDC;
+	m_pUndoStack = new CUndoStack();
+	m_fLightenShadowFactor = 1.0f;
+	m_bLightenShadowsPending = false;
+	m_bParamDBPending = false;
+	m_bInitialParamsChangedByAnalysis = false;
+	m_pAnalysisRequest = NULL;
+	// Pixels rotated by the loader are analyzed in the unrotated layout, thus the pixel hash and the image analysis
+	// do not depend on how the image was loaded. The analysis is started by StartImageAnalysis() or done on demand.
+	m_nAnalysisSourceRotation = nRotation;
+	m_pLDC = pLDC;
 	m_bLDCOwned = pLDC == NULL;
-	if (nJPEGHash == 0) {
-		// Use the decompressed pixel hash in this case
-		m_nPixelHash = m_pLDC->GetPixelHash();
+	m_bImageAnalyzed = m_bLightenShadowFactorKnown = pLDC != NULL;
+	if (pLDC != NULL) {
+		if (nJPEGHash == 0) {
+			m_nPixelHash = m_pLDC->GetPixelHash();
+		}
+		m_fLightenShadowFactor = (1.0f - m_pLDC->GetHistogram()->IsNightShot())*(1.0f - m_pLDC->IsSunset());
 	}
-	m_fLightenShadowFactor = (1.0f - m_pLDC->GetHistogram()->IsNightShot())*(1.0f - m_pLDC->IsSunset());
 
 	// Initialize to INI value, may be overriden later by parameter DB
 	memcpy(m_fColorCorrectionFactors, CSettingsProvider::This().ColorCorrectionAmounts(), sizeof(m_fColorCorrectionFactors));
 }
 
 CJPEGImage::~CJPEGImage(void) {
-	delete[] m_pOrigPixels;
+	WaitForImageAnalysis();
+	CPixelMemory::Free(m_pOrigPixels);
 	m_pOrigPixels = NULL;
+	delete m_pYCbCrPixels;
+	m_pYCbCrPixels = NULL;
+	QoiReaderWriter::FreeMemory(m_pQOIPixels);
+	m_pQOIPixels = NULL;
 	delete[] m_pDIBPixels;
 	m_pDIBPixels = NULL;
 	delete[] m_pDIBPixelsLUTProcessed;
@@ -178,6 +231,8 @@ CJPEGImage::~CJPEGImage(void) {
 	m_pSaturationLUTs = NULL;
 	if (m_bLDCOwned) delete m_pLDC;
 	m_pLDC = NULL;
+	delete m_pUndoStack;
+	m_pUndoStack = NULL;
 	m_pLastDIB = NULL;
 	delete[] m_pEXIFData;
 	m_pEXIFData = NULL;
@@ -256,6 +311,7 @@ void* CJPEGImage::GetDIBUnsharpMasked(CSize clippingSize, CPoint targetOffset,
 
 const CHistogram* CJPEGImage::GetOriginalHistogram() {
 	assert(!m_bIsThumbnailImage);
+	FinishImageAnalysis(false);
 	if (m_pLDC == NULL) {
 		m_pLDC = new CLocalDensityCorr(*this, true);
 	}
@@ -292,6 +348,51 @@ const CHistogram* CJPEGImage::GetHistogramOfProcessedDIB(const CImageProcessingP
 	return m_pCachedProcessedHistogram;
 }
 
+CImageMemoryUsage CJPEGImage::GetMemoryUsage() const {
+	CImageMemoryUsage usage;
+	if (m_pOrigPixels != NULL) {
+		usage.OriginalPixels = m_nOrigPixelsOffset + (size_t)m_nOrigStride * m_nOrigHeight;
+	}
+	if (m_pYCbCrPixels != NULL) {
+		usage.CompressedPixels += m_pYCbCrPixels->SizeInBytes();
+	}
+	if (m_pQOIPixels != NULL) {
+		usage.CompressedPixels += m_nQOISize;
+	}
+	size_t nDIBSize = (size_t)m_ClippingSize.cx * m_ClippingSize.cy * 4;
+	if (m_pDIBPixels != NULL) usage.DIBs += nDIBSize;
+	if (m_pDIBPixelsLUTProcessed != NULL) usage.DIBs += nDIBSize;
+	size_t nGrayImageSize = (size_t)m_ClippingSize.cx * m_ClippingSize.cy * sizeof(int16);
+	if (m_pGrayImage != NULL) usage.UnsharpMask += nGrayImageSize;
+	if (m_pSmoothGrayImage != NULL) usage.UnsharpMask += nGrayImageSize;
+	if (m_pThumbnail != NULL) {
+		usage.Thumbnails += m_pThumbnail->GetMemoryUsage().Total();
+	}
+	if (m_pHistogramThumbnail != NULL) {
+		usage.Thumbnails += m_pHistogramThumbnail->GetMemoryUsage().Total();
+	}
+	// the LDC of thumbnails is owned by the image the thumbnail was created from
+	if (m_pLDC != NULL && m_bLDCOwned) {
+		usage.LDC += m_pLDC->SizeInBytes();
+	}
+	if (m_pCachedProcessedHistogram != NULL) {
+		usage.Histogram += sizeof(CHistogram);
+	}
+	if (m_pLUTAllChannels != NULL) usage.LUTs += 256;
+	if (m_pLUTRGB != NULL) usage.LUTs += 3 * 256;
+	if (m_pSaturationLUTs != NULL) usage.LUTs += 6 * 256 * sizeof(int32);
+	if (m_pEXIFData != NULL) {
+		usage.EXIF += m_nEXIFSize;
+	}
+	if (m_pRawMetadata != NULL) {
+		usage.EXIF += sizeof(CRawMetadata);
+	}
+	if (m_pUndoStack != NULL) {
+		usage.UndoSteps = m_pUndoStack->SizeInBytes();
+	}
+	return usage;
+}
+
 void CJPEGImage::FreeUnsharpMaskResources() {
 	delete[] m_pGrayImage;
 	m_pGrayImage = NULL;
@@ -300,10 +401,18 @@ void CJPEGImage::FreeUnsharpMaskResources() {
 }
 
 bool CJPEGImage::ApplyUnsharpMaskToOriginalPixels(const CUnsharpMaskParams & unsharpMaskParams) {
+	CTraceScope traceScope("UnsharpMaskOriginal");
+	if (!VerifyOriginalPixels()) {
+		return false;
+	}
 	InvalidateAllCachedPixelData();
+	PackOriginalPixels();
 
 	double dStartTime = Helpers::GetExactTickCount();
 
+	// Sharpen into a new buffer, the tiles changed by sharpening are then kept for undo. When out of memory, sharpen in place without undo.
+	COriginalPixelsState previousState = GetOriginalPixelsState();
+	void* pTargetPixels = CPixelMemory::Allocate(previousState.SizeInBytes());
 	bool bSuccess = false;
 	int16* pGray = CBasicProcessing::Create1Channel16bppGrayscaleImage(m_nOrigWidth, m_nOrigHeight, m_pOrigPixels, m_nOriginalChannels);
 	if (pGray != NULL) {
@@ -311,44 +420,81 @@ bool CJPEGImage::ApplyUnsharpMaskToOriginalPixels(const CUnsharpMaskParams & uns
 			CSize(m_nOrigWidth, m_nOrigHeight), unsharpMaskParams.Radius, pGray);
 		if (pSmoothed != NULL) {
 			bSuccess = NULL != CBasicProcessing::UnsharpMask(CSize(m_nOrigWidth, m_nOrigHeight), CPoint(0,0), CSize(m_nOrigWidth, m_nOrigHeight), 
-				unsharpMaskParams.Amount, unsharpMaskParams.Threshold, pGray, pSmoothed, m_pOrigPixels, m_pOrigPixels, m_nOriginalChannels);
+				unsharpMaskParams.Amount, unsharpMaskParams.Threshold, pGray, pSmoothed, m_pOrigPixels, 
+				(pTargetPixels != NULL) ? pTargetPixels : m_pOrigPixels, m_nOriginalChannels);
 		}
 		delete[] pSmoothed;
 	}
 	delete[] pGray;
 
-	m_dUnsharpMaskTickCount = Helpers::GetExactTickCount() - dStartTime;
+	if (!bSuccess) {
+		if (pTargetPixels == NULL) {
+			// may have been partially sharpened in place
+			MarkAsDestructivelyProcessed();
+			m_bIsProcessedNoParamDB = true;
+			m_pUndoStack->PushWithoutStep();
+		}
+		CPixelMemory::Free(pTargetPixels);
+		return false;
+	}
 
+	if (pTargetPixels != NULL) {
+		m_pOrigPixels = pTargetPixels;
+	}
 	MarkAsDestructivelyProcessed();
 	m_bIsProcessedNoParamDB = true;
 
+	if (pTargetPixels != NULL) {
+		CUndoStep* pStep = new(std::nothrow) CUndoStep(previousState, GetOriginalPixelsState());
+		if (pStep != NULL && pStep->IsValid()) {
+			m_pUndoStack->Push(pStep, GetOriginalPixelsState().SizeInBytes());
+		} else {
+			delete pStep;
+			m_pUndoStack->PushWithoutStep();
+		}
+		CPixelMemory::Free(previousState.Pixels);
+	} else {
+		m_pUndoStack->PushWithoutStep();
+	}
+
+	m_dUnsharpMaskTickCount = Helpers::GetExactTickCount() - dStartTime;
+
 	return bSuccess;
 }
 
 bool CJPEGImage::RotateOriginalPixels(double dRotation, bool bAutoCrop, bool bKeepAspectRatio) {
+	if (!VerifyOriginalPixels()) {
+		return false;
+	}
 	InvalidateAllCachedPixelData();
 
 	CPoint offset;
 	CSize newSize = GetSizeAfterFreeRotation(CSize(m_nOrigWidth, m_nOrigHeight), dRotation, bAutoCrop, bKeepAspectRatio, offset);
 	void* pRotatedPixels = CBasicProcessing::RotateHQ(offset, newSize, dRotation,
-		CSize(m_nOrigWidth, m_nOrigHeight), m_pOrigPixels, m_nOriginalChannels, CSettingsProvider::This().ColorBackground());
+		CSize(m_nOrigWidth, m_nOrigHeight), OrigPixelsView(), m_nOrigStride, m_nOriginalChannels, CSettingsProvider::This().ColorBackground(),
+		SupportsSSE(CSettingsProvider::This().AlgorithmImplementation()));
 	if (pRotatedPixels == NULL) return false;
-	delete[] m_pOrigPixels;
+	COriginalPixelsState previousState = GetOriginalPixelsState();
 
 	m_nOrigWidth = newSize.cx;
 	m_nOrigHeight = newSize.cy;
 	m_nOriginalChannels = 4;
 	m_pOrigPixels = pRotatedPixels;
+	ResetOriginalPixelsView();
 	MarkAsDestructivelyProcessed();
 
 	m_rotationParams.FreeRotation = fmod(360 * dRotation / (2 * 3.141592653), 360);
 	m_rotationParams.Flags = SetRotationFlag(m_rotationParams.Flags, RFLAG_AutoCrop, bAutoCrop);
 	m_rotationParams.Flags = SetRotationFlag(m_rotationParams.Flags, RFLAG_KeepAspectRatio, bKeepAspectRatio);
+	PushUndoStep(previousState);
 
 	return true;
 }
 
 bool CJPEGImage::TrapezoidOriginalPixels(const CTrapezoid& trapezoid, bool bAutoCrop, bool bKeepAspectRatio) {
+	if (!VerifyOriginalPixels()) {
+		return false;
+	}
 	InvalidateAllCachedPixelData();
 
 	int nXStart, nXEnd;
@@ -375,16 +521,19 @@ bool CJPEGImage::TrapezoidOriginalPixels(const CTrapezoid& trapezoid, bool bAuto
 
 	CSize newSize(nXEnd - nXStart + 1, nYEnd - nYStart + 1);
 	void* pTransformedPixels = CBasicProcessing::TrapezoidHQ(CPoint(nXStart, nYStart), newSize, trapezoid, 
-		CSize(m_nOrigWidth, m_nOrigHeight), m_pOrigPixels, m_nOriginalChannels, CSettingsProvider::This().ColorBackground());
+		CSize(m_nOrigWidth, m_nOrigHeight), OrigPixelsView(), m_nOrigStride, m_nOriginalChannels, CSettingsProvider::This().ColorBackground(),
+		SupportsSSE(CSettingsProvider::This().AlgorithmImplementation()));
 	if (pTransformedPixels == NULL) return false;
-	delete[] m_pOrigPixels;
+	COriginalPixelsState previousState = GetOriginalPixelsState();
 
 	m_nOrigWidth = newSize.cx;
 	m_nOrigHeight = newSize.cy;
 	m_nOriginalChannels = 4;
 	m_pOrigPixels = pTransformedPixels;
+	ResetOriginalPixelsView();
 	MarkAsDestructivelyProcessed();
 	m_bIsProcessedNoParamDB = true;
+	PushUndoStep(previousState);
 
 	return true;
 }
@@ -403,8 +552,12 @@ bool CJPEGImage::ResizeOriginalPixels(EResizeFilter filter, CSize newSize) {
 	if (newWidth == m_nOrigWidth && newHeight == m_nOrigHeight) {
 		return true;
 	}
+	if (!VerifyOriginalPixels()) {
+		return false;
+	}
 
 	InvalidateAllCachedPixelData();
+	PackOriginalPixels();
 
 	void* pResizedPixels = m_pOrigPixels;
 	int currentWidth = m_nOrigWidth;
@@ -427,18 +580,23 @@ bool CJPEGImage::ResizeOriginalPixels(EResizeFilter filter, CSize newSize) {
 		}
 		void* pOldPixels = pResizedPixels;
 		pResizedPixels = InternalResize(pResizedPixels, channels, usedFilter, CSize(currentWidth, currentHeight), CSize(oldWidth, oldHeight));
+		if (pOldPixels != m_pOrigPixels) {
+			CPixelMemory::Free(pOldPixels); // intermediate step, the original pixels are kept for undo
+		}
 		if (pResizedPixels == NULL)
 			return false;
-		delete[] pOldPixels;
 		channels = 4;
 	}
+	COriginalPixelsState previousState = GetOriginalPixelsState();
 
 	m_nOrigWidth = newWidth;
 	m_nOrigHeight = newHeight;
 	m_nOriginalChannels = 4;
 	m_pOrigPixels = pResizedPixels;
+	ResetOriginalPixelsView();
 	MarkAsDestructivelyProcessed();
 	m_bIsProcessedNoParamDB = true;
+	PushUndoStep(previousState);
 
 	return true;
 }
@@ -572,8 +730,8 @@ void CJPEGImage::ResampleWithPan(void* & pDIBPixels, void* & pDIBPixelsLUTProces
 
 void* CJPEGImage::Resample(CSize fullTargetSize, CSize clippingSize, CPoint targetOffset, 
 						  EProcessingFlags eProcFlags, double dSharpen, double dRotation, EResizeType eResizeType) {
+	CTraceScope traceScope("Resample", "width", clippingSize.cx);
 
-	Helpers::CPUType cpu = CSettingsProvider::This().AlgorithmImplementation();
 	// NOTE: Hacky workaround... there is probably a very obscure bug in the AVX2 implementation
 	//       which causes WaitForSingleObject to wait indefinitely on SampleUp_HQ_SIMD()
 	//       when window dimensions are > 3224 pixels wide.
@@ -589,13 +747,7 @@ void* CJPEGImage::Resample(CSize fullTargetSize, CSize clippingSize, CPoint targ
 	// The known workarounds based on GitHub issues is to either set CPUType=SSE or HighQualityResampling=false
 	//
 	// So, here, we detect and fallback to SSE when the conditions are met.  To be safe, I set the limit at 3200 pixels
-#ifdef AVX_SSE_FREEZE_FALLBACK
-	if (cpu == Helpers::CPU_AVX2 && clippingSize.cx > 3200) {
-		// only override the usage for SSE for these specific conditions
-		// AVX2 is supposed to be ~2.4x faster than SSE
-		cpu = Helpers::CPU_SSE;
-	}
-#endif
+	Helpers::CPUType cpu = GetResampleCPUType(clippingSize);
 
 	EFilterType filter = CSettingsProvider::This().DownsamplingFilter();
 
@@ -610,41 +762,80 @@ void* CJPEGImage::Resample(CSize fullTargetSize, CSize clippingSize, CPoint targ
 
 	if (bUseHQResampling &&
 		!(eResizeType == NoResize && (filter == Filter_Downsampling_Best_Quality || filter == Filter_Downsampling_No_Aliasing))) {
+		if (!VerifyOriginalPixels()) {
+			return NULL;
+		}
 		if (SupportsSIMD(cpu)) {
 			if (bIsUpSample) {
 				return CBasicProcessing::SampleUp_HQ_SIMD(fullTargetSize, targetOffset, clippingSize,
-					CSize(m_nOrigWidth, m_nOrigHeight), m_pOrigPixels, m_nOriginalChannels, ToSIMDArchitecture(cpu));
+					CSize(m_nOrigWidth, m_nOrigHeight), OrigPixelsView(), m_nOrigStride, m_nOriginalChannels, ToSIMDArchitecture(cpu));
 			} else {
 				return CBasicProcessing::SampleDown_HQ_SIMD(fullTargetSize, targetOffset, clippingSize,
-					CSize(m_nOrigWidth, m_nOrigHeight), m_pOrigPixels, m_nOriginalChannels, dSharpen, filter, ToSIMDArchitecture(cpu));
+					CSize(m_nOrigWidth, m_nOrigHeight), OrigPixelsView(), m_nOrigStride, m_nOriginalChannels, dSharpen, filter, ToSIMDArchitecture(cpu));
 			}
 		} else {
 			if (bIsUpSample) {
 				return CBasicProcessing::SampleUp_HQ(fullTargetSize, targetOffset, clippingSize,
-					CSize(m_nOrigWidth, m_nOrigHeight), m_pOrigPixels, m_nOriginalChannels);
+					CSize(m_nOrigWidth, m_nOrigHeight), OrigPixelsView(), m_nOrigStride, m_nOriginalChannels);
 			} else {
 				return CBasicProcessing::SampleDown_HQ(fullTargetSize, targetOffset, clippingSize,
-					CSize(m_nOrigWidth, m_nOrigHeight), m_pOrigPixels, m_nOriginalChannels, dSharpen, filter);
+					CSize(m_nOrigWidth, m_nOrigHeight), OrigPixelsView(), m_nOrigStride, m_nOriginalChannels, dSharpen, filter);
 			}
 		}
 	} else {
 		bool bHasRotation = fabs(dRotation) > 1e-3;
+		if (m_pOrigPixels == NULL && m_pYCbCrPixels != NULL) {
+			// point sampling converts only the sampled pixels, no need to recreate the original pixels
+			if (bHasRotation) {
+				return CBasicProcessing::PointSampleWithRotation(fullTargetSize, targetOffset, clippingSize, 
+					dRotation, *m_pYCbCrPixels, CSettingsProvider::This().ColorBackground());
+			} else {
+				return CBasicProcessing::PointSample(fullTargetSize, targetOffset, clippingSize, *m_pYCbCrPixels);
+			}
+		}
+		if (!VerifyOriginalPixels()) {
+			return NULL;
+		}
 		if (bHasRotation) {
 			return CBasicProcessing::PointSampleWithRotation(fullTargetSize, targetOffset, clippingSize, 
-				CSize(m_nOrigWidth, m_nOrigHeight), dRotation, m_pOrigPixels, m_nOriginalChannels, CSettingsProvider::This().ColorBackground());
+				CSize(m_nOrigWidth, m_nOrigHeight), dRotation, OrigPixelsView(), m_nOrigStride, m_nOriginalChannels, CSettingsProvider::This().ColorBackground());
 		} else {
 			return CBasicProcessing::PointSample(fullTargetSize, targetOffset, clippingSize, 
-				CSize(m_nOrigWidth, m_nOrigHeight), m_pOrigPixels, m_nOriginalChannels);
+				CSize(m_nOrigWidth, m_nOrigHeight), OrigPixelsView(), m_nOrigStride, m_nOriginalChannels);
 		}
 	}
 }
 
+void CJPEGImage::PrecomputeResizeFilters(CSize fullTargetSize, CSize clippingSize, const CImageProcessingParams & imageProcParams, EProcessingFlags eProcFlags) {
+	// same decisions as in Resample()
+	if (!GetProcessingFlag(eProcFlags, PFLAG_HighQualityResampling) || fullTargetSize.cx > 65535 || fullTargetSize.cy > 65535) {
+		return;
+	}
+	EResizeType eResizeType = GetResizeType(fullTargetSize, CSize(m_nOrigWidth, m_nOrigHeight));
+	bool bIsUpSample = (eResizeType == UpSample);
+	if (bIsUpSample && CSettingsProvider::This().HQDownSampleOnly()) {
+		return;
+	}
+	EFilterType filter = bIsUpSample ? Filter_Upsampling_Bicubic : CSettingsProvider::This().DownsamplingFilter();
+	if (eResizeType == NoResize && (filter == Filter_Downsampling_Best_Quality || filter == Filter_Downsampling_No_Aliasing)) {
+		return;
+	}
+	double dSharpen = bIsUpSample ? 0.0 : imageProcParams.Sharpen;
+
+	Helpers::CPUType cpu = GetResampleCPUType(clippingSize);
+	FilterSIMDType filterSIMDType = (cpu == Helpers::CPU_AVX2) ? FilterSIMDType_AVX : SupportsSIMD(cpu) ? FilterSIMDType_SSE : FilterSIMDType_None;
+	CResizeFilterCache& filterCache = CResizeFilterCache::This();
+	filterCache.PrecomputeFilter(m_nOrigWidth, fullTargetSize.cx, dSharpen, filter, filterSIMDType);
+	filterCache.PrecomputeFilter(m_nOrigHeight, fullTargetSize.cy, dSharpen, filter, filterSIMDType);
+}
+
 void* CJPEGImage::InternalResize(void* pixels, int channels, EResizeFilter filter, CSize targetSize, CSize sourceSize) {
 	EResizeType eResizeType = GetResizeType(targetSize, sourceSize);
 	Helpers::CPUType cpu = CSettingsProvider::This().AlgorithmImplementation();
+	int stride = Helpers::DoPadding(sourceSize.cx * channels, 4);
 
 	if (filter == Resize_PointFilter) {
-		return CBasicProcessing::PointSample(targetSize, CPoint(0, 0), targetSize, sourceSize, pixels, channels);
+		return CBasicProcessing::PointSample(targetSize, CPoint(0, 0), targetSize, sourceSize, pixels, stride, channels);
 	}
 
 	EFilterType downSamplingFilter = (filter == Resize_NoAliasing) ? Filter_Downsampling_No_Aliasing : Filter_Downsampling_Best_Quality;
@@ -653,18 +844,18 @@ void* CJPEGImage::InternalResize(void* pixels, int channels, EResizeFilter filte
 	if (SupportsSIMD(cpu)) {
 		if (eResizeType == UpSample) {
 			return CBasicProcessing::SampleUp_HQ_SIMD(targetSize, CPoint(0, 0), targetSize,
-				sourceSize, pixels, channels, ToSIMDArchitecture(cpu));
+				sourceSize, pixels, stride, channels, ToSIMDArchitecture(cpu));
 		} else {
 			return CBasicProcessing::SampleDown_HQ_SIMD(targetSize, CPoint(0, 0), targetSize,
-				sourceSize, pixels, channels, dSharpen, downSamplingFilter, ToSIMDArchitecture(cpu));
+				sourceSize, pixels, stride, channels, dSharpen, downSamplingFilter, ToSIMDArchitecture(cpu));
 		}
 	} else {
 		if (eResizeType == UpSample) {
 			return CBasicProcessing::SampleUp_HQ(targetSize, CPoint(0, 0), targetSize,
-				sourceSize, pixels, channels);
+				sourceSize, pixels, stride, channels);
 		} else {
 			return CBasicProcessing::SampleDown_HQ(targetSize, CPoint(0, 0), targetSize,
-				sourceSize, pixels, channels, dSharpen, downSamplingFilter);
+				sourceSize, pixels, stride, channels, dSharpen, downSamplingFilter);
 		}
 	}
 }
@@ -697,16 +888,19 @@ bool CJPEGImage::Rotate(int nRotation) {
 		return false;
 	}
 
-	InvalidateAllCachedPixelData();
-	void* pNewOriginalPixels = CBasicProcessing::Rotate32bpp(m_nOrigWidth, m_nOrigHeight, m_pOrigPixels, nRotation);
-	if (pNewOriginalPixels == NULL) return false;
-	delete[] m_pOrigPixels;
-	m_pOrigPixels = pNewOriginalPixels;
+	// the pixel hash and the lighten shadow factor are not changed by rotation, if still needed they are determined
+	// from the pixels rotated back. Only derived data is dropped here, it is recreated if the rotation fails.
+	InvalidateAllCachedPixelData(false);
+	if (!CBasicProcessing::Rotate32bppInplace(m_nOrigWidth, m_nOrigHeight, m_pOrigPixels, nRotation)) return false;
+	m_nAnalysisSourceRotation = (m_nAnalysisSourceRotation + nRotation) % 360;
+	m_pUndoStack->Clear();
+	FreeCompactPixels();
 	if (nRotation != 180) {
 		// swap width and height
 		int nTemp = m_nOrigWidth;
 		m_nOrigWidth = m_nOrigHeight;
 		m_nOrigHeight = nTemp;
+		ResetOriginalPixelsView();
 	}
 	m_rotationParams.Rotation = (m_rotationParams.Rotation + nRotation) % 360;
 
@@ -723,10 +917,8 @@ bool CJPEGImage::Mirror(bool bHorizontally) {
 	}
 
 	InvalidateAllCachedPixelData();
-	void* pNewOriginalPixels = CBasicProcessing::Mirror32bpp(m_nOrigWidth, m_nOrigHeight, m_pOrigPixels, bHorizontally);
-	if (pNewOriginalPixels == NULL) return false;
-	delete[] m_pOrigPixels;
-	m_pOrigPixels = pNewOriginalPixels;
+	m_pUndoStack->Clear();
+	CBasicProcessing::Mirror32bppInplace(m_nOrigWidth, m_nOrigHeight, m_pOrigPixels, bHorizontally);
 	MarkAsDestructivelyProcessed();
 	m_bIsProcessedNoParamDB = true;
 
@@ -735,18 +927,18 @@ bool CJPEGImage::Mirror(bool bHorizontally) {
 }
 
 bool CJPEGImage::Crop(CRect cropRect) {
-	// Cropping can only be done in 32 bpp
-	if (!ConvertSrcTo4Channels()) {
+	if (!VerifyOriginalPixels()) {
 		return false;
 	}
-
-	InvalidateAllCachedPixelData();
-	void* pNewOriginalPixels = CBasicProcessing::Crop32bpp(m_nOrigWidth, m_nOrigHeight, m_pOrigPixels, cropRect);
-	if (pNewOriginalPixels == NULL) {
+	if (cropRect.Width() <= 0 || cropRect.Height() <= 0 || cropRect.left < 0 || cropRect.top < 0 ||
+		cropRect.right > m_nOrigWidth || cropRect.bottom > m_nOrigHeight) {
 		return false;
 	}
-	delete[] m_pOrigPixels;
-	m_pOrigPixels = pNewOriginalPixels;
+
+	InvalidateAllCachedPixelData();
+	m_pUndoStack->Clear();
+	// only the view on the original pixels is changed, the pixels outside stay allocated until they are packed or replaced
+	m_nOrigPixelsOffset += (size_t)cropRect.top * m_nOrigStride + (size_t)cropRect.left * m_nOriginalChannels;
 	m_nOrigWidth = cropRect.Width();
 	m_nOrigHeight = cropRect.Height();
 	m_bCropped = true;
@@ -756,6 +948,82 @@ bool CJPEGImage::Crop(CRect cropRect) {
 	return true;
 }
 
+void CJPEGImage::SetYCbCrPixels(CYCbCrImage* pYCbCrPixels) {
+	assert(pYCbCrPixels == NULL || (pYCbCrPixels->Width() == m_nOrigWidth && pYCbCrPixels->Height() == m_nOrigHeight));
+	delete m_pYCbCrPixels;
+	m_pYCbCrPixels = pYCbCrPixels;
+}
+
+bool CJPEGImage::Undo() {
+	COriginalPixelsState state = GetOriginalPixelsState();
+	if (state.Pixels == NULL || !m_pUndoStack->Undo(state)) {
+		return false;
+	}
+	InvalidateAllCachedPixelData();
+	SetOriginalPixelsState(state);
+	return true;
+}
+
+bool CJPEGImage::Redo() {
+	COriginalPixelsState state = GetOriginalPixelsState();
+	if (state.Pixels == NULL || !m_pUndoStack->Redo(state)) {
+		return false;
+	}
+	InvalidateAllCachedPixelData();
+	SetOriginalPixelsState(state);
+	return true;
+}
+
+bool CJPEGImage::CanUndo() const {
+	return m_pUndoStack->CanUndo();
+}
+
+bool CJPEGImage::CanRedo() const {
+	return m_pUndoStack->CanRedo();
+}
+
+void CJPEGImage::ClearUndoSteps() {
+	m_pUndoStack->Clear();
+}
+
+bool CJPEGImage::ReleaseOriginalPixels() {
+	if ((m_pYCbCrPixels == NULL && m_pQOIPixels == NULL) || m_pOrigPixels == NULL) {
+		return false;
+	}
+	if (IsImageAnalysisRunning()) {
+		return false; // released when finished, see CJPEGProvider::OnImageAnalysisFinished()
+	}
+	WaitForImageAnalysis(); // takes over the finished analysis
+	CPixelMemory::Free(m_pOrigPixels);
+	m_pOrigPixels = NULL;
+	ResetOriginalPixelsView();
+	return true;
+}
+
+bool CJPEGImage::CompressOriginalPixels() {
+	if (m_pYCbCrPixels == NULL && m_pQOIPixels == NULL) {
+		if (!VerifyOriginalPixels()) {
+			return false;
+		}
+		int nSize = 0;
+		void* pQOIPixels = QoiReaderWriter::CompressPixels(OrigPixelsView(), m_nOrigWidth, m_nOrigHeight, m_nOrigStride, m_nOriginalChannels, nSize);
+		if (pQOIPixels == NULL) {
+			return false;
+		}
+		m_pQOIPixels = pQOIPixels;
+		m_nQOISize = nSize;
+	}
+	ReleaseOriginalPixels();
+	// the processed pixels are recreated when the image is displayed again, the LDC and the thumbnails are kept
+	m_pLastDIB = NULL;
+	delete[] m_pDIBPixels;
+	m_pDIBPixels = NULL;
+	delete[] m_pDIBPixelsLUTProcessed;
+	m_pDIBPixelsLUTProcessed = NULL;
+	FreeUnsharpMaskResources();
+	return true;
+}
+
 void CJPEGImage::SetDimRects(const CDimRect* dimRects, int numberOfRects) {
 	bool bIdentical = false;
 	if (m_pDIBPixelsLUTProcessed) {
@@ -818,6 +1086,7 @@ void CJPEGImage::VerifyDIBPixelsCreated() {
 }
 
 float CJPEGImage::IsNightShot() const {
+	FinishImageAnalysis(true);
 	if (m_pLDC != NULL) {
 		return m_pLDC->GetHistogram()->IsNightShot();
 	} else {
@@ -826,6 +1095,7 @@ float CJPEGImage::IsNightShot() const {
 }
 
 float CJPEGImage::IsSunset() const {
+	FinishImageAnalysis(true);
 	if (m_pLDC != NULL) {
 		return m_pLDC->IsSunset();
 	} else {
@@ -838,6 +1108,7 @@ void CJPEGImage::SetInitialParameters(const CImageProcessingParams& imageProcPar
 	m_nInitialRotation = nRotation;
 	m_eProcFlagsInitial = procFlags;
 	m_imageProcParamsInitial = imageProcParams;
+	m_bLightenShadowsPending = false;
 	m_dInitialZoom = dZoom;
 	m_initialOffsets = offsets;
 }
@@ -850,9 +1121,14 @@ void CJPEGImage::RestoreInitialParameters(LPCTSTR sFileName, const CImageProcess
 	m_dInitialZoom = dZoom;
 	m_initialOffsets = offsets;
 
-	CParameterDBEntry* dbEntry = CParameterDB::This().FindEntry(GetPixelHash());
+	// do not wait for the pixel hash, the parameter DB is searched when it is known
+	m_bParamDBPending = !IsPixelHashKnown() && !CParameterDB::This().IsEmpty();
+	m_paramDBTargetSize = targetSize;
+	m_paramDBMonitorSize = monitorSize;
+	CParameterDBEntry* dbEntry = m_bParamDBPending ? NULL : FindParamDBEntry();
 	m_bInParamDB = dbEntry != NULL;
 	m_bHasZoomStoredInParamDB = m_bInParamDB && dbEntry->HasZoomOffsetStored();
+	m_bLightenShadowsPending = false;
 	bool bKeepParams = ::GetProcessingFlag(procFlags, PFLAG_KeepParams);
 	if (m_bInParamDB && !bKeepParams) {
 		dbEntry->WriteToProcessParams(m_imageProcParamsInitial, m_eProcFlagsInitial, CRotationParams(m_nInitialRotation));
@@ -865,7 +1141,14 @@ void CJPEGImage::RestoreInitialParameters(LPCTSTR sFileName, const CImageProcess
 		m_eProcFlagsInitial = bKeepParams ? procFlags : GetProcFlagsIncludeExcludeFolders(sFileName, procFlags);
 		procFlags = m_eProcFlagsInitial;
 		m_imageProcParamsInitial = imageProcParams;
-		m_imageProcParamsInitial.LightenShadows *= m_fLightenShadowFactor;
+		if (m_bLightenShadowFactorKnown) {
+			m_imageProcParamsInitial.LightenShadows *= m_fLightenShadowFactor;
+		} else {
+			m_bLightenShadowsPending = true;
+		}
+	}
+	if (m_bParamDBPending) {
+		StartImageAnalysis(procFlags);
 	}
 }
 
@@ -873,13 +1156,14 @@ void CJPEGImage::GetFileParams(LPCTSTR sFileName, EProcessingFlags& eFlags, CIma
 	if (IsClipboardImage()) {
 		return;
 	}
-	CParameterDBEntry* dbEntry = CParameterDB::This().FindEntry(GetPixelHash());
+	CParameterDBEntry* dbEntry = FindParamDBEntry();
 	if (m_bInParamDB) {
 		CRotationParams notUsed(0);
 		if (!::GetProcessingFlag(eFlags, PFLAG_KeepParams)) {
 			dbEntry->WriteToProcessParams(params, eFlags, notUsed);
 		}
 	} else {
+		FinishImageAnalysis(true);
 		params.LightenShadows *= m_fLightenShadowFactor;
 		if (!::GetProcessingFlag(eFlags, PFLAG_KeepParams)) {
 			eFlags = GetProcFlagsIncludeExcludeFolders(sFileName, eFlags);
@@ -888,9 +1172,14 @@ void CJPEGImage::GetFileParams(LPCTSTR sFileName, EProcessingFlags& eFlags, CIma
 }
 
 void CJPEGImage::SetFileDependentProcessParams(LPCTSTR sFileName, CProcessParams* pParams) {
-	CParameterDBEntry* dbEntry = CParameterDB::This().FindEntry(GetPixelHash());
+	// do not wait for the pixel hash, the parameter DB is searched when it is known
+	m_bParamDBPending = !IsPixelHashKnown() && !CParameterDB::This().IsEmpty();
+	m_paramDBTargetSize = CSize(pParams->TargetWidth, pParams->TargetHeight);
+	m_paramDBMonitorSize = pParams->MonitorSize;
+	CParameterDBEntry* dbEntry = m_bParamDBPending ? NULL : FindParamDBEntry();
 	m_bInParamDB = dbEntry != NULL;
 	m_bHasZoomStoredInParamDB = m_bInParamDB && dbEntry->HasZoomOffsetStored();
+	m_bLightenShadowsPending = false;
 	if (m_bInParamDB) {
 		if (!::GetProcessingFlag(pParams->ProcFlags, PFLAG_KeepParams)) {
 			dbEntry->WriteToProcessParams(pParams->ImageProcParams, pParams->ProcFlags, pParams->RotationParams);
@@ -900,10 +1189,15 @@ void CJPEGImage::SetFileDependentProcessParams(LPCTSTR sFileName, CProcessParams
 		}
 	} else {
 		pParams->RotationParams.Rotation = GetRotationFromEXIF(pParams->RotationParams.Rotation);
-		pParams->ImageProcParams.LightenShadows *= m_fLightenShadowFactor;
 		if (!::GetProcessingFlag(pParams->ProcFlags, PFLAG_KeepParams)) {
 			pParams->ProcFlags = GetProcFlagsIncludeExcludeFolders(sFileName, pParams->ProcFlags);
 		}
+		if (m_bLightenShadowFactorKnown) {
+			pParams->ImageProcParams.LightenShadows *= m_fLightenShadowFactor;
+		} else {
+			// do not wait for the analysis, applied when known
+			m_bLightenShadowsPending = true;
+		}
 	}
 
 	m_nInitialRotation = pParams->RotationParams.Rotation;
@@ -913,6 +1207,51 @@ void CJPEGImage::SetFileDependentProcessParams(LPCTSTR sFileName, CProcessParams
 	m_imageProcParamsInitial = pParams->ImageProcParams;
 }
 
+void CJPEGImage::StartImageAnalysis(EProcessingFlags eProcFlags) {
+	if (m_pAnalysisRequest != NULL || !m_bLDCOwned) {
+		return;
+	}
+	// the pixel hash is only needed to search the parameter DB, the histogram for auto contrast and the LDC map
+	// (including sunset detection for the lighten shadow factor) for LDC
+	bool bFull = ::GetProcessingFlag(eProcFlags, PFLAG_LDC) && (!m_bLightenShadowFactorKnown || m_pLDC == NULL || !m_pLDC->IsMaskAvailable());
+	bool bPartial = m_bParamDBPending || (::GetProcessingFlag(eProcFlags, PFLAG_AutoContrast) && m_pLDC == NULL);
+	if (!bFull && !bPartial) {
+		return;
+	}
+	if (!VerifyOriginalPixels()) {
+		return;
+	}
+	// the layout before rotating is only needed if the pixel hash or the lighten shadow factor are not known yet
+	bool bSourceLayout = !m_bImageAnalyzed || (bFull && !m_bLightenShadowFactorKnown);
+	m_pAnalysisRequest = CImageAnalysisThread::This().AsyncAnalyze(this, bFull, bSourceLayout ? m_nAnalysisSourceRotation : 0);
+}
+
+bool CJPEGImage::IsImageAnalysisRunning() const {
+	return m_pAnalysisRequest != NULL && !CImageAnalysisThread::IsFinished(m_pAnalysisRequest);
+}
+
+bool CJPEGImage::UpdateFromImageAnalysis() {
+	if (IsImageAnalysisRunning()) {
+		return false;
+	}
+	WaitForImageAnalysis(); // does not block, already finished
+	if (m_bParamDBPending && IsPixelHashKnown()) {
+		m_bParamDBPending = false;
+		CParameterDBEntry* dbEntry = FindParamDBEntry();
+		if (dbEntry != NULL) {
+			m_bInParamDB = true;
+			m_bHasZoomStoredInParamDB = dbEntry->HasZoomOffsetStored();
+			if (!::GetProcessingFlag(m_eProcFlagsInitial, PFLAG_KeepParams)) {
+				ApplyDeferredParamDBEntry(dbEntry);
+			}
+			m_bInitialParamsChangedByAnalysis = true;
+		}
+	}
+	bool bChanged = m_bInitialParamsChangedByAnalysis;
+	m_bInitialParamsChangedByAnalysis = false;
+	return bChanged;
+}
+
 void CJPEGImage::DIBToOrig(float & fX, float & fY) {
 	float fXo = m_TargetOffset.x + fX;
 	float fYo = m_TargetOffset.y + fY;
@@ -928,6 +1267,7 @@ void CJPEGImage::OrigToDIB(float & fX, float & fY) {
 }
 
 __int64 CJPEGImage::GetUncompressedPixelHash() const { 
+	FinishImageAnalysis(false);
 	return (m_pLDC == NULL) ? 0 : m_pLDC->GetPixelHash(); 
 }
 
@@ -997,7 +1337,8 @@ void* CJPEGImage::GetDIBInternal(CSize fullTargetSize, CSize clippingSize, CPoin
 	if (pDIB == NULL) {
 		// if the image is reprocessed more than once, it is worth to convert the original to 4 channels
 		// as this is faster for further processing
-		if (!m_bFirstReprocessing) {
+		// (not when the original pixels have been released, point sampling can be done on the planar pixels)
+		if (!m_bFirstReprocessing && m_pOrigPixels != NULL) {
 			ConvertSrcTo4Channels();
 		}
 
@@ -1025,9 +1366,9 @@ void* CJPEGImage::GetDIBInternal(CSize fullTargetSize, CSize clippingSize, CPoin
 		if (m_pDIBPixels == NULL && m_pDIBPixelsLUTProcessed == NULL) {
 			if (pTrapezoid == NULL) {
 				m_pDIBPixels = Resample(fullTargetSize, clippingSize, targetOffset, eProcFlags, imageProcParams.Sharpen, dRotation, eResizeType);
-			} else {
+			} else if (VerifyOriginalPixels()) {
 				m_pDIBPixels = CBasicProcessing::PointSampleTrapezoid(fullTargetSize, *pTrapezoid, targetOffset, clippingSize, 
-					CSize(m_nOrigWidth, m_nOrigHeight), m_pOrigPixels, m_nOriginalChannels, CSettingsProvider::This().ColorBackground());
+					CSize(m_nOrigWidth, m_nOrigHeight), OrigPixelsView(), m_nOrigStride, m_nOriginalChannels, CSettingsProvider::This().ColorBackground());
 			}
 		}
 
@@ -1071,6 +1412,7 @@ void* CJPEGImage::GetDIBInternal(CSize fullTargetSize, CSize clippingSize, CPoin
 }
 
 void* CJPEGImage::ApplyUnsharpMask(const CUnsharpMaskParams * pUnsharpMaskParams, bool bNoChangesLDCandLUT) {
+	CTraceScope traceScope("UnsharpMask");
 	bool bThisUnsharpMaskValid = pUnsharpMaskParams != NULL;
 	if (bThisUnsharpMaskValid != m_bUnsharpMaskParamsValid) {
 		delete[] m_pDIBPixelsLUTProcessed;
@@ -1118,6 +1460,7 @@ void* CJPEGImage::ApplyCorrectionLUTandLDC(const CImageProcessingParams & imageP
 										   void * & pCachedTargetDIB, CSize fullTargetSize, CPoint targetOffset, 
 										   void * pSourceDIB, CSize dibSize,
 										   bool bGeometryChanged, bool bOnlyCheck, bool bCanTakeOwnershipOfSourceDIB, bool &bParametersChanged) {
+	CTraceScope traceScope("ApplyCorrectionLUTandLDC", "only_check", bOnlyCheck);
 
 	bool bAutoContrast = GetProcessingFlag(eProcFlags, PFLAG_AutoContrast);
 	bool bAutoContrastOld = GetProcessingFlag(m_eProcFlags, PFLAG_AutoContrast);
@@ -1173,24 +1516,31 @@ void* CJPEGImage::ApplyCorrectionLUTandLDC(const CImageProcessingParams & imageP
 		m_pLUTAllChannels = bNoContrastAndGammaLUT ? NULL : CBasicProcessing::CreateSingleChannelLUT(imageProcParams.Contrast, imageProcParams.Gamma);
 	}
 
-	// Calculate LDC if needed
-	if (m_pLDC == NULL) {
-		m_pLDC = new CLocalDensityCorr(*this, true);
-		bLDCParametersChanged = true;
-	}
-	if (bLDC) {
-		// maybe only partially constructed, we need fully constructed object here
-		m_pLDC->VerifyFullyConstructed();
-	}
-	if (bLDCParametersChanged && m_pLDC->IsMaskAvailable()) {
-		m_pLDC->SetLDCAmount(imageProcParams.LightenShadows, imageProcParams.DarkenHighlights);
+	// Calculate LDC if needed, its histogram is needed for the three channel LUT
+	if (bLDC || bMustUse3ChannelLUT) {
+		FinishImageAnalysis(bLDC);
+		if (m_pLDC == NULL) {
+			m_pLDC = new CLocalDensityCorr(*this, true);
+			bLDCParametersChanged = true;
+		}
+		if (bLDC) {
+			// maybe only partially constructed, we need fully constructed object here
+			m_pLDC->VerifyFullyConstructed();
+		}
+		// the LDC may have been created by the analysis without setting the amount
+		if ((bLDCParametersChanged || bMustReapplyLDC) && m_pLDC->IsMaskAvailable()) {
+			m_pLDC->SetLDCAmount(imageProcParams.LightenShadows, imageProcParams.DarkenHighlights);
+		}
 	}
 
 	// Recalculate special histogram if needed
-	const CHistogram* pHistogram = m_pLDC->GetHistogram();
+	const CHistogram* pHistogram = (m_pLDC == NULL) ? NULL : m_pLDC->GetHistogram();
 	bool bSpecialHistogram = false;
 	if (bMustUse3ChannelLUT) {
 		if (bAutoContrast && bAutoContrastSection && m_bLDCOwned && (!bAutoContrastSectionOld || bCorrectionFactorChanged || bColorCastCorrChanged)) {
+			if (m_pDIBPixels == NULL) {
+				VerifyOriginalPixels(); // the histogram is built from the original pixels in this case
+			}
 			pHistogram = new CHistogram(*this, false);
 			bSpecialHistogram = true;
 			delete[] m_pLUTRGB;
@@ -1270,18 +1620,169 @@ void* CJPEGImage::ApplyCorrectionLUTandLDC(const CImageProcessingParams & imageP
 }
 
 bool CJPEGImage::ConvertSrcTo4Channels() {
+	if (!VerifyOriginalPixels()) {
+		return false;
+	}
+	PackOriginalPixels();
 	if (m_nOriginalChannels == 3) {
 		void* pNewOriginalPixels = CBasicProcessing::Convert3To4Channels(m_nOrigWidth, m_nOrigHeight, m_pOrigPixels);
 		if (pNewOriginalPixels != NULL) {
-			delete[] m_pOrigPixels;
+			CPixelMemory::Free(m_pOrigPixels);
 			m_pOrigPixels = pNewOriginalPixels;
 			m_nOriginalChannels = 4;
+			ResetOriginalPixelsView();
 		}
 		return pNewOriginalPixels != NULL;
 	}
 	return true;
 }
 
+bool CJPEGImage::VerifyOriginalPixels() {
+	if (m_pOrigPixels == NULL && m_pYCbCrPixels != NULL) {
+		m_pOrigPixels = m_pYCbCrPixels->ConvertToBGR(m_nOriginalChannels);
+		ResetOriginalPixelsView();
+	} else if (m_pOrigPixels == NULL && m_pQOIPixels != NULL) {
+		m_pOrigPixels = QoiReaderWriter::DecompressPixels(m_pQOIPixels, m_nQOISize, m_nOrigWidth, m_nOrigHeight, m_nOriginalChannels);
+		ResetOriginalPixelsView();
+	}
+	return m_pOrigPixels != NULL;
+}
+
+void CJPEGImage::PackOriginalPixels() {
+	WaitForImageAnalysis();
+	CBasicProcessing::PackRowsInplace(m_nOrigWidth, m_nOrigHeight, m_nOriginalChannels, m_nOrigStride, m_nOrigPixelsOffset, m_pOrigPixels);
+	ResetOriginalPixelsView();
+}
+
+void CJPEGImage::ResetOriginalPixelsView() {
+	m_nOrigPixelsOffset = 0;
+	m_nOrigStride = Helpers::DoPadding(m_nOrigWidth * m_nOriginalChannels, 4);
+}
+
+COriginalPixelsState CJPEGImage::GetOriginalPixelsState() const {
+	COriginalPixelsState state;
+	state.Pixels = m_pOrigPixels;
+	state.Offset = m_nOrigPixelsOffset;
+	state.Stride = m_nOrigStride;
+	state.Width = m_nOrigWidth;
+	state.Height = m_nOrigHeight;
+	state.Channels = m_nOriginalChannels;
+	state.RotationParams = m_rotationParams;
+	state.IsDestructivelyProcessed = m_bIsDestructivelyProcessed;
+	state.IsProcessedNoParamDB = m_bIsProcessedNoParamDB;
+	return state;
+}
+
+void CJPEGImage::SetOriginalPixelsState(const COriginalPixelsState& state) {
+	m_pOrigPixels = state.Pixels;
+	m_nOrigPixelsOffset = state.Offset;
+	m_nOrigStride = state.Stride;
+	m_nOrigWidth = state.Width;
+	m_nOrigHeight = state.Height;
+	m_nOriginalChannels = state.Channels;
+	m_rotationParams = state.RotationParams;
+	m_bIsDestructivelyProcessed = state.IsDestructivelyProcessed;
+	m_bIsProcessedNoParamDB = state.IsProcessedNoParamDB;
+}
+
+void CJPEGImage::PushUndoStep(const COriginalPixelsState& previousState) {
+	CUndoStep* pStep = new(std::nothrow) CUndoStep(previousState);
+	if (pStep == NULL) {
+		CPixelMemory::Free(previousState.Pixels);
+		m_pUndoStack->PushWithoutStep();
+		return;
+	}
+	m_pUndoStack->Push(pStep, GetOriginalPixelsState().SizeInBytes());
+}
+
+void CJPEGImage::FinishImageAnalysis(bool bLightenShadowFactor) const {
+	WaitForImageAnalysis();
+	if (!m_bLDCOwned || (m_bImageAnalyzed && (m_bLightenShadowFactorKnown || !bLightenShadowFactor))) {
+		return;
+	}
+	// not (fully) analyzed in the background, analyze now
+	CJPEGImage* pThis = const_cast<CJPEGImage*>(this);
+	bool bChanged = m_bInitialParamsChangedByAnalysis;
+	if (m_pLDC != NULL && m_nAnalysisSourceRotation == 0) {
+		if (bLightenShadowFactor) {
+			m_pLDC->VerifyFullyConstructed();
+		}
+		pThis->TakeOverImageAnalysis(m_pLDC, 0);
+	} else if (pThis->VerifyOriginalPixels()) {
+		pThis->TakeOverImageAnalysis(new CLocalDensityCorr(*this, bLightenShadowFactor, m_nAnalysisSourceRotation), m_nAnalysisSourceRotation);
+	}
+	if ((m_bInitialParamsChangedByAnalysis && !bChanged) || m_bParamDBPending) {
+		CImageAnalysisThread::This().NotifyAnalysisFinished(); // the results are taken over as after a background analysis
+	}
+}
+
+void CJPEGImage::WaitForImageAnalysis() const {
+	if (m_pAnalysisRequest == NULL) {
+		return;
+	}
+	CJPEGImage* pThis = const_cast<CJPEGImage*>(this);
+	int nSourceRotation = m_pAnalysisRequest->SourceRotation;
+	CLocalDensityCorr* pLDC = CImageAnalysisThread::WaitForResult(m_pAnalysisRequest);
+	pThis->m_pAnalysisRequest = NULL;
+	pThis->TakeOverImageAnalysis(pLDC, nSourceRotation);
+}
+
+void CJPEGImage::TakeOverImageAnalysis(CLocalDensityCorr* pLDC, int nSourceRotation) {
+	if (pLDC == NULL) {
+		return; // analysis failed, done on demand later
+	}
+	m_bImageAnalyzed = true;
+	if (m_nPixelHash == 0) {
+		// Use the decompressed pixel hash in this case
+		m_nPixelHash = pLDC->GetPixelHash();
+	}
+	if (!m_bLightenShadowFactorKnown && pLDC->IsMaskAvailable()) {
+		m_fLightenShadowFactor = (1.0f - pLDC->GetHistogram()->IsNightShot())*(1.0f - pLDC->IsSunset());
+		m_bLightenShadowFactorKnown = true;
+		if (m_bLightenShadowsPending) {
+			m_imageProcParamsInitial.LightenShadows *= m_fLightenShadowFactor;
+			m_bLightenShadowsPending = false;
+			if (m_fLightenShadowFactor != 1.0f) m_bInitialParamsChangedByAnalysis = true;
+		}
+	}
+	if (pLDC == m_pLDC) {
+		return;
+	}
+	if (nSourceRotation != 0 || m_pLDC != NULL) {
+		// LDC mask must be recalculated on the rotated pixels, as after Rotate()
+		delete pLDC;
+	} else {
+		m_pLDC = pLDC;
+	}
+}
+
+CParameterDBEntry* CJPEGImage::FindParamDBEntry() const {
+	if (CParameterDB::This().IsEmpty()) {
+		return NULL;
+	}
+	return CParameterDB::This().FindEntry(GetPixelHash());
+}
+
+void CJPEGImage::ApplyDeferredParamDBEntry(CParameterDBEntry* dbEntry) {
+	CRotationParams rotationParams(m_rotationParams, m_nInitialRotation);
+	dbEntry->WriteToProcessParams(m_imageProcParamsInitial, m_eProcFlagsInitial, rotationParams);
+	dbEntry->GetColorCorrectionAmounts(m_fColorCorrectionFactors);
+	dbEntry->WriteToGeometricParams(m_dInitialZoom, m_initialOffsets, SizeAfterRotation(rotationParams),
+		dbEntry->IsStoredRelativeToScreenSize() ? m_paramDBMonitorSize : m_paramDBTargetSize);
+	m_nInitialRotation = rotationParams.Rotation;
+	m_bLightenShadowsPending = false;
+	// the loader applies the free rotation to the original pixels, the integer rotation is done when processing
+	VerifyRotation(CRotationParams(rotationParams, m_rotationParams.Rotation));
+}
+
+void CJPEGImage::FreeCompactPixels() {
+	delete m_pYCbCrPixels;
+	m_pYCbCrPixels = NULL;
+	QoiReaderWriter::FreeMemory(m_pQOIPixels);
+	m_pQOIPixels = NULL;
+	m_nQOISize = 0;
+}
+
 EProcessingFlags CJPEGImage::GetProcFlagsIncludeExcludeFolders(LPCTSTR sFileName, EProcessingFlags procFlags) const {
 	EProcessingFlags eFlags = procFlags;
 	CSettingsProvider& sp = CSettingsProvider::This();
@@ -1410,35 +1911,27 @@ CJPEGImage::EResizeType CJPEGImage::GetResizeType(CSize targetSize, CSize source
 	}
 }
 
+int CJPEGImage::GetRotationFromEXIF(void* pEXIFData, EImageFormat eImageFormat, int nWidth, int nHeight) {
+	if (pEXIFData == NULL || !CSettingsProvider::This().AutoRotateEXIF()) {
+		return 0;
+	}
+	CEXIFReader exifReader(pEXIFData, eImageFormat);
+	if (!exifReader.ImageOrientationPresent() || !IsEXIFOrientationTrusted(exifReader, nWidth, nHeight)) {
+		return 0;
+	}
+	return max(0, GetRotationFromOrientation(exifReader.GetImageOrientation()));
+}
+
 int CJPEGImage::GetRotationFromEXIF(int nOrigRotation) {
 	if (m_pEXIFReader != NULL && m_pEXIFReader->ImageOrientationPresent() && CSettingsProvider::This().AutoRotateEXIF()) {
-
-		// Some tools rotate the pixel data but do not reset the EXIF orientation flag.
-		// In this case the EXIF thumbnail is normally also not rotated.
-		// So check if the thumbnail orientation is the same as the image orientation.
-		// If not, it can be assumed that someone touched the pixels and we ignore the EXIF
-		// orientation.
-		if (m_pEXIFReader->GetThumbnailWidth() > 0 && m_pEXIFReader->GetThumbnailHeight() > 0) {
-			bool bWHOrig = m_nInitOrigWidth > m_nInitOrigHeight;
-			bool bWHThumb = m_pEXIFReader->GetThumbnailWidth() > m_pEXIFReader->GetThumbnailHeight();
-			if (bWHOrig != bWHThumb) {
-				return nOrigRotation;
-			}
+		if (!IsEXIFOrientationTrusted(*m_pEXIFReader, m_nInitOrigWidth, m_nInitOrigHeight)) {
+			return nOrigRotation;
 		}
 
-		switch (m_pEXIFReader->GetImageOrientation()) {
-			case 1:
-				m_bRotationByEXIF = true;
-				return 0;
-			case 3:
-				m_bRotationByEXIF = true;
-				return 180;
-			case 6:
-				m_bRotationByEXIF = true;
-				return 90;
-			case 8:
-				m_bRotationByEXIF = true;
-				return 270;
+		int nRotation = GetRotationFromOrientation(m_pEXIFReader->GetImageOrientation());
+		if (nRotation >= 0) {
+			m_bRotationByEXIF = true;
+			return nRotation;
 		}
 	}
 
@@ -1455,13 +1948,47 @@ int CJPEGImage::GetRotationFromEXIF(int nOrigRotation) {
 	return nOrigRotation;
 }
 
+bool CJPEGImage::IsEXIFOrientationTrusted(CEXIFReader& exifReader, int nWidth, int nHeight) {
+	// Some tools rotate the pixel data but do not reset the EXIF orientation flag.
+	// In this case the EXIF thumbnail is normally also not rotated.
+	// So check if the thumbnail orientation is the same as the image orientation.
+	// If not, it can be assumed that someone touched the pixels and we ignore the EXIF
+	// orientation.
+	if (exifReader.GetThumbnailWidth() > 0 && exifReader.GetThumbnailHeight() > 0) {
+		bool bWHOrig = nWidth > nHeight;
+		bool bWHThumb = exifReader.GetThumbnailWidth() > exifReader.GetThumbnailHeight();
+		return bWHOrig == bWHThumb;
+	}
+	return true;
+}
+
+int CJPEGImage::GetRotationFromOrientation(int nOrientation) {
+	switch (nOrientation) {
+		case 1:
+			return 0;
+		case 3:
+			return 180;
+		case 6:
+			return 90;
+		case 8:
+			return 270;
+	}
+	return -1;
+}
+
 void CJPEGImage::MarkAsDestructivelyProcessed() {
+	FreeCompactPixels(); // the compact pixels no longer match the original pixels
 	m_bIsDestructivelyProcessed = true;
 	m_rotationParams.FreeRotation = 0.0;
 	m_rotationParams.Flags = RFLAG_None;
 }
 
-void CJPEGImage::InvalidateAllCachedPixelData() {
+void CJPEGImage::InvalidateAllCachedPixelData(bool bFinishAnalysis) {
+	if (bFinishAnalysis) {
+		FinishImageAnalysis(true); // the analysis must be done on the unmodified pixels
+	} else {
+		WaitForImageAnalysis();
+	}
 	m_pLastDIB = NULL;
 	if (m_bLDCOwned) delete m_pLDC; // LDC mask must be recalculated!
 	m_pLDC = NULL;
@@ -1481,13 +2008,15 @@ void CJPEGImage::InvalidateAllCachedPixelData() {
 }
 
 CJPEGImage* CJPEGImage::CreateThumbnailImage() {
+	FinishImageAnalysis(true);
 	if (m_pLDC == NULL) {
 		m_pLDC = new CLocalDensityCorr(*this, true);
 	}
 	void* pPixels = NULL;
 	int nWidth, nHeight;
-	if (m_nOrigWidth*m_nOrigHeight < 120000) {
+	if (m_nOrigWidth*m_nOrigHeight < 120000 && VerifyOriginalPixels()) {
 		// take a copy of the original pixels
+		PackOriginalPixels();
 		nWidth = m_nOrigWidth;
 		nHeight = m_nOrigHeight;
 		if (m_nOriginalChannels == 3) {
@@ -6,6 +6,11 @@ class CHistogram;
 class CLocalDensityCorr;
 class CEXIFReader;
 class CRawMetadata;
+class CYCbCrImage;
+class CUndoStack;
+class COriginalPixelsState;
+class CImageAnalysisRequest;
+class CParameterDBEntry;
 enum TJSAMP;
 
 // Represents a rectangle to dim out in the image
@@ -16,11 +21,47 @@ struct CDimRect {
 	CRect Rect;
 };
 
+// Memory used by an image in bytes, by category (see CJPEGImage::GetMemoryUsage())
+struct CImageMemoryUsage {
+	CImageMemoryUsage() {
+		OriginalPixels = CompressedPixels = DIBs = UnsharpMask = Thumbnails = LDC = Histogram = LUTs = EXIF = UndoSteps = 0;
+	}
+
+	size_t OriginalPixels; // original pixels, for cropped images up to the last row in use
+	size_t CompressedPixels; // planar YCbCr or QOI compressed pixels the original pixels can be recreated from
+	size_t DIBs; // processed pixels for display, with and without LUT and LDC applied
+	size_t UnsharpMask; // gray and smoothed gray images used for unsharp masking
+	size_t Thumbnails; // thumbnail and histogram thumbnail images, with all their memory
+	size_t LDC; // LDC maps, point sampled image and histograms
+	size_t Histogram; // histogram of the processed pixels
+	size_t LUTs; // lookup tables for contrast, gamma, color and saturation correction
+	size_t EXIF; // copy of the EXIF block and RAW metadata
+	size_t UndoSteps; // pixels held by the undo and redo steps
+
+	size_t Total() const {
+		return OriginalPixels + CompressedPixels + DIBs + UnsharpMask + Thumbnails + LDC + Histogram + LUTs + EXIF + UndoSteps;
+	}
+
+	void Add(const CImageMemoryUsage& other) {
+		OriginalPixels += other.OriginalPixels;
+		CompressedPixels += other.CompressedPixels;
+		DIBs += other.DIBs;
+		UnsharpMask += other.UnsharpMask;
+		Thumbnails += other.Thumbnails;
+		LDC += other.LDC;
+		Histogram += other.Histogram;
+		LUTs += other.LUTs;
+		EXIF += other.EXIF;
+		UndoSteps += other.UndoSteps;
+	}
+};
+
 // Class holding a decoded image (not just JPEG - any supported format) and its meta data (if available).
 class CJPEGImage {
 public:
 	// Ownership of memory in pPixels goes to class, accessing this pointer after the constructor has been called
-	// may causes access violations (use OriginalPixels() instead).
+	// may causes access violations (use OriginalPixels() instead). pPixels must be allocated with new[] or with
+	// CPixelMemory::Allocate(), the latter is used for very large images.
 	// nChannels can be 1 (greyscale image), 3 (BGR color image) or 4 (BGRA color image, A ignored)
 	// pEXIFData can be a pointer to the APP1 block containing the EXIF data. If this pointer is null
 	// no EXIF data is available.
@@ -32,9 +73,11 @@ public:
 	// The pLDC object is used internally only for thumbnail image creation to avoid duplication. In all other situations,
 	// its value must be NULL.
 	// If RAW metadata is specified, ownership of this memory is transferred to this class.
+	// nRotation is set when the loader has already rotated the pixels clockwise by 90, 180 or 270 degrees (see
+	// GetRotationFromEXIF(void*, ...)), nWidth and nHeight are the size of the rotated pixels in this case.
 	CJPEGImage(int nWidth, int nHeight, void* pPixels, void* pEXIFData, int nChannels, 
 		__int64 nJPEGHash, EImageFormat eImageFormat, bool bIsAnimation, int nFrameIndex, int nNumberOfFrames, int nFrameTimeMs,
-		CLocalDensityCorr* pLDC = NULL, bool bIsThumbnailImage = false, CRawMetadata* pRawMetadata = NULL);
+		CLocalDensityCorr* pLDC = NULL, bool bIsThumbnailImage = false, CRawMetadata* pRawMetadata = NULL, int nRotation = 0);
 	~CJPEGImage(void);
 
 	// Gets resampled and processed 32 bpp DIB image (up or downsampled).
@@ -57,6 +100,10 @@ public:
 		return GetDIBInternal(fullTargetSize, clippingSize, targetOffset, imageProcParams, eProcFlags, NULL, NULL, 0.0, false, bNotUsed);
 	}
 
+	// Calculates the resize filters needed by GetDIB() for the given full target size and clipping size in the background,
+	// thus a later GetDIB() call with these sizes does not need to create them. Used for the zoom steps next to the current one.
+	void PrecomputeResizeFilters(CSize fullTargetSize, CSize clippingSize, const CImageProcessingParams & imageProcParams, EProcessingFlags eProcFlags);
+
 	// Gets resampled and processed DIB image (up or downsampled), also including a low quality rotation.
 	// The rotation angle is specified in radians.
 	// PFLAG_HighQualityResampling must not be set when calling this method 
@@ -105,7 +152,7 @@ public:
 
 	// Operations on original pixels of the image
 
-	// Apply unsharp masking to the original image pixels. Cannot be undone except by reloading the image from disk.
+	// Apply unsharp masking to the original image pixels. Can be undone with Undo().
 	// Returns false if not enough memory is available to perform the operation.
 	bool ApplyUnsharpMaskToOriginalPixels(const CUnsharpMaskParams & unsharpMaskParams);
 
@@ -138,14 +185,26 @@ public:
 	// Returns false if not enough memory is available to perform the operation or if specified size is not valid.
 	bool ResizeOriginalPixels(EResizeFilter filter, CSize newSize);
 
+	// Undoes or redoes the last of the operations above. The original pixels replaced or modified by these operations
+	// are kept in memory (only the modified tiles for in-place operations), thus no reloading is needed.
+	// Mirror(), Crop() and Rotate() remove all undo steps. Returns false if there is nothing to undo or redo.
+	bool Undo();
+	bool Redo();
+	bool CanUndo() const;
+	bool CanRedo() const;
+
+	// Removes all undo and redo steps, freeing the memory held by them
+	void ClearUndoSteps();
+
 	// Gets histogram of the original, unprocessed image
 	const CHistogram* GetOriginalHistogram();
 
 	// Gets the histogram of the processed image - histogram is over the whole image, not only the visible section
 	const CHistogram* GetProcessedHistogram();
 
-	// Gets the hash value of the pixels, for JPEGs the hash is on the compressed pixels
-	__int64 GetPixelHash() const { return m_nPixelHash; }
+	// Gets the hash value of the pixels, for JPEGs the hash is on the compressed pixels.
+	// For other images the pixels are analyzed if not yet done.
+	__int64 GetPixelHash() const { if (!IsPixelHashKnown()) FinishImageAnalysis(false); return m_nPixelHash; }
 
 	// Gets the pixel hash over the de-compressed pixels
 	__int64 GetUncompressedPixelHash() const;
@@ -198,10 +257,33 @@ public:
 	bool IsProcessedNoParamDB() { return m_bIsProcessedNoParamDB; }
 
 	// raw access to original pixels - do not delete or store the returned pointer
-	void* OriginalPixels() { return  m_pOrigPixels; }
-	const void* OriginalPixels() const { return m_pOrigPixels; }
+	// The const version returns NULL if the original pixels have been released with ReleaseOriginalPixels()
+	// After cropping, the original pixels are a section of a larger image, use OriginalStride() to step the rows.
+	void* OriginalPixels() { VerifyOriginalPixels(); return OrigPixelsView(); }
+	const void* OriginalPixels() const { return OrigPixelsView(); }
+	// distance of the rows of the original pixels in bytes
+	int OriginalStride() const { return m_nOrigStride; }
 	// remove original pixels from class - OriginalPixels() will return NULL afterwards
-	void DetachOriginalPixels() { m_pOrigPixels = NULL; }
+	void DetachOriginalPixels() { WaitForImageAnalysis(); m_pOrigPixels = NULL; FreeCompactPixels(); ClearUndoSteps(); }
+
+	// Attaches the planar YCbCr pixels (JPEG only) the original pixels have been decoded from. The image takes ownership.
+	void SetYCbCrPixels(CYCbCrImage* pYCbCrPixels);
+
+	// Releases the original pixels if they can be recreated from the planar YCbCr pixels, which need much less memory.
+	// The original pixels are recreated when needed, the point samplers work directly on the planar pixels.
+	// Returns if the original pixels have been released.
+	bool ReleaseOriginalPixels();
+
+	// Compresses the original pixels losslessly (QOI) and releases them together with the processed pixels, used for the
+	// images in the second tier of the JPEG provider. As after ReleaseOriginalPixels(), the original pixels are recreated when needed.
+	// May be called by another thread while the image is not accessed otherwise. Returns if the pixels have been released.
+	bool CompressOriginalPixels();
+
+	// Size of the QOI compressed original pixels in bytes, zero if not available
+	int CompressedPixelsSize() const { return m_nQOISize; }
+
+	// Gets the memory used by this image by category. Results of the background analysis are only counted when finished.
+	CImageMemoryUsage GetMemoryUsage() const;
 
 	// returns the number of channels in the OriginalPixels (3 or 4, corresponding to 24 bpp and 32 bpp)
 	int OriginalChannels() const { return m_nOriginalChannels; }
@@ -226,7 +308,8 @@ public:
 	// Gets the image processing flags last used to process an image
 	EProcessingFlags GetLastProcessFlags() const { return m_eProcFlags; }
 	
-	// Gets the image processing parameters as set as default (may varies from file to file)
+	// Gets the image processing parameters as set as default (may varies from file to file).
+	// The lighten shadow factor and the parameter DB entry may be applied later, see UpdateFromImageAnalysis().
 	const CImageProcessingParams& GetInitialProcessParams() const { return m_imageProcParamsInitial; }
 
 	// Gets the image processing parameters last used to process an image
@@ -257,6 +340,19 @@ public:
 	// processing parameters for this file (maybe different from the global ones)
 	void SetFileDependentProcessParams(LPCTSTR sFileName, CProcessParams* pParams);
 
+	// Starts analyzing the original pixels in the background as far as needed for processing with the given flags and for
+	// searching the parameter DB. Nothing is started if not needed, the analysis is done on demand then.
+	// Called by the loader after the file dependent parameters have been set and the image has been rotated.
+	void StartImageAnalysis(EProcessingFlags eProcFlags);
+
+	// Returns if the background analysis of the image is still running
+	bool IsImageAnalysisRunning() const;
+
+	// Takes over the results of a finished background analysis without waiting and searches the parameter DB if deferred.
+	// Returns true if the initial parameters have been changed by the analysis since the last call (lighten shadow factor
+	// applied or image found in parameter DB), the image must be shown again with these parameters then.
+	bool UpdateFromImageAnalysis();
+
 	// Sets the regions of the returned DIB that are dimmed out (set dimRects to NULL for no dimming)
 	void SetDimRects(const CDimRect* dimRects, int numberOfRects);
 	// Disable/enable dimming with the set dim rects (default is enabled)
@@ -272,8 +368,12 @@ public:
 	// Gets if zoom and offset values are stored for this image in the parameter DB
 	bool HasZoomStoredInParamDB() const { return m_bHasZoomStoredInParamDB; }
 
-	// Gets the factor to lighten shadows based on sunset and nightshot detection
-	float GetLightenShadowFactor() { return m_fLightenShadowFactor; }
+	// Gets the factor to lighten shadows based on sunset and nightshot detection. Analyzes the image if not yet done,
+	// without bWait 1.0 is returned in this case.
+	float GetLightenShadowFactor(bool bWait = true) {
+		if (bWait) FinishImageAnalysis(true);
+		return m_bLightenShadowFactorKnown ? m_fLightenShadowFactor : 1.0f;
+	}
 
 	// Gets the EXIF data block (including the APP1 marker in the first two bytes) of the image. Returns NULL if none.
 	void* GetEXIFData() { return m_pEXIFData; }
@@ -321,6 +421,11 @@ public:
 	// Converts the target offset from 'center of image' based format to pixel coordinate format 
 	static CPoint ConvertOffset(CSize fullTargetSize, CSize clippingSize, CPoint targetOffset);
 
+	// Gets the rotation given by the EXIF orientation for an image not yet constructed, nWidth and nHeight are the
+	// size of the unrotated image. Returns zero if the image will not be auto-rotated by EXIF.
+	// Loaders use this to write the pixels directly in the rotated layout instead of rotating them after loading.
+	static int GetRotationFromEXIF(void* pEXIFData, EImageFormat eImageFormat, int nWidth, int nHeight);
+
 	// Debug: Returns if this could be a night shot (heuristic, between 0 and 1)
 	float IsNightShot() const;
 
@@ -334,6 +439,13 @@ public:
 	void SetLoadTickCount(double tc) { m_dLoadTickCount = tc; }
 	double GetLoadTickCount() { return m_dLoadTickCount; }
 
+	// Debug: Time in ms spent in the given stage of loading the image, set by the image load thread
+	void SetLoadStageTickCounts(const double* pTickCounts) { memcpy(m_dLoadStageTickCounts, pTickCounts, sizeof(m_dLoadStageTickCounts)); }
+	double GetLoadStageTickCount(ELoadStage eStage) const { return m_dLoadStageTickCounts[eStage]; }
+
+	// Debug: Time in ms spent parsing the EXIF block in the constructor
+	double GetEXIFParseTickCount() const { return m_dEXIFParseTickCount; }
+
 	// Debug: Unsharp mask time of image in ms
 	double GetUnsharpMaskTickCount() { return m_dUnsharpMaskTickCount; }
 
@@ -349,6 +461,15 @@ private:
 	// Original pixel data - only rotations and crop are done directly on this data because this is non-destructive
 	// The data is not modified in all other cases
 	void* m_pOrigPixels;
+	// The original pixels used start m_nOrigPixelsOffset bytes into m_pOrigPixels and have rows of m_nOrigStride bytes.
+	// Cropping only changes this view, the other operations pack the rows first if needed (see PackOriginalPixels()).
+	size_t m_nOrigPixelsOffset;
+	int m_nOrigStride;
+	// Planar YCbCr pixels of JPEG images the original pixels can be recreated from, NULL if not available
+	CYCbCrImage* m_pYCbCrPixels;
+	// QOI compressed original pixels the original pixels can be recreated from, NULL if not available
+	void* m_pQOIPixels;
+	int m_nQOISize;
 	void* m_pEXIFData;
 	CRawMetadata* m_pRawMetadata;
 	int m_nEXIFSize;
@@ -428,6 +549,8 @@ private:
 
 	double m_dLastOpTickCount;
 	double m_dLoadTickCount;
+	double m_dLoadStageTickCounts[LoadStage_NumStages];
+	double m_dEXIFParseTickCount;
 	double m_dUnsharpMaskTickCount;
 
 	// stuff needed to perform LUT and LDC processing
@@ -435,7 +558,17 @@ private:
 	uint8* m_pLUTRGB; // B,G,R three channel LUT
 	int32* m_pSaturationLUTs; // Saturation LUTs
 	CLocalDensityCorr* m_pLDC;
+	CUndoStack* m_pUndoStack;
 	bool m_bLDCOwned;
+	// Analysis of the original pixels running in the background, NULL if none
+	CImageAnalysisRequest* m_pAnalysisRequest;
+	int m_nAnalysisSourceRotation; // rotation of the original pixels against the layout analyzed for pixel hash and lighten shadow factor
+	bool m_bImageAnalyzed; // pixel hash known (also of non-JPEG images)
+	bool m_bLightenShadowFactorKnown; // sunset and night shot detection done, m_fLightenShadowFactor is valid
+	bool m_bLightenShadowsPending; // m_imageProcParamsInitial.LightenShadows still needs to be multiplied by m_fLightenShadowFactor
+	bool m_bParamDBPending; // the parameter DB is searched when the pixel hash is known, see UpdateFromImageAnalysis()
+	bool m_bInitialParamsChangedByAnalysis;
+	CSize m_paramDBTargetSize, m_paramDBMonitorSize; // to apply the geometric parameters of a deferred parameter DB entry
 	float m_fColorCorrectionFactors[6];
 	float m_fColorCorrectionFactorsNull[6];
 
@@ -480,9 +613,50 @@ private:
 			pSourceDIB, dibSize, bGeometryChanged, bOnlyCheck, bCanTakeOwnershipOfSourceDIB, bNotUsed);
 	}
 
-	// makes sure that the input image (m_pOrigPixels) is a 4 channel BGRA image (converts if necessary)
+	// makes sure that the input image (m_pOrigPixels) is a packed 4 channel BGRA image (converts if necessary)
 	bool ConvertSrcTo4Channels();
 
+	// first pixel of the view on the original pixels, NULL if there are no original pixels
+	void* OrigPixelsView() const { return (m_pOrigPixels == NULL) ? NULL : (uint8*)m_pOrigPixels + m_nOrigPixelsOffset; }
+
+	// moves the view on the original pixels to the start of m_pOrigPixels, with rows padded to 4 bytes
+	void PackOriginalPixels();
+
+	// resets the view to the full m_pOrigPixels, to be called when m_pOrigPixels, its size or its channels change
+	void ResetOriginalPixelsView();
+
+	// gets and sets the original pixels and the state changed by the undoable operations
+	COriginalPixelsState GetOriginalPixelsState() const;
+	void SetOriginalPixelsState(const COriginalPixelsState& state);
+
+	// pushes an undo step for an operation that has replaced the original pixels, the step takes ownership of the previous pixels
+	void PushUndoStep(const COriginalPixelsState& previousState);
+
+	// completes the analysis of the original pixels and takes over its results (m_pLDC, pixel hash of non-JPEG images and,
+	// with bLightenShadowFactor, the lighten shadow factor). Waits for the background analysis or analyzes synchronously.
+	// Must be called before accessing these and before modifying the original pixels.
+	void FinishImageAnalysis(bool bLightenShadowFactor) const;
+
+	// waits for the background analysis if started and takes over its results, to be called before moving or freeing the original pixels
+	void WaitForImageAnalysis() const;
+
+	// takes over the results of an analysis of the original pixels rotated by nSourceRotation, pLDC is deleted if not kept as m_pLDC
+	void TakeOverImageAnalysis(CLocalDensityCorr* pLDC, int nSourceRotation);
+
+	bool IsPixelHashKnown() const { return m_nPixelHash != 0 || m_bImageAnalyzed; }
+
+	// finds the parameter DB entry of this image, no need to wait for the pixel hash if the DB is empty
+	CParameterDBEntry* FindParamDBEntry() const;
+
+	// writes a parameter DB entry found after loading to the initial parameters and applies its free rotation
+	void ApplyDeferredParamDBEntry(CParameterDBEntry* dbEntry);
+
+	// makes sure that m_pOrigPixels is available, recreates it from the planar YCbCr or the QOI pixels if it has been released
+	bool VerifyOriginalPixels();
+
+	// deletes the planar YCbCr and the QOI pixels, to be called when the original pixels are modified
+	void FreeCompactPixels();
+
 	// Gets the processing flags according to the inclusion/exclusion list in INI file
 	EProcessingFlags GetProcFlagsIncludeExcludeFolders(LPCTSTR sFileName, EProcessingFlags procFlags) const;
 
@@ -498,11 +672,17 @@ private:
 	// Gets the rotation from EXIF if available
 	int GetRotationFromEXIF(int nOrigRotation);
 
+	// Returns if the EXIF orientation can be trusted for an image of the given unrotated size and gets the rotation
+	// for the orientation (-1 if the orientation is not supported)
+	static bool IsEXIFOrientationTrusted(CEXIFReader& exifReader, int nWidth, int nHeight);
+	static int GetRotationFromOrientation(int nOrientation);
+
 	// Sets the m_bIsDestructivelyProcessed flag to true and resets rotation
 	void MarkAsDestructivelyProcessed();
 
-	// Called when the original pixels have changed (rotate, crop, unsharp mask), all cached pixel data gets invalid
-	void InvalidateAllCachedPixelData();
+	// Called when the original pixels have changed (rotate, crop, unsharp mask), all cached pixel data gets invalid.
+	// bFinishAnalysis can be false if the analysis still to be done does not depend on the change.
+	void InvalidateAllCachedPixelData(bool bFinishAnalysis = true);
 
 	// Create a thumbnail image of this image
 	CJPEGImage* CreateThumbnailImage();
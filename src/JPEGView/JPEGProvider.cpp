@@ -2,10 +2,13 @@
 #include "JPEGProvider.h"
 #include "JPEGImage.h"
 #include "ImageLoadThread.h"
+#include "ImageCompressThread.h"
+#include "SettingsProvider.h"
 #include "MessageDef.h"
 #include "FileList.h"
 #include "ProcessParams.h"
 #include "BasicProcessing.h"
+#include "Tracing.h"
 
 CJPEGProvider::CJPEGProvider(HWND handlerWnd, int nNumThreads, int nNumBuffers) {
 	m_hHandlerWnd = handlerWnd;
@@ -17,6 +20,8 @@ CJPEGProvider::CJPEGProvider(HWND handlerWnd, int nNumThreads, int nNumBuffers)
 	for (int i = 0; i < nNumThreads; i++) {
 		m_pWorkThreads[i] = new CImageLoadThread();
 	}
+	m_nMaxCompressedBytes = (__int64)CSettingsProvider::This().CompressedCacheSizeMB() * 1024 * 1024;
+	m_pCompressThread = (m_nMaxCompressedBytes > 0) ? new CImageCompressThread() : NULL;
 }
 
 CJPEGProvider::~CJPEGProvider(void) {
@@ -24,8 +29,18 @@ CJPEGProvider::~CJPEGProvider(void) {
 		delete m_pWorkThreads[i];
 	}
 	delete[] m_pWorkThreads;
+	// terminating the thread finishes the compression in progress, the images not yet compressed are not accessed anymore
+	delete m_pCompressThread;
 	std::list<CImageRequest*>::iterator iter;
 	for (iter = m_requestList.begin( ); iter != m_requestList.end( ); iter++ ) {
+		if ((*iter)->SecondTierRequest != NULL) {
+			delete (*iter)->SecondTierRequest->Image;
+			delete (*iter)->SecondTierRequest;
+		}
+		delete (*iter)->Image;
+		delete *iter;
+	}
+	for (iter = m_compressedList.begin( ); iter != m_compressedList.end( ); iter++ ) {
 		delete (*iter)->Image;
 		delete *iter;
 	}
@@ -41,7 +56,7 @@ CJPEGImage* CJPEGProvider::RequestImage(CFileList* pFileList, EReadAheadDirectio
 	}
 
 	// Search if we have the requested image already present or in progress
-	CImageRequest* pRequest = FindRequest(strFileName, nFrameIndex);
+	CImageRequest* pRequest = FindRequest(strFileName, nFrameIndex, processParams);
 	bool bDirectionChanged = eDirection != m_eOldDirection || eDirection == TOGGLE;
 	bool bRemoveAlsoActiveRequests = bDirectionChanged; // if direction changed, all read-ahead requests are wrongly guessed
 	bool bWasOutOfMemory = false;
@@ -58,13 +73,17 @@ CJPEGImage* CJPEGProvider::RequestImage(CFileList* pFileList, EReadAheadDirectio
 	}
 
 	// wait for request if not yet ready
+	bool bCached = pRequest->Ready;
 	if (!pRequest->Ready) {
 #ifdef DEBUG
 		::OutputDebugString(_T("Waiting for request: ")); ::OutputDebugString(pRequest->FileName); ::OutputDebugString(_T("\n"));
 #endif
+		CTraceScope traceScope("RequestImage wait", "frame", nFrameIndex);
 		::WaitForSingleObject(pRequest->EventFinished, INFINITE);
 		GetLoadedImageFromWorkThread(pRequest);
-	} else {
+		bCached = pRequest->FromSecondTier; // the file is unchanged and the image of the second tier is used
+	}
+	if (bCached) {
 		CJPEGImage* pImage = pRequest->Image;
 		if (pImage != NULL) {
 			// make sure the initial parameters are reset as when keep params was on before they are wrong
@@ -98,6 +117,7 @@ CJPEGImage* CJPEGProvider::RequestImage(CFileList* pFileList, EReadAheadDirectio
 	// cleanup stuff no longer used
 	RemoveUnusedImages(bRemoveAlsoActiveRequests);
 	ClearOldestInactiveRequest();
+	RemoveCompressedImagesOverBudget();
 
 	// check if we shall start new requests (don't start another request if we are short of memory!)
 	if (m_requestList.size() < (unsigned int)m_nNumBuffers && !bDirectionChanged && !bWasOutOfMemory && eDirection != NONE) {
@@ -116,6 +136,10 @@ void CJPEGProvider::NotifyNotUsed(CJPEGImage* pImage) {
 		if ((*iter)->Image == pImage) {
 			(*iter)->InUse = false;
 			(*iter)->IsActive = false;
+			if (pImage != NULL) {
+				pImage->ReleaseOriginalPixels(); // cached images only keep the compact pixel data if available
+				pImage->ClearUndoSteps(); // undo is only kept for the image currently displayed
+			}
 			return;
 		}
 	}
@@ -124,6 +148,7 @@ void CJPEGProvider::NotifyNotUsed(CJPEGImage* pImage) {
 }
 
 void CJPEGProvider::ClearAllRequests() {
+	ClearSecondTier();
 	std::list<CImageRequest*>::iterator iter;
 	for (iter = m_requestList.begin( ); iter != m_requestList.end( ); iter++ ) {
 		if (ClearRequest((*iter)->Image)) {
@@ -135,7 +160,7 @@ void CJPEGProvider::ClearAllRequests() {
 }
 
 bool CJPEGProvider::FreeAllPossibleMemory() {
-	bool bCouldFreeMemory = false;
+	bool bCouldFreeMemory = ClearSecondTier();
 	std::list<CImageRequest*>::iterator iter;
 	for (iter = m_requestList.begin( ); iter != m_requestList.end( ); iter++ ) {
 		CImageRequest* pRequest = *iter;
@@ -149,6 +174,23 @@ bool CJPEGProvider::FreeAllPossibleMemory() {
 	return bCouldFreeMemory;
 }
 
+CImageMemoryUsage CJPEGProvider::GetMemoryUsage() const {
+	CImageMemoryUsage usage;
+	std::list<CImageRequest*>::const_iterator iter;
+	for (iter = m_requestList.begin( ); iter != m_requestList.end( ); iter++ ) {
+		if ((*iter)->Ready && (*iter)->Image != NULL) {
+			usage.Add((*iter)->Image->GetMemoryUsage());
+		}
+	}
+	// images are modified by the compress thread until the event is signaled
+	for (iter = m_compressedList.begin( ); iter != m_compressedList.end( ); iter++ ) {
+		if (::WaitForSingleObject((*iter)->EventFinished, 0) == WAIT_OBJECT_0 && (*iter)->Image != NULL) {
+			usage.Add((*iter)->Image->GetMemoryUsage());
+		}
+	}
+	return usage;
+}
+
 void CJPEGProvider::FileHasRenamed(LPCTSTR sOldFileName, LPCTSTR sNewFileName) {
 	std::list<CImageRequest*>::iterator iter;
 	for (iter = m_requestList.begin( ); iter != m_requestList.end( ); iter++ ) {
@@ -156,6 +198,11 @@ void CJPEGProvider::FileHasRenamed(LPCTSTR sOldFileName, LPCTSTR sNewFileName) {
 			(*iter)->FileName = sNewFileName;
 		}
 	}
+	for (iter = m_compressedList.begin( ); iter != m_compressedList.end( ); iter++ ) {
+		if (_tcsicmp(sOldFileName, (*iter)->FileName) == 0) {
+			(*iter)->FileName = sNewFileName;
+		}
+	}
 }
 
 bool CJPEGProvider::ClearRequest(CJPEGImage* pImage, bool releaseLockedFile) {
@@ -185,28 +232,56 @@ void CJPEGProvider::OnImageLoadCompleted(int nHandle) {
 	std::list<CImageRequest*>::iterator iter;
 	for (iter = m_requestList.begin( ); iter != m_requestList.end( ); iter++ ) {
 		if ((*iter)->Handle == nHandle) {
+			bool bIsReadAhead = (*iter)->HandlingThread != NULL && !(*iter)->InUse;
 			GetLoadedImageFromWorkThread(*iter);
 			if ((*iter)->Deleted) {
 				// this request was deleted, delete image now
 				ClearRequest((*iter)->Image);
+			} else if (bIsReadAhead && (*iter)->Image != NULL) {
+				// read ahead images only keep the compact pixel data if available, the processed DIB is kept anyway
+				(*iter)->Image->ReleaseOriginalPixels();
 			}
 			break;
 		}
 	}
 }
 
-CJPEGProvider::CImageRequest* CJPEGProvider::FindRequest(LPCTSTR strFileName, int nFrameIndex) {
+void CJPEGProvider::OnImageAnalysisFinished() {
+	std::list<CImageRequest*>::iterator iter;
+	for (iter = m_requestList.begin( ); iter != m_requestList.end( ); iter++ ) {
+		CJPEGImage* pImage = (*iter)->Image;
+		if ((*iter)->Ready && !(*iter)->InUse && pImage != NULL && !pImage->IsImageAnalysisRunning()) {
+			pImage->UpdateFromImageAnalysis(); // the initial parameters are restored when the image is requested
+			pImage->ReleaseOriginalPixels();
+		}
+	}
+}
+
+CJPEGProvider::CImageRequest* CJPEGProvider::FindRequest(LPCTSTR strFileName, int nFrameIndex, const CProcessParams & processParams) {
 	std::list<CImageRequest*>::iterator iter;
 	for (iter = m_requestList.begin( ); iter != m_requestList.end( ); iter++ ) {
 		if (_tcsicmp((*iter)->FileName, strFileName) == 0 && (*iter)->FrameIndex == nFrameIndex && !(*iter)->Deleted) {
 			return *iter;
 		}
 	}
+	for (iter = m_compressedList.begin( ); iter != m_compressedList.end( ); iter++ ) {
+		if (_tcsicmp((*iter)->FileName, strFileName) == 0 && (*iter)->FrameIndex == nFrameIndex) {
+#ifdef DEBUG
+			::OutputDebugString(_T("Found in second tier: ")); ::OutputDebugString(strFileName); ::OutputDebugString(_T("\n"));
+#endif
+			// The file may have been changed on disk since it was loaded. A load thread checks this, it only loads the file
+			// if changed. Otherwise the image of the entry is used, its original pixels are decompressed when needed.
+			CImageRequest* pSecondTierRequest = *iter;
+			m_compressedList.erase(iter);
+			return StartNewRequest(strFileName, nFrameIndex, processParams, pSecondTierRequest);
+		}
+	}
 	return NULL;
 }
 
 CJPEGProvider::CImageRequest* CJPEGProvider::StartRequestAndWaitUntilReady(LPCTSTR sFileName, int nFrameIndex, const CProcessParams & processParams) {
 	CImageRequest* pRequest = StartNewRequest(sFileName, nFrameIndex, processParams);
+	CTraceScope traceScope("RequestImage wait", "frame", nFrameIndex);
 	::WaitForSingleObject(pRequest->EventFinished, INFINITE);
 	GetLoadedImageFromWorkThread(pRequest);
 	return pRequest;
@@ -221,28 +296,28 @@ void CJPEGProvider::StartNewRequestBundle(CFileList* pFileList, EReadAheadDirect
 		bool bSwitchImage = true;
 		int nFrameIndex = (pLastReadyRequest != NULL) ? Helpers::GetFrameIndex(pLastReadyRequest->Image, eDirection == FORWARD, true, bSwitchImage) : 0;
 		LPCTSTR sFileName = bSwitchImage ? pFileList->PeekNextPrev(i + 1, eDirection == FORWARD, eDirection == TOGGLE) : pFileList->Current();
-		if (sFileName != NULL && FindRequest(sFileName, nFrameIndex) == NULL) {
-			if (GetProcessingFlag(PFLAG_NoProcessingAfterLoad, processParams.ProcFlags)) {
-				// The read ahead threads need this flag to be deleted - we can speculatively process the image with good hit rate
-				CProcessParams paramsCopied = processParams;
-				paramsCopied.ProcFlags = SetProcessingFlag(paramsCopied.ProcFlags, PFLAG_NoProcessingAfterLoad, false);
+		if (sFileName != NULL) {
+			// The read ahead threads need this flag to be deleted - we can speculatively process the image with good hit rate
+			CProcessParams paramsCopied = processParams;
+			paramsCopied.ProcFlags = SetProcessingFlag(paramsCopied.ProcFlags, PFLAG_NoProcessingAfterLoad, false);
+			if (FindRequest(sFileName, nFrameIndex, paramsCopied) == NULL) {
 				StartNewRequest(sFileName, nFrameIndex, paramsCopied);
-			} else {
-				StartNewRequest(sFileName, nFrameIndex, processParams);
 			}
 		}
 	}
 }
 
-CJPEGProvider::CImageRequest* CJPEGProvider::StartNewRequest(LPCTSTR sFileName, int nFrameIndex, const CProcessParams & processParams) {
+CJPEGProvider::CImageRequest* CJPEGProvider::StartNewRequest(LPCTSTR sFileName, int nFrameIndex, const CProcessParams & processParams,
+															  CImageRequest* pSecondTierRequest) {
 #ifdef DEBUG
 	::OutputDebugString(_T("Start new request: ")); ::OutputDebugString(sFileName); ::OutputDebugString(_T("\n"));
 #endif
 	CImageRequest* pRequest = new CImageRequest(sFileName, nFrameIndex);
+	pRequest->SecondTierRequest = pSecondTierRequest;
 	m_requestList.push_back(pRequest);
 	pRequest->HandlingThread = SearchThreadForNewRequest();
 	pRequest->Handle = pRequest->HandlingThread->AsyncLoad(pRequest->FileName, nFrameIndex,
-		processParams, m_hHandlerWnd, pRequest->EventFinished);
+		processParams, m_hHandlerWnd, pRequest->EventFinished, (pSecondTierRequest != NULL) ? &(pSecondTierRequest->FileStamp) : NULL);
 	return pRequest;
 }
 
@@ -252,6 +327,20 @@ void CJPEGProvider::GetLoadedImageFromWorkThread(CImageRequest* pRequest) {
 		::OutputDebugString(_T("Finished request: ")); ::OutputDebugString(pRequest->FileName); ::OutputDebugString(_T("\n"));
 #endif
 		CImageData imageData = pRequest->HandlingThread->GetLoadedImage(pRequest->Handle);
+		if (pRequest->SecondTierRequest != NULL) {
+			CImageRequest* pSecondTierRequest = pRequest->SecondTierRequest;
+			pRequest->SecondTierRequest = NULL;
+			// the image is modified by the compress thread until the event is signaled
+			::WaitForSingleObject(pSecondTierRequest->EventFinished, INFINITE);
+			if (imageData.IsUnchanged) {
+				imageData.Image = pSecondTierRequest->Image;
+				pRequest->FromSecondTier = true;
+			} else {
+				delete pSecondTierRequest->Image;
+			}
+			delete pSecondTierRequest;
+		}
+		pRequest->FileStamp = imageData.FileStamp;
 		pRequest->Image = imageData.Image;
 		pRequest->OutOfMemory = imageData.IsRequestFailedOutOfMemory;
 		pRequest->ExceptionError = imageData.IsRequestFailedException;
@@ -300,13 +389,20 @@ void CJPEGProvider::RemoveUnusedImages(bool bRemoveAlsoActiveRequests) {
 				}
 				// remove the readahead images - if we get here with read ahead, the strategy was wrong and
 				// the read ahead image is not used.
-				if ((*iter)->AccessTimeStamp == nTimeStampToRemove || IsDestructivelyProcessed((*iter)->Image)) {
+				if (IsDestructivelyProcessed((*iter)->Image)) {
 #ifdef DEBUG
 					::OutputDebugString(_T("Delete request: ")); ::OutputDebugString((*iter)->FileName); ::OutputDebugString(_T("\n"));
 #endif
 					DeleteElementAt(iter);
 					bRemoved = true;
 					break;
+				} else if ((*iter)->AccessTimeStamp == nTimeStampToRemove) {
+#ifdef DEBUG
+					::OutputDebugString(_T("Remove request: ")); ::OutputDebugString((*iter)->FileName); ::OutputDebugString(_T("\n"));
+#endif
+					MoveToSecondTier(iter);
+					bRemoved = true;
+					break;
 				}
 			}
 		}
@@ -359,6 +455,72 @@ void CJPEGProvider::DeleteElement(CImageRequest* pRequest) {
 	m_requestList.remove(pRequest);
 }
 
+void CJPEGProvider::MoveToSecondTier(std::list<CImageRequest*>::iterator iteratorAt) {
+	CImageRequest* pRequest = *iteratorAt;
+	if (m_pCompressThread == NULL || !IsWorthCompressing(pRequest->Image)) {
+		DeleteElementAt(iteratorAt);
+		return;
+	}
+	m_requestList.erase(iteratorAt);
+	pRequest->IsActive = false;
+	::ResetEvent(pRequest->EventFinished);
+	m_pCompressThread->AsyncCompress(pRequest->Image, pRequest->EventFinished);
+	m_compressedList.push_front(pRequest);
+}
+
+void CJPEGProvider::DeleteCompressedElementAt(std::list<CImageRequest*>::iterator iteratorAt) {
+	CImageRequest* pRequest = *iteratorAt;
+	::WaitForSingleObject(pRequest->EventFinished, INFINITE);
+	m_compressedList.erase(iteratorAt);
+	delete pRequest->Image;
+	delete pRequest;
+}
+
+void CJPEGProvider::RemoveCompressedImagesOverBudget() {
+	// images still being compressed are not counted, they are checked on the next call
+	__int64 nCompressedBytes = 0;
+	std::list<CImageRequest*>::iterator iter = m_compressedList.begin();
+	while (iter != m_compressedList.end()) {
+		std::list<CImageRequest*>::iterator iterNext = iter;
+		iterNext++;
+		if (::WaitForSingleObject((*iter)->EventFinished, 0) == WAIT_OBJECT_0) {
+			int nSize = (*iter)->Image->CompressedPixelsSize();
+			if (nSize == 0 || nCompressedBytes + nSize > m_nMaxCompressedBytes) {
+				// compression failed or the image does not fit into the budget anymore
+				DeleteCompressedElementAt(iter);
+			} else {
+				nCompressedBytes += nSize;
+			}
+		}
+		iter = iterNext;
+	}
+}
+
+bool CJPEGProvider::ClearSecondTier() {
+	bool bHadImages = !m_compressedList.empty();
+	while (!m_compressedList.empty()) {
+		DeleteCompressedElementAt(m_compressedList.begin());
+	}
+	return bHadImages;
+}
+
 bool CJPEGProvider::IsDestructivelyProcessed(CJPEGImage* pImage) {
 	return pImage != NULL && pImage->IsDestructivelyProcessed();
+}
+
+bool CJPEGProvider::IsWorthCompressing(CJPEGImage* pImage) {
+	if (pImage == NULL || pImage->IsDestructivelyProcessed() || pImage->IsAnimation()) {
+		return false;
+	}
+	switch (pImage->GetImageFormat()) {
+		case IF_JPEG:
+		case IF_JPEG_Embedded:
+		case IF_WindowsBMP:
+		case IF_TGA:
+		case IF_QOI:
+		case IF_CLIPBOARD:
+			return false; // decoding these formats is about as fast as decompressing QOI
+		default:
+			return true;
+	}
 }
\ No newline at end of file
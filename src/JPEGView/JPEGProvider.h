@@ -1,12 +1,17 @@
 #pragma once
 
+#include "ImageLoadThread.h"
+
 class CJPEGImage;
-class CImageLoadThread;
+class CImageCompressThread;
 class CFileList;
 class CProcessParams;
+struct CImageMemoryUsage;
 
 // Class that reads and processes image files (not only JPEG, any supported format) using read ahead with
 // additional read ahead threads (typically only one).
+// Images removed from the buffers are kept in a second tier with losslessly (QOI) compressed original pixels,
+// see CompressedCacheSizeMB in INI file. Going back to such an image does not need to decode the file again.
 class CJPEGProvider
 {
 public:
@@ -54,12 +59,16 @@ public:
 	bool ClearRequest(CJPEGImage* pImage, bool releaseLockedFile = false);
 
 	// Clears all requests by marking them as invalid - forces reloading of all images next time they are requested
-	// Any references to CJPEGImage objects get invalid by this call.
+	// Any references to CJPEGImage objects get invalid by this call. Also clears the second tier.
 	void ClearAllRequests();
 
 	// Free as much memory as possible by clearing all requests that are not in use. Returns if some memory could be freed.
 	bool FreeAllPossibleMemory();
 
+	// Gets the memory used by all images held by the provider, including the images in use and in the second tier.
+	// Images still being loaded or compressed are not counted.
+	CImageMemoryUsage GetMemoryUsage() const;
+
 	// Tells the provider that a file has been renamed externally so that pending requests to read this file can be updated.
 	void FileHasRenamed(LPCTSTR sOldFileName, LPCTSTR sNewFileName);
 
@@ -67,6 +76,10 @@ public:
 	// message was received.
 	void OnImageLoadCompleted(int nHandle);
 
+	// Must be called by the message handler window when the WM_IMAGE_ANALYSIS_FINISHED message was received.
+	// Releases the original pixels of the cached images that have been kept while analyzed.
+	void OnImageAnalysisFinished();
+
 private:
 	// stores a request for loading and processing a JPEG image
 	struct CImageRequest {
@@ -83,6 +96,9 @@ private:
 		int AccessTimeStamp; // LRU handling
 		CImageLoadThread* HandlingThread; // thread that is loading the image, NULL when image is ready
 		HANDLE EventFinished; // event fired when image has finished loading
+		CFileStamp FileStamp; // stamp of the file when it was loaded, taken by the load thread
+		CImageRequest* SecondTierRequest; // second tier entry of the file, used instead of loading if the file is unchanged
+		bool FromSecondTier; // true if the image has been taken from the second tier
 
 		CImageRequest(LPCTSTR fileName, int nFrameIndex) {
 			FileName = fileName;
@@ -98,6 +114,8 @@ private:
 			AccessTimeStamp = -1;
 			HandlingThread = NULL;
 			EventFinished = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+			SecondTierRequest = NULL;
+			FromSecondTier = false;
 		}
 
 		~CImageRequest() {
@@ -107,6 +125,9 @@ private:
 	};
 
 	std::list<CImageRequest*> m_requestList;
+	std::list<CImageRequest*> m_compressedList; // second tier, most recently added first. The EventFinished is signaled when compressed.
+	CImageCompressThread* m_pCompressThread; // NULL if the second tier is disabled
+	__int64 m_nMaxCompressedBytes;
 	HWND m_hHandlerWnd;
 	CImageLoadThread** m_pWorkThreads;
 	int m_nNumThread; // number of threads in m_pWorkThreads
@@ -119,11 +140,18 @@ private:
 	CImageLoadThread* SearchThreadForNewRequest(void);
 	void RemoveUnusedImages(bool bRemoveAlsoReadAhead);
 	CImageRequest* StartRequestAndWaitUntilReady(LPCTSTR sFileName, int nFrameIndex, const CProcessParams & processParams);
-	CImageRequest* StartNewRequest(LPCTSTR sFileName, int nFrameIndex, const CProcessParams & processParams);
+	// pSecondTierRequest: second tier entry taken out of the second tier, its image is used if the file is unchanged
+	CImageRequest* StartNewRequest(LPCTSTR sFileName, int nFrameIndex, const CProcessParams & processParams, CImageRequest* pSecondTierRequest = NULL);
 	void StartNewRequestBundle(CFileList* pFileList, EReadAheadDirection eDirection, const CProcessParams & processParams, int nNumRequests, CImageRequest* pLastReadyRequest);
-	CImageRequest* FindRequest(LPCTSTR strFileName, int nFrameIndex);
+	// requests found in the second tier are moved back to the request list, validated by a load thread
+	CImageRequest* FindRequest(LPCTSTR strFileName, int nFrameIndex, const CProcessParams & processParams);
 	void ClearOldestInactiveRequest();
 	void DeleteElementAt(std::list<CImageRequest*>::iterator iteratorAt); // also deletes the request and the image in the request
 	void DeleteElement(CImageRequest* pRequest);
+	void MoveToSecondTier(std::list<CImageRequest*>::iterator iteratorAt); // deletes the element if not worth compressing
+	void DeleteCompressedElementAt(std::list<CImageRequest*>::iterator iteratorAt); // waits until compressed, then deletes
+	void RemoveCompressedImagesOverBudget();
+	bool ClearSecondTier(); // returns if there were images in the second tier
 	bool IsDestructivelyProcessed(CJPEGImage* pImage);
+	static bool IsWorthCompressing(CJPEGImage* pImage);
 };
@@ -6,6 +6,10 @@
 #include "resource.h"
 #include "MainDlg.h"
 #include "SettingsProvider.h"
+#include "ProcessingThreadPool.h"
+#include "ProcessingBenchmark.h"
+#include "DecodeBenchmark.h"
+#include "Tracing.h"
 
 #ifdef DEBUG
 #include <dbghelp.h>
@@ -86,6 +90,66 @@ static bool ParseCommandLineForAutoExit(LPCTSTR sCommandLine) {
 	return Helpers::stristr(sCommandLine, _T("/autoexit")) != NULL;
 }
 
+static bool ParseCommandLineForCalibration(LPCTSTR sCommandLine) {
+	return Helpers::stristr(sCommandLine, _T("/calibrate")) != NULL;
+}
+
+static bool ParseCommandLineForTracing(LPCTSTR sCommandLine) {
+	return Helpers::stristr(sCommandLine, _T("/trace")) != NULL;
+}
+
+// Writes the recorded trace events, if tracing is enabled
+static void WriteTrace() {
+	if (CTracing::IsEnabled()) {
+		::CreateDirectory(Helpers::JPEGViewAppDataPath(), NULL);
+		CTracing::WriteChromeTrace(CTracing::DefaultFileName());
+	}
+}
+
+// Parses an optional, optionally quoted value of a command line parameter starting at sValue.
+// Returns a pointer after the value and leaves sResult unchanged if there is no value.
+static LPCTSTR ParseCommandLineValue(LPCTSTR sValue, CString& sResult) {
+	while (*sValue == _T(' ')) {
+		sValue++;
+	}
+	if (*sValue == _T('"')) {
+		LPCTSTR posQuote = _tcschr(sValue + 1, _T('"'));
+		if (posQuote != NULL) {
+			sResult = CString(sValue + 1, (int)(posQuote - sValue - 1));
+			return posQuote + 1;
+		}
+	} else if (*sValue != 0 && *sValue != _T('/')) {
+		LPCTSTR posSpace = _tcschr(sValue, _T(' '));
+		sResult = (posSpace == NULL) ? CString(sValue) : CString(sValue, (int)(posSpace - sValue));
+		return sValue + sResult.GetLength();
+	}
+	return sValue;
+}
+
+// Returns if the benchmark is requested, sOutputFile is the file name following the parameter or the default file name
+static bool ParseCommandLineForBenchmark(LPCTSTR sCommandLine, CString& sOutputFile) {
+	LPCTSTR sBenchmark = Helpers::stristr(sCommandLine, _T("/benchmark"));
+	if (sBenchmark == NULL) {
+		return false;
+	}
+	sOutputFile = _T("JPEGViewBenchmark.json");
+	ParseCommandLineValue(sBenchmark + _tcslen(_T("/benchmark")), sOutputFile);
+	return true;
+}
+
+// Returns if the decode benchmark is requested, with the folder and the output file following the parameter or the defaults
+static bool ParseCommandLineForDecodeBenchmark(LPCTSTR sCommandLine, CString& sFolder, CString& sOutputFile) {
+	LPCTSTR sBenchmark = Helpers::stristr(sCommandLine, _T("/decodebenchmark"));
+	if (sBenchmark == NULL) {
+		return false;
+	}
+	sFolder = _T(".");
+	sOutputFile = _T("JPEGViewDecodeBenchmark.json");
+	LPCTSTR sNext = ParseCommandLineValue(sBenchmark + _tcslen(_T("/decodebenchmark")), sFolder);
+	ParseCommandLineValue(sNext, sOutputFile);
+	return true;
+}
+
 static int ParseCommandLineForDisplayMonitor(LPCTSTR sCommandLine) {
 	LPCTSTR sMonitor = Helpers::stristr(sCommandLine, _T("/monitor"));
 	if (sMonitor == NULL) {
@@ -210,6 +274,37 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPTSTR lp
 	Helpers::ETransitionEffect eTransitionEffect = ParseCommandLineForSlideShowEffect(lpstrCmdLine);
 	int nTransitionTime = ParseCommandLineForTransitionTime(lpstrCmdLine);
 	int nDisplayMonitor = ParseCommandLineForDisplayMonitor(lpstrCmdLine);
+	bool bForceCalibration = ParseCommandLineForCalibration(lpstrCmdLine);
+	if (ParseCommandLineForTracing(lpstrCmdLine) || CSettingsProvider::This().EnableTracing()) {
+		CTracing::Enable();
+	}
+
+	CString sBenchmarkFile;
+	if (ParseCommandLineForBenchmark(lpstrCmdLine, sBenchmarkFile)) {
+		// headless benchmark of the image processing, no window is created and other instances are not touched
+		CProcessingThreadPool::This().CreateThreadPoolThreads();
+		int nResult = CProcessingBenchmark::Run(sBenchmarkFile) ? 0 : 1;
+		CProcessingThreadPool::This().StopAllThreads();
+		WriteTrace();
+		_Module.Term();
+		::CoUninitialize();
+		return nResult;
+	}
+	CString sDecodeBenchmarkFolder;
+	if (ParseCommandLineForDecodeBenchmark(lpstrCmdLine, sDecodeBenchmarkFolder, sBenchmarkFile)) {
+		// headless benchmark of loading the images of a folder, some of the decoders need GDI+
+		Gdiplus::GdiplusStartupInput gdiplusStartupInput;
+		ULONG_PTR gdiplusToken;
+		Gdiplus::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
+		CProcessingThreadPool::This().CreateThreadPoolThreads();
+		int nResult = CDecodeBenchmark::Run(sDecodeBenchmarkFolder, sBenchmarkFile) ? 0 : 1;
+		CProcessingThreadPool::This().StopAllThreads();
+		Gdiplus::GdiplusShutdown(gdiplusToken);
+		WriteTrace();
+		_Module.Term();
+		::CoUninitialize();
+		return nResult;
+	}
 
 	// Searches for other instances and terminates them
 	bool bFileLoadedByExistingInstance = false;
@@ -239,7 +334,7 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPTSTR lp
 
 		CMainDlg dlgMain(bForceFullScreen);
 
-		dlgMain.SetStartupInfo(sStartupFile, nAutostartSlideShow, eSorting, eTransitionEffect, nTransitionTime, bAutoExit, nDisplayMonitor);
+		dlgMain.SetStartupInfo(sStartupFile, nAutostartSlideShow, eSorting, eTransitionEffect, nTransitionTime, bAutoExit, nDisplayMonitor, bForceCalibration);
 
 		try {
 			nRet = (int)dlgMain.DoModal();
@@ -254,6 +349,7 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPTSTR lp
 
 		// Shut down GDI+
 		Gdiplus::GdiplusShutdown(gdiplusToken);
+		WriteTrace();
 	}
 
 	::CloseHandle(hMutex);
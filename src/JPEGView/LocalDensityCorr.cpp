@@ -3,8 +3,12 @@
 #include "HistogramCorr.h"
 #include "JPEGImage.h"
 #include "Helpers.h"
+#include "SettingsProvider.h"
+#include "ProcessingThreadPool.h"
+#include "Tracing.h"
 #include <math.h>
 #include <assert.h>
+#include <emmintrin.h>
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // static helpers
@@ -24,6 +28,11 @@ static void CalculateLDCResponseLUT(uint8* pLUT) {
 
 // Uses the HSV color model to determine if a color is in the typical hue range for sunsets
 static bool IsSunsetPixel(int nR, int nG, int nB) {
+	// The hue is only in the sunset range if red is the maximal component, other colors can be rejected
+	// without the float calculations below
+	if (nR < nG || nR < nB)
+		return false;
+
 	float fR = nR*(1.0f/255.0f);
 	float fG = nG*(1.0f/255.0f);
 	float fB = nB*(1.0f/255.0f);
@@ -56,11 +65,99 @@ static bool IsSunsetPixel(int nR, int nG, int nB) {
 	return false;
 }
 
+// Triangle filter of length 3 with the weights 128, 768, 128 (in 1/1024), pPrev and pNext point to the
+// neighbours of the nCount pixels in pSrc. The SSE2 code uses the weights 1, 6, 1 (in 1/8), giving identical results.
+static void SmoothTriangle3(const uint8* pPrev, const uint8* pSrc, const uint8* pNext, uint8* pDst, int nCount, bool bUseSSE) {
+	int n = 0;
+	if (bUseSSE) {
+		__m128i zero = _mm_setzero_si128();
+		for (; n + 16 <= nCount; n += 16) {
+			__m128i prev = _mm_loadu_si128((const __m128i*)(pPrev + n));
+			__m128i src = _mm_loadu_si128((const __m128i*)(pSrc + n));
+			__m128i next = _mm_loadu_si128((const __m128i*)(pNext + n));
+			__m128i srcLo = _mm_unpacklo_epi8(src, zero);
+			__m128i srcHi = _mm_unpackhi_epi8(src, zero);
+			__m128i sumLo = _mm_add_epi16(_mm_unpacklo_epi8(prev, zero), _mm_unpacklo_epi8(next, zero));
+			__m128i sumHi = _mm_add_epi16(_mm_unpackhi_epi8(prev, zero), _mm_unpackhi_epi8(next, zero));
+			sumLo = _mm_add_epi16(sumLo, _mm_add_epi16(_mm_slli_epi16(srcLo, 2), _mm_slli_epi16(srcLo, 1)));
+			sumHi = _mm_add_epi16(sumHi, _mm_add_epi16(_mm_slli_epi16(srcHi, 2), _mm_slli_epi16(srcHi, 1)));
+			_mm_storeu_si128((__m128i*)(pDst + n), _mm_packus_epi16(_mm_srli_epi16(sumLo, 3), _mm_srli_epi16(sumHi, 3)));
+		}
+	}
+	for (; n < nCount; n++) {
+		pDst[n] = ((int)pPrev[n]*128 + (int)pSrc[n]*768 + (int)pNext[n]*128) >> 10;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Point sampling request
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Point samples the source image into the point sampled image (PSI) and builds the channel histograms, processed
+// in strips of PSI rows on the thread pool. Each strip counts into local histograms that are added to the shared
+// ones at the end of the strip. As all sums are integer, the result does not depend on the number of strips.
+class CPointSampleRequest : public CProcessingRequest {
+public:
+	CPointSampleRequest(const uint8* pSourcePixels, const size_t* pRowOffsets, const size_t* pColumnOffsets,
+		uint16* pPSI, CSize psiSize, int* pChannelB, int* pChannelG, int* pChannelR, int* pChannelGrey)
+		: CProcessingRequest(pSourcePixels, psiSize, pPSI, psiSize, CPoint(0, 0), psiSize) {
+		RowOffsets = pRowOffsets;
+		ColumnOffsets = pColumnOffsets;
+		ChannelB = pChannelB;
+		ChannelG = pChannelG;
+		ChannelR = pChannelR;
+		ChannelGrey = pChannelGrey;
+	}
+
+	virtual bool ProcessStrip(int offsetY, int sizeY) {
+		int channelR[256]{ 0 }, channelG[256]{ 0 }, channelB[256]{ 0 };
+		int channelGrey[256]{ 0 };
+		int nPSIWidth = FullTargetSize.cx;
+		for (int j = offsetY; j < offsetY + sizeY; j++) {
+			const uint8* pSrcRow = (const uint8*)SourcePixels + RowOffsets[j];
+			uint16* pSubSampImage = (uint16*)TargetPixels + j*nPSIWidth*3;
+			for (int i = 0; i < nPSIWidth; i++) {
+				const uint8* pSrc = pSrcRow + ColumnOffsets[i];
+				channelB[pSrc[0]]++;
+				channelG[pSrc[1]]++;
+				channelR[pSrc[2]]++;
+				channelGrey[(pSrc[0]*128 + pSrc[1]*640 + pSrc[2]*256) >> 10]++;
+				pSubSampImage[0] = pSrc[0];
+				pSubSampImage[nPSIWidth] = pSrc[1];
+				pSubSampImage[nPSIWidth*2] = pSrc[2];
+				pSubSampImage++;
+			}
+		}
+		AddToHistogram(ChannelB, channelB);
+		AddToHistogram(ChannelG, channelG);
+		AddToHistogram(ChannelR, channelR);
+		AddToHistogram(ChannelGrey, channelGrey);
+		return true;
+	}
+
+	const size_t* RowOffsets; // byte offset in source image of each PSI row
+	const size_t* ColumnOffsets; // byte offset in source image row of each PSI column
+	int* ChannelB;
+	int* ChannelG;
+	int* ChannelR;
+	int* ChannelGrey;
+
+private:
+	static void AddToHistogram(int* pShared, const int* pLocal) {
+		for (int n = 0; n < 256; n++) {
+			if (pLocal[n] != 0) {
+				::InterlockedExchangeAdd((volatile LONG*)&pShared[n], pLocal[n]);
+			}
+		}
+	}
+};
+
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Public
 /////////////////////////////////////////////////////////////////////////////////////////////
 
-CLocalDensityCorr::CLocalDensityCorr(const CJPEGImage & image, bool bFullConstruct) {
+CLocalDensityCorr::CLocalDensityCorr(const CJPEGImage & image, bool bFullConstruct, int nSourceRotation) {
+	CTraceScope traceScope("LDC");
 
 	// Caution: If something is changed in this code, this breaks all existing image DBs
 
@@ -78,41 +175,58 @@ CLocalDensityCorr::CLocalDensityCorr(const CJPEGImage & image, bool bFullConstru
 	int channelR[256]{ 0 }, channelG[256]{ 0 }, channelB[256]{ 0 };
 	int channelGrey[256]{ 0 };
 
-	int nWidth = image.OrigWidth();
-	int nHeight = image.OrigHeight();
+	int nSourceWidth = image.OrigWidth();
+	int nSourceHeight = image.OrigHeight();
 	int nChannels = image.OriginalChannels();
 	const uint8* pSourcePixels = (const uint8*)image.OriginalPixels();
 
+	// Width and height of the analyzed layout, the source pixels are rotated by nSourceRotation against it
+	bool bSwapWH = nSourceRotation == 90 || nSourceRotation == 270;
+	int nWidth = bSwapWH ? nSourceHeight : nSourceWidth;
+	int nHeight = bSwapWH ? nSourceWidth : nSourceHeight;
+
 	double dFactor = (double)nWidth/nHeight;
 	m_nPSIWidth  = Helpers::DoPadding((int)(dFactor*sqrt(NUM_VALUES/dFactor)), 4);
 	m_nPSIHeight = Helpers::DoPadding((int)(m_nPSIWidth/dFactor), 4);
 
-	uint32 nY = 0;
 	uint32 nIncX = (uint32)nWidth*65536/m_nPSIWidth;
 	uint32 nIncY = (uint32)nHeight*65536/m_nPSIHeight;
-	int nLineSize = Helpers::DoPadding(nWidth * nChannels, 4);
-
-	// The subsampled image has 16 bits per channel and three line interleaved channels B, G, R
-	m_pPointSampledImage = new uint16[m_nPSIWidth*m_nPSIHeight*3];
+	int nLineSize = image.OriginalStride();
 
+	// The source pixel of a PSI pixel is given by a byte offset depending on the PSI row plus one depending on the PSI column
+	size_t* pRowOffsets = new size_t[m_nPSIHeight];
+	size_t* pColumnOffsets = new size_t[m_nPSIWidth];
+	uint32 nY = 0;
 	for (int j = 0; j < m_nPSIHeight; j++) {
-		uint32 nX = 0;
-		const uint8* pSrcStart = pSourcePixels + nLineSize*(nY >> 16);
-		uint16* pSubSampImage = m_pPointSampledImage + j*m_nPSIWidth*3;
-		for (int i = 0; i < m_nPSIWidth; i++) {
-			const uint8* pSrc = (nChannels == 3) ? pSrcStart + (nX >> 16)*3 : pSrcStart + (nX >> 16)*4;
-			channelB[pSrc[0]]++;
-			channelG[pSrc[1]]++;
-			channelR[pSrc[2]]++;
-			channelGrey[(pSrc[0]*128 + pSrc[1]*640 + pSrc[2]*256) >> 10]++;
-			pSubSampImage[0] = pSrc[0];
-			pSubSampImage[m_nPSIWidth] = pSrc[1];
-			pSubSampImage[m_nPSIWidth*2] = pSrc[2];
-			pSubSampImage++;
-			nX += nIncX;
+		int nRow = nY >> 16;
+		switch (nSourceRotation) {
+			case 90: pRowOffsets[j] = (size_t)(nHeight - 1 - nRow)*nChannels; break;
+			case 180: pRowOffsets[j] = (size_t)nLineSize*(nHeight - 1 - nRow); break;
+			case 270: pRowOffsets[j] = (size_t)nRow*nChannels; break;
+			default: pRowOffsets[j] = (size_t)nLineSize*nRow; break;
 		}
 		nY += nIncY;
 	}
+	uint32 nX = 0;
+	for (int i = 0; i < m_nPSIWidth; i++) {
+		int nColumn = nX >> 16;
+		switch (nSourceRotation) {
+			case 90: pColumnOffsets[i] = (size_t)nLineSize*nColumn; break;
+			case 180: pColumnOffsets[i] = (size_t)(nWidth - 1 - nColumn)*nChannels; break;
+			case 270: pColumnOffsets[i] = (size_t)nLineSize*(nWidth - 1 - nColumn); break;
+			default: pColumnOffsets[i] = (size_t)nColumn*nChannels; break;
+		}
+		nX += nIncX;
+	}
+
+	// The subsampled image has 16 bits per channel and three line interleaved channels B, G, R
+	m_pPointSampledImage = new uint16[m_nPSIWidth*m_nPSIHeight*3];
+
+	CPointSampleRequest request(pSourcePixels, pRowOffsets, pColumnOffsets, m_pPointSampledImage, CSize(m_nPSIWidth, m_nPSIHeight),
+		channelB, channelG, channelR, channelGrey);
+	CProcessingThreadPool::This().Process(&request);
+	delete[] pRowOffsets;
+	delete[] pColumnOffsets;
 
 	// Calculate a CRC over the histograms
 	uint32 crc_table[256];
@@ -174,6 +288,16 @@ CLocalDensityCorr::~CLocalDensityCorr(void) {
 	m_pLDCMapMultiplied = NULL;
 }
 
+size_t CLocalDensityCorr::SizeInBytes() const {
+	size_t nSize = sizeof(CLocalDensityCorr);
+	size_t nMapSize = (size_t)m_nLDCWidth * m_nLDCHeight;
+	if (m_pLDCMap != NULL) nSize += nMapSize;
+	if (m_pLDCMapMultiplied != NULL) nSize += nMapSize;
+	if (m_pPointSampledImage != NULL) nSize += (size_t)m_nPSIWidth * m_nPSIHeight * 3 * sizeof(uint16);
+	if (m_pHistogramm != NULL) nSize += sizeof(CHistogram);
+	return nSize;
+}
+
 void* CLocalDensityCorr::GetPSImageAsDIB() {
 	uint32* pDIBStart = new uint32[m_nPSIWidth*m_nPSIHeight];
 	uint32* pDIB = pDIBStart;
@@ -332,34 +456,27 @@ void CLocalDensityCorr::SmoothLDCMask() {
 		return; // do not smooth tiny masks
 	}
 
+	bool bUseSSE = CSettingsProvider::This().AlgorithmImplementation() >= Helpers::CPU_SSE;
+	int nW = m_nLDCWidth;
 	uint8* pNewLDC = new uint8[m_nLDCHeight*m_nLDCWidth];
-	uint8* pSrc = m_pLDCMap;
-	uint8* pDst = pNewLDC;
 	for (int i = 0; i < m_nLDCHeight; i++) {
-		for (int j = 0; j < m_nLDCWidth; j++) {
-			if (j == 0) {
-				*pDst = ((int)pSrc[0]*768 + (int)pSrc[1]*256) >> 10;
-			} else if (j == m_nLDCWidth-1) {
-				*pDst = ((int)pSrc[0]*768 + (int)pSrc[-1]*256) >> 10;
-			} else {
-				*pDst = ((int)pSrc[-1]*128 + (int)pSrc[0]*768 + (int)pSrc[1]*128) >> 10;
-			}
-			pDst++; pSrc++;
-		}
+		const uint8* pSrc = m_pLDCMap + i*nW;
+		uint8* pDst = pNewLDC + i*nW;
+		pDst[0] = ((int)pSrc[0]*768 + (int)pSrc[1]*256) >> 10;
+		SmoothTriangle3(pSrc, pSrc + 1, pSrc + 2, pDst + 1, nW - 2, bUseSSE);
+		pDst[nW-1] = ((int)pSrc[nW-1]*768 + (int)pSrc[nW-2]*256) >> 10;
 	}
-	pSrc = pNewLDC;
-	pDst = m_pLDCMap;
-	for (int i = 0; i < m_nLDCHeight; i++) {
-		for (int j = 0; j < m_nLDCWidth; j++) {
-			if (i == 0) {
-				*pDst = ((int)pSrc[0]*768 + (int)pSrc[m_nLDCWidth]*256) >> 10;
-			} else if (i == m_nLDCHeight-1) {
-				*pDst = ((int)pSrc[0]*768 + (int)pSrc[-m_nLDCWidth]*256) >> 10;
-			} else {
-				*pDst = ((int)pSrc[-m_nLDCWidth]*128 + (int)pSrc[0]*768 + (int)pSrc[m_nLDCWidth]*128) >> 10;
-			}
-			pDst++; pSrc++;
-		}
+	for (int j = 0; j < nW; j++) {
+		m_pLDCMap[j] = ((int)pNewLDC[j]*768 + (int)pNewLDC[j + nW]*256) >> 10;
+	}
+	for (int i = 1; i < m_nLDCHeight - 1; i++) {
+		const uint8* pSrc = pNewLDC + i*nW;
+		SmoothTriangle3(pSrc - nW, pSrc, pSrc + nW, m_pLDCMap + i*nW, nW, bUseSSE);
+	}
+	const uint8* pLastRow = pNewLDC + (m_nLDCHeight - 1)*nW;
+	uint8* pLastDstRow = m_pLDCMap + (m_nLDCHeight - 1)*nW;
+	for (int j = 0; j < nW; j++) {
+		pLastDstRow[j] = ((int)pLastRow[j]*768 + (int)pLastRow[j - nW]*256) >> 10;
 	}
 
 	delete[] pNewLDC;
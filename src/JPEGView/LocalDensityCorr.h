@@ -8,7 +8,9 @@ class CLocalDensityCorr
 {
 public:
 	// Note: Partially constructed LDC object allows getting the histogram and the pixel hash but not much more
-	CLocalDensityCorr(const CJPEGImage & image, bool bFullConstruct);
+	// If nSourceRotation is not zero, the original pixels of the image are rotated clockwise by this angle and
+	// the LDC is calculated for the image rotated back to the unrotated layout.
+	CLocalDensityCorr(const CJPEGImage & image, bool bFullConstruct, int nSourceRotation = 0);
 	~CLocalDensityCorr(void);
 	// if only constructed partially this does the rest for creating a fully functional LDC object
 	void VerifyFullyConstructed();
@@ -46,6 +48,9 @@ public:
 	// Gets the size of the point sampled image
 	CSize GetPSISize() const { return CSize(m_nPSIWidth, m_nPSIHeight); }
 
+	// Memory used by the maps, the point sampled image and the histogram in bytes
+	size_t SizeInBytes() const;
+
 	// Gets the point sampled image as 32 bpp DIB. The caller gets ownership of the returned DIB
 	// and must delete it when no longer used.
 	void* GetPSImageAsDIB();
@@ -36,6 +36,8 @@
 #include "EXIFHelpers.h"
 #include "RawMetadata.h"
 #include "ProcessingThreadPool.h"
+#include "ProcessingCalibration.h"
+#include "ImageAnalysisThread.h"
 #include "PaintMemDCMgr.h"
 #include "PanelMgr.h"
 #include "ZoomNavigatorCtl.h"
@@ -69,6 +71,7 @@ static const int NUM_THREADS = 1; // number of readahead threads to use
 static const int READ_AHEAD_BUFFERS = 2; // number of readahead buffers to use (NUM_THREADS+1 is a good choice)
 static const int ZOOM_TIMEOUT = 200; // refinement done after this many milliseconds
 static const int ZOOM_TEXT_TIMEOUT = 1000; // zoom label disappears after this many milliseconds
+static const int CALIBRATION_DELAY = 500; // processing calibration starts this many milliseconds after the first image is shown
 
 static const int DARKEN_HIGHLIGHTS = 0; // used in AdjustLDC() call
 static const int BRIGHTEN_SHADOWS = 1; // used in AdjustLDC() call
@@ -218,6 +221,7 @@ CMainDlg::CMainDlg(bool bForceFullScreen) {
 	m_dMovieFPS = 1.0;
 	m_nAutoStartSlideShow = false;
 	m_eForcedSorting = Helpers::FS_Undefined;
+	m_bForceCalibration = false;
 
 	m_eProcFlagsBeforeMovie = PFLAG_None;
 	m_nRotation = 0;
@@ -298,9 +302,10 @@ CMainDlg::~CMainDlg() {
 }
 
 void CMainDlg::SetStartupInfo(LPCTSTR sStartupFile, int nAutostartSlideShow, Helpers::ESorting eSorting, Helpers::ETransitionEffect eEffect, 
-	int nTransitionTime, bool bAutoExit, int nDisplayMonitor) { 
+	int nTransitionTime, bool bAutoExit, int nDisplayMonitor, bool bForceCalibration) { 
 	m_sStartupFile = sStartupFile; m_nAutoStartSlideShow = nAutostartSlideShow; m_eForcedSorting = eSorting;
 	m_bAutoExit = bAutoExit;
+	m_bForceCalibration = bForceCalibration;
 	if ((int)eEffect >= 0) m_eTransitionEffect = eEffect;
 	if (nTransitionTime > 0) m_nTransitionTime = nTransitionTime;
 	if (nDisplayMonitor >= 0) CSettingsProvider::This().SetMonitorOverride(nDisplayMonitor);
@@ -382,6 +387,12 @@ LRESULT CMainDlg::OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam
 	// create thread pool for processing requests on multiple CPU cores
 	CProcessingThreadPool::This().CreateThreadPoolThreads();
 
+	// use the calibrated strip sizes and number of threads, calibrating once per CPU is done after the first image is shown
+	bool bCalibrate = CProcessingCalibration::Initialize(m_bForceCalibration);
+
+	// create thread analyzing the loaded images in the background
+	CImageAnalysisThread::This().SetNotificationWindow(m_hWnd);
+
 	// create JPEG provider and request first image - do no processing yet if not in fullscreen mode (as we do not know the size yet)
 	m_pJPEGProvider = new CJPEGProvider(m_hWnd, NUM_THREADS, READ_AHEAD_BUFFERS);	
 	m_pCurrentImage = m_pJPEGProvider->RequestImage(m_pFileList, CJPEGProvider::FORWARD,
@@ -428,6 +439,11 @@ LRESULT CMainDlg::OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam
 
 	this->DragAcceptFiles();
 
+	if (bCalibrate) {
+		// the timer message is not handled before the first paint
+		::SetTimer(this->m_hWnd, CALIBRATION_TIMER_EVENT_ID, CALIBRATION_DELAY, NULL);
+	}
+
 	return TRUE;
 }
 
@@ -510,9 +526,19 @@ LRESULT CMainDlg::OnPaint(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, B
 			pDIBData = m_pTiltCorrectionPanelCtl->GetDIBForPreview(newSize, clippedSize, offsetsInImage, 
 				*m_pImageProcParams, CreateProcessingFlags(false, m_bAutoContrast, m_bAutoContrastSection, m_bLDC, false, m_bLandscapeMode));
 		} else {
+			EProcessingFlags eProcFlags = CreateProcessingFlags(m_bHQResampling && !m_bTemporaryLowQ && !m_bZoomMode, m_bAutoContrast, m_bAutoContrastSection, m_bLDC, false, m_bLandscapeMode);
 			pDIBData = m_pCurrentImage->GetDIB(newSize, clippedSize, offsetsInImage, 
-				*m_pImageProcParams, 
-				CreateProcessingFlags(m_bHQResampling && !m_bTemporaryLowQ && !m_bZoomMode, m_bAutoContrast, m_bAutoContrastSection, m_bLDC, false, m_bLandscapeMode));
+				*m_pImageProcParams, eProcFlags);
+
+			// let the filters for zooming in and out by one step be calculated in the background
+			if (m_dZoom > 0.0 && m_dZoomMult > 1.0) {
+				for (int nStep = -1; nStep <= 1; nStep += 2) {
+					double dZoom = m_dZoom * pow(m_dZoomMult, nStep);
+					CSize zoomStepSize((int)(m_pCurrentImage->OrigWidth() * dZoom + 0.5), (int)(m_pCurrentImage->OrigHeight() * dZoom + 0.5));
+					CSize zoomStepClippedSize(min(zoomStepSize.cx, m_clientRect.Width()), min(zoomStepSize.cy, m_clientRect.Height()));
+					m_pCurrentImage->PrecomputeResizeFilters(zoomStepSize, zoomStepClippedSize, *m_pImageProcParams, eProcFlags);
+				}
+			}
 		}
 
 		// Zoom navigator - check if visible and create exclusion rectangle
@@ -1028,6 +1054,29 @@ LRESULT CMainDlg::OnImageLoadCompleted(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM
 	return 0;
 }
 
+LRESULT CMainDlg::OnImageAnalysisFinished(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/) {
+	if (m_pJPEGProvider == NULL) {
+		return 0;
+	}
+	m_pJPEGProvider->OnImageAnalysisFinished();
+	if (m_pCurrentImage != NULL && m_pCurrentImage->UpdateFromImageAnalysis()) {
+		// the image has been shown before its lighten shadow factor or its parameter DB entry were known, show it again with them
+		if (m_pCurrentImage->IsInParamDB() && !m_bCurrentImageInParamDB) {
+			SynchronizeProcessingParams();
+		} else {
+			double dLastInitialLightenShadows = m_dCurrentInitialLightenShadows;
+			m_dCurrentInitialLightenShadows = m_pCurrentImage->GetInitialProcessParams().LightenShadows;
+			m_bCurrentImageIsSpecialProcessing = m_pCurrentImage->GetLightenShadowFactor(false) != 1.0f;
+			// keep the value if changed by the user in the meantime
+			if (m_pImageProcParams->LightenShadows == dLastInitialLightenShadows) {
+				m_pImageProcParams->LightenShadows = m_dCurrentInitialLightenShadows;
+			}
+		}
+		this->Invalidate(FALSE);
+	}
+	return 0;
+}
+
 LRESULT CMainDlg::OnDisplayedFileChangedOnDisk(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/) {
 	if (CSettingsProvider::This().ReloadWhenDisplayedImageChanged() && m_pCurrentImage != NULL && !m_pCurrentImage->IsClipboardImage() &&
 		m_pFileList != NULL && m_pFileList->CanOpenCurrentFileForReading()) {
@@ -1104,6 +1153,9 @@ LRESULT CMainDlg::OnTimer(UINT /*uMsg*/, WPARAM wParam, LPARAM /*lParam*/, BOOL&
 				this->Invalidate(FALSE);
 			}
 		}
+	} else if (wParam == CALIBRATION_TIMER_EVENT_ID) {
+		::KillTimer(this->m_hWnd, CALIBRATION_TIMER_EVENT_ID);
+		CProcessingCalibration::StartCalibration();
 	} else if (wParam == ZOOM_TEXT_TIMER_EVENT_ID) {
 		m_bShowZoomFactor = false;
 		::KillTimer(this->m_hWnd, ZOOM_TEXT_TIMER_EVENT_ID);
@@ -1235,6 +1287,8 @@ LRESULT CMainDlg::OnContextMenu(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM lParam,
 			::EnableMenuItem(hMenuModDate, IDM_TOUCH_IMAGE, MF_BYCOMMAND | MF_GRAYED);
 			::EnableMenuItem(hMenuModDate, IDM_TOUCH_IMAGE_EXIF, MF_BYCOMMAND | MF_GRAYED);
 		}
+		if (!m_pCurrentImage->CanUndo()) ::EnableMenuItem(hMenuTrackPopup, IDM_UNDO, MF_BYCOMMAND | MF_GRAYED);
+		if (!m_pCurrentImage->CanRedo()) ::EnableMenuItem(hMenuTrackPopup, IDM_REDO, MF_BYCOMMAND | MF_GRAYED);
 		if (m_pCurrentImage->GetEXIFReader() == NULL || !m_pCurrentImage->GetEXIFReader()->GetAcquisitionTimePresent()) {
 			::EnableMenuItem(hMenuModDate, IDM_TOUCH_IMAGE_EXIF, MF_BYCOMMAND | MF_GRAYED);
 		}
@@ -1566,7 +1620,7 @@ void CMainDlg::ExecuteCommand(int nCommand) {
 						GetDefaultProcessingParams(), procFlags, 0, -1, CPoint(0, 0), CSize(0, 0), CSize(0, 0));
 					*m_pImageProcParams = GetDefaultProcessingParams();
 					// Sunset and night shot detection may has changed this
-					m_pImageProcParams->LightenShadows = m_pCurrentImage->GetInitialProcessParams().LightenShadows;
+					m_pImageProcParams->LightenShadows *= m_pCurrentImage->GetLightenShadowFactor();
 					InitFromProcessingFlags(procFlags, m_bHQResampling, m_bAutoContrast, m_bAutoContrastSection, m_bLDC, m_bLandscapeMode);
 					m_nRotation = m_pCurrentImage->GetInitialRotation();
 					m_nUserRotation = 0;
@@ -1623,6 +1677,16 @@ void CMainDlg::ExecuteCommand(int nCommand) {
 				this->Invalidate(FALSE);
 			}
 			break;
+		case IDM_UNDO:
+		case IDM_REDO:
+			if (m_pCurrentImage != NULL) {
+				bool bChanged = (nCommand == IDM_UNDO) ? m_pCurrentImage->Undo() : m_pCurrentImage->Redo();
+				if (bChanged) {
+					m_pImageProcPanelCtl->ShowHideSaveDBButtons();
+					this->Invalidate(FALSE);
+				}
+			}
+			break;
 		case IDM_ROTATE_90_LOSSLESS:
 		case IDM_ROTATE_90_LOSSLESS_CONFIRM:
 		case IDM_ROTATE_270_LOSSLESS:
@@ -2570,6 +2634,7 @@ void CMainDlg::GotoImage(EImagePosition ePos, int nFlags) {
 		m_pCurrentImage = CClipboard::PasteImageFromClipboard(m_hWnd, procParams.ImageProcParams, procParams.ProcFlags);
 		if (m_pCurrentImage != NULL) {
 			m_pCurrentImage->SetFileDependentProcessParams(_T("_cbrd_"), &procParams);
+			m_pCurrentImage->StartImageAnalysis(procParams.ProcFlags);
 			m_nLastLoadError = HelpersGUI::FileLoad_Ok;
 		} else {
 			m_nLastLoadError = HelpersGUI::FileLoad_PasteFromClipboardFailed;
@@ -3040,43 +3105,47 @@ void CMainDlg::AfterNewImageLoaded(bool bSynchronize, bool bAfterStartup, bool n
 	if (m_pCurrentImage != NULL) m_pCropCtl->SetImageSize(m_pCurrentImage->OrigSize()); // inform CropCtl of the image size for CropImageAR
 	m_pPrintImage->ClearOffsets();
 	if (bSynchronize) {
-		// after loading an image, the per image processing parameters must be synchronized with
-		// the current processing parameters
-		bool bLastWasSpecialProcessing = m_bCurrentImageIsSpecialProcessing;
-		bool bLastWasInParamDB = m_bCurrentImageInParamDB;
-		m_bCurrentImageInParamDB = false;
-		m_bCurrentImageIsSpecialProcessing = false;
-		if (m_pCurrentImage != NULL) {
-			m_dCurrentInitialLightenShadows = m_pCurrentImage->GetInitialProcessParams().LightenShadows;
-			m_bCurrentImageInParamDB = m_pCurrentImage->IsInParamDB();
-			m_bCurrentImageIsSpecialProcessing = m_pCurrentImage->GetLightenShadowFactor() != 1.0f;
-			if (!m_bKeepParams) {
-				m_bHQResampling = GetProcessingFlag(m_pCurrentImage->GetInitialProcessFlags(), PFLAG_HighQualityResampling);
-				m_bAutoContrast = GetProcessingFlag(m_pCurrentImage->GetInitialProcessFlags(), PFLAG_AutoContrast);
-				m_bLDC = GetProcessingFlag(m_pCurrentImage->GetInitialProcessFlags(), PFLAG_LDC);
-
-				m_nRotation = m_pCurrentImage->GetInitialRotation();
-				m_dZoom = m_pCurrentImage->GetInititialZoom();
-				m_offsets = m_pCurrentImage->GetInitialOffsets();
-
-				if (m_pCurrentImage->HasZoomStoredInParamDB()) {
-					m_bUserZoom = m_bUserPan = true;
-				}
+		SynchronizeProcessingParams();
+		if (!bAfterStartup && !m_bIsAnimationPlaying && !noAdjustWindow) {
+			AdjustWindowToImage(false);
+		}
+	}
+}
 
-				*m_pImageProcParams = m_pCurrentImage->GetInitialProcessParams();
-			} else if (m_bCurrentImageIsSpecialProcessing && m_bKeepParams) {
-				// set this factor, no matter if we keep parameters
-				m_pImageProcParams->LightenShadows = m_pCurrentImage->GetInitialProcessParams().LightenShadows;
-			} else if (bLastWasSpecialProcessing && m_bKeepParams) {
-				// take kept value when last was special processing as the special processing value is not usable
-				m_pImageProcParams->LightenShadows = m_pImageProcParamsKept->LightenShadows;
-			}
-			if (m_bKeepParams) {
-				m_nRotation = m_pCurrentImage->GetInitialRotation() + m_nUserRotation;
+void CMainDlg::SynchronizeProcessingParams() {
+	// after loading an image, the per image processing parameters must be synchronized with
+	// the current processing parameters
+	bool bLastWasSpecialProcessing = m_bCurrentImageIsSpecialProcessing;
+	bool bLastWasInParamDB = m_bCurrentImageInParamDB;
+	m_bCurrentImageInParamDB = false;
+	m_bCurrentImageIsSpecialProcessing = false;
+	if (m_pCurrentImage != NULL) {
+		m_dCurrentInitialLightenShadows = m_pCurrentImage->GetInitialProcessParams().LightenShadows;
+		m_bCurrentImageInParamDB = m_pCurrentImage->IsInParamDB();
+		m_bCurrentImageIsSpecialProcessing = m_pCurrentImage->GetLightenShadowFactor(false) != 1.0f;
+		if (!m_bKeepParams) {
+			m_bHQResampling = GetProcessingFlag(m_pCurrentImage->GetInitialProcessFlags(), PFLAG_HighQualityResampling);
+			m_bAutoContrast = GetProcessingFlag(m_pCurrentImage->GetInitialProcessFlags(), PFLAG_AutoContrast);
+			m_bLDC = GetProcessingFlag(m_pCurrentImage->GetInitialProcessFlags(), PFLAG_LDC);
+
+			m_nRotation = m_pCurrentImage->GetInitialRotation();
+			m_dZoom = m_pCurrentImage->GetInititialZoom();
+			m_offsets = m_pCurrentImage->GetInitialOffsets();
+
+			if (m_pCurrentImage->HasZoomStoredInParamDB()) {
+				m_bUserZoom = m_bUserPan = true;
 			}
+
+			*m_pImageProcParams = m_pCurrentImage->GetInitialProcessParams();
+		} else if (m_bCurrentImageIsSpecialProcessing && m_bKeepParams) {
+			// set this factor, no matter if we keep parameters
+			m_pImageProcParams->LightenShadows = m_pCurrentImage->GetInitialProcessParams().LightenShadows;
+		} else if (bLastWasSpecialProcessing && m_bKeepParams) {
+			// take kept value when last was special processing as the special processing value is not usable
+			m_pImageProcParams->LightenShadows = m_pImageProcParamsKept->LightenShadows;
 		}
-		if (!bAfterStartup && !m_bIsAnimationPlaying && !noAdjustWindow) {
-			AdjustWindowToImage(false);
+		if (m_bKeepParams) {
+			m_nRotation = m_pCurrentImage->GetInitialRotation() + m_nUserRotation;
 		}
 	}
 }
@@ -3506,6 +3575,7 @@ void CMainDlg::AnimateTransition() {
 void CMainDlg::CleanupAndTerminate() {
 	StopMovieMode();
 	StopAnimation();
+	CProcessingCalibration::StopCalibration();
 	delete m_pJPEGProvider; // delete this early to properly shut down the loading threads
 	m_pJPEGProvider = NULL;
 	EndDialog(0);
@@ -11,6 +11,9 @@
 // list of images in the directory needs to be reloaded
 #define WM_ACTIVE_DIRECTORY_FILELIST_CHANGED (WM_APP + 8)
 
+// Message posted when the background analysis of an image has finished, see CImageAnalysisThread
+#define WM_IMAGE_ANALYSIS_FINISHED (WM_APP + 9)
+
 // Posted to main dialog for asynchronously loading the image with file name CMainDlg::m_sStartupFile
 #define WM_LOAD_FILE_ASYNCH (WM_APP + 24)
 
@@ -5,6 +5,8 @@
 #ifndef WINXP
 #include "png.h"
 #include "MaxImageDef.h"
+#include "ICCProfileTransform.h"
+#include "SettingsProvider.h"
 #include <stdexcept>
 
 // Uncomment to build without APNG support
@@ -69,6 +71,7 @@ struct PngReader::png_cache {
 	void* buffer;
 	size_t buffer_size;
 	size_t buffer_offset;
+	void* transform;
 };
 
 PngReader::png_cache PngReader::cache = { 0 };
@@ -278,6 +281,16 @@ bool PngReader::BeginReading(void* buffer, size_t sizebytes, bool& outOfMemory)
 			cache.x0 = x0;
 			cache.y0 = y0;
 			cache.frame_count = frames;
+
+			// Color profile, applied to the composed frames
+			png_charp icc_name;
+			int icc_compression;
+			png_bytep icc_profile;
+			png_uint_32 icc_size;
+			if (CSettingsProvider::This().UseEmbeddedColorProfiles() &&
+				png_get_iCCP(png_ptr, info_ptr, &icc_name, &icc_compression, &icc_profile, &icc_size) != 0) {
+				cache.transform = ICCProfileTransform::CreateTransform(icc_profile, icc_size, ICCProfileTransform::FORMAT_BGRA);
+			}
 			return frames > 0;
 		}
 		free(p_image);
@@ -333,6 +346,7 @@ void* PngReader::ReadImage(int& width,
 	height = cache.height;
 	nchannels = cache.channels;
 	has_animation = (cache.frame_count > 1);
+	ICCProfileTransform::DoTransform(cache.transform, pixels, pixels, width, height);
 	frame_count = cache.frame_count;
 
 	// https://wiki.mozilla.org/APNG_Specification
@@ -364,6 +378,7 @@ void PngReader::DeleteCacheInternal(bool free_buffer)
 	free(cache.p_frame);
 	free(cache.p_image);
 	png_destroy_read_struct(&cache.png_ptr, &cache.info_ptr, NULL);
+	ICCProfileTransform::DeleteTransform(cache.transform);
 	void* temp_buffer = cache.buffer;
 	size_t temp_buffer_size = cache.buffer_size;
 	cache = { 0 };
@@ -0,0 +1,194 @@
+#include "StdAfx.h"
+#include "PixelKernels.h"
+#include "PixelKernelsSSE.h"
+#include "PixelKernelsAVX.h"
+#include "SettingsProvider.h"
+
+#define ALPHA_OPAQUE 0xFF000000
+
+const CPixelKernels* CPixelKernels::sm_pSelected = NULL;
+Helpers::CPUType CPixelKernels::sm_eSelectedTier = Helpers::CPU_Unknown;
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Generic C++ kernels
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+void Apply3ChannelLUT_Generic(const uint32* pSource, uint32* pTarget, int nCount, const uint8* pLUT) {
+	for (int i = 0; i < nCount; i++) {
+		uint32 nSrcPixels = pSource[i];
+		pTarget[i] = pLUT[nSrcPixels & 0xFF] + pLUT[256 + ((nSrcPixels >> 8) & 0xFF)] * 256 +
+			pLUT[512 + ((nSrcPixels >> 16) & 0xFF)] * 65536 + ALPHA_OPAQUE;
+	}
+}
+
+void ApplyLDCRow_Generic(const uint32* pSource, uint32* pTarget, int nCount, const int32* pMaskRow,
+	uint32 nStartX, uint32 nIncrementX, const int32* pLUT32, const int32* pMulLUT) {
+	uint32 nCurX = nStartX;
+	for (int i = 0; i < nCount; i++) {
+		// linear interpolation of mask in x direction
+		uint32 nCurXTrunc = nCurX >> 16;
+		uint32 nCurXFrac = nCurX & 0xFFFF;
+		int32 nLeft = pMaskRow[nCurXTrunc];
+		int32 nRight = pMaskRow[nCurXTrunc + 1];
+		int32 nMaskValue = ((int)nCurXFrac*(nRight - nLeft) >> 16) + nLeft - 127;
+
+		uint32 nSrcPixels = pSource[i];
+		int32 nBlue = pLUT32[nSrcPixels & 0xFF];
+		nBlue = nBlue + (nMaskValue*pMulLUT[nBlue] >> 14);
+		int32 nGreen = pLUT32[((nSrcPixels >> 8) & 0xFF) + 256];
+		nGreen = nGreen + (nMaskValue*pMulLUT[nGreen] >> 14);
+		int32 nRed = pLUT32[((nSrcPixels >> 16) & 0xFF) + 512];
+		nRed = nRed + (nMaskValue*pMulLUT[nRed] >> 14);
+
+		pTarget[i] = max(0, min(255, nBlue)) + max(0, min(255, nGreen))*256 + max(0, min(255, nRed))*65536 + ALPHA_OPAQUE;
+		nCurX += nIncrementX;
+	}
+}
+
+void Convert3To4ChannelsRow_Generic(const uint8* pSource, uint32* pTarget, int nCount) {
+	for (int i = 0; i < nCount; i++) {
+		*pTarget++ = pSource[0] + pSource[1] * 256 + pSource[2] * 65536 + ALPHA_OPAQUE;
+		pSource += 3;
+	}
+}
+
+void Convert4To3ChannelsRow_Generic(const uint8* pSource, uint8* pTarget, int nCount) {
+	for (int i = 0; i < nCount; i++) {
+		*pTarget++ = pSource[0];
+		*pTarget++ = pSource[1];
+		*pTarget++ = pSource[2];
+		pSource += 4;
+	}
+}
+
+void SetAlphaOpaque_Generic(const uint32* pSource, uint32* pTarget, int nCount) {
+	for (int i = 0; i < nCount; i++) {
+		pTarget[i] = pSource[i] | ALPHA_OPAQUE;
+	}
+}
+
+void MirrorRow_Generic(const uint32* pSource, uint32* pTarget, int nCount) {
+	const uint32* pSrc = pSource + nCount - 1;
+	for (int i = 0; i < nCount; i++) {
+		pTarget[i] = *pSrc--;
+	}
+}
+
+void MirrorRowInplace_Generic(uint32* pPixels, int nCount) {
+	uint32* pLeft = pPixels;
+	uint32* pRight = pPixels + nCount - 1;
+	while (pLeft < pRight) {
+		uint32 nTemp = *pLeft;
+		*pLeft++ = *pRight;
+		*pRight-- = nTemp;
+	}
+}
+
+void RotateBlock_Generic(const uint32* pSource, uint32* pTarget, int nWidth, int nHeight,
+	int nXStart, int nYStart, int nBlockWidth, int nBlockHeight, bool bCW) {
+	int nIncTargetLine = bCW ? nHeight : -nHeight;
+	int nIncStartYPtr = bCW ? -1 : +1;
+	const uint32* pSrc = pSource + (size_t)nWidth * nYStart + nXStart;
+	uint32* pStartYPtr = bCW ? pTarget + (size_t)nHeight * nXStart + (nHeight - 1 - nYStart) :
+		pTarget + (size_t)nHeight * (nWidth - 1 - nXStart) + nYStart;
+
+	for (int i = 0; i < nBlockHeight; i++) {
+		uint32* pTgt = pStartYPtr;
+		for (int j = 0; j < nBlockWidth; j++) {
+			*pTgt = pSrc[j];
+			pTgt += nIncTargetLine;
+		}
+		pStartYPtr += nIncStartYPtr;
+		pSrc += nWidth;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Kernel tables
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static const CPixelKernels GenericKernels = {
+	Apply3ChannelLUT_Generic,
+	ApplyLDCRow_Generic,
+	Convert3To4ChannelsRow_Generic,
+	Convert4To3ChannelsRow_Generic,
+	SetAlphaOpaque_Generic,
+	MirrorRow_Generic,
+	MirrorRowInplace_Generic,
+	RotateBlock_Generic
+};
+
+// SSE2 has no gather and no byte shuffle instructions, LUT, LDC and 24 bpp conversions use the generic kernels
+static const CPixelKernels SSEKernels = {
+	Apply3ChannelLUT_Generic,
+	ApplyLDCRow_Generic,
+	Convert3To4ChannelsRow_Generic,
+	Convert4To3ChannelsRow_Generic,
+	SetAlphaOpaque_SSE,
+	MirrorRow_SSE,
+	MirrorRowInplace_SSE,
+	RotateBlock_SSE
+};
+
+#ifdef _WIN64
+static const CPixelKernels AVX2Kernels = {
+	Apply3ChannelLUT_AVX2,
+	ApplyLDCRow_AVX2,
+	Convert3To4ChannelsRow_AVX2,
+	Convert4To3ChannelsRow_AVX2,
+	SetAlphaOpaque_AVX2,
+	MirrorRow_AVX2,
+	MirrorRowInplace_AVX2,
+	RotateBlock_AVX2
+};
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Public
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+const CPixelKernels& CPixelKernels::Get() {
+	// Concurrent first calls from several threads all select the same tier, thus no locking is needed
+	if (sm_pSelected == NULL) {
+		SelectTier(CSettingsProvider::This().AlgorithmImplementation());
+	}
+	return *sm_pSelected;
+}
+
+const CPixelKernels& CPixelKernels::ForTier(Helpers::CPUType eTier) {
+	switch (SupportedTier(eTier)) {
+#ifdef _WIN64
+		case Helpers::CPU_AVX2:
+			return AVX2Kernels;
+#endif
+		case Helpers::CPU_SSE:
+			return SSEKernels;
+		default:
+			return GenericKernels;
+	}
+}
+
+void CPixelKernels::SelectTier(Helpers::CPUType eTier) {
+	sm_eSelectedTier = SupportedTier(eTier);
+	sm_pSelected = &ForTier(sm_eSelectedTier);
+}
+
+Helpers::CPUType CPixelKernels::SelectedTier() {
+	Get();
+	return sm_eSelectedTier;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Private
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+Helpers::CPUType CPixelKernels::SupportedTier(Helpers::CPUType eTier) {
+	// the CPUType setting may request more than the CPU can do
+	eTier = min(eTier, Helpers::ProbeCPU());
+#ifndef _WIN64
+	// the AVX2 kernels are only compiled for 64 bit
+	eTier = min(eTier, Helpers::CPU_SSE);
+#endif
+	// there are no MMX kernels
+	return (eTier >= Helpers::CPU_SSE) ? eTier : Helpers::CPU_Generic;
+}
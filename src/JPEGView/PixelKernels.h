@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Helpers.h"
+
+// Table of the pixel kernels used by CBasicProcessing for LUT application, LDC, pixel format conversion, mirroring and
+// rotation by multiples of 90 degrees. There is one table per instruction set tier (Generic, SSE, AVX2), each tier has
+// its own compilation unit (PixelKernels.cpp, PixelKernelsSSE.cpp, PixelKernelsAVX.cpp). Kernels without an
+// implementation for a tier use the implementation of the next lower tier.
+// All tiers give identical results.
+class CPixelKernels
+{
+public:
+	// Applies a three channel LUT (256 entries for B, G and R channel each) to nCount 32 bpp pixels,
+	// the A channel is set to 0xFF
+	void (*Apply3ChannelLUT)(const uint32* pSource, uint32* pTarget, int nCount, const uint8* pLUT);
+
+	// Applies the three channel LUT and the LDC to one row of nCount 32 bpp pixels, the A channel is set to 0xFF.
+	// pMaskRow: LDC map row, already interpolated in y direction, one value more than the width of the LDC map
+	// nStartX, nIncrementX: Position of the first pixel in pMaskRow and increment per pixel, 16.16 fixed point format
+	// pLUT32: Three channel LUT widened to int32
+	// pMulLUT: LDC response LUT, 256 entries
+	void (*ApplyLDCRow)(const uint32* pSource, uint32* pTarget, int nCount, const int32* pMaskRow,
+		uint32 nStartX, uint32 nIncrementX, const int32* pLUT32, const int32* pMulLUT);
+
+	// Converts one row of nCount 24 bpp BGR pixels to 32 bpp BGRA, the A channel is set to 0xFF
+	void (*Convert3To4ChannelsRow)(const uint8* pSource, uint32* pTarget, int nCount);
+
+	// Converts one row of nCount 32 bpp BGRA pixels to 24 bpp BGR
+	void (*Convert4To3ChannelsRow)(const uint8* pSource, uint8* pTarget, int nCount);
+
+	// Copies nCount 32 bpp pixels, setting the A channel to 0xFF
+	void (*SetAlphaOpaque)(const uint32* pSource, uint32* pTarget, int nCount);
+
+	// Copies nCount 32 bpp pixels in reverse order, pTarget[i] = pSource[nCount - 1 - i]
+	void (*MirrorRow)(const uint32* pSource, uint32* pTarget, int nCount);
+
+	// Reverses the order of nCount 32 bpp pixels in place
+	void (*MirrorRowInplace)(uint32* pPixels, int nCount);
+
+	// Rotates a block of a 32 bpp image of size nWidth x nHeight by 90 degrees (bCW = true) or 270 degrees (bCW = false)
+	// from pSource to pTarget, pTarget has the size nHeight x nWidth
+	void (*RotateBlock)(const uint32* pSource, uint32* pTarget, int nWidth, int nHeight,
+		int nXStart, int nYStart, int nBlockWidth, int nBlockHeight, bool bCW);
+
+	// Kernels of the selected tier. On first use, the tier is selected from the CPUType setting, limited to what
+	// Helpers::ProbeCPU() detects.
+	static const CPixelKernels& Get();
+
+	// Kernels of the given tier, limited to what the CPU supports. Allows comparing the tiers side by side.
+	static const CPixelKernels& ForTier(Helpers::CPUType eTier);
+
+	// Forces the kernels of the given tier to be used by Get(), limited to what the CPU supports.
+	// Not thread safe, call when no processing is running.
+	static void SelectTier(Helpers::CPUType eTier);
+
+	// The tier of the kernels returned by Get()
+	static Helpers::CPUType SelectedTier();
+
+private:
+	static const CPixelKernels* sm_pSelected;
+	static Helpers::CPUType sm_eSelectedTier;
+
+	static Helpers::CPUType SupportedTier(Helpers::CPUType eTier);
+};
+
+// Generic C++ implementation of the kernels, used by the SIMD implementations for the pixels they do not process
+void Apply3ChannelLUT_Generic(const uint32* pSource, uint32* pTarget, int nCount, const uint8* pLUT);
+void ApplyLDCRow_Generic(const uint32* pSource, uint32* pTarget, int nCount, const int32* pMaskRow,
+	uint32 nStartX, uint32 nIncrementX, const int32* pLUT32, const int32* pMulLUT);
+void Convert3To4ChannelsRow_Generic(const uint8* pSource, uint32* pTarget, int nCount);
+void Convert4To3ChannelsRow_Generic(const uint8* pSource, uint8* pTarget, int nCount);
+void SetAlphaOpaque_Generic(const uint32* pSource, uint32* pTarget, int nCount);
+void MirrorRow_Generic(const uint32* pSource, uint32* pTarget, int nCount);
+void MirrorRowInplace_Generic(uint32* pPixels, int nCount);
+void RotateBlock_Generic(const uint32* pSource, uint32* pTarget, int nWidth, int nHeight,
+	int nXStart, int nYStart, int nBlockWidth, int nBlockHeight, bool bCW);
@@ -0,0 +1,207 @@
+#include "StdAfx.h"
+#include "PixelKernels.h"
+#include "PixelKernelsAVX.h"
+#include <immintrin.h>
+
+#ifdef _WIN64
+
+#define ALPHA_OPAQUE 0xFF000000
+
+// Reverses the order of the eight pixels
+static inline __m256i Reverse(__m256i pixels) {
+	return _mm256_permutevar8x32_epi32(pixels, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+static inline __m256i Clamp0To255(__m256i values) {
+	return _mm256_min_epi32(_mm256_max_epi32(values, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+}
+
+void Apply3ChannelLUT_AVX2(const uint32* pSource, uint32* pTarget, int nCount, const uint8* pLUT) {
+	// widening the LUT does not pay off for a few pixels
+	if (nCount < 4096) {
+		Apply3ChannelLUT_Generic(pSource, pTarget, nCount, pLUT);
+		return;
+	}
+	// LUT widened to 32 bit for the gather instructions, the values are shifted to the position of the channel
+	int32 LUT32[3 * 256];
+	for (int i = 0; i < 256; i++) {
+		LUT32[i] = pLUT[i];
+		LUT32[i + 256] = pLUT[i + 256] << 8;
+		LUT32[i + 512] = pLUT[i + 512] << 16;
+	}
+	__m256i mask = _mm256_set1_epi32(0xFF);
+	__m256i offsetGreen = _mm256_set1_epi32(256);
+	__m256i offsetRed = _mm256_set1_epi32(512);
+	__m256i alpha = _mm256_set1_epi32((int)ALPHA_OPAQUE);
+	int i = 0;
+	for (; i + 8 <= nCount; i += 8) {
+		__m256i pixels = _mm256_loadu_si256((const __m256i*)(pSource + i));
+		__m256i blue = _mm256_and_si256(pixels, mask);
+		__m256i green = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(pixels, 8), mask), offsetGreen);
+		__m256i red = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(pixels, 16), mask), offsetRed);
+		__m256i result = _mm256_or_si256(_mm256_i32gather_epi32(LUT32, blue, 4), _mm256_i32gather_epi32(LUT32, green, 4));
+		result = _mm256_or_si256(result, _mm256_or_si256(_mm256_i32gather_epi32(LUT32, red, 4), alpha));
+		_mm256_storeu_si256((__m256i*)(pTarget + i), result);
+	}
+	Apply3ChannelLUT_Generic(pSource + i, pTarget + i, nCount - i, pLUT);
+}
+
+// LUT lookup and LDC of one channel, see ApplyLDCRow_Generic()
+static inline __m256i ApplyLDCChannel(__m256i channel, __m256i maskValue, const int32* pLUT32, const int32* pMulLUT) {
+	__m256i value = _mm256_i32gather_epi32(pLUT32, channel, 4);
+	__m256i correction = _mm256_srai_epi32(_mm256_mullo_epi32(maskValue, _mm256_i32gather_epi32(pMulLUT, value, 4)), 14);
+	return Clamp0To255(_mm256_add_epi32(value, correction));
+}
+
+void ApplyLDCRow_AVX2(const uint32* pSource, uint32* pTarget, int nCount, const int32* pMaskRow,
+	uint32 nStartX, uint32 nIncrementX, const int32* pLUT32, const int32* pMulLUT) {
+	__m256i curX = _mm256_add_epi32(_mm256_set1_epi32(nStartX), _mm256_mullo_epi32(_mm256_set1_epi32(nIncrementX), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+	__m256i increment = _mm256_set1_epi32(nIncrementX * 8);
+	__m256i fracMask = _mm256_set1_epi32(0xFFFF);
+	__m256i one = _mm256_set1_epi32(1);
+	__m256i maskOffset = _mm256_set1_epi32(127);
+	__m256i mask = _mm256_set1_epi32(0xFF);
+	__m256i offsetGreen = _mm256_set1_epi32(256);
+	__m256i offsetRed = _mm256_set1_epi32(512);
+	__m256i alpha = _mm256_set1_epi32((int)ALPHA_OPAQUE);
+	int i = 0;
+	for (; i + 8 <= nCount; i += 8) {
+		// linear interpolation of mask in x direction
+		__m256i curXTrunc = _mm256_srli_epi32(curX, 16);
+		__m256i curXFrac = _mm256_and_si256(curX, fracMask);
+		__m256i left = _mm256_i32gather_epi32(pMaskRow, curXTrunc, 4);
+		__m256i right = _mm256_i32gather_epi32(pMaskRow, _mm256_add_epi32(curXTrunc, one), 4);
+		__m256i maskValue = _mm256_srai_epi32(_mm256_mullo_epi32(curXFrac, _mm256_sub_epi32(right, left)), 16);
+		maskValue = _mm256_sub_epi32(_mm256_add_epi32(maskValue, left), maskOffset);
+
+		__m256i pixels = _mm256_loadu_si256((const __m256i*)(pSource + i));
+		__m256i blue = ApplyLDCChannel(_mm256_and_si256(pixels, mask), maskValue, pLUT32, pMulLUT);
+		__m256i green = ApplyLDCChannel(_mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(pixels, 8), mask), offsetGreen), maskValue, pLUT32, pMulLUT);
+		__m256i red = ApplyLDCChannel(_mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(pixels, 16), mask), offsetRed), maskValue, pLUT32, pMulLUT);
+		__m256i result = _mm256_or_si256(_mm256_or_si256(blue, _mm256_slli_epi32(green, 8)), _mm256_or_si256(_mm256_slli_epi32(red, 16), alpha));
+		_mm256_storeu_si256((__m256i*)(pTarget + i), result);
+		curX = _mm256_add_epi32(curX, increment);
+	}
+	ApplyLDCRow_Generic(pSource + i, pTarget + i, nCount - i, pMaskRow, nStartX + i * nIncrementX, nIncrementX, pLUT32, pMulLUT);
+}
+
+void Convert3To4ChannelsRow_AVX2(const uint8* pSource, uint32* pTarget, int nCount) {
+	__m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	__m256i alpha = _mm256_set1_epi32((int)ALPHA_OPAQUE);
+	int i = 0;
+	// eight pixels are 24 bytes but 28 bytes are read, thus the last two pixels are left to the generic code
+	for (; i + 10 <= nCount; i += 8) {
+		const uint8* pSrc = pSource + i * 3;
+		__m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)pSrc)),
+			_mm_loadu_si128((const __m128i*)(pSrc + 12)), 1);
+		_mm256_storeu_si256((__m256i*)(pTarget + i), _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha));
+	}
+	Convert3To4ChannelsRow_Generic(pSource + i * 3, pTarget + i, nCount - i);
+}
+
+void Convert4To3ChannelsRow_AVX2(const uint8* pSource, uint8* pTarget, int nCount) {
+	__m256i shuffle = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	int i = 0;
+	// eight pixels are 24 bytes but 28 bytes are written, thus the last two pixels are left to the generic code
+	for (; i + 10 <= nCount; i += 8) {
+		__m256i pixels = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(pSource + i * 4)), shuffle);
+		uint8* pTgt = pTarget + i * 3;
+		_mm_storeu_si128((__m128i*)pTgt, _mm256_castsi256_si128(pixels));
+		_mm_storeu_si128((__m128i*)(pTgt + 12), _mm256_extracti128_si256(pixels, 1));
+	}
+	Convert4To3ChannelsRow_Generic(pSource + i * 4, pTarget + i * 3, nCount - i);
+}
+
+void SetAlphaOpaque_AVX2(const uint32* pSource, uint32* pTarget, int nCount) {
+	__m256i alpha = _mm256_set1_epi32((int)ALPHA_OPAQUE);
+	int i = 0;
+	for (; i + 8 <= nCount; i += 8) {
+		_mm256_storeu_si256((__m256i*)(pTarget + i), _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(pSource + i)), alpha));
+	}
+	SetAlphaOpaque_Generic(pSource + i, pTarget + i, nCount - i);
+}
+
+void MirrorRow_AVX2(const uint32* pSource, uint32* pTarget, int nCount) {
+	int i = 0;
+	for (; i + 8 <= nCount; i += 8) {
+		__m256i pixels = _mm256_loadu_si256((const __m256i*)(pSource + nCount - 8 - i));
+		_mm256_storeu_si256((__m256i*)(pTarget + i), Reverse(pixels));
+	}
+	MirrorRow_Generic(pSource, pTarget + i, nCount - i);
+}
+
+void MirrorRowInplace_AVX2(uint32* pPixels, int nCount) {
+	uint32* pLeft = pPixels;
+	uint32* pRight = pPixels + nCount; // after the last pixel not yet swapped
+	while (pRight - pLeft >= 16) {
+		__m256i left = _mm256_loadu_si256((const __m256i*)pLeft);
+		__m256i right = _mm256_loadu_si256((const __m256i*)(pRight - 8));
+		_mm256_storeu_si256((__m256i*)pLeft, Reverse(right));
+		_mm256_storeu_si256((__m256i*)(pRight - 8), Reverse(left));
+		pLeft += 8;
+		pRight -= 8;
+	}
+	MirrorRowInplace_Generic(pLeft, (int)(pRight - pLeft));
+}
+
+void RotateBlock_AVX2(const uint32* pSource, uint32* pTarget, int nWidth, int nHeight,
+	int nXStart, int nYStart, int nBlockWidth, int nBlockHeight, bool bCW) {
+	// tiles of 8 x 8 pixels are transposed in registers, the remaining columns and rows are rotated by the generic code
+	int nTilesWidth = nBlockWidth & ~7;
+	int nTilesHeight = nBlockHeight & ~7;
+	for (int y = nYStart; y < nYStart + nTilesHeight; y += 8) {
+		const uint32* pSrc = pSource + (size_t)nWidth * y;
+		for (int x = nXStart; x < nXStart + nTilesWidth; x += 8) {
+			__m256i r[8];
+			for (int k = 0; k < 8; k++) {
+				r[k] = _mm256_loadu_si256((const __m256i*)(pSrc + k * nWidth + x));
+			}
+			__m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+			__m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+			__m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+			__m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+			__m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+			__m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+			__m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+			__m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+			// columns k and k + 4 of the rows 0 to 3 (u0 to u3) and 4 to 7 (u4 to u7)
+			__m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+			__m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+			__m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+			__m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+			__m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+			__m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+			__m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+			__m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+			// c[k] is the column x + k of the tile
+			__m256i c[8];
+			c[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+			c[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+			c[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+			c[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+			c[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+			c[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+			c[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+			c[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+			if (bCW) {
+				// column x goes to target row x, reversed
+				uint32* pTgt = pTarget + (size_t)nHeight * x + (nHeight - 8 - y);
+				for (int k = 0; k < 8; k++) {
+					_mm256_storeu_si256((__m256i*)(pTgt + k * nHeight), Reverse(c[k]));
+				}
+			} else {
+				// column x goes to target row nWidth - 1 - x
+				uint32* pTgt = pTarget + (size_t)nHeight * (nWidth - 1 - x) + y;
+				for (int k = 0; k < 8; k++) {
+					_mm256_storeu_si256((__m256i*)(pTgt - k * nHeight), c[k]);
+				}
+			}
+		}
+	}
+	RotateBlock_Generic(pSource, pTarget, nWidth, nHeight, nXStart + nTilesWidth, nYStart, nBlockWidth - nTilesWidth, nBlockHeight, bCW);
+	RotateBlock_Generic(pSource, pTarget, nWidth, nHeight, nXStart, nYStart + nTilesHeight, nTilesWidth, nBlockHeight - nTilesHeight, bCW);
+}
+
+#endif
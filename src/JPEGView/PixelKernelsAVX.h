@@ -0,0 +1,19 @@
+#pragma once
+
+// Used by PixelKernels.cpp: AVX2 implementation of the pixel kernels, see CPixelKernels for the description of the
+// parameters. Own compilation unit to be able to compile this with AVX compiler flag, only available for 64 bit.
+
+#ifdef _WIN64
+
+void Apply3ChannelLUT_AVX2(const uint32* pSource, uint32* pTarget, int nCount, const uint8* pLUT);
+void ApplyLDCRow_AVX2(const uint32* pSource, uint32* pTarget, int nCount, const int32* pMaskRow,
+	uint32 nStartX, uint32 nIncrementX, const int32* pLUT32, const int32* pMulLUT);
+void Convert3To4ChannelsRow_AVX2(const uint8* pSource, uint32* pTarget, int nCount);
+void Convert4To3ChannelsRow_AVX2(const uint8* pSource, uint8* pTarget, int nCount);
+void SetAlphaOpaque_AVX2(const uint32* pSource, uint32* pTarget, int nCount);
+void MirrorRow_AVX2(const uint32* pSource, uint32* pTarget, int nCount);
+void MirrorRowInplace_AVX2(uint32* pPixels, int nCount);
+void RotateBlock_AVX2(const uint32* pSource, uint32* pTarget, int nWidth, int nHeight,
+	int nXStart, int nYStart, int nBlockWidth, int nBlockHeight, bool bCW);
+
+#endif
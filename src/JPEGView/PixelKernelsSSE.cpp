@@ -0,0 +1,85 @@
+#include "StdAfx.h"
+#include "PixelKernels.h"
+#include "PixelKernelsSSE.h"
+#include <emmintrin.h>
+
+#define ALPHA_OPAQUE 0xFF000000
+
+// Reverses the order of the four pixels
+static inline __m128i Reverse(__m128i pixels) {
+	return _mm_shuffle_epi32(pixels, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+void SetAlphaOpaque_SSE(const uint32* pSource, uint32* pTarget, int nCount) {
+	__m128i alpha = _mm_set1_epi32((int)ALPHA_OPAQUE);
+	int i = 0;
+	for (; i + 4 <= nCount; i += 4) {
+		_mm_storeu_si128((__m128i*)(pTarget + i), _mm_or_si128(_mm_loadu_si128((const __m128i*)(pSource + i)), alpha));
+	}
+	SetAlphaOpaque_Generic(pSource + i, pTarget + i, nCount - i);
+}
+
+void MirrorRow_SSE(const uint32* pSource, uint32* pTarget, int nCount) {
+	int i = 0;
+	for (; i + 4 <= nCount; i += 4) {
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(pSource + nCount - 4 - i));
+		_mm_storeu_si128((__m128i*)(pTarget + i), Reverse(pixels));
+	}
+	MirrorRow_Generic(pSource, pTarget + i, nCount - i);
+}
+
+void MirrorRowInplace_SSE(uint32* pPixels, int nCount) {
+	uint32* pLeft = pPixels;
+	uint32* pRight = pPixels + nCount; // after the last pixel not yet swapped
+	while (pRight - pLeft >= 8) {
+		__m128i left = _mm_loadu_si128((const __m128i*)pLeft);
+		__m128i right = _mm_loadu_si128((const __m128i*)(pRight - 4));
+		_mm_storeu_si128((__m128i*)pLeft, Reverse(right));
+		_mm_storeu_si128((__m128i*)(pRight - 4), Reverse(left));
+		pLeft += 4;
+		pRight -= 4;
+	}
+	MirrorRowInplace_Generic(pLeft, (int)(pRight - pLeft));
+}
+
+void RotateBlock_SSE(const uint32* pSource, uint32* pTarget, int nWidth, int nHeight,
+	int nXStart, int nYStart, int nBlockWidth, int nBlockHeight, bool bCW) {
+	// tiles of 4 x 4 pixels are transposed in registers, the remaining columns and rows are rotated by the generic code
+	int nTilesWidth = nBlockWidth & ~3;
+	int nTilesHeight = nBlockHeight & ~3;
+	for (int y = nYStart; y < nYStart + nTilesHeight; y += 4) {
+		const uint32* pSrc = pSource + (size_t)nWidth * y;
+		for (int x = nXStart; x < nXStart + nTilesWidth; x += 4) {
+			__m128i r0 = _mm_loadu_si128((const __m128i*)(pSrc + x));
+			__m128i r1 = _mm_loadu_si128((const __m128i*)(pSrc + nWidth + x));
+			__m128i r2 = _mm_loadu_si128((const __m128i*)(pSrc + 2 * nWidth + x));
+			__m128i r3 = _mm_loadu_si128((const __m128i*)(pSrc + 3 * nWidth + x));
+			__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+			__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+			__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+			__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+			// c0 to c3 are the columns x to x + 3 of the tile
+			__m128i c0 = _mm_unpacklo_epi64(t0, t1);
+			__m128i c1 = _mm_unpackhi_epi64(t0, t1);
+			__m128i c2 = _mm_unpacklo_epi64(t2, t3);
+			__m128i c3 = _mm_unpackhi_epi64(t2, t3);
+			if (bCW) {
+				// column x goes to target row x, reversed
+				uint32* pTgt = pTarget + (size_t)nHeight * x + (nHeight - 4 - y);
+				_mm_storeu_si128((__m128i*)pTgt, Reverse(c0));
+				_mm_storeu_si128((__m128i*)(pTgt + nHeight), Reverse(c1));
+				_mm_storeu_si128((__m128i*)(pTgt + 2 * nHeight), Reverse(c2));
+				_mm_storeu_si128((__m128i*)(pTgt + 3 * nHeight), Reverse(c3));
+			} else {
+				// column x goes to target row nWidth - 1 - x
+				uint32* pTgt = pTarget + (size_t)nHeight * (nWidth - 1 - x) + y;
+				_mm_storeu_si128((__m128i*)pTgt, c0);
+				_mm_storeu_si128((__m128i*)(pTgt - nHeight), c1);
+				_mm_storeu_si128((__m128i*)(pTgt - 2 * nHeight), c2);
+				_mm_storeu_si128((__m128i*)(pTgt - 3 * nHeight), c3);
+			}
+		}
+	}
+	RotateBlock_Generic(pSource, pTarget, nWidth, nHeight, nXStart + nTilesWidth, nYStart, nBlockWidth - nTilesWidth, nBlockHeight, bCW);
+	RotateBlock_Generic(pSource, pTarget, nWidth, nHeight, nXStart, nYStart + nTilesHeight, nTilesWidth, nBlockHeight - nTilesHeight, bCW);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+// Used by PixelKernels.cpp: SSE2 implementation of the pixel kernels, see CPixelKernels for the description of the
+// parameters. Own compilation unit to keep the instruction set tiers separated.
+
+void SetAlphaOpaque_SSE(const uint32* pSource, uint32* pTarget, int nCount);
+void MirrorRow_SSE(const uint32* pSource, uint32* pTarget, int nCount);
+void MirrorRowInplace_SSE(uint32* pPixels, int nCount);
+void RotateBlock_SSE(const uint32* pSource, uint32* pTarget, int nWidth, int nHeight,
+	int nXStart, int nYStart, int nBlockWidth, int nBlockHeight, bool bCW);
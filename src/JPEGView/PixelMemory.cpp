@@ -0,0 +1,131 @@
+#include "StdAfx.h"
+#include "PixelMemory.h"
+#include "Helpers.h"
+#include <map>
+
+// Buffers smaller than this are always allocated on the heap
+#define MIN_SCRATCH_FILE_SIZE (64 * 1024 * 1024)
+
+///////////////////////////////////////////////////////////////////////////////////
+// Supporting classes
+///////////////////////////////////////////////////////////////////////////////////
+
+// Scratch files of the mapped views, the file is deleted when its handle is closed
+static class CScratchFileRegistry {
+public:
+	CScratchFileRegistry() { ::InitializeCriticalSection(&m_cs); }
+	~CScratchFileRegistry() { ::DeleteCriticalSection(&m_cs); }
+
+	void Add(void* pView, HANDLE hFile) {
+		Helpers::CAutoCriticalSection lock(m_cs);
+		m_files[pView] = hFile;
+	}
+
+	// Returns INVALID_HANDLE_VALUE if the view is not registered
+	HANDLE Remove(void* pView) {
+		Helpers::CAutoCriticalSection lock(m_cs);
+		std::map<void*, HANDLE>::iterator iter = m_files.find(pView);
+		if (iter == m_files.end()) {
+			return INVALID_HANDLE_VALUE;
+		}
+		HANDLE hFile = iter->second;
+		m_files.erase(iter);
+		return hFile;
+	}
+
+	bool Contains(const void* pView) {
+		Helpers::CAutoCriticalSection lock(m_cs);
+		return m_files.find((void*)pView) != m_files.end();
+	}
+
+	bool IsEmpty() {
+		Helpers::CAutoCriticalSection lock(m_cs);
+		return m_files.empty();
+	}
+
+private:
+	CRITICAL_SECTION m_cs;
+	std::map<void*, HANDLE> m_files;
+} s_scratchFiles;
+
+///////////////////////////////////////////////////////////////////////////////////
+// Public interface
+///////////////////////////////////////////////////////////////////////////////////
+
+void* CPixelMemory::Allocate(size_t nSizeBytes) {
+	bool bLarge = nSizeBytes >= MIN_SCRATCH_FILE_SIZE;
+	if (bLarge && ExceedsFreePhysicalMemory(nSizeBytes)) {
+		void* pMemory = AllocateScratchFile(nSizeBytes);
+		if (pMemory != NULL) {
+			return pMemory;
+		}
+	}
+	void* pMemory = new(std::nothrow) uint8[nSizeBytes];
+	if (pMemory == NULL && bLarge) {
+		// the heap may be fragmented or the commit limit reached, a scratch file can still work
+		pMemory = AllocateScratchFile(nSizeBytes);
+	}
+	return pMemory;
+}
+
+void CPixelMemory::Free(void* pMemory) {
+	if (pMemory == NULL) {
+		return;
+	}
+	if (!s_scratchFiles.IsEmpty()) { // usually there are no scratch files
+		HANDLE hFile = s_scratchFiles.Remove(pMemory);
+		if (hFile != INVALID_HANDLE_VALUE) {
+			::UnmapViewOfFile(pMemory);
+			::CloseHandle(hFile);
+			return;
+		}
+	}
+	delete[] (uint8*)pMemory;
+}
+
+bool CPixelMemory::IsScratchFileBacked(const void* pMemory) {
+	return pMemory != NULL && s_scratchFiles.Contains(pMemory);
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// Private
+///////////////////////////////////////////////////////////////////////////////////
+
+void* CPixelMemory::AllocateScratchFile(size_t nSizeBytes) {
+	TCHAR sTempPath[MAX_PATH];
+	TCHAR sTempFileName[MAX_PATH];
+	if (::GetTempPath(MAX_PATH, sTempPath) == 0 || ::GetTempFileName(sTempPath, _T("JPV"), 0, sTempFileName) == 0) {
+		return NULL;
+	}
+	HANDLE hFile = ::CreateFile(sTempFileName, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		::DeleteFile(sTempFileName);
+		return NULL;
+	}
+	unsigned __int64 nSize = nSizeBytes;
+	HANDLE hMapping = ::CreateFileMapping(hFile, NULL, PAGE_READWRITE, (DWORD)(nSize >> 32), (DWORD)nSize, NULL);
+	if (hMapping == NULL) {
+		::CloseHandle(hFile);
+		return NULL;
+	}
+	// the view keeps the mapping alive, only the file handle is needed to delete the file when freeing the view
+	void* pView = ::MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, nSizeBytes);
+	::CloseHandle(hMapping);
+	if (pView == NULL) {
+		::CloseHandle(hFile);
+		return NULL;
+	}
+	s_scratchFiles.Add(pView, hFile);
+	return pView;
+}
+
+bool CPixelMemory::ExceedsFreePhysicalMemory(size_t nSizeBytes) {
+	MEMORYSTATUSEX memoryStatus;
+	memoryStatus.dwLength = sizeof(memoryStatus);
+	if (!::GlobalMemoryStatusEx(&memoryStatus)) {
+		return false;
+	}
+	// leave half of the free memory for the processed and displayed pixels
+	return nSizeBytes > memoryStatus.ullAvailPhys / 2;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// Allocation of the pixels of large images. Buffers fitting into the free physical memory are allocated on the heap,
+// larger buffers are backed by a memory mapped scratch file in the temp directory. The system then writes the cold parts
+// of the image (e.g. of a gigapixel panorama) to the scratch file instead of failing the allocation, all processing
+// reads the pixels through the mapped view as if they were in memory.
+class CPixelMemory
+{
+public:
+	// Allocates nSizeBytes bytes, returns NULL when out of memory
+	static void* Allocate(size_t nSizeBytes);
+
+	// Frees memory allocated with Allocate() or with new[], NULL is ignored
+	static void Free(void* pMemory);
+
+	// Returns if the memory is backed by a scratch file
+	static bool IsScratchFileBacked(const void* pMemory);
+
+private:
+	CPixelMemory(void);
+
+	static void* AllocateScratchFile(size_t nSizeBytes);
+	static bool ExceedsFreePhysicalMemory(size_t nSizeBytes);
+};
@@ -0,0 +1,118 @@
+#include "StdAfx.h"
+#include "PointSampleAVX.h"
+
+#ifdef _WIN64
+
+#define ALPHA_OPAQUE 0xFF000000
+
+// Positions of the eight target pixels starting with nStart and advancing by nIncrement
+static inline __m256i GetPositions(int32 nStart, int32 nIncrement) {
+	return _mm256_add_epi32(_mm256_set1_epi32(nStart), _mm256_mullo_epi32(_mm256_set1_epi32(nIncrement), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+}
+
+// Byte offsets of the pixels in a row of pixels having nChannels channels
+static inline __m256i GetPixelOffsets(__m256i x, int nChannels) {
+	return (nChannels == 3) ? _mm256_add_epi32(x, _mm256_slli_epi32(x, 1)) : _mm256_slli_epi32(x, 2);
+}
+
+// Gathers the pixels at x, y of an image too large for 32 bit byte offsets, using two gathers of four pixels with 64 bit offsets
+static inline __m256i GatherPixels64(const uint8* pSourcePixels, __m256i x, __m256i y, __m256i stride, int nChannels,
+	__m256i backColor, __m256i inside) {
+	__m256i pixelOffsets = GetPixelOffsets(x, nChannels);
+	__m256i offsetsLow = _mm256_add_epi64(_mm256_mul_epi32(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(y)), stride),
+		_mm256_cvtepi32_epi64(_mm256_castsi256_si128(pixelOffsets)));
+	__m256i offsetsHigh = _mm256_add_epi64(_mm256_mul_epi32(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(y, 1)), stride),
+		_mm256_cvtepi32_epi64(_mm256_extracti128_si256(pixelOffsets, 1)));
+	__m128i pixelsLow = _mm256_mask_i64gather_epi32(_mm256_castsi256_si128(backColor), (const int*)pSourcePixels, offsetsLow,
+		_mm256_castsi256_si128(inside), 1);
+	__m128i pixelsHigh = _mm256_mask_i64gather_epi32(_mm256_extracti128_si256(backColor, 1), (const int*)pSourcePixels, offsetsHigh,
+		_mm256_extracti128_si256(inside, 1), 1);
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(pixelsLow), pixelsHigh, 1);
+}
+
+int PointSampleRow_AVX2(const uint8* pSourceRow, int nSourceWidth, int nChannels, uint32 nStartX, uint32 nIncrementX,
+	int nCount, uint32* pTarget) {
+	uint32 nLastX = (nChannels == 3) ? nSourceWidth - 2 : nSourceWidth - 1;
+	__m256i curX = GetPositions(nStartX, nIncrementX);
+	__m256i increment = _mm256_set1_epi32(nIncrementX * 8);
+	__m256i alpha = _mm256_set1_epi32((nChannels == 3) ? ALPHA_OPAQUE : 0);
+	int i = 0;
+	for (; i + 8 <= nCount; i += 8) {
+		if (((nStartX + (i + 7) * nIncrementX) >> 16) > nLastX) {
+			break;
+		}
+		__m256i offsets = GetPixelOffsets(_mm256_srli_epi32(curX, 16), nChannels);
+		__m256i pixels = _mm256_i32gather_epi32((const int*)pSourceRow, offsets, 1);
+		_mm256_storeu_si256((__m256i*)(pTarget + i), _mm256_or_si256(pixels, alpha));
+		curX = _mm256_add_epi32(curX, increment);
+	}
+	return i;
+}
+
+int PointSampleRowClipped_AVX2(const uint8* pSourceRow, int nSourceWidth, int nChannels, int32 nStartX, int32 nIncrementX,
+	uint32 nBackColor, int nCount, uint32* pTarget) {
+	__m256i curX = GetPositions(nStartX, nIncrementX);
+	__m256i increment = _mm256_set1_epi32(nIncrementX * 8);
+	__m256i alpha = _mm256_set1_epi32((nChannels == 3) ? ALPHA_OPAQUE : 0);
+	__m256i backColor = _mm256_set1_epi32(nBackColor);
+	__m256i minusOne = _mm256_set1_epi32(-1);
+	__m256i width = _mm256_set1_epi32(nSourceWidth);
+	int i = 0;
+	for (; i + 8 <= nCount; i += 8) {
+		if (nChannels == 3 && ((int32)((uint32)nStartX + (uint32)(i + 7) * (uint32)nIncrementX) >> 16) >= nSourceWidth - 1) {
+			break;
+		}
+		__m256i x = _mm256_srai_epi32(curX, 16);
+		__m256i inside = _mm256_and_si256(_mm256_cmpgt_epi32(x, minusOne), _mm256_cmpgt_epi32(width, x));
+		__m256i pixels = _mm256_mask_i32gather_epi32(backColor, (const int*)pSourceRow, GetPixelOffsets(x, nChannels), inside, 1);
+		_mm256_storeu_si256((__m256i*)(pTarget + i), _mm256_or_si256(pixels, alpha));
+		curX = _mm256_add_epi32(curX, increment);
+	}
+	return i;
+}
+
+int PointSampleRotated_AVX2(const uint8* pSourcePixels, int nSourceWidth, int nSourceHeight, int nSourceStride, int nChannels,
+	int32 nStartX, int32 nStartY, int32 nIncrementX, int32 nIncrementY, uint32 nBackColor, int nCount, uint32* pTarget) {
+	__m256i curX = GetPositions(nStartX, nIncrementX);
+	__m256i curY = GetPositions(nStartY, nIncrementY);
+	__m256i incrementX = _mm256_set1_epi32(nIncrementX * 8);
+	__m256i incrementY = _mm256_set1_epi32(nIncrementY * 8);
+	__m256i alpha = _mm256_set1_epi32((nChannels == 3) ? ALPHA_OPAQUE : 0);
+	__m256i backColor = _mm256_set1_epi32(nBackColor);
+	__m256i minusOne = _mm256_set1_epi32(-1);
+	__m256i width = _mm256_set1_epi32(nSourceWidth);
+	__m256i height = _mm256_set1_epi32(nSourceHeight);
+	__m256i stride = _mm256_set1_epi32(nSourceStride);
+	__m256i lastX = _mm256_set1_epi32(nSourceWidth - 1);
+	__m256i lastY = _mm256_set1_epi32(nSourceHeight - 1);
+	// the byte offsets of the pixels only fit into the 32 bit offsets of the faster gathers for images up to 2 GB
+	bool bOffsets64 = (__int64)nSourceStride * nSourceHeight > INT_MAX;
+	__m256i stride64 = _mm256_set1_epi64x(nSourceStride);
+	int i = 0;
+	for (; i + 8 <= nCount; i += 8) {
+		__m256i x = _mm256_srai_epi32(curX, 16);
+		__m256i y = _mm256_srai_epi32(curY, 16);
+		__m256i inside = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(x, minusOne), _mm256_cmpgt_epi32(width, x)),
+			_mm256_and_si256(_mm256_cmpgt_epi32(y, minusOne), _mm256_cmpgt_epi32(height, y)));
+		if (nChannels == 3) {
+			// reading the last pixel of the image as 32 bit value would read after the image
+			__m256i lastPixel = _mm256_and_si256(_mm256_cmpeq_epi32(x, lastX), _mm256_cmpeq_epi32(y, lastY));
+			if (!_mm256_testz_si256(lastPixel, lastPixel)) {
+				break;
+			}
+		}
+		__m256i pixels;
+		if (bOffsets64) {
+			pixels = GatherPixels64(pSourcePixels, x, y, stride64, nChannels, backColor, inside);
+		} else {
+			__m256i offsets = _mm256_add_epi32(_mm256_mullo_epi32(y, stride), GetPixelOffsets(x, nChannels));
+			pixels = _mm256_mask_i32gather_epi32(backColor, (const int*)pSourcePixels, offsets, inside, 1);
+		}
+		_mm256_storeu_si256((__m256i*)(pTarget + i), _mm256_or_si256(pixels, alpha));
+		curX = _mm256_add_epi32(curX, incrementX);
+		curY = _mm256_add_epi32(curY, incrementY);
+	}
+	return i;
+}
+
+#endif
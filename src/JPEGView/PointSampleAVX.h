@@ -0,0 +1,19 @@
+#pragma once
+
+// Used by BasicProcessing.cpp: Point sampling of eight target pixels at once using AVX2 gathers. Own compilation unit to be able
+// to compile this with AVX compiler flag.
+// All methods process the first pixels of a target row and return the number of pixels processed, this is always a multiple of
+// eight. The caller must process the remaining pixels of the row. The x and y positions are in 16.16 fixed point format.
+// Three channel pixels are read as 32 bit values, thus pixels that would read after the source image are left to the caller.
+
+// Point sampling of one source row, all sampled x positions must be inside the source row
+int PointSampleRow_AVX2(const uint8* pSourceRow, int nSourceWidth, int nChannels, uint32 nStartX, uint32 nIncrementX,
+	int nCount, uint32* pTarget);
+
+// Point sampling of one source row, target pixels having their x position outside of the source row get nBackColor
+int PointSampleRowClipped_AVX2(const uint8* pSourceRow, int nSourceWidth, int nChannels, int32 nStartX, int32 nIncrementX,
+	uint32 nBackColor, int nCount, uint32* pTarget);
+
+// Point sampling along a line in the source image, target pixels having their position outside of the source image get nBackColor
+int PointSampleRotated_AVX2(const uint8* pSourcePixels, int nSourceWidth, int nSourceHeight, int nSourceStride, int nChannels,
+	int32 nStartX, int32 nStartY, int32 nIncrementX, int32 nIncrementY, uint32 nBackColor, int nCount, uint32* pTarget);
@@ -0,0 +1,431 @@
+#include "StdAfx.h"
+#include "ProcessingBenchmark.h"
+#include "ProcessingThreadPool.h"
+#include "BasicProcessing.h"
+#include "PixelKernels.h"
+#include "SettingsProvider.h"
+#include "Helpers.h"
+#include <algorithm>
+
+// Increment when the benchmarks change, results with different versions cannot be compared
+static const int BENCHMARK_VERSION = 1;
+
+// Sizes of the synthetic source images
+static const SIZE IMAGE_SIZES[] = { { 1024, 576 }, { 1920, 1080 }, { 3840, 2160 } };
+static const int NUM_IMAGE_SIZES = sizeof(IMAGE_SIZES) / sizeof(SIZE);
+
+// Each measurement is repeated NUM_RUNS times after one warm up run, the minimal and the median time are reported
+static const int NUM_RUNS = 5;
+static const int LDC_MAP_SIZE = 32;
+
+static const Helpers::CPUType TIERS[] = { Helpers::CPU_Generic, Helpers::CPU_SSE, Helpers::CPU_AVX2 };
+static const char* TIER_NAMES[] = { "Generic", "SSE", "AVX2" };
+static const int NUM_TIERS = sizeof(TIERS) / sizeof(Helpers::CPUType);
+
+#ifdef _WIN64
+static const char PLATFORM[] = "x64";
+#else
+static const char PLATFORM[] = "x86";
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////
+// Supporting classes
+///////////////////////////////////////////////////////////////////////////////////
+
+// Synthetic input images in all pixel formats used by CBasicProcessing, allocated for the largest image size
+class CBenchmarkImages {
+public:
+	CBenchmarkImages(CSize maxSize) {
+		int nNumPixels = maxSize.cx * maxSize.cy;
+		Pixels32 = new(std::nothrow) uint32[nNumPixels];
+		Pixels24 = new(std::nothrow) uint8[Helpers::DoPadding(maxSize.cx * 3, 4) * maxSize.cy];
+		Pixels8 = new(std::nothrow) uint8[Helpers::DoPadding(maxSize.cx, 4) * maxSize.cy];
+		Work = new(std::nothrow) uint32[nNumPixels];
+		Target = new(std::nothrow) uint32[nNumPixels];
+		Gray16 = NULL;
+		SatLUTs = CBasicProcessing::CreateColorSaturationLUTs(1.3);
+		if (Pixels32 != NULL && Pixels24 != NULL && Pixels8 != NULL && Work != NULL) {
+			uint32 nSeed = 4711;
+			for (int i = 0; i < nNumPixels; i++) {
+				nSeed = nSeed * 1103515245 + 12345;
+				Pixels32[i] = (nSeed >> 8) | 0xFF000000;
+			}
+			memcpy(Work, Pixels32, nNumPixels * sizeof(uint32));
+			CBasicProcessing::Convert32bppTo24bppDIB(maxSize.cx, maxSize.cy, Pixels24, Pixels32, false);
+			memset(Pixels8, 0x5A, Helpers::DoPadding(maxSize.cx, 4) * maxSize.cy);
+			Gray16 = CBasicProcessing::Create1Channel16bppGrayscaleImage(maxSize.cx, maxSize.cy, Pixels32, 4);
+		}
+		for (int i = 0; i < 256; i++) {
+			LUT[i] = LUT[i + 256] = LUT[i + 512] = (uint8)(255 - i);
+			Palette[i * 4] = Palette[i * 4 + 1] = Palette[i * 4 + 2] = (uint8)i;
+			Palette[i * 4 + 3] = 0;
+		}
+		for (int i = 0; i < LDC_MAP_SIZE * LDC_MAP_SIZE; i++) {
+			LDCMap[i] = (uint8)(64 + (i * 7) % 128);
+		}
+	}
+
+	~CBenchmarkImages() {
+		delete[] Pixels32;
+		delete[] Pixels24;
+		delete[] Pixels8;
+		delete[] Work;
+		delete[] Target;
+		delete[] Gray16;
+		delete[] SatLUTs;
+	}
+
+	bool IsValid() const {
+		return Pixels32 != NULL && Pixels24 != NULL && Pixels8 != NULL && Work != NULL && Target != NULL &&
+			Gray16 != NULL && SatLUTs != NULL;
+	}
+
+	uint32* Pixels32; // 32 bpp BGRA
+	uint8* Pixels24; // 24 bpp BGR DIB, rows padded to 4 bytes
+	uint8* Pixels8; // 8 bpp DIB, rows padded to 4 bytes
+	int16* Gray16; // 16 bpp grayscale
+	uint32* Work; // 32 bpp BGRA, modified by the inplace methods
+	uint32* Target; // 32 bpp, target of the methods not allocating their target image
+	int32* SatLUTs;
+	uint8 LUT[3 * 256];
+	uint8 Palette[4 * 256];
+	uint8 LDCMap[LDC_MAP_SIZE * LDC_MAP_SIZE];
+};
+
+// Processes the images of the given size once with the given tier, returns false on failure
+typedef bool (*BenchmarkFunction)(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier);
+
+struct CBenchmarkEntry {
+	const char* Name;
+	BenchmarkFunction Function;
+	bool UsesThreadPool; // measured with different numbers of threads
+};
+
+static bool Done(void* pResult) {
+	delete[] (uint8*)pResult;
+	return pResult != NULL;
+}
+
+static CBasicProcessing::SIMDArchitecture ToSIMDArchitecture(Helpers::CPUType eTier) {
+	return (eTier == Helpers::CPU_AVX2) ? CBasicProcessing::AVX2 : CBasicProcessing::SSE;
+}
+
+static bool Convert8bppTo32bppDIB(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::Convert8bppTo32bppDIB(size.cx, size.cy, images.Pixels8, images.Palette));
+}
+
+static bool Convert32bppTo24bppDIB(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	CBasicProcessing::Convert32bppTo24bppDIB(size.cx, size.cy, images.Target, images.Pixels32, false);
+	return true;
+}
+
+static bool Convert1To4Channels(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::Convert1To4Channels(size.cx, size.cy, images.Pixels8));
+}
+
+static bool Convert16bppGrayTo32bppDIB(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::Convert16bppGrayTo32bppDIB(size.cx, size.cy, images.Gray16));
+}
+
+static bool Convert3To4Channels(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::Convert3To4Channels(size.cx, size.cy, images.Pixels24));
+}
+
+static bool ConvertGdiplus32bppRGB(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::ConvertGdiplus32bppRGB(size.cx, size.cy, size.cx * 4, images.Pixels32));
+}
+
+static bool CopyRect32bpp(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	CSize rectSize(size.cx / 2, size.cy / 2);
+	CRect sourceRect(CPoint(size.cx / 4, size.cy / 4), rectSize);
+	return Done(CBasicProcessing::CopyRect32bpp(NULL, images.Pixels32, rectSize, CRect(CPoint(0, 0), rectSize), size, sourceRect));
+}
+
+static bool Rotate32bpp90(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::Rotate32bpp(size.cx, size.cy, images.Pixels32, 90));
+}
+
+static bool Rotate32bpp180(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::Rotate32bpp(size.cx, size.cy, images.Pixels32, 180));
+}
+
+static bool AlphaBlendRotate32bpp(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	// a new image is returned for 90 degrees
+	return Done(CBasicProcessing::AlphaBlendRotate32bpp(size.cx, size.cy, images.Work, RGB(0, 0, 0), 90));
+}
+
+static bool MirrorH32bpp(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::Mirror32bpp(size.cx, size.cy, images.Pixels32, true));
+}
+
+static bool MirrorV32bpp(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::Mirror32bpp(size.cx, size.cy, images.Pixels32, false));
+}
+
+static bool Crop32bpp(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::Crop32bpp(size.cx, size.cy, images.Pixels32, CRect(size.cx / 4, size.cy / 4, size.cx * 3 / 4, size.cy * 3 / 4)));
+}
+
+static bool Rotate32bppInplace90(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return CBasicProcessing::Rotate32bppInplace(size.cx, size.cy, images.Work, 90);
+}
+
+static bool Rotate32bppInplace180(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return CBasicProcessing::Rotate32bppInplace(size.cx, size.cy, images.Work, 180);
+}
+
+static bool Mirror32bppInplace(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	CBasicProcessing::Mirror32bppInplace(size.cx, size.cy, images.Work, true);
+	return true;
+}
+
+static bool MirrorVInplace(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	CBasicProcessing::MirrorVInplace(size.cx, size.cy, size.cx * 4, images.Work);
+	return true;
+}
+
+static bool PackRowsInplace(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	// view starting at the second pixel of the first row, one pixel narrower than the image
+	CBasicProcessing::PackRowsInplace(size.cx - 1, size.cy, 4, size.cx * 4, 4, images.Work);
+	return true;
+}
+
+static bool Create1Channel16bppGrayscaleImage(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::Create1Channel16bppGrayscaleImage(size.cx, size.cy, images.Pixels32, 4));
+}
+
+static bool Apply3ChannelLUT32bpp(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::Apply3ChannelLUT32bpp(size.cx, size.cy, images.Pixels32, images.LUT));
+}
+
+static bool ApplySaturationAnd3ChannelLUT32bpp(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::ApplySaturationAnd3ChannelLUT32bpp(size.cx, size.cy, images.Pixels32, images.SatLUTs, images.LUT));
+}
+
+static bool DimRectangle32bpp(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	CBasicProcessing::DimRectangle32bpp(size.cx, size.cy, images.Work, CRect(CPoint(0, 0), size), 0.5f);
+	return true;
+}
+
+static bool FillRectangle32bpp(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	CBasicProcessing::FillRectangle32bpp(size.cx, size.cy, images.Work, CRect(CPoint(0, 0), size), RGB(128, 128, 128));
+	return true;
+}
+
+static bool ApplyLDC32bpp(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::ApplyLDC32bpp(size, CPoint(0, 0), size, CSize(LDC_MAP_SIZE, LDC_MAP_SIZE), images.Pixels32,
+		NULL, images.LUT, images.LDCMap, 0.05f, 0.95f, 0.5f));
+}
+
+static bool ApplyLDC32bppSaturation(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::ApplyLDC32bpp(size, CPoint(0, 0), size, CSize(LDC_MAP_SIZE, LDC_MAP_SIZE), images.Pixels32,
+		images.SatLUTs, images.LUT, images.LDCMap, 0.05f, 0.95f, 0.5f));
+}
+
+static bool PointSample(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	CSize targetSize(size.cx / 2, size.cy / 2);
+	return Done(CBasicProcessing::PointSample(targetSize, CPoint(0, 0), targetSize, size, images.Pixels32, size.cx * 4, 4));
+}
+
+static bool PointSampleWithRotation(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::PointSampleWithRotation(size, CPoint(0, 0), size, size, 0.3, images.Pixels32, size.cx * 4, 4, 0));
+}
+
+static bool PointSampleTrapezoid(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	CTrapezoid trapezoid(0, size.cx, 0, size.cx / 8, size.cx - size.cx / 8, size.cy);
+	return Done(CBasicProcessing::PointSampleTrapezoid(size, trapezoid, CPoint(0, 0), size, size, images.Pixels32, size.cx * 4, 4, 0));
+}
+
+static bool SampleDown_HQ(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	// to half the size of the image
+	CSize targetSize(size.cx / 2, size.cy / 2);
+	if (eTier >= Helpers::CPU_SSE) {
+		return Done(CBasicProcessing::SampleDown_HQ_SIMD(targetSize, CPoint(0, 0), targetSize, size, images.Pixels32, size.cx * 4, 4,
+			0.3, Filter_Downsampling_Best_Quality, ToSIMDArchitecture(eTier)));
+	}
+	return Done(CBasicProcessing::SampleDown_HQ(targetSize, CPoint(0, 0), targetSize, size, images.Pixels32, size.cx * 4, 4,
+		0.3, Filter_Downsampling_Best_Quality));
+}
+
+static bool SampleUp_HQ(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	// from half the size of the image to the size of the image
+	CSize sourceSize(size.cx / 2, size.cy / 2);
+	if (eTier >= Helpers::CPU_SSE) {
+		return Done(CBasicProcessing::SampleUp_HQ_SIMD(size, CPoint(0, 0), size, sourceSize, images.Pixels32, sourceSize.cx * 4, 4,
+			ToSIMDArchitecture(eTier)));
+	}
+	return Done(CBasicProcessing::SampleUp_HQ(size, CPoint(0, 0), size, sourceSize, images.Pixels32, sourceSize.cx * 4, 4));
+}
+
+static bool RotateHQ(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return Done(CBasicProcessing::RotateHQ(CPoint(0, 0), size, 0.3, size, images.Pixels32, size.cx * 4, 4, 0, eTier >= Helpers::CPU_SSE));
+}
+
+static bool TrapezoidHQ(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	CTrapezoid trapezoid(0, size.cx, 0, size.cx / 8, size.cx - size.cx / 8, size.cy - 1);
+	return Done(CBasicProcessing::TrapezoidHQ(CPoint(0, 0), size, trapezoid, size, images.Pixels32, size.cx * 4, 4, 0, eTier >= Helpers::CPU_SSE));
+}
+
+static bool GaussFilter16bpp1Channel(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	int16* pFiltered = CBasicProcessing::GaussFilter16bpp1Channel(size, CPoint(0, 0), size, 2.0, images.Gray16);
+	delete[] pFiltered;
+	return pFiltered != NULL;
+}
+
+static bool UnsharpMask(const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier) {
+	return NULL != CBasicProcessing::UnsharpMask(size, CPoint(0, 0), size, 1.0, 4.0, images.Gray16, images.Gray16,
+		images.Pixels32, images.Target, 4);
+}
+
+static const CBenchmarkEntry BENCHMARKS[] = {
+	{ "Convert8bppTo32bppDIB", Convert8bppTo32bppDIB, false },
+	{ "Convert32bppTo24bppDIB", Convert32bppTo24bppDIB, false },
+	{ "Convert1To4Channels", Convert1To4Channels, false },
+	{ "Convert16bppGrayTo32bppDIB", Convert16bppGrayTo32bppDIB, false },
+	{ "Convert3To4Channels", Convert3To4Channels, false },
+	{ "ConvertGdiplus32bppRGB", ConvertGdiplus32bppRGB, false },
+	{ "CopyRect32bpp", CopyRect32bpp, false },
+	{ "Rotate32bpp_90", Rotate32bpp90, false },
+	{ "Rotate32bpp_180", Rotate32bpp180, false },
+	{ "AlphaBlendRotate32bpp_90", AlphaBlendRotate32bpp, false },
+	{ "Mirror32bpp_H", MirrorH32bpp, false },
+	{ "Mirror32bpp_V", MirrorV32bpp, false },
+	{ "Crop32bpp", Crop32bpp, false },
+	{ "Rotate32bppInplace_90", Rotate32bppInplace90, false },
+	{ "Rotate32bppInplace_180", Rotate32bppInplace180, false },
+	{ "Mirror32bppInplace_H", Mirror32bppInplace, false },
+	{ "MirrorVInplace", MirrorVInplace, false },
+	{ "PackRowsInplace", PackRowsInplace, false },
+	{ "Create1Channel16bppGrayscaleImage", Create1Channel16bppGrayscaleImage, false },
+	{ "Apply3ChannelLUT32bpp", Apply3ChannelLUT32bpp, false },
+	{ "ApplySaturationAnd3ChannelLUT32bpp", ApplySaturationAnd3ChannelLUT32bpp, false },
+	{ "DimRectangle32bpp", DimRectangle32bpp, false },
+	{ "FillRectangle32bpp", FillRectangle32bpp, false },
+	{ "ApplyLDC32bpp", ApplyLDC32bpp, true },
+	{ "ApplyLDC32bpp_Saturation", ApplyLDC32bppSaturation, true },
+	{ "PointSample", PointSample, true },
+	{ "PointSampleWithRotation", PointSampleWithRotation, true },
+	{ "PointSampleTrapezoid", PointSampleTrapezoid, true },
+	{ "SampleDown_HQ", SampleDown_HQ, true },
+	{ "SampleUp_HQ", SampleUp_HQ, true },
+	{ "RotateHQ", RotateHQ, true },
+	{ "TrapezoidHQ", TrapezoidHQ, true },
+	{ "GaussFilter16bpp1Channel", GaussFilter16bpp1Channel, true },
+	{ "UnsharpMask", UnsharpMask, true }
+};
+static const int NUM_BENCHMARKS = sizeof(BENCHMARKS) / sizeof(CBenchmarkEntry);
+
+// Uses at most nThreads threads for all kinds of requests, in parallel also for small images
+static void SetNumberOfThreads(int nThreads) {
+	CProcessingTuning tunings[Kernel_NumKernels];
+	for (int i = 0; i < Kernel_NumKernels; i++) {
+		tunings[i].MaxThreads = nThreads;
+		if (nThreads > 1) {
+			tunings[i].MinPixelsForParallel = 0;
+		}
+	}
+	CProcessingThreadPool::This().SetTunings(tunings);
+}
+
+// Measures one benchmark, writes the minimal and the median time in milliseconds. Returns false on failure.
+static bool Measure(const CBenchmarkEntry& benchmark, const CBenchmarkImages& images, CSize size, Helpers::CPUType eTier,
+	double& dMinTime, double& dMedianTime) {
+	// warm up, e.g. fills the resize filter cache
+	if (!benchmark.Function(images, size, eTier)) {
+		return false;
+	}
+	double dTimes[NUM_RUNS];
+	for (int i = 0; i < NUM_RUNS; i++) {
+		double dStartTime = Helpers::GetExactTickCount();
+		if (!benchmark.Function(images, size, eTier)) {
+			return false;
+		}
+		dTimes[i] = Helpers::GetExactTickCount() - dStartTime;
+	}
+	std::sort(dTimes, dTimes + NUM_RUNS);
+	dMinTime = dTimes[0];
+	dMedianTime = dTimes[NUM_RUNS / 2];
+	return true;
+}
+
+static CStringA EscapeJSON(const CStringA& sText) {
+	CStringA sEscaped(sText);
+	sEscaped.Replace("\\", "\\\\");
+	sEscaped.Replace("\"", "\\\"");
+	return sEscaped;
+}
+
+static bool WriteTextFile(LPCTSTR sFileName, const CStringA& sContent) {
+	FILE* fptr;
+	if ((fptr = _tfopen(sFileName, _T("wb"))) == NULL) {
+		return false;
+	}
+	bool bSuccess = fwrite((LPCSTR)sContent, 1, sContent.GetLength(), fptr) == (size_t)sContent.GetLength();
+	return (fclose(fptr) == 0) && bSuccess;
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// Public
+///////////////////////////////////////////////////////////////////////////////////
+
+bool CProcessingBenchmark::Run(LPCTSTR sOutputFile) {
+	CSize maxSize = IMAGE_SIZES[NUM_IMAGE_SIZES - 1];
+	CBenchmarkImages images(maxSize);
+	if (!images.IsValid()) {
+		return false;
+	}
+
+	CProcessingThreadPool& threadPool = CProcessingThreadPool::This();
+	CSettingsProvider& settings = CSettingsProvider::This();
+	Helpers::CPUType eOriginalCPUType = settings.AlgorithmImplementation();
+	CProcessingTuning originalTunings[Kernel_NumKernels];
+	for (int i = 0; i < Kernel_NumKernels; i++) {
+		originalTunings[i] = threadPool.GetTuning((EProcessingKernel)i);
+	}
+	int nNumThreads = threadPool.NumberOfThreads();
+
+	CStringA sResults;
+	for (int nTier = 0; nTier < NUM_TIERS; nTier++) {
+		// tiers not supported by the CPU or the build are skipped
+		CPixelKernels::SelectTier(TIERS[nTier]);
+		if (CPixelKernels::SelectedTier() != TIERS[nTier]) {
+			continue;
+		}
+		settings.SetAlgorithmImplementationOverride(TIERS[nTier]);
+		for (int nSize = 0; nSize < NUM_IMAGE_SIZES; nSize++) {
+			CSize size = IMAGE_SIZES[nSize];
+			for (int nBenchmark = 0; nBenchmark < NUM_BENCHMARKS; nBenchmark++) {
+				const CBenchmarkEntry& benchmark = BENCHMARKS[nBenchmark];
+				// 1, 2, 4, ... threads and all threads of the pool
+				int nThreads = 1;
+				while (true) {
+					SetNumberOfThreads(nThreads);
+					double dMinTime, dMedianTime;
+					if (Measure(benchmark, images, size, TIERS[nTier], dMinTime, dMedianTime)) {
+						if (!sResults.IsEmpty()) {
+							sResults += ",\n";
+						}
+						sResults.AppendFormat("    { \"method\": \"%s\", \"tier\": \"%s\", \"width\": %d, \"height\": %d, \"threads\": %d, "
+							"\"min_ms\": %.3f, \"median_ms\": %.3f, \"mpixels_per_s\": %.1f }",
+							benchmark.Name, TIER_NAMES[nTier], size.cx, size.cy, nThreads, dMinTime, dMedianTime,
+							size.cx * size.cy / (max(dMedianTime, 0.001) * 1000.0));
+					}
+					if (!benchmark.UsesThreadPool || nThreads >= nNumThreads) {
+						break;
+					}
+					nThreads = min(nThreads * 2, nNumThreads);
+				}
+			}
+		}
+	}
+
+	settings.SetAlgorithmImplementationOverride(eOriginalCPUType);
+	CPixelKernels::SelectTier(eOriginalCPUType);
+	threadPool.SetTunings(originalTunings);
+
+	CStringA sJSON;
+	sJSON.Format("{\n  \"version\": %d,\n  \"cpu\": \"%s\",\n  \"platform\": \"%s\",\n  \"threads_available\": %d,\n  \"runs\": %d,\n"
+		"  \"results\": [\n%s\n  ]\n}\n",
+		BENCHMARK_VERSION, (LPCSTR)EscapeJSON(CStringA(Helpers::CPUName())), PLATFORM, nNumThreads, NUM_RUNS, (LPCSTR)sResults);
+	return WriteTextFile(sOutputFile, sJSON);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// Headless benchmark of the image processing methods of CBasicProcessing, started with the /benchmark command line
+// parameter. No window is created. Synthetic images of several sizes are processed with all instruction set tiers the CPU
+// supports (generic C++, SSE, AVX2) and, for the methods processed on the thread pool, with different numbers of threads.
+// The results are written to a JSON file, allowing to compare the performance of different versions.
+class CProcessingBenchmark
+{
+public:
+	// Runs the benchmark and writes the results to the file sOutputFile. Must be called after the thread pool threads
+	// have been created, no other processing must be done at the same time. The tier and the tuning of the thread pool
+	// are changed while running and restored afterwards.
+	// Returns false if the benchmark images cannot be allocated or the output file cannot be written.
+	static bool Run(LPCTSTR sOutputFile);
+};
@@ -0,0 +1,357 @@
+#include "StdAfx.h"
+#include "ProcessingCalibration.h"
+#include "ProcessingThreadPool.h"
+#include "ScratchArena.h"
+#include "BasicProcessing.h"
+#include "SettingsProvider.h"
+#include "Helpers.h"
+#include <float.h>
+#include <math.h>
+#include <process.h>
+
+static const TCHAR TUNING_FILE_NAME[] = _T("ProcessingTuning.ini");
+
+// Increment when the benchmarks change, this invalidates all stored calibrations
+static const int CALIBRATION_VERSION = 2;
+
+// Names of the calibrated kinds of requests in the INI file, Kernel_Other is not calibrated
+static const LPCTSTR KERNEL_NAMES[Kernel_Other] = {
+	_T("UpDownSampling"), _T("LDC"), _T("Gauss"), _T("UnsharpMask"), _T("Rotate"), _T("Trapezoid")
+};
+
+// Size of the images used for the benchmarks. Each measurement is repeated NUM_RUNS times, the fastest run counts.
+// Runs disturbed by other work on the thread pool are repeated, at most MAX_ATTEMPTS runs are done per measurement.
+static const int BENCHMARK_WIDTH = 1024;
+static const int BENCHMARK_HEIGHT = 576;
+static const int NUM_RUNS = 3;
+static const int MAX_ATTEMPTS = 30;
+static const int BUSY_WAIT_TIME = 50; // ms waited before the next attempt when the pool is busy
+static const int LDC_MAP_SIZE = 32;
+
+// Candidates for the number of source pixels per strip and for the minimal number of target pixels for parallel processing
+static const int STRIP_SIZES[] = { 1024 * 25, 1024 * 50, 1024 * 200, 1024 * 400, 1024 * 800 };
+static const int PARALLEL_THRESHOLDS[] = { 25000, 50000, 100000, 200000, 400000 };
+
+// A candidate must be faster than the best one found so far by this factor to replace it. Prevents using more threads
+// or deviating from the default strip size because of measurement noise.
+static const double MIN_GAIN = 0.95;
+
+///////////////////////////////////////////////////////////////////////////////////
+// Supporting classes
+///////////////////////////////////////////////////////////////////////////////////
+
+// Synthetic input images and the micro benchmarks of the different kinds of requests
+class CBenchmark {
+public:
+	// The measurements end as soon as bAbort is set
+	CBenchmark(const volatile bool& bAbort) : m_bAbort(bAbort) {
+		// the source image has twice the benchmark size, for measuring downsampling
+		m_sourceSize = CSize(BENCHMARK_WIDTH * 2, BENCHMARK_HEIGHT * 2);
+		m_pSourcePixels = new(std::nothrow) uint32[m_sourceSize.cx * m_sourceSize.cy];
+		m_pTargetPixels = new(std::nothrow) uint32[BENCHMARK_WIDTH * BENCHMARK_HEIGHT];
+		m_pGrayImage = NULL;
+		if (m_pSourcePixels != NULL) {
+			uint32 nSeed = 4711;
+			for (int i = 0; i < m_sourceSize.cx * m_sourceSize.cy; i++) {
+				nSeed = nSeed * 1103515245 + 12345;
+				m_pSourcePixels[i] = (nSeed >> 8) | 0xFF000000;
+			}
+			m_pGrayImage = CBasicProcessing::Create1Channel16bppGrayscaleImage(BENCHMARK_WIDTH, BENCHMARK_HEIGHT, m_pSourcePixels, 4);
+		}
+		for (int i = 0; i < 256; i++) {
+			m_LUT[i] = m_LUT[i + 256] = m_LUT[i + 512] = (uint8)i;
+		}
+		memset(m_LDCMap, 128, sizeof(m_LDCMap));
+		m_eCPU = CSettingsProvider::This().AlgorithmImplementation();
+	}
+
+	~CBenchmark() {
+		delete[] m_pSourcePixels;
+		delete[] m_pTargetPixels;
+		delete[] m_pGrayImage;
+	}
+
+	bool IsValid() const { return m_pSourcePixels != NULL && m_pTargetPixels != NULL && m_pGrayImage != NULL; }
+
+	// Processes an image of the given size once, targetSize must not be larger than the benchmark size
+	bool Run(EProcessingKernel eKernel, CSize targetSize) {
+		bool bUseSSE = m_eCPU == Helpers::CPU_SSE || m_eCPU == Helpers::CPU_AVX2;
+		CPoint offset(0, 0);
+		void* pResult = NULL;
+		switch (eKernel) {
+			case Kernel_UpDownSampling: {
+				CSize sourceSize(targetSize.cx * 2, targetSize.cy * 2);
+				if (m_eCPU == Helpers::CPU_MMX || m_eCPU == Helpers::CPU_SSE || m_eCPU == Helpers::CPU_AVX2) {
+					CBasicProcessing::SIMDArchitecture simd = (m_eCPU == Helpers::CPU_AVX2) ? CBasicProcessing::AVX2 :
+						(m_eCPU == Helpers::CPU_SSE) ? CBasicProcessing::SSE : CBasicProcessing::MMX;
+					pResult = CBasicProcessing::SampleDown_HQ_SIMD(targetSize, offset, targetSize, sourceSize, m_pSourcePixels, sourceSize.cx * 4, 4,
+						0.3, Filter_Downsampling_Best_Quality, simd);
+				} else {
+					pResult = CBasicProcessing::SampleDown_HQ(targetSize, offset, targetSize, sourceSize, m_pSourcePixels, sourceSize.cx * 4, 4,
+						0.3, Filter_Downsampling_Best_Quality);
+				}
+				break;
+			}
+			case Kernel_LDC:
+				pResult = CBasicProcessing::ApplyLDC32bpp(targetSize, offset, targetSize, CSize(LDC_MAP_SIZE, LDC_MAP_SIZE), m_pSourcePixels,
+					NULL, m_LUT, m_LDCMap, 0.0f, 1.0f, 0.5f);
+				break;
+			case Kernel_Gauss: {
+				int16* pFiltered = CBasicProcessing::GaussFilter16bpp1Channel(targetSize, offset, targetSize, 2.0, m_pGrayImage);
+				delete[] pFiltered;
+				return pFiltered != NULL;
+			}
+			case Kernel_UnsharpMask:
+				// target pixels are provided by the caller, nothing to delete
+				return NULL != CBasicProcessing::UnsharpMask(targetSize, offset, targetSize, 1.0, 4.0, m_pGrayImage, m_pGrayImage,
+					m_pSourcePixels, m_pTargetPixels, 4);
+			case Kernel_Rotate:
+				pResult = CBasicProcessing::RotateHQ(offset, targetSize, 0.3, targetSize, m_pSourcePixels, targetSize.cx * 4, 4, 0, bUseSSE);
+				break;
+			case Kernel_Trapezoid: {
+				CTrapezoid trapezoid(0, targetSize.cx, 0, targetSize.cx / 8, targetSize.cx - targetSize.cx / 8, targetSize.cy - 1);
+				pResult = CBasicProcessing::TrapezoidHQ(offset, targetSize, trapezoid, targetSize, m_pSourcePixels, targetSize.cx * 4, 4, 0, bUseSSE);
+				break;
+			}
+			default:
+				return false;
+		}
+		delete[] (uint8*)pResult;
+		return pResult != NULL;
+	}
+
+	// Time in milliseconds for processing an image of the given size with the given tuning parameters.
+	// The tuning is only used by the calling thread, other threads processing meanwhile are not affected. Runs overlapping
+	// other requests on the thread pool are discarded, these requests compete for the threads and distort the time.
+	// Returns DBL_MAX if aborted, if the processing fails or if the pool has been too busy for NUM_RUNS undisturbed runs.
+	double Measure(EProcessingKernel eKernel, CSize targetSize, const CProcessingTuning& tuning) {
+		CProcessingThreadPool& threadPool = CProcessingThreadPool::This();
+		CProcessingThreadPool::SetThreadTuning(&tuning);
+		double dBestTime = DBL_MAX;
+		int nValidRuns = 0;
+		for (int nAttempt = 0; nAttempt < MAX_ATTEMPTS && nValidRuns < NUM_RUNS; nAttempt++) {
+			if (m_bAbort) {
+				break;
+			}
+			// counter read first, requests starting after the check of the active requests change it
+			LONG nActivityCounter = threadPool.ActivityCounter();
+			if (threadPool.NumberOfActiveRequests() > 0) {
+				::Sleep(BUSY_WAIT_TIME);
+				continue;
+			}
+			double dStartTime = Helpers::GetExactTickCount();
+			if (!Run(eKernel, targetSize)) {
+				break;
+			}
+			double dTime = Helpers::GetExactTickCount() - dStartTime;
+			if (threadPool.ActivityCounter() == nActivityCounter) {
+				dBestTime = min(dBestTime, dTime);
+				nValidRuns++;
+			}
+		}
+		CProcessingThreadPool::SetThreadTuning(NULL);
+		return (nValidRuns == NUM_RUNS) ? dBestTime : DBL_MAX;
+	}
+
+private:
+	const volatile bool& m_bAbort;
+	CSize m_sourceSize;
+	uint32* m_pSourcePixels;
+	uint32* m_pTargetPixels;
+	int16* m_pGrayImage;
+	uint8 m_LUT[3 * 256];
+	uint8 m_LDCMap[LDC_MAP_SIZE * LDC_MAP_SIZE];
+	Helpers::CPUType m_eCPU;
+};
+
+// Image size with 16:9 aspect ratio and approximately the given number of pixels
+static CSize SizeWithPixels(int nPixels) {
+	int nWidth = (int)sqrt(nPixels * 16.0 / 9.0);
+	return CSize(nWidth, nPixels / nWidth);
+}
+
+// Finds the best tuning parameters for one kind of request, one parameter after the other.
+// Returns false if a measurement failed or has been aborted, the tuning is undefined then.
+static bool CalibrateKernel(CBenchmark& benchmark, EProcessingKernel eKernel, CProcessingTuning& tuning) {
+	CSize benchmarkSize(BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+	tuning = CProcessingTuning();
+	tuning.MinPixelsForParallel = 0;
+	tuning.MaxThreads = 1;
+	// warm up, e.g. fills the resize filter cache
+	if (benchmark.Measure(eKernel, benchmarkSize, tuning) == DBL_MAX) {
+		return false;
+	}
+
+	// Number of threads, candidates are the powers of two and the number of threads of the pool
+	int nNumThreads = CProcessingThreadPool::This().NumberOfThreads();
+	double dBestTime = benchmark.Measure(eKernel, benchmarkSize, tuning);
+	if (dBestTime == DBL_MAX) {
+		return false;
+	}
+	int nBestThreads = 1;
+	int nThreads = 1;
+	while (nThreads < nNumThreads) {
+		nThreads = min(nThreads * 2, nNumThreads);
+		tuning.MaxThreads = nThreads;
+		double dTime = benchmark.Measure(eKernel, benchmarkSize, tuning);
+		if (dTime == DBL_MAX) {
+			return false;
+		}
+		if (dTime < dBestTime * MIN_GAIN) {
+			dBestTime = dTime;
+			nBestThreads = nThreads;
+		}
+	}
+	tuning.MaxThreads = nBestThreads;
+
+	// Strip size, dBestTime has been measured with the default strip size
+	int nBestStripSize = tuning.MaxSourcePixelsPerStrip;
+	int nNumStripSizes = sizeof(STRIP_SIZES) / sizeof(int);
+	for (int i = 0; i < nNumStripSizes; i++) {
+		tuning.MaxSourcePixelsPerStrip = STRIP_SIZES[i];
+		double dTime = benchmark.Measure(eKernel, benchmarkSize, tuning);
+		if (dTime == DBL_MAX) {
+			return false;
+		}
+		if (dTime < dBestTime * MIN_GAIN) {
+			dBestTime = dTime;
+			nBestStripSize = STRIP_SIZES[i];
+		}
+	}
+	tuning.MaxSourcePixelsPerStrip = nBestStripSize;
+
+	// Smallest image size where parallel processing is faster than processing on one thread
+	tuning.MinPixelsForParallel = CProcessingTuning().MinPixelsForParallel;
+	if (nBestThreads > 1) {
+		int nNumThresholds = sizeof(PARALLEL_THRESHOLDS) / sizeof(int);
+		tuning.MinPixelsForParallel = PARALLEL_THRESHOLDS[nNumThresholds - 1];
+		for (int i = 0; i < nNumThresholds; i++) {
+			CSize size = SizeWithPixels(PARALLEL_THRESHOLDS[i]);
+			CProcessingTuning singleThreaded(tuning.MaxSourcePixelsPerStrip, 0, 1);
+			CProcessingTuning parallel(tuning.MaxSourcePixelsPerStrip, 0, nBestThreads);
+			double dTimeSingleThreaded = benchmark.Measure(eKernel, size, singleThreaded);
+			double dTimeParallel = benchmark.Measure(eKernel, size, parallel);
+			if (dTimeSingleThreaded == DBL_MAX || dTimeParallel == DBL_MAX) {
+				return false;
+			}
+			if (dTimeParallel < dTimeSingleThreaded * MIN_GAIN) {
+				tuning.MinPixelsForParallel = PARALLEL_THRESHOLDS[i];
+				break;
+			}
+		}
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// Public
+///////////////////////////////////////////////////////////////////////////////////
+
+HANDLE CProcessingCalibration::sm_hCalibrationThread = NULL;
+volatile bool CProcessingCalibration::sm_bAbortCalibration = false;
+
+bool CProcessingCalibration::Initialize(bool bForceCalibration) {
+	if (!bForceCalibration && Load(GetCPUKey())) {
+		return false;
+	}
+	return bForceCalibration || CSettingsProvider::This().AutoCalibrateProcessing();
+}
+
+void CProcessingCalibration::StartCalibration() {
+	if (sm_hCalibrationThread != NULL) {
+		return;
+	}
+	sm_bAbortCalibration = false;
+	sm_hCalibrationThread = (HANDLE)_beginthreadex(NULL, 0, CalibrationThreadFunc, NULL, 0, NULL);
+}
+
+void CProcessingCalibration::StopCalibration() {
+	if (sm_hCalibrationThread != NULL) {
+		// the measurements check the flag before each run, thus the thread ends after at most one benchmark run
+		sm_bAbortCalibration = true;
+		::WaitForSingleObject(sm_hCalibrationThread, INFINITE);
+		::CloseHandle(sm_hCalibrationThread);
+		sm_hCalibrationThread = NULL;
+	}
+}
+
+bool CProcessingCalibration::Calibrate() {
+	CBenchmark benchmark(sm_bAbortCalibration);
+	if (!benchmark.IsValid()) {
+		return false;
+	}
+	// the tuning of the pool is replaced at the end, the processing meanwhile uses the previous tuning
+	CProcessingTuning tunings[Kernel_NumKernels];
+	for (int i = 0; i < Kernel_Other; i++) {
+		if (!CalibrateKernel(benchmark, (EProcessingKernel)i, tunings[i])) {
+			return false;
+		}
+	}
+	tunings[Kernel_Other] = CProcessingThreadPool::This().GetTuning(Kernel_Other);
+	CProcessingThreadPool::This().SetTunings(tunings);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// Private
+///////////////////////////////////////////////////////////////////////////////////
+
+unsigned __stdcall CProcessingCalibration::CalibrationThreadFunc(void* arg) {
+	if (Calibrate()) {
+		Save(GetCPUKey());
+	}
+	CScratchArena::FreeThisThread();
+	return 0;
+}
+
+CString CProcessingCalibration::GetCPUKey() {
+	static const LPCTSTR CPU_TYPE_NAMES[] = { _T("Unknown"), _T("Generic"), _T("MMX"), _T("SSE"), _T("AVX2") };
+
+	SYSTEM_INFO systemInfo;
+	::GetSystemInfo(&systemInfo);
+	int nCPUType = CSettingsProvider::This().AlgorithmImplementation();
+	CString sKey;
+	sKey.Format(_T("%s, %d logical processors, %d threads, %s"), (LPCTSTR)Helpers::CPUName(), systemInfo.dwNumberOfProcessors,
+		CProcessingThreadPool::This().NumberOfThreads(), CPU_TYPE_NAMES[max(0, min(nCPUType, Helpers::CPU_AVX2))]);
+	return sKey;
+}
+
+CString CProcessingCalibration::GetFileName() {
+	return CString(Helpers::JPEGViewAppDataPath()) + TUNING_FILE_NAME;
+}
+
+bool CProcessingCalibration::Load(LPCTSTR sCPUKey) {
+	CString sFileName = GetFileName();
+	if (::GetPrivateProfileInt(sCPUKey, _T("Version"), 0, sFileName) != CALIBRATION_VERSION) {
+		return false;
+	}
+	CProcessingTuning tunings[Kernel_NumKernels];
+	for (int i = 0; i < Kernel_Other; i++) {
+		TCHAR sValue[64];
+		::GetPrivateProfileString(sCPUKey, KERNEL_NAMES[i], _T(""), sValue, 64, sFileName);
+		if (_stscanf_s(sValue, _T("%d %d %d"), &tunings[i].MaxSourcePixelsPerStrip, &tunings[i].MinPixelsForParallel, &tunings[i].MaxThreads) != 3) {
+			return false;
+		}
+	}
+	tunings[Kernel_Other] = CProcessingThreadPool::This().GetTuning(Kernel_Other);
+	CProcessingThreadPool::This().SetTunings(tunings);
+	return true;
+}
+
+void CProcessingCalibration::Save(LPCTSTR sCPUKey) {
+	if (::GetFileAttributes(Helpers::JPEGViewAppDataPath()) == INVALID_FILE_ATTRIBUTES) {
+		::CreateDirectory(Helpers::JPEGViewAppDataPath(), NULL);
+	}
+	CString sFileName = GetFileName();
+	for (int i = 0; i < Kernel_Other; i++) {
+		CProcessingTuning tuning = CProcessingThreadPool::This().GetTuning((EProcessingKernel)i);
+		CString sValue;
+		sValue.Format(_T("%d %d %d"), tuning.MaxSourcePixelsPerStrip, tuning.MinPixelsForParallel, tuning.MaxThreads);
+		::WritePrivateProfileString(sCPUKey, KERNEL_NAMES[i], sValue, sFileName);
+	}
+	// written last, an incompletely written calibration is not used
+	CString sVersion;
+	sVersion.Format(_T("%d"), CALIBRATION_VERSION);
+	::WritePrivateProfileString(sCPUKey, _T("Version"), sVersion, sFileName);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// Calibrates how the processing thread pool splits the image processing requests into strips and threads.
+// For each kind of request (see EProcessingKernel) the strip size, the number of threads and the image size
+// above which processing is done in parallel are measured with micro benchmarks on synthetic images.
+// The results are stored per CPU in ProcessingTuning.ini in the JPEGView application data folder.
+class CProcessingCalibration
+{
+public:
+	// Loads the calibration for the current CPU and passes it to the thread pool. Returns true if the calibration still
+	// needs to be done with StartCalibration(), this is the case when there is no stored calibration for this CPU and
+	// calibration is enabled in the INI file, or when bForceCalibration is true.
+	// Must be called after the thread pool threads have been created, before any other processing is done.
+	static bool Initialize(bool bForceCalibration);
+
+	// Calibrates on a background thread and stores the calibration. The thread pool uses the default tuning until the
+	// calibration has finished, processing can be done meanwhile.
+	static void StartCalibration();
+
+	// Aborts the calibration started with StartCalibration() and waits until its thread has ended, this takes at most
+	// one benchmark run
+	static void StopCalibration();
+
+	// Runs the micro benchmarks for all kinds of requests and passes the found parameters to the thread pool.
+	// Takes about one or two seconds. Returns false if the benchmark images cannot be allocated, if aborted or if the thread
+	// pool has been too busy with other requests for reliable measurements. Nothing is stored then, thus the calibration
+	// is repeated on the next start.
+	static bool Calibrate();
+
+private:
+	static HANDLE sm_hCalibrationThread;
+	static volatile bool sm_bAbortCalibration;
+
+	static unsigned __stdcall CalibrationThreadFunc(void* arg);
+	// Key identifying the CPU and the settings the calibration depends on, used as section name in the INI file
+	static CString GetCPUKey();
+	static CString GetFileName();
+	static bool Load(LPCTSTR sCPUKey);
+	static void Save(LPCTSTR sCPUKey);
+};
@@ -1,9 +1,19 @@
 #include "StdAfx.h"
 #include "ProcessingThreadPool.h"
 #include "SettingsProvider.h"
+#include "ScratchArena.h"
+#include "Tracing.h"
 
 CProcessingThreadPool* CProcessingThreadPool::sm_instance;
 
+// Tuning parameters overriding the ones of the pool for the requests of the calling thread, see SetThreadTuning()
+static __declspec(thread) const CProcessingTuning* s_pThreadTuning = NULL;
+
+// Names of the trace events of the strips, by EProcessingKernel
+static const char* STRIP_TRACE_NAMES[Kernel_NumKernels] = {
+	"Strip UpDownSampling", "Strip LDC", "Strip Gauss", "Strip UnsharpMask", "Strip Rotate", "Strip Trapezoid", "Strip Other"
+};
+
 ///////////////////////////////////////////////////////////////////////////////////
 // Supporting classes
 ///////////////////////////////////////////////////////////////////////////////////
@@ -12,15 +22,17 @@ CProcessingThreadPool* CProcessingThreadPool::sm_instance;
 class CWrappedRequest : public CRequestBase {
 public:
 	// nOffset, nSize defines the strip to process: 'nSize' rows, starting at row 'nOffset'
-	CWrappedRequest(CProcessingRequest * pRequest, int nOffset, int nSize, HANDLE hEventFinished) : CRequestBase(hEventFinished) {
+	CWrappedRequest(CProcessingRequest * pRequest, int nOffset, int nSize, uint32 nMaxSourcePixelsPerStrip, HANDLE hEventFinished) : CRequestBase(hEventFinished) {
 		InnerRequest = pRequest;
 		Offset = nOffset;
 		SizeY = nSize;
+		MaxSourcePixelsPerStrip = nMaxSourcePixelsPerStrip;
 	}
 
 	CProcessingRequest* InnerRequest;
 	int Offset;
 	int SizeY;
+	uint32 MaxSourcePixelsPerStrip;
 };
 
 
@@ -34,7 +46,7 @@ public:
 	void StartProcess(CWrappedRequest* pRequest);
 
 	// Processes a request synchronously on the calling thread
-	static void DoProcess(CProcessingRequest* pRequest, int nOffsetY, int nSizeY);
+	static void DoProcess(CProcessingRequest* pRequest, int nOffsetY, int nSizeY, uint32 nMaxSourcePixelsPerStrip);
 private:
 
 	virtual void ProcessRequest(CRequestBase& request);
@@ -70,19 +82,50 @@ void CProcessingThreadPool::StopAllThreads() {
 	}
 	m_nNumThreads = 0;
 	m_threads = NULL;
+	for (unsigned int i = 0; i < m_replacedTunings.size(); i++) {
+		delete[] m_replacedTunings[i];
+	}
+	m_replacedTunings.clear();
+}
+
+void CProcessingThreadPool::SetTunings(const CProcessingTuning* pTunings) {
+	// the table is completely filled before it is published, a request reads either the old or the new table
+	CProcessingTuning* pNewTunings = new CProcessingTuning[Kernel_NumKernels];
+	for (int i = 0; i < Kernel_NumKernels; i++) {
+		pNewTunings[i].MaxSourcePixelsPerStrip = max(1024, pTunings[i].MaxSourcePixelsPerStrip);
+		pNewTunings[i].MinPixelsForParallel = max(0, pTunings[i].MinPixelsForParallel);
+		pNewTunings[i].MaxThreads = max(0, pTunings[i].MaxThreads);
+	}
+	CProcessingTuning* pOldTunings = (CProcessingTuning*)::InterlockedExchangePointer((PVOID volatile*)&m_pTunings, pNewTunings);
+	m_replacedTunings.push_back(pOldTunings);
+}
+
+void CProcessingThreadPool::SetThreadTuning(const CProcessingTuning* pTuning) {
+	s_pThreadTuning = pTuning;
 }
 
 bool CProcessingThreadPool::Process(CProcessingRequest* pRequest) {
 	int nTargetCX = pRequest->ClippedTargetSize.cx;
 	int nTargetCY = pRequest->ClippedTargetSize.cy;
-	if (m_nNumThreads == 0) {
-		CProcessingThread::DoProcess(pRequest, 0, nTargetCY);
+	bool bPoolTuning = (s_pThreadTuning == NULL);
+	// copied, the table may be replaced while the request is processed
+	const CProcessingTuning tuning = bPoolTuning ? m_pTunings[pRequest->Kernel] : *s_pThreadTuning;
+	if (bPoolTuning) {
+		::InterlockedIncrement(&m_nActiveRequests);
+		::InterlockedIncrement(&m_nActivityCounter);
+	}
+	int nMaxThreads = m_nNumThreads + 1; // we also use the calling thread, thus +1
+	if (tuning.MaxThreads > 0) {
+		nMaxThreads = min(nMaxThreads, tuning.MaxThreads);
+	}
+	if (nMaxThreads <= 1) {
+		CProcessingThread::DoProcess(pRequest, 0, nTargetCY, tuning.MaxSourcePixelsPerStrip);
 	} else {
-		if (nTargetCX * nTargetCY < 100000 || nTargetCY <= 12) {
-			CProcessingThread::DoProcess(pRequest, 0, nTargetCY);
+		if (nTargetCX * nTargetCY < tuning.MinPixelsForParallel || nTargetCY <= 12) {
+			CProcessingThread::DoProcess(pRequest, 0, nTargetCY, tuning.MaxSourcePixelsPerStrip);
 		} else {
 			// Important: All slices must have a height dividable by 'StripPadding', except the last one
-			int nNumThreadsUsed = m_nNumThreads + 1; // we also use the calling thread, thus +1
+			int nNumThreadsUsed = nMaxThreads;
 			int nSliceCY;
 			while ((nSliceCY = ~(pRequest->StripPadding - 1) & (nTargetCY / nNumThreadsUsed)) < pRequest->StripPadding) {
 				nNumThreadsUsed--;
@@ -93,12 +136,12 @@ bool CProcessingThreadPool::Process(CProcessingRequest* pRequest) {
 			HANDLE eventFinished = ::CreateEvent(0, TRUE, FALSE, NULL);
 			CWrappedRequest** pAllWrappedRequests = new CWrappedRequest*[nNumThreadsUsed-1];
 			for (int i = 0; i < nNumThreadsUsed-1; i++) {
-				pAllWrappedRequests[i] = new CWrappedRequest(pRequest, nCurrCY, nSliceCY, eventFinished);
+				pAllWrappedRequests[i] = new CWrappedRequest(pRequest, nCurrCY, nSliceCY, tuning.MaxSourcePixelsPerStrip, eventFinished);
 				pAllWrappedRequests[i]->EventFinishedCounter = &nRequestThreadCounter;
 				m_threads[i]->StartProcess(pAllWrappedRequests[i]);
 				nCurrCY += nSliceCY;
 			}
-			CProcessingThread::DoProcess(pRequest, nCurrCY, nLastCY);
+			CProcessingThread::DoProcess(pRequest, nCurrCY, nLastCY, tuning.MaxSourcePixelsPerStrip);
 			::WaitForSingleObject(eventFinished, INFINITE);
 			::CloseHandle(eventFinished);
 			for (int i = 0; i < nNumThreadsUsed-1; i++) {
@@ -107,12 +150,19 @@ bool CProcessingThreadPool::Process(CProcessingRequest* pRequest) {
 			delete [] pAllWrappedRequests;
 		}
 	}
+	if (bPoolTuning) {
+		::InterlockedIncrement(&m_nActivityCounter);
+		::InterlockedDecrement(&m_nActiveRequests);
+	}
 	return pRequest->Success;
 }
 
 CProcessingThreadPool::CProcessingThreadPool(void) {
 	m_threads = NULL;
 	m_nNumThreads = 0;
+	m_pTunings = new CProcessingTuning[Kernel_NumKernels];
+	m_nActivityCounter = 0;
+	m_nActiveRequests = 0;
 }
 
 
@@ -120,13 +170,12 @@ void CProcessingThread::StartProcess(CWrappedRequest* pRequest) {
 	ProcessAsync(pRequest);
 }
 
-void CProcessingThread::DoProcess(CProcessingRequest* pRequest, int nOffsetY, int nSizeY) {
+void CProcessingThread::DoProcess(CProcessingRequest* pRequest, int nOffsetY, int nSizeY, uint32 nMaxSourcePixelsPerStrip) {
 	// Processing is done in strips to reduce memory consumption and increase cache hit rate.
-	// The following constant gives the number of pixels to process per strip.
-	const uint32 MAX_SRC_PIXELS_PER_STRIP = 1024 * 100;
+	// nMaxSourcePixelsPerStrip gives the number of pixels to process per strip.
 	uint32 nNumberOfPixelsInSource = (uint32)((pRequest->SourceSize.cx * (double)pRequest->ClippedTargetSize.cx / pRequest->FullTargetSize.cx) *
 		(pRequest->SourceSize.cy * (double)nSizeY / pRequest->FullTargetSize.cy));
-	uint32 nStrips = 1 + nNumberOfPixelsInSource / MAX_SRC_PIXELS_PER_STRIP;
+	uint32 nStrips = 1 + nNumberOfPixelsInSource / nMaxSourcePixelsPerStrip;
 	uint32 nStripHeight = nSizeY / nStrips;
 	uint32 minimalStripHeight = min(16, pRequest->StripPadding);
 
@@ -138,6 +187,8 @@ void CProcessingThread::DoProcess(CProcessingRequest* pRequest, int nOffsetY, in
 	int nCurrentSizeY = nStripHeight;
 	while (nSizeProcessed < nSizeY) {
 		int nCurrentOffsetY = nOffsetY + nSizeProcessed;
+		CScratchArena::CStripScope scratchArenaScope; // temporary images of the strip are freed at end of scope
+		CTraceScope traceScope(STRIP_TRACE_NAMES[pRequest->Kernel], "y", nCurrentOffsetY);
 		if (!pRequest->ProcessStrip(nCurrentOffsetY, nCurrentSizeY)) {
 			pRequest->Success = false;
 			break;
@@ -149,6 +200,6 @@ void CProcessingThread::DoProcess(CProcessingRequest* pRequest, int nOffsetY, in
 
 void CProcessingThread::ProcessRequest(CRequestBase& request) {
 	CWrappedRequest* pWrappedRequest = (CWrappedRequest*)&request;
-	DoProcess(pWrappedRequest->InnerRequest, pWrappedRequest->Offset, pWrappedRequest->SizeY);
+	DoProcess(pWrappedRequest->InnerRequest, pWrappedRequest->Offset, pWrappedRequest->SizeY, pWrappedRequest->MaxSourcePixelsPerStrip);
 }
 
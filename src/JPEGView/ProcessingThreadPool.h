@@ -1,9 +1,40 @@
 #pragma once
 
 #include "WorkThread.h"
+#include <vector>
 
 class CProcessingThread;
 
+// Kinds of processing requests, the thread pool uses separately tuned strip sizes and parallelism for each kind
+enum EProcessingKernel {
+	Kernel_UpDownSampling,
+	Kernel_LDC,
+	Kernel_Gauss,
+	Kernel_UnsharpMask,
+	Kernel_Rotate,
+	Kernel_Trapezoid,
+	Kernel_Other,
+	Kernel_NumKernels
+};
+
+// Parameters controlling how a processing request is split into strips and distributed to the threads
+struct CProcessingTuning {
+	CProcessingTuning() {
+		MaxSourcePixelsPerStrip = 1024 * 100;
+		MinPixelsForParallel = 100000;
+		MaxThreads = 0;
+	}
+	CProcessingTuning(int nMaxSourcePixelsPerStrip, int nMinPixelsForParallel, int nMaxThreads) {
+		MaxSourcePixelsPerStrip = nMaxSourcePixelsPerStrip;
+		MinPixelsForParallel = nMinPixelsForParallel;
+		MaxThreads = nMaxThreads;
+	}
+
+	int MaxSourcePixelsPerStrip; // Number of source pixels processed per strip, for good cache usage
+	int MinPixelsForParallel; // Target images with less pixels are processed on the calling thread only
+	int MaxThreads; // Maximal number of threads used, including the calling thread. 0 to use all threads of the pool.
+};
+
 // Request for performing an image processing operation parallel on all thread pool threads
 class CProcessingRequest : public CRequestBase {
 public:
@@ -16,6 +47,7 @@ public:
 		FullTargetOffset = fullTargetOffset;
 		ClippedTargetSize = clippedTargetSize;
 		StripPadding = 8;
+		Kernel = Kernel_Other;
 		Success = true;
 	}
 
@@ -31,6 +63,7 @@ public:
 	CPoint FullTargetOffset;
 	CSize ClippedTargetSize;
 	int StripPadding; // Height of strip is padded to multiple of this
+	EProcessingKernel Kernel; // Selects the tuning parameters used for this request
 
 	// Processing thread can signal failure by setting this flag to false. Must not be set to true by processing threads!
 	bool Success;
@@ -52,11 +85,38 @@ public:
 	// The processing work is distributed to the thread pool threads. The pRequest->ProcessStrip()
 	// method is called to process a strip of the image.
 	bool Process(CProcessingRequest* pRequest);
+
+	// Number of threads available for processing, including the calling thread. This is the upper bound for
+	// the number of threads given in the tuning parameters.
+	int NumberOfThreads() const { return m_nNumThreads + 1; }
+
+	// Tuning parameters for the given kind of request, either the defaults or the calibrated values
+	CProcessingTuning GetTuning(EProcessingKernel eKernel) const { return m_pTunings[eKernel]; }
+
+	// Replaces the tuning parameters of all kinds of requests at once, indexed by EProcessingKernel. Requests being
+	// processed meanwhile use either the old or the new parameters, never a mix. Calls must not overlap each other.
+	void SetTunings(const CProcessingTuning* pTunings);
+
+	// Number of requests processed with the tuning of the pool that have been started or finished so far, and number of
+	// those currently in progress. Requests processed with a thread tuning (see SetThreadTuning()) are not counted.
+	// Allows measurements to detect that other work has been done on the pool meanwhile.
+	LONG ActivityCounter() const { return m_nActivityCounter; }
+	LONG NumberOfActiveRequests() const { return m_nActiveRequests; }
+
+	// Overrides the tuning parameters of all kinds of requests processed by the calling thread, NULL to use the tuning
+	// of the pool again. Allows measuring tuning candidates while other threads keep using the pool.
+	static void SetThreadTuning(const CProcessingTuning* pTuning);
 private:
 	static CProcessingThreadPool* sm_instance;
 
 	CProcessingThread** m_threads;
 	int m_nNumThreads;
+	// Current tuning table, replaced as a whole by SetTunings(). Replaced tables are freed in StopAllThreads() only,
+	// requests started before the replacement may still read them.
+	CProcessingTuning* volatile m_pTunings;
+	std::vector<CProcessingTuning*> m_replacedTunings;
+	volatile LONG m_nActivityCounter;
+	volatile LONG m_nActiveRequests;
 
 	CProcessingThreadPool(void);
 };
@@ -6,6 +6,7 @@
 #include "qoi/qoi.h"
 #include "MaxImageDef.h"
 #include "Helpers.h"
+#include "PixelMemory.h"
 
 #define LINEAR_TO_SRGB(rgb) ((rgb) > 0 ? ((rgb) < 255 ? (255.0 * (1.055 * pow((rgb)/255.0, 1.0/2.4) - 0.055)) : 255) : 0)
 
@@ -90,6 +91,51 @@ void* QoiReaderWriter::Compress(const void* source,
 	return pOutput;
 }
 
+void* QoiReaderWriter::CompressPixels(const void* pixels, int width, int height, int stride, int nchannels, int& len) {
+	qoi_desc desc;
+	desc.width = width;
+	desc.height = height;
+	desc.channels = nchannels;
+	desc.colorspace = QOI_SRGB;
+	int packed_stride = width * nchannels;
+	if (stride == packed_stride) {
+		return qoi_encode(pixels, &desc, &len);
+	}
+	// QOI needs packed rows
+	unsigned char* pPackedPixels = new(std::nothrow) unsigned char[(size_t)packed_stride * height];
+	if (pPackedPixels == NULL) {
+		return NULL;
+	}
+	for (int y = 0; y < height; y++) {
+		memcpy(pPackedPixels + (size_t)y * packed_stride, (const unsigned char*)pixels + (size_t)y * stride, packed_stride);
+	}
+	void* pOutput = qoi_encode(pPackedPixels, &desc, &len);
+	delete[] pPackedPixels;
+	return pOutput;
+}
+
+void* QoiReaderWriter::DecompressPixels(const void* buffer, int sizebytes, int width, int height, int nchannels) {
+	qoi_desc desc = { 0 };
+	unsigned char* pDecodedPixels = (unsigned char*)qoi_decode(buffer, sizebytes, &desc, nchannels);
+	if (pDecodedPixels == NULL) {
+		return NULL;
+	}
+	if (desc.width != width || desc.height != height) {
+		QOI_FREE(pDecodedPixels);
+		return NULL;
+	}
+	int decoded_stride = width * nchannels;
+	int padded_stride = Helpers::DoPadding(decoded_stride, 4);
+	unsigned char* pPixelData = (unsigned char*)CPixelMemory::Allocate((size_t)padded_stride * height);
+	if (pPixelData != NULL) {
+		for (int y = 0; y < height; y++) {
+			memcpy(pPixelData + (size_t)y * padded_stride, pDecodedPixels + (size_t)y * decoded_stride, decoded_stride);
+		}
+	}
+	QOI_FREE(pDecodedPixels);
+	return pPixelData;
+}
+
 void QoiReaderWriter::FreeMemory(void* pointer) {
 	QOI_FREE(pointer);
 }
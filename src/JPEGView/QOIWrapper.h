@@ -17,5 +17,13 @@ public:
 		int height, // height of image in pixels.
 		int& len); // returns length of compressed data
 
+	// Compresses 3-byte BGR or 4-byte BGRA pixels with rows of stride bytes losslessly, the channel order is kept.
+	// Returns NULL if out of memory, free the compressed data with FreeMemory().
+	static void* CompressPixels(const void* pixels, int width, int height, int stride, int nchannels, int& len);
+
+	// Decompresses pixels compressed with CompressPixels() into a buffer allocated with CPixelMemory::Allocate(),
+	// rows are padded to 4-byte boundary. Returns NULL if out of memory or if the data does not match the size.
+	static void* DecompressPixels(const void* buffer, int sizebytes, int width, int height, int nchannels);
+
 	static void FreeMemory(void* pointer);
 };
@@ -1,6 +1,7 @@
 #include "StdAfx.h"
 #include "ResizeFilter.h"
 #include "Helpers.h"
+#include "WorkThread.h"
 #include <math.h>
 #include <stdlib.h>
 
@@ -194,6 +195,7 @@ CResizeFilter::CResizeFilter(int nSourceSize, int nTargetSize, double dSharpen,
 	m_dSharpen = min(0.5, max(0.0, dSharpen));
 	m_eFilter = eFilter;
 	m_filterSIMDType = filterSIMDType;
+	m_nHashKey = GetHashKey(nSourceSize, nTargetSize, dSharpen, eFilter, filterSIMDType);
 
 	if (filterSIMDType == FilterSIMDType_AVX) {
 		CalculateAVXFilterKernels();
@@ -214,6 +216,7 @@ CResizeFilter::~CResizeFilter(void) {
 }
 
 bool CResizeFilter::ParametersMatch(int nSourceSize, int nTargetSize, double dSharpen, EFilterType eFilter, FilterSIMDType filterSIMDType) {
+	dSharpen = min(0.5, max(0.0, dSharpen));
 	if (nSourceSize == m_nSourceSize && nTargetSize == m_nTargetSize && abs(dSharpen - m_dSharpen) < 1e-6 &&
 		eFilter == m_eFilter && m_filterSIMDType == filterSIMDType) {
 			return true;
@@ -222,6 +225,17 @@ bool CResizeFilter::ParametersMatch(int nSourceSize, int nTargetSize, double dSh
 	}
 }
 
+uint32 CResizeFilter::GetHashKey(int nSourceSize, int nTargetSize, double dSharpen, EFilterType eFilter, FilterSIMDType filterSIMDType) {
+	// the sharpen amount is compared with a tolerance of 1e-6, rounding to this precision gives the same key for matching filters
+	uint32 nSharpen = (uint32)(min(0.5, max(0.0, dSharpen)) * 1000000 + 0.5);
+	uint32 nValues[5] = { (uint32)nSourceSize, (uint32)nTargetSize, nSharpen, (uint32)eFilter, (uint32)filterSIMDType };
+	uint32 nHash = 2166136261; // FNV-1a
+	for (int i = 0; i < 5; i++) {
+		nHash = (nHash ^ nValues[i]) * 16777619;
+	}
+	return nHash ^ (nHash >> 16);
+}
+
 void CResizeFilter::GetBicubicFilterKernels(int nNumKernels, int16* pKernels) {
 	uint32 nIncFrac = 65535/(nNumKernels - 1);
 	uint32 nKFrac = 0;
@@ -474,6 +488,49 @@ int16* CResizeFilter::GetFilter(uint16 nFrac, EFilterType eFilter) {
 	return m_Filter;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////
+// CFilterPrecomputeThread
+//////////////////////////////////////////////////////////////////////////////////////
+
+// Thread calculating filters in the background and putting them into the filter cache
+class CFilterPrecomputeThread : public CWorkThread {
+public:
+	CFilterPrecomputeThread() : CWorkThread(false) {}
+
+	void AsyncPrecompute(int nSourceSize, int nTargetSize, double dSharpen, EFilterType eFilter, FilterSIMDType filterSIMDType) {
+		ProcessAsync(new CRequest(nSourceSize, nTargetSize, dSharpen, eFilter, filterSIMDType));
+	}
+
+protected:
+	virtual void ProcessRequest(CRequestBase& request) {
+		CRequest& rq = (CRequest&)request;
+		CResizeFilterCache& cache = CResizeFilterCache::This();
+		cache.ReleaseFilter(cache.GetFilter(rq.SourceSize, rq.TargetSize, rq.Sharpen, rq.Filter, rq.SIMDType));
+	}
+
+	virtual void AfterFinishProcess(CRequestBase& request) {
+		// nobody waits for the request
+		request.Deleted = true;
+	}
+
+private:
+	class CRequest : public CRequestBase {
+	public:
+		CRequest(int nSourceSize, int nTargetSize, double dSharpen, EFilterType eFilter, FilterSIMDType filterSIMDType) {
+			SourceSize = nSourceSize;
+			TargetSize = nTargetSize;
+			Sharpen = dSharpen;
+			Filter = eFilter;
+			SIMDType = filterSIMDType;
+		}
+
+		int SourceSize, TargetSize;
+		double Sharpen;
+		EFilterType Filter;
+		FilterSIMDType SIMDType;
+	};
+};
+
 //////////////////////////////////////////////////////////////////////////////////////
 // CResizeFilterCache
 //////////////////////////////////////////////////////////////////////////////////////
@@ -488,68 +545,108 @@ CResizeFilterCache& CResizeFilterCache::This() {
 	return *sm_instance;
 }
 
-CResizeFilterCache::CResizeFilterCache()
-	: m_csList{ 0 }
-{
-	::InitializeCriticalSection(&m_csList);
+CResizeFilterCache::CResizeFilterCache() {
+	for (int i = 0; i < NUM_SHARDS; i++) {
+		::InitializeCriticalSection(&m_shards[i].csList);
+	}
+	m_pPrecomputeThread = NULL;
 }
 
 CResizeFilterCache::~CResizeFilterCache() {
-	::DeleteCriticalSection(&m_csList);
-	std::list<CResizeFilter*>::iterator iter;
-	for (iter = m_filterList.begin( ); iter != m_filterList.end( ); iter++ ) {
-		delete (*iter);
+	delete m_pPrecomputeThread; // terminates the thread
+	for (int i = 0; i < NUM_SHARDS; i++) {
+		::DeleteCriticalSection(&m_shards[i].csList);
+		std::list<CResizeFilter*>::iterator iter;
+		for (iter = m_shards[i].filterList.begin( ); iter != m_shards[i].filterList.end( ); iter++ ) {
+			delete (*iter);
+		}
 	}
 }
 
 const CResizeFilter& CResizeFilterCache::GetFilter(int nSourceSize, int nTargetSize, double dSharpen, EFilterType eFilter, FilterSIMDType filterSIMDType) {
-	CResizeFilter* pMatchingFilter = NULL;
-
-	Helpers::CAutoCriticalSection autoCriticalSection(m_csList);
-	std::list<CResizeFilter*>::iterator iter;
-	for (iter = m_filterList.begin( ); iter != m_filterList.end( ); iter++ ) {
-		if ((*iter)->ParametersMatch(nSourceSize, nTargetSize, dSharpen, eFilter, filterSIMDType)) {
-			pMatchingFilter = *iter;
-			break;
+	uint32 nHashKey = CResizeFilter::GetHashKey(nSourceSize, nTargetSize, dSharpen, eFilter, filterSIMDType);
+	CShard& shard = m_shards[nHashKey % NUM_SHARDS];
+
+	{
+		Helpers::CAutoCriticalSection autoCriticalSection(shard.csList);
+		CResizeFilter* pMatchingFilter = FindFilter(shard, nHashKey, nSourceSize, nTargetSize, dSharpen, eFilter, filterSIMDType);
+		if (pMatchingFilter != NULL) {
+			// found matching filter, return it
+			pMatchingFilter->m_nRefCnt++;
+			return *pMatchingFilter;
 		}
 	}
 
+	// no matching filter found, create a new one. The kernels are calculated without holding the lock, if another
+	// thread created the same filter in the meantime, its filter is used.
+	CResizeFilter* pNewFilter = new CResizeFilter(nSourceSize, nTargetSize, dSharpen, eFilter, filterSIMDType);
+
+	Helpers::CAutoCriticalSection autoCriticalSection(shard.csList);
+	CResizeFilter* pMatchingFilter = FindFilter(shard, nHashKey, nSourceSize, nTargetSize, dSharpen, eFilter, filterSIMDType);
 	if (pMatchingFilter != NULL) {
-		// found matching filter, return it
-		pMatchingFilter->m_nRefCnt++;
-		m_filterList.remove(pMatchingFilter);
-		m_filterList.push_front(pMatchingFilter); // move to top in list
-		return *pMatchingFilter;
+		delete pNewFilter;
+	} else {
+		shard.filterList.push_front(pNewFilter);
+		pMatchingFilter = pNewFilter;
 	}
+	pMatchingFilter->m_nRefCnt++;
 
-	// no matching filter found, create a new one
-	CResizeFilter* pNewFilter = new CResizeFilter(nSourceSize, nTargetSize, dSharpen, eFilter, filterSIMDType);
-	pNewFilter->m_nRefCnt++;
-	m_filterList.push_front(pNewFilter);
-
-	return *pNewFilter;
+	return *pMatchingFilter;
 }
 
 void CResizeFilterCache::ReleaseFilter(const CResizeFilter& filter) {
-	
-	const int MAX_SIZE = 4;
+	CShard& shard = m_shards[filter.m_nHashKey % NUM_SHARDS];
 
-	Helpers::CAutoCriticalSection autoCriticalSection(m_csList);
+	Helpers::CAutoCriticalSection autoCriticalSection(shard.csList);
 	const_cast<CResizeFilter&>(filter).m_nRefCnt--;
-	if (m_filterList.size() > MAX_SIZE) {
-		// cache too large - try to free one entry
-		CResizeFilter* pElementTBRemoved = NULL;
+	TrimShard(shard);
+}
+
+void CResizeFilterCache::PrecomputeFilter(int nSourceSize, int nTargetSize, double dSharpen, EFilterType eFilter, FilterSIMDType filterSIMDType) {
+	if (nSourceSize <= 0 || nTargetSize <= 0) {
+		return;
+	}
+	uint32 nHashKey = CResizeFilter::GetHashKey(nSourceSize, nTargetSize, dSharpen, eFilter, filterSIMDType);
+	CShard& shard = m_shards[nHashKey % NUM_SHARDS];
+	{
+		Helpers::CAutoCriticalSection autoCriticalSection(shard.csList);
+		if (FindFilter(shard, nHashKey, nSourceSize, nTargetSize, dSharpen, eFilter, filterSIMDType) != NULL) {
+			return;
+		}
+	}
+	if (m_pPrecomputeThread == NULL) {
+		m_pPrecomputeThread = new CFilterPrecomputeThread();
+	}
+	m_pPrecomputeThread->AsyncPrecompute(nSourceSize, nTargetSize, dSharpen, eFilter, filterSIMDType);
+}
+
+CResizeFilter* CResizeFilterCache::FindFilter(CShard& shard, uint32 nHashKey, int nSourceSize, int nTargetSize, double dSharpen, EFilterType eFilter, FilterSIMDType filterSIMDType) {
+	std::list<CResizeFilter*>::iterator iter;
+	for (iter = shard.filterList.begin( ); iter != shard.filterList.end( ); iter++ ) {
+		if ((*iter)->m_nHashKey == nHashKey && (*iter)->ParametersMatch(nSourceSize, nTargetSize, dSharpen, eFilter, filterSIMDType)) {
+			CResizeFilter* pMatchingFilter = *iter;
+			shard.filterList.splice(shard.filterList.begin(), shard.filterList, iter); // move to top in list
+			return pMatchingFilter;
+		}
+	}
+	return NULL;
+}
+
+void CResizeFilterCache::TrimShard(CShard& shard) {
+	while (shard.filterList.size() > MAX_FILTERS_PER_SHARD) {
+		// cache too large - try to free the least recently used entry that is not in use
 		std::list<CResizeFilter*>::reverse_iterator iter;
-		for (iter = m_filterList.rbegin( ); iter != m_filterList.rend( ); iter++ ) {
+		for (iter = shard.filterList.rbegin( ); iter != shard.filterList.rend( ); iter++ ) {
 			if ((*iter)->m_nRefCnt <= 0) {
-				pElementTBRemoved = *iter;
 				break;
 			}
 		}
-		if (pElementTBRemoved != NULL) {
-			m_filterList.remove(pElementTBRemoved);
-			delete pElementTBRemoved;
+		if (iter == shard.filterList.rend()) {
+			return;
 		}
+		CResizeFilter* pElementTBRemoved = *iter;
+		shard.filterList.remove(pElementTBRemoved);
+		delete pElementTBRemoved;
 	}
 }
 
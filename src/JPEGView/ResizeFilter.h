@@ -101,6 +101,9 @@ public:
 	// E.g. when requesting 33 kernels, the kernel for fractional position 0.5 is starting at pKernels[4 * 16]
 	static void GetBicubicFilterKernels(int nNumKernels, int16* pKernels);
 
+	// Hash key of the filter parameters, filters with equal parameters have the same key
+	static uint32 GetHashKey(int nSourceSize, int nTargetSize, double dSharpen, EFilterType eFilter, FilterSIMDType filterSIMDType);
+
 private:
 	friend class CResizeFilterCache;
 
@@ -115,6 +118,7 @@ private:
 	XMMFilterKernelBlock m_kernelsXMM;
 	AVXFilterKernelBlock m_kernelsAVX;
 	FilterSIMDType m_filterSIMDType;
+	uint32 m_nHashKey;
 	int m_nRefCnt;
 
 	void CalculateFilterKernels();
@@ -128,7 +132,12 @@ private:
 	int16* GetFilter(uint16 nFrac, EFilterType eFilter);
 };
 
-// Caches the last used resize filters (LRU cache)
+class CFilterPrecomputeThread;
+
+// Caches the last used resize filters (LRU cache).
+// The cache is split into shards selected by the hash key of the filter parameters, each shard having its own lock.
+// Thus the strips processed in parallel rarely contend and the kernels of a missing filter are calculated without
+// blocking the other threads.
 class CResizeFilterCache
 {
 public:
@@ -140,14 +149,32 @@ public:
 	// Release filter
 	void ReleaseFilter(const CResizeFilter& filter);
 
+	// Calculates the filter in the background if it is not in the cache, a later GetFilter() call finds it in the cache.
+	// Must only be called from the main thread.
+	void PrecomputeFilter(int nSourceSize, int nTargetSize, double dSharpen, EFilterType eFilter, FilterSIMDType filterSIMDType);
+
 private:
+	enum {
+		NUM_SHARDS = 8,
+		MAX_FILTERS_PER_SHARD = 3
+	};
+
+	struct CShard {
+		CRITICAL_SECTION csList; // access to list must be thread safe
+		std::list<CResizeFilter*> filterList;
+	};
+
 	static CResizeFilterCache* sm_instance;
 
-	CRITICAL_SECTION m_csList; // access to list must be thread safe
-	std::list<CResizeFilter*> m_filterList;
+	CShard m_shards[NUM_SHARDS];
+	CFilterPrecomputeThread* m_pPrecomputeThread;
 
 	CResizeFilterCache();
 	~CResizeFilterCache();
+	// Finds the filter and moves it to the top of the list, shard must be locked
+	static CResizeFilter* FindFilter(CShard& shard, uint32 nHashKey, int nSourceSize, int nTargetSize, double dSharpen, EFilterType eFilter, FilterSIMDType filterSIMDType);
+	// Frees unused filters if the shard is too large, shard must be locked
+	static void TrimShard(CShard& shard);
 	static void Delete() { delete sm_instance; }
 };
 
@@ -0,0 +1,189 @@
+#include "StdAfx.h"
+#include "ScratchArena.h"
+
+// Block sizes are multiples of the allocation granularity of VirtualAlloc()
+static const size_t BLOCK_GRANULARITY = 64 * 1024;
+
+static __declspec(thread) CScratchArena* s_pThreadArena = NULL;
+static __declspec(thread) CScratchArena* s_pActiveArena = NULL;
+
+static size_t AlignUp(size_t nValue, size_t nAlignment) {
+	return (nValue + nAlignment - 1) & ~(nAlignment - 1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Public
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+CScratchArena* CScratchArena::Active() {
+	return s_pActiveArena;
+}
+
+CScratchArena* CScratchArena::Owner(const void* pMemory) {
+	return (s_pThreadArena != NULL && s_pThreadArena->Contains(pMemory)) ? s_pThreadArena : NULL;
+}
+
+void* CScratchArena::Allocate(size_t nSizeBytes, const void* pNextTo) {
+	size_t nAlignedSize = AlignUp(max(nSizeBytes, (size_t)1), ALIGNMENT);
+	if (m_blocks.empty() || m_blocks.back().Used[BOTTOM] + m_blocks.back().Used[TOP] + nAlignedSize > m_blocks.back().Size) {
+		// grow by at least the size of the blocks allocated so far, the next Reset() merges all blocks
+		size_t nTotalSize = 0;
+		for (std::vector<Block>::const_iterator iter = m_blocks.begin(); iter != m_blocks.end(); iter++) {
+			nTotalSize += iter->Size;
+		}
+		Block newBlock = AllocateBlock(max(nAlignedSize, nTotalSize + m_nUsed));
+		if (newBlock.Memory == NULL) {
+			return NULL;
+		}
+		m_blocks.push_back(newBlock);
+	}
+	Block& block = m_blocks.back();
+
+	int nBlock, nEnd, nIndex;
+	if (pNextTo == NULL || !FindAllocation(pNextTo, nBlock, nEnd, nIndex) || nBlock != (int)m_blocks.size() - 1) {
+		if (block.Allocations[BOTTOM].empty()) {
+			nEnd = BOTTOM;
+		} else if (block.Allocations[TOP].empty()) {
+			nEnd = TOP;
+		} else {
+			nEnd = (block.Used[TOP] < block.Used[BOTTOM]) ? TOP : BOTTOM;
+		}
+	}
+	Allocation allocation;
+	allocation.Memory = (nEnd == BOTTOM) ? block.Memory + block.Used[BOTTOM] : block.Memory + block.Size - block.Used[TOP] - nAlignedSize;
+	allocation.Size = nAlignedSize;
+	allocation.Freed = false;
+	block.Allocations[nEnd].push_back(allocation);
+	block.Used[nEnd] += nAlignedSize;
+	m_nUsed += nAlignedSize;
+	m_nPeakUsed = max(m_nPeakUsed, m_nUsed);
+	return allocation.Memory;
+}
+
+void CScratchArena::Free(void* pMemory) {
+	int nBlock, nEnd, nIndex;
+	if (pMemory == NULL || !FindAllocation(pMemory, nBlock, nEnd, nIndex)) {
+		return;
+	}
+	Block& block = m_blocks[nBlock];
+	std::vector<Allocation>& allocations = block.Allocations[nEnd];
+	allocations[nIndex].Freed = true;
+	// give back the freed allocations on top of the stack of this end
+	while (!allocations.empty() && allocations.back().Freed) {
+		block.Used[nEnd] -= allocations.back().Size;
+		m_nUsed -= allocations.back().Size;
+		allocations.pop_back();
+	}
+}
+
+bool CScratchArena::Contains(const void* pMemory) const {
+	const uint8* p = (const uint8*)pMemory;
+	for (std::vector<Block>::const_iterator iter = m_blocks.begin(); iter != m_blocks.end(); iter++) {
+		if (p >= iter->Memory && p < iter->Memory + iter->Size) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void CScratchArena::FreeThisThread() {
+	delete s_pThreadArena;
+	s_pThreadArena = NULL;
+}
+
+CScratchArena::CStripScope::CStripScope() {
+	m_pPreviousArena = s_pActiveArena;
+	s_pActiveArena = &CScratchArena::ThisThread();
+}
+
+CScratchArena::CStripScope::~CStripScope() {
+	if (m_pPreviousArena != s_pActiveArena) {
+		// outermost scope, nested scopes (e.g. processing started from a strip) share the arena of the thread
+		s_pActiveArena->Reset();
+	}
+	s_pActiveArena = m_pPreviousArena;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Private
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+CScratchArena::CScratchArena(void) {
+	m_nUsed = 0;
+	m_nPeakUsed = 0;
+}
+
+CScratchArena::~CScratchArena(void) {
+	for (std::vector<Block>::iterator iter = m_blocks.begin(); iter != m_blocks.end(); iter++) {
+		FreeBlock(*iter);
+	}
+	m_blocks.clear();
+}
+
+CScratchArena& CScratchArena::ThisThread() {
+	if (s_pThreadArena == NULL) {
+		s_pThreadArena = new CScratchArena();
+	}
+	return *s_pThreadArena;
+}
+
+void CScratchArena::Reset() {
+	if (m_blocks.size() > 1) {
+		// replace all blocks by one block large enough for the peak usage
+		for (std::vector<Block>::iterator iter = m_blocks.begin(); iter != m_blocks.end(); iter++) {
+			FreeBlock(*iter);
+		}
+		m_blocks.clear();
+		Block block = AllocateBlock(m_nPeakUsed);
+		if (block.Memory != NULL) {
+			m_blocks.push_back(block);
+		}
+	} else if (!m_blocks.empty()) {
+		Block& block = m_blocks.back();
+		for (int nEnd = BOTTOM; nEnd <= TOP; nEnd++) {
+			block.Used[nEnd] = 0;
+			block.Allocations[nEnd].clear();
+		}
+	}
+	m_nUsed = 0;
+	m_nPeakUsed = 0;
+}
+
+bool CScratchArena::FindAllocation(const void* pMemory, int& nBlock, int& nEnd, int& nIndex) const {
+	for (nBlock = 0; nBlock < (int)m_blocks.size(); nBlock++) {
+		const Block& block = m_blocks[nBlock];
+		if ((const uint8*)pMemory < block.Memory || (const uint8*)pMemory >= block.Memory + block.Size) {
+			continue;
+		}
+		for (nEnd = BOTTOM; nEnd <= TOP; nEnd++) {
+			for (nIndex = (int)block.Allocations[nEnd].size() - 1; nIndex >= 0; nIndex--) {
+				const Allocation& allocation = block.Allocations[nEnd][nIndex];
+				if (allocation.Memory == pMemory && !allocation.Freed) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+	return false;
+}
+
+CScratchArena::Block CScratchArena::AllocateBlock(size_t nSizeBytes) {
+	Block block;
+	block.Size = AlignUp(nSizeBytes, BLOCK_GRANULARITY);
+	// Allocate memory aligned on page boundaries
+	block.Memory = (uint8*)::VirtualAlloc(NULL, block.Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (block.Memory == NULL) {
+		block.Size = 0;
+	}
+	block.Used[BOTTOM] = block.Used[TOP] = 0;
+	return block;
+}
+
+void CScratchArena::FreeBlock(Block& block) {
+	if (block.Memory != NULL) {
+		::VirtualFree(block.Memory, 0, MEM_RELEASE);
+	}
+	block.Memory = NULL;
+	block.Size = 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+
+// Per thread arena for the temporary images of the processing strips (see CProcessingThreadPool). Memory is taken
+// from a preallocated block, the whole arena is reset after each strip. The block grows to the largest amount of memory
+// a strip has ever needed, thus in steady state no memory is allocated by the strips.
+// The block is used from both ends like two stacks. The processing creates each intermediate image from the previous one
+// and deletes the previous one afterwards, placing consecutive images on opposite ends lets the memory of an image be
+// reused two images later. The peak memory of a strip is thus the largest sum of two consecutive intermediate images.
+class CScratchArena
+{
+public:
+	enum {
+		ALIGNMENT = 64 // alignment of all allocations in bytes, enough for SSE and AVX
+	};
+
+	// Returns the arena of the calling thread if the thread is processing a strip, NULL otherwise
+	static CScratchArena* Active();
+
+	// Returns the arena of the calling thread if pMemory has been allocated from it, NULL otherwise
+	static CScratchArena* Owner(const void* pMemory);
+
+	// Allocates nSizeBytes bytes of aligned memory, returns NULL when out of memory. The memory is placed on the end
+	// of the arena holding pNextTo, e.g. the pixels of an image next to the image object. If pNextTo is NULL, it is placed
+	// on an empty end or, if there is none, on the end using less memory.
+	void* Allocate(size_t nSizeBytes, const void* pNextTo = NULL);
+
+	// Frees the memory. The memory is given back to its end of the arena as soon as all memory allocated after it on
+	// this end has been freed. Memory not allocated from the arena since the last reset is ignored.
+	void Free(void* pMemory);
+
+	// Returns if the memory has been allocated from this arena
+	bool Contains(const void* pMemory) const;
+
+	// Frees the arena of the calling thread. Must be called before a thread ends that may have processed strips.
+	static void FreeThisThread();
+
+	// Makes the arena of the calling thread active for the lifetime of the object. The outermost scope resets the arena
+	// when destroyed, all memory allocated from the arena must have been freed then.
+	class CStripScope {
+	public:
+		CStripScope();
+		~CStripScope();
+	private:
+		CScratchArena* m_pPreviousArena;
+	};
+
+private:
+	enum {
+		BOTTOM = 0, // end growing upwards from the start of the block
+		TOP = 1 // end growing downwards from the end of the block
+	};
+
+	struct Allocation {
+		uint8* Memory;
+		size_t Size;
+		bool Freed;
+	};
+
+	struct Block {
+		uint8* Memory;
+		size_t Size;
+		size_t Used[2]; // bytes used on the bottom and top end
+		std::vector<Allocation> Allocations[2]; // allocations on the bottom and top end, most recent last
+	};
+
+	std::vector<Block> m_blocks; // the allocations are taken from the last block, the others are freed on Reset()
+	size_t m_nUsed; // bytes used in all blocks
+	size_t m_nPeakUsed; // maximal number of bytes used since the last Reset()
+
+	CScratchArena(void);
+	~CScratchArena(void);
+
+	// Arena of the calling thread, created on first use
+	static CScratchArena& ThisThread();
+
+	void Reset();
+	bool FindAllocation(const void* pMemory, int& nBlock, int& nEnd, int& nIndex) const;
+	static Block AllocateBlock(size_t nSizeBytes);
+	static void FreeBlock(Block& block);
+};
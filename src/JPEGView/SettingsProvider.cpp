@@ -137,10 +137,14 @@ CSettingsProvider::CSettingsProvider(void) {
 	else {
 		m_eCPUAlgorithm = Helpers::ProbeCPU();
 	}
-	m_nNumCores = GetInt(_T("CPUCoresUsed"), 0, 0, 4);
+	m_bAutoCalibrateProcessing = GetBool(_T("AutoCalibrateProcessing"), true);
+	m_bEnableTracing = GetBool(_T("EnableTracing"), false);
+	m_nNumCores = GetInt(_T("CPUCoresUsed"), 0, 0, 16);
 	if (m_nNumCores == 0) {
+		// with calibration the number of cores is only an upper bound, the calibration finds the number of threads really used
+		int nMaxCores = m_bAutoCalibrateProcessing ? 16 : 4;
 		m_nNumCores = Helpers::NumCoresPerPhysicalProc();
-		if (m_nNumCores > 4) m_nNumCores = 4;
+		if (m_nNumCores > nMaxCores) m_nNumCores = nMaxCores;
 	}
 
 	CString sDownSampling = GetString(_T("DownSamplingFilter"), _T("BestQuality"));
@@ -171,6 +175,9 @@ CSettingsProvider::CSettingsProvider(void) {
 	m_nMaxSlideShowFileListSize = GetInt(_T("MaxSlideShowFileListSizeKB"), 200, 100, 10000);
 	m_nSlideShowEffectTimeMs = GetInt(_T("SlideShowEffectTime"), 200, 100, 5000);
 	m_bForceGDIPlus = GetBool(_T("ForceGDIPlus"), false);
+	m_bKeepJPEGAsYCbCr = GetBool(_T("KeepJPEGAsYCbCr"), false);
+	m_nFileCacheSizeMB = GetInt(_T("FileCacheSizeMB"), 64, 0, 1024);
+	m_nCompressedCacheSizeMB = GetInt(_T("CompressedCacheSizeMB"), 256, 0, 4096);
 	m_bSingleInstance = GetBool(_T("SingleInstance"), false);
 	m_bSingleFullScreenInstance = GetBool(_T("SingleFullScreenInstance"), true);
 	m_nJPEGSaveQuality = GetInt(_T("JPEGSaveQuality"), 85, 0, 100);
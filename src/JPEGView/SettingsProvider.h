@@ -48,6 +48,8 @@ public:
 	LPCTSTR Language() { return m_sLanguage; }
 	Helpers::CPUType AlgorithmImplementation() { return m_eCPUAlgorithm; }
 	int NumberOfCoresToUse() { return m_nNumCores; }
+	bool AutoCalibrateProcessing() { return m_bAutoCalibrateProcessing; }
+	bool EnableTracing() { return m_bEnableTracing; }
 	EFilterType DownsamplingFilter() { return m_eDownsamplingFilter; }
 	Helpers::ESorting Sorting() { return m_eSorting; }
 	bool IsSortedAscending() { return m_bIsSortedAscending; }
@@ -58,6 +60,7 @@ public:
 	Helpers::EAutoZoomMode AutoZoomModeFullscreen() { return m_eAutoZoomModeFullscreen; }
 	int DisplayMonitor() { return m_nDisplayMonitor; }
 	void SetMonitorOverride(int nMonitor) { m_nDisplayMonitor = nMonitor; }
+	void SetAlgorithmImplementationOverride(Helpers::CPUType eCPUType) { m_eCPUAlgorithm = eCPUType; }
 	bool AutoContrastCorrection() { return m_bAutoContrastCorrection; }
 	double AutoContrastAmount() { return m_dAutoContrastAmount; }
 	float* ColorCorrectionAmounts(); // can't be declared inline due to compiler bug...sad but true
@@ -72,6 +75,9 @@ public:
 	Helpers::ETransitionEffect SlideShowTransitionEffect() { return m_eSlideShowTransitionEffect; }
 	int SlideShowEffectTimeMs() { return m_nSlideShowEffectTimeMs; }
 	bool ForceGDIPlus() { return m_bForceGDIPlus; }
+	bool KeepJPEGAsYCbCr() { return m_bKeepJPEGAsYCbCr; }
+	int FileCacheSizeMB() { return m_nFileCacheSizeMB; }
+	int CompressedCacheSizeMB() { return m_nCompressedCacheSizeMB; }
 	bool SingleInstance() { return m_bSingleInstance; }
 	bool SingleFullScreenInstance() { return m_bSingleFullScreenInstance; }
 	int JPEGSaveQuality() { return m_nJPEGSaveQuality; }
@@ -222,6 +228,8 @@ private:
 	CString m_sLanguage;
 	Helpers::CPUType m_eCPUAlgorithm;
 	int m_nNumCores;
+	bool m_bAutoCalibrateProcessing;
+	bool m_bEnableTracing;
 	EFilterType m_eDownsamplingFilter;
 	Helpers::ESorting m_eSorting;
 	bool m_bIsSortedAscending;
@@ -245,6 +253,9 @@ private:
 	Helpers::ETransitionEffect m_eSlideShowTransitionEffect;
 	int m_nSlideShowEffectTimeMs;
 	bool m_bForceGDIPlus;
+	bool m_bKeepJPEGAsYCbCr;
+	int m_nFileCacheSizeMB;
+	int m_nCompressedCacheSizeMB;
 	bool m_bSingleInstance;
 	bool m_bSingleFullScreenInstance;
 	int m_nJPEGSaveQuality;
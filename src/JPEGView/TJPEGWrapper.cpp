@@ -3,6 +3,68 @@
 #include "TJPEGWrapper.h"
 #include "libjpeg-turbo\include\turbojpeg.h"
 #include "MaxImageDef.h"
+#include "ICCProfileTransform.h"
+#include "SettingsProvider.h"
+#include "YCbCrImage.h"
+#include "PixelMemory.h"
+
+// Gets the ICC profile stored in the APP2 markers of the JPEG stream. Large profiles are split over several markers.
+// Returns NULL if there is no valid profile, otherwise the profile must be freed by the caller with delete[].
+static unsigned char* GetICCProfile(const unsigned char* pStream, int nStreamLength, unsigned int& nProfileSize) {
+	const int MAX_CHUNKS = 256;
+	const unsigned char* pChunks[MAX_CHUNKS] = { 0 };
+	unsigned int nChunkSizes[MAX_CHUNKS] = { 0 };
+	int nNumChunks = 0;
+	nProfileSize = 0;
+	if (nStreamLength < 4 || pStream[0] != 0xFF || pStream[1] != 0xD8) {
+		return NULL;
+	}
+	int nIndex = 2;
+	while (nIndex + 4 <= nStreamLength && pStream[nIndex] == 0xFF) {
+		unsigned char nMarker = pStream[nIndex + 1];
+		if (nMarker == 0xFF) {
+			nIndex++; // padding
+			continue;
+		}
+		if (nMarker == 0xDA || nMarker == 0xD9) {
+			break; // start of scan, the profile must be before
+		}
+		int nLength = pStream[nIndex + 2] * 256 + pStream[nIndex + 3];
+		if (nLength < 2 || nIndex + 2 + nLength > nStreamLength) {
+			break;
+		}
+		// APP2 marker: "ICC_PROFILE\0", sequence number (1 based), number of chunks, profile data
+		if (nMarker == 0xE2 && nLength > 16 && memcmp(pStream + nIndex + 4, "ICC_PROFILE", 12) == 0) {
+			int nSeqNo = pStream[nIndex + 16];
+			int nCount = pStream[nIndex + 17];
+			if (nSeqNo == 0 || nSeqNo > nCount || (nNumChunks != 0 && nCount != nNumChunks) || pChunks[nSeqNo] != NULL) {
+				return NULL; // corrupt profile
+			}
+			nNumChunks = nCount;
+			pChunks[nSeqNo] = pStream + nIndex + 18;
+			nChunkSizes[nSeqNo] = nLength - 16;
+		}
+		nIndex += 2 + nLength;
+	}
+	for (int i = 1; i <= nNumChunks; i++) {
+		if (pChunks[i] == NULL) {
+			return NULL; // incomplete profile
+		}
+		nProfileSize += nChunkSizes[i];
+	}
+	if (nProfileSize == 0) {
+		return NULL;
+	}
+	unsigned char* pProfile = new(std::nothrow) unsigned char[nProfileSize];
+	if (pProfile != NULL) {
+		unsigned char* pDest = pProfile;
+		for (int i = 1; i <= nNumChunks; i++) {
+			memcpy(pDest, pChunks[i], nChunkSizes[i]);
+			pDest += nChunkSizes[i];
+		}
+	}
+	return pProfile;
+}
 
 void * TurboJpeg::ReadImage(int &width,
 					   int &height,
@@ -31,12 +93,19 @@ void * TurboJpeg::ReadImage(int &width,
 		if (abs((double)width * height) > MAX_IMAGE_PIXELS) {
 			outOfMemory = true;
 		} else if (width <= MAX_IMAGE_DIMENSION && height <= MAX_IMAGE_DIMENSION && chromoSubsampling != TJSAMP_UNKNOWN) {
-			pPixelData = new(std::nothrow) unsigned char[TJPAD(width * 3) * height];
+			pPixelData = (unsigned char*)CPixelMemory::Allocate((size_t)TJPAD(width * 3) * height);
 			if (pPixelData != NULL) {
 				nResult = tj3Decompress8(hDecoder, (unsigned char*)buffer, sizebytes, pPixelData, TJPAD(width * 3), TJPF_BGR);
 				if (nResult != 0) {
-					delete[] pPixelData;
+					CPixelMemory::Free(pPixelData);
 					pPixelData = NULL;
+				} else if (CSettingsProvider::This().UseEmbeddedColorProfiles()) {
+					unsigned int nProfileSize;
+					unsigned char* pProfile = GetICCProfile((const unsigned char*)buffer, sizebytes, nProfileSize);
+					void* transform = ICCProfileTransform::CreateTransform(pProfile, nProfileSize, ICCProfileTransform::FORMAT_BGR);
+					ICCProfileTransform::DoTransform(transform, pPixelData, pPixelData, width, height, TJPAD(width * 3));
+					ICCProfileTransform::DeleteTransform(transform);
+					delete[] pProfile;
 				}
 			} else {
 				outOfMemory = true;
@@ -49,6 +118,85 @@ void * TurboJpeg::ReadImage(int &width,
 	return pPixelData;
 }
 
+CYCbCrImage * TurboJpeg::ReadImageYCbCr(int &width,
+					   int &height,
+					   TJSAMP &chromoSubsampling,
+					   bool &outOfMemory,
+					   const void *buffer,
+					   int sizebytes)
+{
+	outOfMemory = false;
+	width = height = 0;
+	chromoSubsampling = TJSAMP_420;
+
+	if (CSettingsProvider::This().UseEmbeddedColorProfiles()) {
+		unsigned int nProfileSize;
+		unsigned char* pProfile = GetICCProfile((const unsigned char*)buffer, sizebytes, nProfileSize);
+		delete[] pProfile;
+		if (pProfile != NULL) {
+			return NULL; // the profile can only be applied to BGR pixels
+		}
+	}
+
+	tjhandle hDecoder = tj3Init(TJINIT_DECOMPRESS);
+	if (hDecoder == NULL) {
+		return NULL;
+	}
+
+	CYCbCrImage* pImage = NULL;
+	int nResult = tj3DecompressHeader(hDecoder, (unsigned char*)buffer, sizebytes);
+	if (nResult == 0) {
+		width = tj3Get(hDecoder, TJPARAM_JPEGWIDTH);
+		height = tj3Get(hDecoder, TJPARAM_JPEGHEIGHT);
+		chromoSubsampling = (TJSAMP)tj3Get(hDecoder, TJPARAM_SUBSAMP);
+		int nColorSpace = tj3Get(hDecoder, TJPARAM_COLORSPACE);
+		bool bIsPlanar = (nColorSpace == TJCS_YCbCr || nColorSpace == TJCS_GRAY) && tj3Get(hDecoder, TJPARAM_LOSSLESS) == 0;
+		if (abs((double)width * height) > MAX_IMAGE_PIXELS) {
+			outOfMemory = true;
+		} else if (bIsPlanar && width <= MAX_IMAGE_DIMENSION && height <= MAX_IMAGE_DIMENSION && chromoSubsampling != TJSAMP_UNKNOWN) {
+			const int ROW_ALIGNMENT = 4;
+			unsigned char* pPlanes = (unsigned char*)CPixelMemory::Allocate(tj3YUVBufSize(width, ROW_ALIGNMENT, height, chromoSubsampling));
+			if (pPlanes != NULL) {
+				nResult = tj3DecompressToYUV8(hDecoder, (unsigned char*)buffer, sizebytes, pPlanes, ROW_ALIGNMENT);
+				if (nResult == 0) {
+					pImage = new CYCbCrImage(width, height, chromoSubsampling, pPlanes, ROW_ALIGNMENT);
+				} else {
+					CPixelMemory::Free(pPlanes);
+				}
+			} else {
+				outOfMemory = true;
+			}
+		}
+	}
+
+	tj3Destroy(hDecoder);
+
+	return pImage;
+}
+
+bool TurboJpeg::ReadImageSize(int &width,
+					   int &height,
+					   const void *buffer,
+					   int sizebytes)
+{
+	width = height = 0;
+
+	tjhandle hDecoder = tj3Init(TJINIT_DECOMPRESS);
+	if (hDecoder == NULL) {
+		return false;
+	}
+
+	bool bSuccess = tj3DecompressHeader(hDecoder, (unsigned char*)buffer, sizebytes) == 0;
+	if (bSuccess) {
+		width = tj3Get(hDecoder, TJPARAM_JPEGWIDTH);
+		height = tj3Get(hDecoder, TJPARAM_JPEGHEIGHT);
+	}
+
+	tj3Destroy(hDecoder);
+
+	return bSuccess;
+}
+
 void * TurboJpeg::Compress(const void *source,
 					  int width,
 					  int height,
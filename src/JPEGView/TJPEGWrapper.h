@@ -2,11 +2,14 @@
 #pragma once
 
 enum TJSAMP;
+class CYCbCrImage;
 
 class TurboJpeg
 {
 public:
 	// Returns data in the form BGRBGR**********BGR000 where the zeros are padding to 4 byte boundary
+	// The embedded ICC profile is applied if UseEmbeddedColorProfiles is set
+	// The returned pixels are allocated with CPixelMemory::Allocate()
 	static void * ReadImage(int &width,   // width of the image loaded.
 						 int &height,  // height of the image loaded.
 						 int &bpp,     // BYTES (not bits) PER PIXEL.
@@ -15,6 +18,21 @@ public:
 						 const void *buffer, // memory address containing jpeg compressed data.
 						 int sizebytes); // size of jpeg compressed data.
 
+	// Returns the planar YCbCr pixels with the chroma subsampling of the JPEG, NULL if the JPEG cannot be represented
+	// this way (e.g. CMYK or lossless JPEG, or an embedded ICC profile must be applied). Use ReadImage() in this case.
+	static CYCbCrImage * ReadImageYCbCr(int &width,   // width of the image loaded.
+						 int &height,  // height of the image loaded.
+						 TJSAMP &chromoSubsampling, // chromo subsampling of image
+						 bool &outOfMemory, // set to true when no memory to read image
+						 const void *buffer, // memory address containing jpeg compressed data.
+						 int sizebytes); // size of jpeg compressed data.
+
+	// Reads the image size from the JPEG header without decoding the pixels, returns false if the header is invalid
+	static bool ReadImageSize(int &width,   // width of the image
+						 int &height,  // height of the image
+						 const void *buffer, // memory address containing jpeg compressed data.
+						 int sizebytes); // size of jpeg compressed data.
+
 	// Compress image data into JPEG stream, returns compressed data.
 	// The returned buffer must be freed with Free()!
 	static void * Compress(const void *buffer, // address of image in memory, format must be 3 bytes per pixel BRGBGR with padding to 4 byte boundary
@@ -8,4 +8,5 @@
 #define NAVPANEL_ANI_TIMER_EVENT_ID 6 // animation timer for navigation panel
 #define NAVPANEL_START_ANI_TIMER_EVENT_ID 7 // animation start timer for navigation panel
 #define IPPANEL_TIMER_EVENT_ID 8 // to show image processing panel in window mode
-#define ANIMATION_TIMER_EVENT_ID 9 // GIF animation timer ID
\ No newline at end of file
+#define ANIMATION_TIMER_EVENT_ID 9 // GIF animation timer ID
+#define CALIBRATION_TIMER_EVENT_ID 10 // starts the processing calibration after the first image is shown
\ No newline at end of file
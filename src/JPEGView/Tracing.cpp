@@ -0,0 +1,163 @@
+#include "StdAfx.h"
+#include "Tracing.h"
+
+CTracing::CEvent* CTracing::sm_pEvents = NULL;
+volatile LONG64 CTracing::sm_nNextEvent = 0;
+LPTOP_LEVEL_EXCEPTION_FILTER CTracing::sm_pPreviousExceptionFilter = NULL;
+volatile LONG CTracing::sm_nCrashTraceWritten = 0;
+TCHAR CTracing::sm_sCrashTraceFolder[MAX_PATH + 32];
+TCHAR CTracing::sm_sCrashTraceFileName[MAX_PATH + 64];
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Supporting classes
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Formats text into a fixed size buffer and writes it to the file whenever the buffer is almost full.
+// Does not allocate memory, the buffer is small enough to be placed on the stack of a crashing thread.
+class CTraceFileWriter {
+public:
+	CTraceFileWriter(HANDLE hFile) {
+		m_hFile = hFile;
+		m_nUsed = 0;
+		m_bSuccess = true;
+	}
+
+	// Appends formatted text, at most MAX_TEXT_LENGTH characters per call
+	void Append(const char* sFormat, ...) {
+		if (m_nUsed > BUFFER_SIZE - MAX_TEXT_LENGTH) {
+			Flush();
+		}
+		va_list args;
+		va_start(args, sFormat);
+		int nLength = _vsnprintf_s(m_buffer + m_nUsed, BUFFER_SIZE - m_nUsed, _TRUNCATE, sFormat, args);
+		va_end(args);
+		if (nLength < 0) {
+			m_bSuccess = false; // truncated
+		} else {
+			m_nUsed += nLength;
+		}
+	}
+
+	// Writes the buffered text, returns false if any text could not be formatted or written
+	bool Flush() {
+		DWORD nWritten;
+		if (m_nUsed > 0 && (!::WriteFile(m_hFile, m_buffer, m_nUsed, &nWritten, NULL) || nWritten != m_nUsed)) {
+			m_bSuccess = false;
+		}
+		m_nUsed = 0;
+		return m_bSuccess;
+	}
+
+private:
+	enum {
+		BUFFER_SIZE = 2048,
+		MAX_TEXT_LENGTH = 512 // the event names are short literals, an event needs less
+	};
+
+	HANDLE m_hFile;
+	char m_buffer[BUFFER_SIZE];
+	DWORD m_nUsed;
+	bool m_bSuccess;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Public
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+void CTracing::Enable() {
+	if (sm_pEvents != NULL) {
+		return;
+	}
+	CEvent* pEvents = new(std::nothrow) CEvent[NUM_EVENTS];
+	if (pEvents != NULL) {
+		for (int i = 0; i < NUM_EVENTS; i++) {
+			pEvents[i].Sequence = -1;
+		}
+		sm_pEvents = pEvents;
+		_tcscpy_s(sm_sCrashTraceFolder, MAX_PATH + 32, Helpers::JPEGViewAppDataPath());
+		_tcscpy_s(sm_sCrashTraceFileName, MAX_PATH + 64, DefaultFileName());
+		sm_pPreviousExceptionFilter = ::SetUnhandledExceptionFilter(WriteTraceOnCrash);
+	}
+}
+
+void CTracing::AddEvent(const char* sName, double dStartTime, const char* sArgName, int nArgValue) {
+	if (sm_pEvents == NULL) {
+		return;
+	}
+	double dEndTime = Helpers::GetExactTickCount();
+	LONG64 nIndex = ::InterlockedIncrement64(&sm_nNextEvent) - 1;
+	CEvent& event = sm_pEvents[nIndex & (NUM_EVENTS - 1)];
+	// the interlocked operations are full barriers, a reader sees either the old or the new sequence number with consistent data
+	::InterlockedExchange64(&event.Sequence, -1);
+	event.Name = sName;
+	event.ArgName = sArgName;
+	event.ArgValue = nArgValue;
+	event.ThreadId = ::GetCurrentThreadId();
+	event.StartTime = dStartTime;
+	event.Duration = dEndTime - dStartTime;
+	::InterlockedExchange64(&event.Sequence, nIndex);
+}
+
+bool CTracing::WriteChromeTrace(LPCTSTR sFileName) {
+	if (sm_pEvents == NULL) {
+		return false;
+	}
+	LONG64 nEnd = Read(sm_nNextEvent);
+	LONG64 nStart = max(0, nEnd - NUM_EVENTS);
+	HANDLE hFile = ::CreateFile(sFileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	DWORD nProcessId = ::GetCurrentProcessId();
+	// streamed to the file, a JSON string of all events would be several MB
+	CTraceFileWriter writer(hFile);
+	writer.Append("{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	bool bFirst = true;
+	for (LONG64 nIndex = nStart; nIndex < nEnd; nIndex++) {
+		CEvent& slot = sm_pEvents[nIndex & (NUM_EVENTS - 1)];
+		if (Read(slot.Sequence) != nIndex) {
+			continue; // still written or already overwritten
+		}
+		CEvent event;
+		event.Name = slot.Name;
+		event.ArgName = slot.ArgName;
+		event.ArgValue = slot.ArgValue;
+		event.ThreadId = slot.ThreadId;
+		event.StartTime = slot.StartTime;
+		event.Duration = slot.Duration;
+		::MemoryBarrier();
+		if (Read(slot.Sequence) != nIndex) {
+			continue; // overwritten while copying
+		}
+		// timestamps are in microseconds
+		writer.Append("%s  { \"name\": \"%s\", \"cat\": \"JPEGView\", \"ph\": \"X\", \"ts\": %.1f, \"dur\": %.1f, \"pid\": %u, \"tid\": %u",
+			bFirst ? "" : ",\n", event.Name, event.StartTime * 1000.0, event.Duration * 1000.0, nProcessId, event.ThreadId);
+		if (event.ArgName != NULL) {
+			writer.Append(", \"args\": { \"%s\": %d }", event.ArgName, event.ArgValue);
+		}
+		writer.Append(" }");
+		bFirst = false;
+	}
+	writer.Append("\n] }\n");
+
+	bool bSuccess = writer.Flush();
+	return ::CloseHandle(hFile) && bSuccess;
+}
+
+CString CTracing::DefaultFileName() {
+	return CString(Helpers::JPEGViewAppDataPath()) + _T("JPEGViewTrace.json");
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Private
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+LONG WINAPI CTracing::WriteTraceOnCrash(EXCEPTION_POINTERS* pExceptionInfo) {
+	// the events leading to a crash are the most interesting ones, write them before the process is gone.
+	// Only the first crashing thread writes the trace, the previous filter (e.g. writing a minidump) is called afterwards.
+	if (::InterlockedExchange(&sm_nCrashTraceWritten, 1) == 0) {
+		::CreateDirectory(sm_sCrashTraceFolder, NULL);
+		WriteChromeTrace(sm_sCrashTraceFileName);
+	}
+	return (sm_pPreviousExceptionFilter != NULL) ? sm_pPreviousExceptionFilter(pExceptionInfo) : EXCEPTION_CONTINUE_SEARCH;
+}
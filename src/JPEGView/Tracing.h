@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Helpers.h"
+
+// Low overhead tracing of the stages of loading and processing images, e.g. to diagnose stuttering.
+// Enabled with the EnableTracing INI setting or the /trace command line parameter, otherwise no events are recorded.
+// The events are stored in a ring buffer of fixed size without locking, when it is full the oldest events are overwritten.
+// When JPEGView exits or crashes, the events are written in Chrome trace format, viewable with chrome://tracing or Perfetto.
+class CTracing
+{
+public:
+	// Starts recording events and installs an unhandled exception filter writing the trace to DefaultFileName() on a crash.
+	// Must be called once at startup, before any other thread is created.
+	static void Enable();
+
+	static bool IsEnabled() { return sm_pEvents != NULL; }
+
+	// Records an event that started at dStartTime (see Helpers::GetExactTickCount()) and ends now. Does nothing if tracing
+	// is disabled. sName and sArgName (can be NULL) must be string literals, they are only stored as pointers.
+	static void AddEvent(const char* sName, double dStartTime, const char* sArgName = NULL, int nArgValue = 0);
+
+	// Writes the recorded events in Chrome trace JSON format. Events recorded while writing may be missing.
+	// Returns false if the file cannot be written. Does not allocate memory, thus can be used when crashing.
+	static bool WriteChromeTrace(LPCTSTR sFileName);
+
+	// Default file name of the trace, in the JPEGView application data folder
+	static CString DefaultFileName();
+
+private:
+	enum {
+		NUM_EVENTS = 65536 // must be a power of 2
+	};
+
+	struct CEvent {
+		const char* Name;
+		const char* ArgName;
+		int ArgValue;
+		DWORD ThreadId;
+		double StartTime;
+		double Duration;
+		volatile LONG64 Sequence; // index of the event stored in this slot, -1 while the slot is written
+	};
+
+	static CEvent* sm_pEvents;
+	static volatile LONG64 sm_nNextEvent; // 64 bit, a 32 bit index would wrap after 2^31 events
+	static LPTOP_LEVEL_EXCEPTION_FILTER sm_pPreviousExceptionFilter;
+	static volatile LONG sm_nCrashTraceWritten;
+	// Folder and file name of the trace written on a crash, determined in Enable() as the heap may be corrupt when crashing
+	static TCHAR sm_sCrashTraceFolder[MAX_PATH + 32];
+	static TCHAR sm_sCrashTraceFileName[MAX_PATH + 64];
+
+	static LONG WINAPI WriteTraceOnCrash(EXCEPTION_POINTERS* pExceptionInfo);
+	// Atomic read, also on 32 bit
+	static LONG64 Read(volatile LONG64& nValue) { return ::InterlockedCompareExchange64(&nValue, 0, 0); }
+};
+
+// Records a trace event covering the lifetime of the object, if tracing is enabled
+class CTraceScope
+{
+public:
+	CTraceScope(const char* sName, const char* sArgName = NULL, int nArgValue = 0) {
+		m_sName = CTracing::IsEnabled() ? sName : NULL;
+		if (m_sName != NULL) {
+			m_sArgName = sArgName;
+			m_nArgValue = nArgValue;
+			m_dStartTime = Helpers::GetExactTickCount();
+		}
+	}
+
+	~CTraceScope() {
+		if (m_sName != NULL) {
+			CTracing::AddEvent(m_sName, m_dStartTime, m_sArgName, m_nArgValue);
+		}
+	}
+
+private:
+	const char* m_sName;
+	const char* m_sArgName;
+	int m_nArgValue;
+	double m_dStartTime;
+};
@@ -0,0 +1,189 @@
+#include "StdAfx.h"
+#include "UndoStack.h"
+#include "PixelMemory.h"
+
+// Maximum number of undo steps kept per image
+#define MAX_UNDO_STEPS 8
+// The steps may use this multiple of the current image size, the newest step is always kept
+#define MAX_UNDO_MEMORY_FACTOR 2
+
+///////////////////////////////////////////////////////////////////////////////////
+// CUndoStep
+///////////////////////////////////////////////////////////////////////////////////
+
+CUndoStep::CUndoStep(const COriginalPixelsState& previousState) : m_state(previousState) {
+	m_pTilePixels = NULL;
+	m_nSizeBytes = previousState.SizeInBytes() + previousState.Offset;
+}
+
+CUndoStep::CUndoStep(const COriginalPixelsState& previousState, const COriginalPixelsState& currentState) : m_state(previousState) {
+	assert(previousState.Width == currentState.Width && previousState.Height == currentState.Height &&
+		previousState.Channels == currentState.Channels);
+	m_state.Pixels = NULL;
+	m_pTilePixels = NULL;
+	m_nSizeBytes = 0;
+
+	size_t nDataSize = 0;
+	for (int nY = 0; nY < previousState.Height; nY += TILE_SIZE) {
+		for (int nX = 0; nX < previousState.Width; nX += TILE_SIZE) {
+			CTile tile;
+			tile.X = nX;
+			tile.Y = nY;
+			tile.Width = min((int)TILE_SIZE, previousState.Width - nX);
+			tile.Height = min((int)TILE_SIZE, previousState.Height - nY);
+			tile.DataOffset = nDataSize;
+			if (TileDiffers(previousState, currentState, tile)) {
+				m_tiles.push_back(tile);
+				nDataSize += (size_t)tile.Width * tile.Height * previousState.Channels;
+			}
+		}
+	}
+	if (nDataSize == 0) {
+		return;
+	}
+
+	m_pTilePixels = new(std::nothrow) uint8[nDataSize];
+	if (m_pTilePixels == NULL) {
+		return; // IsValid() returns false
+	}
+	m_nSizeBytes = nDataSize;
+	for (std::vector<CTile>::const_iterator iter = m_tiles.begin(); iter != m_tiles.end(); iter++) {
+		int nRowBytes = iter->Width * previousState.Channels;
+		const uint8* pSrc = (uint8*)previousState.Pixels + previousState.Offset + (size_t)iter->Y * previousState.Stride + iter->X * previousState.Channels;
+		uint8* pDst = m_pTilePixels + iter->DataOffset;
+		for (int j = 0; j < iter->Height; j++) {
+			memcpy(pDst, pSrc, nRowBytes);
+			pSrc += previousState.Stride;
+			pDst += nRowBytes;
+		}
+	}
+}
+
+CUndoStep::~CUndoStep() {
+	CPixelMemory::Free(m_state.Pixels);
+	m_state.Pixels = NULL;
+	delete[] m_pTilePixels;
+	m_pTilePixels = NULL;
+}
+
+void CUndoStep::Swap(COriginalPixelsState& state) {
+	if (m_state.Pixels != NULL) {
+		COriginalPixelsState tempState = state;
+		state = m_state;
+		m_state = tempState;
+		m_nSizeBytes = m_state.SizeInBytes() + m_state.Offset;
+		return;
+	}
+
+	// swap the saved tiles with the pixels of the current state, the geometry stays the same
+	uint8 tempRow[TILE_SIZE * 4];
+	for (std::vector<CTile>::const_iterator iter = m_tiles.begin(); iter != m_tiles.end(); iter++) {
+		int nRowBytes = iter->Width * state.Channels;
+		uint8* pPixels = (uint8*)state.Pixels + state.Offset + (size_t)iter->Y * state.Stride + iter->X * state.Channels;
+		uint8* pTile = m_pTilePixels + iter->DataOffset;
+		for (int j = 0; j < iter->Height; j++) {
+			memcpy(tempRow, pTile, nRowBytes);
+			memcpy(pTile, pPixels, nRowBytes);
+			memcpy(pPixels, tempRow, nRowBytes);
+			pPixels += state.Stride;
+			pTile += nRowBytes;
+		}
+	}
+	CRotationParams tempRotation = state.RotationParams;
+	state.RotationParams = m_state.RotationParams;
+	m_state.RotationParams = tempRotation;
+	bool bTemp = state.IsDestructivelyProcessed;
+	state.IsDestructivelyProcessed = m_state.IsDestructivelyProcessed;
+	m_state.IsDestructivelyProcessed = bTemp;
+	bTemp = state.IsProcessedNoParamDB;
+	state.IsProcessedNoParamDB = m_state.IsProcessedNoParamDB;
+	m_state.IsProcessedNoParamDB = bTemp;
+}
+
+bool CUndoStep::TileDiffers(const COriginalPixelsState& state1, const COriginalPixelsState& state2, const CTile& tile) {
+	int nRowBytes = tile.Width * state1.Channels;
+	const uint8* pPixels1 = (uint8*)state1.Pixels + state1.Offset + (size_t)tile.Y * state1.Stride + tile.X * state1.Channels;
+	const uint8* pPixels2 = (uint8*)state2.Pixels + state2.Offset + (size_t)tile.Y * state2.Stride + tile.X * state2.Channels;
+	for (int j = 0; j < tile.Height; j++) {
+		if (memcmp(pPixels1, pPixels2, nRowBytes) != 0) {
+			return true;
+		}
+		pPixels1 += state1.Stride;
+		pPixels2 += state2.Stride;
+	}
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// CUndoStack
+///////////////////////////////////////////////////////////////////////////////////
+
+CUndoStack::CUndoStack() {
+}
+
+CUndoStack::~CUndoStack() {
+	Clear();
+}
+
+void CUndoStack::Push(CUndoStep* pStep, size_t nImageSizeBytes) {
+	DeleteSteps(m_redoSteps);
+	m_undoSteps.push_back(pStep);
+	size_t nMaxBytes = nImageSizeBytes * MAX_UNDO_MEMORY_FACTOR;
+	while (m_undoSteps.size() > 1 && (m_undoSteps.size() > MAX_UNDO_STEPS || SizeInBytes() > nMaxBytes)) {
+		delete m_undoSteps.front();
+		m_undoSteps.pop_front();
+	}
+}
+
+bool CUndoStack::Undo(COriginalPixelsState& state) {
+	if (m_undoSteps.empty()) {
+		return false;
+	}
+	CUndoStep* pStep = m_undoSteps.back();
+	m_undoSteps.pop_back();
+	pStep->Swap(state);
+	m_redoSteps.push_back(pStep);
+	return true;
+}
+
+bool CUndoStack::Redo(COriginalPixelsState& state) {
+	if (m_redoSteps.empty()) {
+		return false;
+	}
+	CUndoStep* pStep = m_redoSteps.back();
+	m_redoSteps.pop_back();
+	pStep->Swap(state);
+	m_undoSteps.push_back(pStep);
+	return true;
+}
+
+void CUndoStack::PushWithoutStep() {
+	DeleteSteps(m_redoSteps);
+	while (!m_undoSteps.empty() && m_undoSteps.back()->IsTiled()) {
+		delete m_undoSteps.back();
+		m_undoSteps.pop_back();
+	}
+}
+
+void CUndoStack::Clear() {
+	DeleteSteps(m_undoSteps);
+	DeleteSteps(m_redoSteps);
+}
+
+size_t CUndoStack::SizeInBytes() const {
+	size_t nSize = 0;
+	for (std::list<CUndoStep*>::const_iterator iter = m_undoSteps.begin(); iter != m_undoSteps.end(); iter++) {
+		nSize += (*iter)->SizeInBytes();
+	}
+	for (std::list<CUndoStep*>::const_iterator iter = m_redoSteps.begin(); iter != m_redoSteps.end(); iter++) {
+		nSize += (*iter)->SizeInBytes();
+	}
+	return nSize;
+}
+
+void CUndoStack::DeleteSteps(std::list<CUndoStep*>& steps) {
+	for (std::list<CUndoStep*>::iterator iter = steps.begin(); iter != steps.end(); iter++) {
+		delete *iter;
+	}
+	steps.clear();
+}
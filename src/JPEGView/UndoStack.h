@@ -0,0 +1,106 @@
+#pragma once
+
+#include "ProcessParams.h"
+#include <list>
+#include <vector>
+
+// State of the original pixels of an image as saved and restored by the undo stack
+class COriginalPixelsState {
+public:
+	COriginalPixelsState() : RotationParams(0) {
+		Pixels = NULL;
+		Offset = 0;
+		Stride = 0;
+		Width = Height = 0;
+		Channels = 0;
+		IsDestructivelyProcessed = false;
+		IsProcessedNoParamDB = false;
+	}
+
+	void* Pixels; // allocation of the pixels, the first pixel is Offset bytes into it
+	size_t Offset;
+	int Stride; // distance of the rows in bytes
+	int Width, Height;
+	int Channels;
+	CRotationParams RotationParams;
+	bool IsDestructivelyProcessed;
+	bool IsProcessedNoParamDB;
+
+	// Size of the pixels in bytes
+	size_t SizeInBytes() const { return (size_t)Stride * Height; }
+};
+
+// One step of the undo stack. The step holds the state of the original pixels before an operation.
+// Undoing exchanges the step with the current state, the step then holds the state for redoing the operation.
+class CUndoStep {
+public:
+	// For operations replacing the original pixels. The step takes ownership of the pixels of previousState,
+	// they are freed with CPixelMemory::Free().
+	CUndoStep(const COriginalPixelsState& previousState);
+	// For operations modifying the original pixels without changing their size. Only the tiles of previousState.Pixels
+	// differing from currentState.Pixels are copied, both states must have the same geometry. The pixels are not taken over.
+	CUndoStep(const COriginalPixelsState& previousState, const COriginalPixelsState& currentState);
+	~CUndoStep();
+
+	// False if the tiles could not be allocated, the step must not be used in this case
+	bool IsValid() const { return m_state.Pixels != NULL || m_pTilePixels != NULL || m_tiles.empty(); }
+
+	// Memory held by the step in bytes
+	size_t SizeInBytes() const { return m_nSizeBytes; }
+
+	// True if the step only holds the changed tiles, it can then only be swapped with the exact state it was created for
+	bool IsTiled() const { return m_state.Pixels == NULL; }
+
+	// Exchanges the state held by this step with the given current state
+	void Swap(COriginalPixelsState& state);
+
+private:
+	enum { TILE_SIZE = 64 };
+
+	// A tile of the original pixels, the pixels are stored in m_pTilePixels at DataOffset with packed rows
+	struct CTile {
+		int X, Y, Width, Height;
+		size_t DataOffset;
+	};
+
+	COriginalPixelsState m_state; // m_state.Pixels is NULL for tiled steps
+	std::vector<CTile> m_tiles;
+	uint8* m_pTilePixels;
+	size_t m_nSizeBytes;
+
+	static bool TileDiffers(const COriginalPixelsState& state1, const COriginalPixelsState& state2, const CTile& tile);
+};
+
+// Undo and redo steps of the destructive operations on the original pixels of an image
+class CUndoStack {
+public:
+	CUndoStack();
+	~CUndoStack();
+
+	// Adds the step of an operation that has just been done and removes all redo steps. The stack takes ownership of the step.
+	// The oldest steps are removed when the steps use more memory than allowed for an image of nImageSizeBytes bytes.
+	void Push(CUndoStep* pStep, size_t nImageSizeBytes);
+
+	bool CanUndo() const { return !m_undoSteps.empty(); }
+	bool CanRedo() const { return !m_redoSteps.empty(); }
+
+	// Undoes or redoes the last step by exchanging it with the given current state. Returns false if there is no step.
+	bool Undo(COriginalPixelsState& state);
+	bool Redo(COriginalPixelsState& state);
+
+	// For an operation that has been done without a step, e.g. because the step could not be allocated. Removes all redo steps
+	// and the newest undo steps holding only changed tiles, these do not match the pixels anymore. The older steps are kept.
+	void PushWithoutStep();
+
+	// Removes all steps
+	void Clear();
+
+	// Memory held by all steps in bytes
+	size_t SizeInBytes() const;
+
+private:
+	std::list<CUndoStep*> m_undoSteps; // newest step last
+	std::list<CUndoStep*> m_redoSteps; // newest step last
+
+	static void DeleteSteps(std::list<CUndoStep*>& steps);
+};
@@ -1,6 +1,7 @@
 
 #include "StdAfx.h"
 #include "WorkThread.h"
+#include "ScratchArena.h"
 #include <process.h>
 
 /////////////////////////////////////////////////////////////////////////////////////////////
@@ -131,6 +132,7 @@ void CWorkThread::ThreadFunc(void* arg) {
 			::ResetEvent(thisPtr->m_wakeUp);
 		}
 	} while (!thisPtr->m_bTerminate);
+	CScratchArena::FreeThisThread();
 	if (thisPtr->m_bCoInitialize) {
 		::CoUninitialize();
 	}
@@ -1,6 +1,7 @@
 #include "StdAfx.h"
 #include "XMMImage.h"
 #include "Helpers.h"
+#include "ScratchArena.h"
 
 CXMMImage::CXMMImage(int nWidth, int nHeight, int padding) {
 	Init(nWidth, nHeight, false, padding);
@@ -11,13 +12,13 @@ CXMMImage::CXMMImage(int nWidth, int nHeight, bool bPadHeight, int padding) {
 }
 
 CXMMImage::CXMMImage(int nWidth, int nHeight, int nFirstX, int nLastX, int nFirstY, int nLastY, 
-	const void* pDIB, int nChannels, int padding) {
+	const void* pDIB, int nStride, int nChannels, int padding) {
 	int nSectionWidth = nLastX - nFirstX + 1;
 	int nSectionHeight = nLastY - nFirstY + 1;
 	Init(nSectionWidth, nSectionHeight, false, padding);
 
 	if (m_pMemory != NULL) {
-		int nSrcLineWidthPadded = Helpers::DoPadding(nWidth * nChannels, 4);
+		int nSrcLineWidthPadded = nStride;
 		const uint8* pSrc = (uint8*)pDIB + (long long)nFirstY*(long long)nSrcLineWidthPadded + (long long)nFirstX*(long long)nChannels;
 		uint16* pDst = (unsigned short*) m_pMemory;
 		for (int j = 0; j < nSectionHeight; j++) {
@@ -54,12 +55,31 @@ CXMMImage::CXMMImage(int nWidth, int nHeight, int nFirstX, int nLastX, int nFirs
 
 CXMMImage::~CXMMImage(void) {
 	if (m_pMemory != NULL) {
-		// free the memory pages
-		::VirtualFree(m_pMemory, 0, MEM_RELEASE);
+		if (m_pArena != NULL) {
+			m_pArena->Free(m_pMemory);
+		} else {
+			// free the memory pages
+			::VirtualFree(m_pMemory, 0, MEM_RELEASE);
+		}
 		m_pMemory = NULL;
 	}
 }
 
+void* CXMMImage::operator new(size_t nSize) {
+	CScratchArena* pArena = CScratchArena::Active();
+	void* pObject = (pArena != NULL) ? pArena->Allocate(nSize) : NULL;
+	return (pObject != NULL) ? pObject : ::operator new(nSize);
+}
+
+void CXMMImage::operator delete(void* pObject) {
+	CScratchArena* pArena = CScratchArena::Owner(pObject);
+	if (pArena != NULL) {
+		pArena->Free(pObject);
+	} else {
+		::operator delete(pObject);
+	}
+}
+
 void* CXMMImage::ConvertToDIBRGBA() const {
 	if (m_pMemory == NULL) {
 		return NULL;
@@ -102,6 +122,14 @@ void CXMMImage::Init(int nWidth, int nHeight, bool bPadHeight, int padding) {
 	m_nHeight = nHeight;
 	int nMemSize = GetMemSize();
 
+	// the pixels are placed on the same end of the arena as the image object, see CScratchArena
+	CScratchArena* pArena = CScratchArena::Active();
+	m_pMemory = (pArena != NULL) ? pArena->Allocate(nMemSize, this) : NULL;
+	m_pArena = (m_pMemory != NULL) ? pArena : NULL;
+	if (m_pArena != NULL) {
+		return;
+	}
+
 	// Allocate memory aligned on page boundaries
 	m_pMemory = ::VirtualAlloc(
 						NULL,	  // let the call determine the start address
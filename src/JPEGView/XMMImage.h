@@ -2,6 +2,8 @@
 
 #include "ImageProcessingTypes.h"
 
+class CScratchArena;
+
 // Represents an image with line interleaving and padding rows to 2^x bytes (16 for SSE, 32 for AVX) optimal for
 // SIMD processing. Each pixel has 16 bits per channel, channel order is B, G, R, x stands for padding:
 // BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBxxx
@@ -17,10 +19,15 @@ public:
 	CXMMImage(int nWidth, int nHeight, int padding);
 	CXMMImage(int nWidth, int nHeight, bool bPadHeight, int padding); // padding is in pixels (not bytes), width is always padded, height only when bPadHeight is true
 	// convert from section of 24 or 32 bpp DIB, from first to (and including) last column and row
-	// padding is in pixels(not bytes)
-	CXMMImage(int nWidth, int nHeight, int nFirstX, int nLastX, int nFirstY, int nLastY, const void* pDIB, int nChannels, int padding);
+	// nStride is the distance of the DIB rows in bytes, padding is in pixels(not bytes)
+	CXMMImage(int nWidth, int nHeight, int nFirstX, int nLastX, int nFirstY, int nLastY, const void* pDIB, int nStride, int nChannels, int padding);
 	~CXMMImage(void);
 
+	// Images created while processing a strip on the thread pool are placed in the scratch arena of the thread,
+	// including their pixel memory. They must be deleted before the strip is finished.
+	static void* operator new(size_t nSize);
+	static void operator delete(void* pObject);
+
 	// Pointer to aligned memory of 16 bpp image
 	void * AlignedPtr() { return m_pMemory; }
 	void * AlignedPtr() const { return m_pMemory; }
@@ -40,6 +47,7 @@ private:
 	void Init(int nWidth, int nHeight, bool bPadHeight, int padding);
 
 	void* m_pMemory;
+	CScratchArena* m_pArena; // arena m_pMemory is allocated from, NULL if allocated with VirtualAlloc()
 	int m_nWidth, m_nHeight;
 	int m_nPaddedWidth; // in pixels
 	int m_nPaddedHeight; // in pixels
@@ -0,0 +1,222 @@
+#include "StdAfx.h"
+#include "YCbCrImage.h"
+#include "Helpers.h"
+#include "ProcessingThreadPool.h"
+#include "PixelMemory.h"
+#include "libjpeg-turbo\include\turbojpeg.h"
+
+#define ALPHA_OPAQUE 0xFF000000
+
+///////////////////////////////////////////////////////////////////////////////////
+// Supporting classes
+///////////////////////////////////////////////////////////////////////////////////
+
+// Fixed point YCbCr to RGB conversion tables, same values and rounding as libjpeg (jdcolor.c)
+static struct CConversionTables {
+	int CrToR[256];
+	int CbToB[256];
+	int CrToG[256]; // scaled by 65536
+	int CbToG[256]; // scaled by 65536, includes rounding
+
+	CConversionTables() {
+		const int ONE_HALF = 1 << 15;
+		const int FIX_1_40200 = 91881;
+		const int FIX_1_77200 = 116130;
+		const int FIX_0_71414 = 46802;
+		const int FIX_0_34414 = 22554;
+		for (int i = 0; i < 256; i++) {
+			int x = i - 128;
+			CrToR[i] = (FIX_1_40200 * x + ONE_HALF) >> 16;
+			CbToB[i] = (FIX_1_77200 * x + ONE_HALF) >> 16;
+			CrToG[i] = -FIX_0_71414 * x;
+			CbToG[i] = -FIX_0_34414 * x + ONE_HALF;
+		}
+	}
+} s_tables;
+
+static inline uint32 Clamp(int nValue) {
+	return (nValue < 0) ? 0 : (nValue > 255) ? 255 : nValue;
+}
+
+static inline uint32 YCbCrToBGRA(int nY, int nCb, int nCr) {
+	uint32 nRed = Clamp(nY + s_tables.CrToR[nCr]);
+	uint32 nGreen = Clamp(nY + ((s_tables.CbToG[nCb] + s_tables.CrToG[nCr]) >> 16));
+	uint32 nBlue = Clamp(nY + s_tables.CbToB[nCb]);
+	return nBlue + (nGreen << 8) + (nRed << 16) + ALPHA_OPAQUE;
+}
+
+// Request for converting the YCbCr planes to BGR(A), one strip per thread
+class CRequestYCbCrToBGR : public CProcessingRequest {
+public:
+	CRequestYCbCrToBGR(const CYCbCrImage& image, void* pTargetPixels, int nChannels)
+		: CProcessingRequest(NULL, CSize(image.Width(), image.Height()), pTargetPixels,
+		CSize(image.Width(), image.Height()), CPoint(0, 0), CSize(image.Width(), image.Height())), Image(image) {
+		Channels = nChannels;
+	}
+
+	virtual bool ProcessStrip(int offsetY, int sizeY) {
+		Image.ConvertRows(TargetPixels, Channels, offsetY, sizeY);
+		return true;
+	}
+
+	const CYCbCrImage& Image;
+	int Channels;
+};
+
+///////////////////////////////////////////////////////////////////////////////////
+// Public interface
+///////////////////////////////////////////////////////////////////////////////////
+
+CYCbCrImage::CYCbCrImage(int nWidth, int nHeight, TJSAMP eSampling, uint8* pPlanes, int nAlign) {
+	m_nWidth = nWidth;
+	m_nHeight = nHeight;
+	m_eSampling = eSampling;
+	m_nRotation = 0;
+	m_pPlanes = pPlanes;
+	m_nYStride = Helpers::DoPadding(tj3YUVPlaneWidth(0, nWidth, eSampling), nAlign);
+	m_nSizeBytes = tj3YUVBufSize(nWidth, nAlign, nHeight, eSampling);
+	m_pY = pPlanes;
+	if (eSampling == TJSAMP_GRAY) {
+		m_pCb = m_pCr = NULL;
+		m_nChromaStride = m_nChromaWidth = m_nChromaHeight = 0;
+		m_nSubsamplingX = m_nSubsamplingY = 1;
+		m_bFancyUpsampling = false;
+	} else {
+		m_nChromaWidth = tj3YUVPlaneWidth(1, nWidth, eSampling);
+		m_nChromaHeight = tj3YUVPlaneHeight(1, nHeight, eSampling);
+		m_nChromaStride = Helpers::DoPadding(m_nChromaWidth, nAlign);
+		m_pCb = m_pY + (size_t)m_nYStride * tj3YUVPlaneHeight(0, nHeight, eSampling);
+		m_pCr = m_pCb + (size_t)m_nChromaStride * m_nChromaHeight;
+		m_nSubsamplingX = tjMCUWidth[eSampling] / 8;
+		m_nSubsamplingY = tjMCUHeight[eSampling] / 8;
+		// libjpeg-turbo does not interpolate horizontally subsampled chroma when the chroma plane is very narrow
+		m_bFancyUpsampling = m_nSubsamplingX != 2 || m_nChromaWidth > 2;
+	}
+}
+
+CYCbCrImage::~CYCbCrImage() {
+	CPixelMemory::Free(m_pPlanes);
+	m_pPlanes = NULL;
+}
+
+uint32 CYCbCrImage::GetPixel(int nX, int nY) const {
+	switch (m_nRotation) {
+		case 90: return GetPlanePixel(nY, m_nHeight - 1 - nX);
+		case 180: return GetPlanePixel(m_nWidth - 1 - nX, m_nHeight - 1 - nY);
+		case 270: return GetPlanePixel(m_nWidth - 1 - nY, nX);
+	}
+	return GetPlanePixel(nX, nY);
+}
+
+void CYCbCrImage::ConvertRows(void* pTarget, int nChannels, int nStartY, int nSizeY) const {
+	ptrdiff_t nPaddedTargetWidth = Helpers::DoPadding(Width() * nChannels, 4);
+
+	// Section of the planes covering the target rows and the target address increments when stepping one
+	// column (nIncX) or one row (nIncY) in the planes. pOrigin is the target address of plane pixel (0, 0).
+	int nStartX = 0, nEndX = m_nWidth, nStartRow = nStartY, nEndRow = nStartY + nSizeY;
+	ptrdiff_t nIncX = nChannels, nIncY = nPaddedTargetWidth;
+	uint8* pOrigin = (uint8*)pTarget;
+	switch (m_nRotation) {
+		case 90: // plane pixel (x, y) goes to (height - 1 - y, x)
+			nStartX = nStartY; nEndX = nStartY + nSizeY; nStartRow = 0; nEndRow = m_nHeight;
+			nIncX = nPaddedTargetWidth; nIncY = -nChannels;
+			pOrigin += (ptrdiff_t)(m_nHeight - 1) * nChannels;
+			break;
+		case 180: // plane pixel (x, y) goes to (width - 1 - x, height - 1 - y)
+			nStartRow = m_nHeight - nStartY - nSizeY; nEndRow = m_nHeight - nStartY;
+			nIncX = -nChannels; nIncY = -nPaddedTargetWidth;
+			pOrigin += (m_nHeight - 1) * nPaddedTargetWidth + (ptrdiff_t)(m_nWidth - 1) * nChannels;
+			break;
+		case 270: // plane pixel (x, y) goes to (y, width - 1 - x)
+			nStartX = m_nWidth - nStartY - nSizeY; nEndX = m_nWidth - nStartY; nStartRow = 0; nEndRow = m_nHeight;
+			nIncX = -nPaddedTargetWidth; nIncY = nChannels;
+			pOrigin += (m_nWidth - 1) * nPaddedTargetWidth;
+			break;
+	}
+
+	for (int j = nStartRow; j < nEndRow; j++) {
+		const uint8* pLuma = m_pY + (size_t)j * m_nYStride;
+		uint8* pDst = pOrigin + j * nIncY + nStartX * nIncX;
+		int nRow, nNeighborRow;
+		GetChromaRows(j, nRow, nNeighborRow);
+		for (int i = nStartX; i < nEndX; i++) {
+			uint32 nPixel;
+			if (m_pCb == NULL) {
+				nPixel = pLuma[i] + (pLuma[i] << 8) + (pLuma[i] << 16);
+			} else {
+				int nCol, nNeighborCol;
+				GetChromaColumns(i, nCol, nNeighborCol);
+				nPixel = YCbCrToBGRA(pLuma[i], UpsampleChroma(m_pCb, nRow, nNeighborRow, nCol, nNeighborCol, i, j),
+					UpsampleChroma(m_pCr, nRow, nNeighborRow, nCol, nNeighborCol, i, j));
+			}
+			if (nChannels == 3) {
+				pDst[0] = (uint8)nPixel;
+				pDst[1] = (uint8)(nPixel >> 8);
+				pDst[2] = (uint8)(nPixel >> 16);
+			} else {
+				*((uint32*)pDst) = nPixel | ALPHA_OPAQUE;
+			}
+			pDst += nIncX;
+		}
+	}
+}
+
+void* CYCbCrImage::ConvertToBGR(int nChannels) const {
+	uint8* pTarget = (uint8*)CPixelMemory::Allocate((size_t)Helpers::DoPadding(Width() * nChannels, 4) * Height());
+	if (pTarget == NULL) return NULL;
+
+	CRequestYCbCrToBGR request(*this, pTarget, nChannels);
+	CProcessingThreadPool::This().Process(&request);
+	return pTarget;
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// Private
+///////////////////////////////////////////////////////////////////////////////////
+
+uint32 CYCbCrImage::GetPlanePixel(int nX, int nY) const {
+	int nLuma = m_pY[(size_t)nY * m_nYStride + nX];
+	if (m_pCb == NULL) {
+		return nLuma + (nLuma << 8) + (nLuma << 16) + ALPHA_OPAQUE;
+	}
+	int nRow, nNeighborRow, nCol, nNeighborCol;
+	GetChromaRows(nY, nRow, nNeighborRow);
+	GetChromaColumns(nX, nCol, nNeighborCol);
+	return YCbCrToBGRA(nLuma, UpsampleChroma(m_pCb, nRow, nNeighborRow, nCol, nNeighborCol, nX, nY),
+		UpsampleChroma(m_pCr, nRow, nNeighborRow, nCol, nNeighborCol, nX, nY));
+}
+
+// For 2x subsampling, each pixel is interpolated from its own chroma sample (weight 3/4) and the nearest neighbor
+// sample (weight 1/4), the neighbor is on the left/top for even and on the right/bottom for odd pixels.
+void CYCbCrImage::GetChromaRows(int nY, int& nRow, int& nNeighborRow) const {
+	nRow = nNeighborRow = nY / m_nSubsamplingY;
+	if (m_nSubsamplingY == 2) {
+		nNeighborRow = (nY & 1) ? min(nRow + 1, m_nChromaHeight - 1) : max(nRow - 1, 0);
+	}
+}
+
+void CYCbCrImage::GetChromaColumns(int nX, int& nCol, int& nNeighborCol) const {
+	nCol = nNeighborCol = nX / m_nSubsamplingX;
+	if (m_nSubsamplingX == 2) {
+		nNeighborCol = (nX & 1) ? min(nCol + 1, m_nChromaWidth - 1) : max(nCol - 1, 0);
+	}
+}
+
+// The rounding terms are the ones of libjpeg-turbo (jdsample.c), which alternate between even and odd pixels
+int CYCbCrImage::UpsampleChroma(const uint8* pPlane, int nRow, int nNeighborRow, int nCol, int nNeighborCol, int nX, int nY) const {
+	const uint8* pRow = pPlane + (size_t)nRow * m_nChromaStride;
+	if (!m_bFancyUpsampling) {
+		return pRow[nCol];
+	} else if (m_nSubsamplingY == 2) {
+		const uint8* pNeighborRow = pPlane + (size_t)nNeighborRow * m_nChromaStride;
+		int nThis = 3 * pRow[nCol] + pNeighborRow[nCol];
+		if (m_nSubsamplingX == 2) {
+			int nNeighbor = 3 * pRow[nNeighborCol] + pNeighborRow[nNeighborCol];
+			return (3 * nThis + nNeighbor + ((nX & 1) ? 7 : 8)) >> 4;
+		}
+		return (nThis + ((nY & 1) ? 2 : 1)) >> 2;
+	} else if (m_nSubsamplingX == 2) {
+		return (3 * pRow[nCol] + pRow[nNeighborCol] + ((nX & 1) ? 2 : 1)) >> 2;
+	}
+	return pRow[nCol];
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+enum TJSAMP;
+
+// Planar YCbCr pixels of a JPEG image as decoded by libjpeg-turbo. The chroma planes keep the subsampling of
+// the JPEG file, thus a 4:2:0 image needs 1.5 bytes per pixel instead of 3 bytes (BGR) or 4 bytes (BGRA).
+// The pixels are converted to BGR on request, the chroma is upsampled the same way as libjpeg-turbo does
+// (triangle filter for 2x subsampling, replication otherwise).
+class CYCbCrImage
+{
+public:
+	// Takes ownership of pPlanes, which must be allocated with new[] or CPixelMemory::Allocate(). The planes are stored one after each other,
+	// the rows are padded to nAlign bytes (layout as written by tj3DecompressToYUV8()).
+	// For TJSAMP_GRAY there is only the Y plane.
+	CYCbCrImage(int nWidth, int nHeight, TJSAMP eSampling, uint8* pPlanes, int nAlign);
+	~CYCbCrImage();
+
+	// Width and height of the image after the rotation set with SetRotation()
+	int Width() const { return (m_nRotation == 90 || m_nRotation == 270) ? m_nHeight : m_nWidth; }
+	int Height() const { return (m_nRotation == 90 || m_nRotation == 270) ? m_nWidth : m_nHeight; }
+	TJSAMP Sampling() const { return m_eSampling; }
+
+	// Sets the clockwise rotation (0, 90, 180 or 270 degrees) applied when accessing and converting the pixels.
+	// The planes itself are not changed, the rotation is done as part of the color conversion.
+	void SetRotation(int nRotation) { m_nRotation = nRotation; }
+	int Rotation() const { return m_nRotation; }
+
+	// Memory used by the planes in bytes
+	size_t SizeInBytes() const { return m_nSizeBytes; }
+
+	// Gets the pixel at (nX, nY) of the rotated image as BGRA, alpha is set to opaque
+	uint32 GetPixel(int nX, int nY) const;
+
+	// Converts the rows nStartY to nStartY + nSizeY - 1 of the rotated image to BGR (nChannels = 3) or BGRA (nChannels = 4).
+	// pTarget is the first pixel of the full size target image, its rows are padded to 4 bytes.
+	void ConvertRows(void* pTarget, int nChannels, int nStartY, int nSizeY) const;
+
+	// Converts the rotated image to BGR (nChannels = 3) or BGRA (nChannels = 4) using the processing thread pool.
+	// Rows are padded to 4 bytes. Returns NULL when out of memory, the returned pixels must be freed with CPixelMemory::Free().
+	void* ConvertToBGR(int nChannels) const;
+
+private:
+	int m_nWidth, m_nHeight; // size of the unrotated planes
+	TJSAMP m_eSampling;
+	int m_nRotation;
+	uint8* m_pPlanes;
+	const uint8* m_pY;
+	const uint8* m_pCb;
+	const uint8* m_pCr;
+	int m_nYStride;
+	int m_nChromaStride;
+	int m_nChromaWidth, m_nChromaHeight;
+	int m_nSubsamplingX, m_nSubsamplingY; // 1, 2 or 4
+	bool m_bFancyUpsampling; // interpolate chroma for 2x subsampling, else replicate
+	size_t m_nSizeBytes;
+
+	// Gets the pixel at (nX, nY) of the unrotated planes as BGRA
+	inline uint32 GetPlanePixel(int nX, int nY) const;
+	// Gets the chroma rows contributing to image row nY and the chroma columns contributing to image column nX
+	inline void GetChromaRows(int nY, int& nRow, int& nNeighborRow) const;
+	inline void GetChromaColumns(int nX, int& nCol, int& nNeighborCol) const;
+	// Gets the upsampled chroma value at image pixel (nX, nY) from the contributing chroma samples of the plane
+	inline int UpsampleChroma(const uint8* pPlane, int nRow, int nNeighborRow, int nCol, int nNeighborCol, int nX, int nY) const;
+};
@@ -222,6 +222,8 @@
 #define IDM_PERSPECTIVE     9150		// :KeyMap: show perpective correction dialog
 #define IDM_MIRROR_H        9200		// :KeyMap: mirror image horizontally
 #define IDM_MIRROR_V        9300		// :KeyMap: mirror image vertically
+#define IDM_UNDO            9310		// :KeyMap: undo last change of the image pixels (rotate, resize, sharpen, perspective correction)
+#define IDM_REDO            9320		// :KeyMap: redo last undone change of the image pixels
 #define IDM_ROTATE_90_LOSSLESS 9400		// :KeyMap: Lossless JPEG transformation: rotate image 90 deg
 #define IDM_ROTATE_90_LOSSLESS_CONFIRM 9401		// :KeyMap: Lossless JPEG transformation: rotate image 90 deg with user confirmation
 #define IDM_ROTATE_270_LOSSLESS 9410		// :KeyMap: Lossless JPEG transformation: rotate image 270 deg
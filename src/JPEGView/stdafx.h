@@ -18,6 +18,13 @@
 
 #include <tchar.h>
 #include <atlbase.h>
+#ifdef JPEGVIEW_PROCESSING_ONLY
+// Console build of the image processing only (JPEGViewBenchmark.vcxproj), no WTL and no windows
+#include <atlstr.h>
+#include <atltypes.h>
+#include <assert.h>
+#include <stdio.h>
+#else
 #pragma warning(push)
 #pragma warning(disable:4996)
 #pragma warning(disable:4838)
@@ -36,6 +43,7 @@ extern CAppModule _Module;
 #include <atlscrl.h>
 
 #pragma warning(pop)
+#endif
 
 // STL stuff
 #include  <list>